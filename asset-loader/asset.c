@@ -13,23 +13,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdatomic.h>
 
 #define MODULE_NAME "assetld"
 
-/* No need for a mutex here since
- * we're only incrementing and decrementing here.
- * But I still made it atomic just to be safe. */
-static _Atomic i32 g_n_active_handles = 0;
-
-#define add_n_active_handles(diff) do {                         \
-    const i32 current_val = atomic_load(&g_n_active_handles);   \
-    atomic_store(&g_n_active_handles, current_val + diff);      \
-} while (0)
+/* The number of assets that exist or are being loaded right now.
+ * Once it drops to 0, all the plugins are unloaded.
+ *
+ * Assets can be loaded from many threads at once, so the mutex
+ * makes sure that the plugins can't be unloaded between one thread
+ * incrementing the count and then using a plugin to load its asset. */
+static p_mt_mutex_t g_n_active_handles_mutex = P_MT_MUTEX_INITIALIZER;
+static i32 g_n_active_handles = 0;
 
 const char * asset_get_assets_dir(void);
 static i32 get_bin_dir(char *buf, u32 buf_size);
 
+static void acquire_handle(void);
+static void release_handle(void);
+static void free_asset(struct asset **a_p);
+
 struct asset * asset_load(const u_filepath_t rel_file_path)
 {
     u_check_params(rel_file_path != NULL);
@@ -37,6 +39,7 @@ struct asset * asset_load(const u_filepath_t rel_file_path)
     s_log_verbose("Loading asset \"%s\"...", rel_file_path);
 
     FILE *fp = NULL;
+    acquire_handle();
 
     struct asset *a = calloc(1, sizeof(struct asset));
     s_assert(a != NULL, "calloc() failed for %s", "struct asset");
@@ -50,15 +53,9 @@ struct asset * asset_load(const u_filepath_t rel_file_path)
     if (a->type == IMG_TYPE_UNKNOWN)
         goto_error("Asset image type is UNKNOWN!");
 
-    i32 plugin_loaded = asset_get_plugin_loaded(a->type);
-    if (plugin_loaded == PLUGIN_DOES_NOT_EXIST) {
-        goto_error("Plugin for type \"%s\" does not exist!",
+    if (asset_require_plugin(a->type))
+        goto_error("Failed to load plugin for type \"%s\"",
             asset_get_type_name(a->type));
-    } else if(plugin_loaded == PLUGIN_NOT_LOADED) {
-        if (asset_load_plugin_by_type(a->type))
-            goto_error("Failed to load plugin for type \"%s\"",
-                asset_img_type_strings[a->type]);
-    }
 
     switch(a->type) {
         case IMG_TYPE_PNG:
@@ -74,13 +71,17 @@ struct asset * asset_load(const u_filepath_t rel_file_path)
     if (a->surface == NULL)
         goto_error("Failed to create a surface from the pixel_data!");
 
+    /* Premultiplied pixels are cheaper to blend */
+    if (r_surface_convert(a->surface, RGBA32_PREMUL))
+        goto_error("Failed to premultiply the alpha of the surface!");
+
     fclose(fp);
-    add_n_active_handles(1);
     return a;
 
 err:
     if (fp) fclose(fp);
-    if (a) asset_destroy(&a);
+    if (a) free_asset(&a);
+    release_handle();
     return NULL;
 }
 
@@ -115,52 +116,27 @@ void asset_destroy(struct asset **asset)
 {
     if (asset == NULL || *asset == NULL) return;
 
-    struct asset *a = *asset;
-
-    if (a->surface)
-        r_surface_destroy(&a->surface);
-    else if (a->pixel_data.buf)
-        free(a->pixel_data.buf);
-
-    u_nzfree(&a);
-
-    i32 curr_n_active_handles = atomic_load(&g_n_active_handles);
-
-    if (curr_n_active_handles > 0) {
-        add_n_active_handles(-1);
-        curr_n_active_handles = atomic_load(&g_n_active_handles);
-    }
-
-    if (curr_n_active_handles == 0)
-        asset_unload_all_plugins();
-    else if (curr_n_active_handles < 0)
-        s_log_error("%s(): Invalid value of g_n_active_handles: %i",
-            __func__, curr_n_active_handles);
-
+    free_asset(asset);
+    release_handle();
 }
 
-static p_mt_mutex_t bin_dir_buf_mutex = P_MT_MUTEX_INITIALIZER;
-static char bin_dir_buf[u_BUF_SIZE] = { 0 };
-
 static p_mt_mutex_t asset_dir_buf_mutex = P_MT_MUTEX_INITIALIZER;
+static char bin_dir_buf[u_BUF_SIZE] = { 0 };
 static char asset_dir_buf[u_BUF_SIZE] = { 0 };
 
 const char * asset_get_assets_dir(void)
 {
-    if (bin_dir_buf[0] == '\0') {
-        p_mt_mutex_lock(&bin_dir_buf_mutex);
+    /* Assets can be loaded from multiple threads at once,
+     * so even checking whether it's been done yet needs the mutex */
+    p_mt_mutex_lock(&asset_dir_buf_mutex);
 
+    if (asset_dir_buf[0] == '\0') {
         if (get_bin_dir(bin_dir_buf, u_BUF_SIZE)) {
             s_log_error("%s: Failed to get the bin dir", __func__);
+            p_mt_mutex_unlock(&asset_dir_buf_mutex);
             return NULL;
         }
 
-        p_mt_mutex_unlock(&bin_dir_buf_mutex);
-    }
-
-    if (asset_dir_buf[0] == '\0') {
-        p_mt_mutex_lock(&asset_dir_buf_mutex);
-
         strncpy(asset_dir_buf, bin_dir_buf, u_BUF_SIZE);
         asset_dir_buf[u_BUF_SIZE - 1] = '\0';
         strncat(
@@ -171,10 +147,9 @@ const char * asset_get_assets_dir(void)
 
         asset_dir_buf[u_BUF_SIZE - 1] = '\0';
         s_log_debug("%s: The asset dir is \"%s\"", __func__, asset_dir_buf);
-
-        p_mt_mutex_unlock(&asset_dir_buf_mutex);
     }
 
+    p_mt_mutex_unlock(&asset_dir_buf_mutex);
     return asset_dir_buf;
 }
 
@@ -197,6 +172,39 @@ static i32 get_bin_dir(char *buf, u32 buf_size)
 
 }
 
+static void acquire_handle(void)
+{
+    p_mt_mutex_lock(&g_n_active_handles_mutex);
+    g_n_active_handles++;
+    p_mt_mutex_unlock(&g_n_active_handles_mutex);
+}
+
+static void release_handle(void)
+{
+    p_mt_mutex_lock(&g_n_active_handles_mutex);
+
+    if (g_n_active_handles <= 0) {
+        s_log_error("%s(): Invalid value of g_n_active_handles: %i",
+            __func__, g_n_active_handles);
+    } else if (--g_n_active_handles == 0) {
+        asset_unload_all_plugins();
+    }
+
+    p_mt_mutex_unlock(&g_n_active_handles_mutex);
+}
+
+static void free_asset(struct asset **a_p)
+{
+    struct asset *a = *a_p;
+
+    if (a->surface)
+        r_surface_destroy(&a->surface);
+    else if (a->pixel_data.buf)
+        free(a->pixel_data.buf);
+
+    u_nzfree(a_p);
+}
+
 #undef MODULE_NAME
 #define MODULE_NAME "assetwr"
 
@@ -213,25 +221,54 @@ i32 asset_write(struct asset *a, const char *rel_file_path,
     s_log_verbose("Writing asset \"%s\" to file \"%s\"",
         a->rel_file_path, rel_file_path);
 
+    /* The surface might have been converted to some other format
+     * (see `r_surface_optimize`), but the image writers expect RGBA32 */
+    struct r_surface *rgba_copy = NULL;
+    struct pixel_flat_data *pixel_data = &a->pixel_data;
+    if (a->surface != NULL && a->surface->color_format != RGBA32) {
+        rgba_copy = r_surface_create(a->surface->data.w, a->surface->data.h,
+            a->surface->color_format);
+        if (rgba_copy == NULL) {
+            s_log_error("Failed to create a copy of the surface");
+            return -1;
+        }
+        memcpy(rgba_copy->data.buf, a->surface->data.buf,
+            (u64)rgba_copy->data.w * rgba_copy->data.h * sizeof(pixel_t));
+
+        if (r_surface_convert(rgba_copy, RGBA32)) {
+            s_log_error("Failed to convert the surface to RGBA32");
+            r_surface_destroy(&rgba_copy);
+            return -1;
+        }
+        pixel_data = &rgba_copy->data;
+    }
+
+    i32 ret = EXIT_SUCCESS;
+
     FILE *fp = asset_fopen(rel_file_path, "wb");
-    if (fp == NULL)
-        return -2;
+    if (fp == NULL) {
+        ret = -2;
+        goto out;
+    }
 
     switch(a->type) {
         case IMG_TYPE_PNG:
-            if (write_PNG(&a->pixel_data, fp)) {
+            if (write_PNG(pixel_data, fp)) {
                 s_log_error("write_PNG failed for \"%s\"", a->rel_file_path);
-                fclose(fp);
-                return -3;
+                ret = -3;
             }
             break;
         case IMG_TYPE_UNKNOWN: default:
             s_log_error("image type of \"%s\" is UNKNOWN!", a->rel_file_path);
-            fclose(fp);
-            return -4;
+            ret = -4;
+            break;
     }
 
     fclose(fp);
 
-    return EXIT_SUCCESS;
+out:
+    if (rgba_copy != NULL)
+        r_surface_destroy(&rgba_copy);
+
+    return ret;
 }
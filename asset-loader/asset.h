@@ -11,6 +11,8 @@ struct asset {
     u_filepath_t rel_file_path;
     enum asset_img_type type;
 
+    /* The surface is created with the format `RGBA32_PREMUL`,
+     * although it may later be converted to some other format */
     struct pixel_flat_data pixel_data;
     struct r_surface *surface;
 };
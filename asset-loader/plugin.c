@@ -28,6 +28,7 @@ i32 asset_load_plugin_by_type(enum asset_img_type type)
     if (p == NULL) {
         s_log_error("%s: No plugin exists for type \"%s\"",
             __func__, asset_get_type_name(type));
+        p_mt_mutex_unlock(&plugin_registry_mutex);
         return 1;
     }
 
@@ -37,6 +38,26 @@ i32 asset_load_plugin_by_type(enum asset_img_type type)
     return ret;
 }
 
+i32 asset_require_plugin(enum asset_img_type type)
+{
+    p_mt_mutex_lock(&plugin_registry_mutex);
+
+    struct asset_plugin *p = lookup_by_type(type);
+    if (p == NULL) {
+        s_log_error("%s: No plugin exists for type \"%s\"",
+            __func__, asset_get_type_name(type));
+        p_mt_mutex_unlock(&plugin_registry_mutex);
+        return 1;
+    }
+
+    i32 ret = 0;
+    if (!p->is_loaded)
+        ret = load_plugin(p);
+
+    p_mt_mutex_unlock(&plugin_registry_mutex);
+    return ret;
+}
+
 i32 asset_load_plugin_by_name(char name[ASSET_PLUGIN_MAX_NAME_LEN])
 {
     p_mt_mutex_lock(&plugin_registry_mutex);
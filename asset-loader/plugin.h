@@ -25,6 +25,12 @@ struct asset_plugin {
 i32 asset_load_plugin_by_type(enum asset_img_type type);
 i32 asset_load_plugin_by_name(char name[ASSET_PLUGIN_MAX_NAME_LEN]);
 
+/* Loads the plugin that handles `type`, unless it's already loaded.
+ * Unlike checking `asset_get_plugin_loaded` first,
+ * this is safe to call from many threads at once.
+ * Returns 0 on success and non-zero on failure. */
+i32 asset_require_plugin(enum asset_img_type type);
+
 /* returns the number of plugins that failed to load (0 on success, abviously) */
 i32 asset_load_all_plugins(void);
 
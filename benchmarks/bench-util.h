@@ -0,0 +1,145 @@
+#ifndef BENCH_UTIL_H_
+#define BENCH_UTIL_H_
+
+#include <core/int.h>
+#include <core/log.h>
+#include <platform/ptime.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifndef MODULE_NAME
+#error MODULE_NAME not defined
+#endif /* MODULE_NAME */
+
+/* Every case is run this many times ("samples"),
+ * and the reported times are the percentiles of those */
+#ifndef BENCH_N_SAMPLES
+#define BENCH_N_SAMPLES 31
+#endif /* BENCH_N_SAMPLES */
+
+/* Fast operations are repeated until a single sample
+ * takes at least this long, so that the timer's resolution
+ * (and overhead) doesn't matter */
+#define BENCH_MIN_SAMPLE_NS 200000
+
+/* The results are written to stdout, one JSON object per line:
+ *  {"bench": <MODULE_NAME>, "name": <the case>, "variant": <e.g. alpha mix>,
+ *   "w": <width>, "h": <height>, "pixels": <pixels per operation>,
+ *   "samples": <number of samples>, "reps": <operations per sample>,
+ *   "ns_min": ..., "ns_p50": ..., "ns_p90": ..., "ns_p99": ...,
+ *   "ns_per_pixel": <based on p50>, "mpix_per_s": <based on p50>}
+ * where all the `ns_*` times are per operation.
+ *
+ * The logs go to stderr, so that they don't get mixed in.
+ * If any arguments are given, only the cases whose name
+ * contains at least one of them are run. */
+
+typedef void (bench_fn_t)(void *arg);
+
+static int bench_argc = 0;
+static char **bench_argv = NULL;
+
+static i32 bench_setup(int argc, char **argv)
+{
+    bench_argc = argc;
+    bench_argv = argv;
+
+    const struct s_log_output_cfg out_cfg = {
+        .type = S_LOG_OUTPUT_FILE,
+        .out.file = stderr,
+    };
+    if (s_configure_log_outputs(S_LOG_ALL_MASKS, &out_cfg)) {
+        fprintf(stderr, "Failed to configure log output. Stop.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static bool bench_enabled(const char *name)
+{
+    if (bench_argc <= 1)
+        return true;
+
+    for (int i = 1; i < bench_argc; i++) {
+        if (strstr(name, bench_argv[i]) != NULL)
+            return true;
+    }
+    return false;
+}
+
+static inline i64 bench_time_ns(void)
+{
+    timestamp_t t;
+    p_time_get_ticks(&t);
+    return t.s * 1000000000LL + t.ns;
+}
+
+static int bench_compare_i64(const void *a, const void *b)
+{
+    const i64 x = *(const i64 *)a, y = *(const i64 *)b;
+    return (x > y) - (x < y);
+}
+
+/* Returns the `p`th percentile of the sorted `samples` (nearest-rank) */
+static inline i64 bench_percentile(const i64 *samples, u32 n, u32 p)
+{
+    u32 rank = (p * n + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+    return samples[rank - 1];
+}
+
+/* Times `fn(arg)`, which processes `n_pixels` pixels, and prints
+ * the results. `w` and `h` are only reported, as is `variant`. */
+static void bench_run(const char *name, const char *variant, u32 w, u32 h,
+    u64 n_pixels, bench_fn_t *fn, void *arg)
+{
+    if (!bench_enabled(name))
+        return;
+
+    /* Warm up (the caches, the page tables, the branch predictors, ...)
+     * and find out how many repetitions make up a sample */
+    i64 t0 = bench_time_ns();
+    fn(arg);
+    i64 dt = bench_time_ns() - t0;
+
+    u32 reps = 1;
+    if (dt < BENCH_MIN_SAMPLE_NS)
+        reps = BENCH_MIN_SAMPLE_NS / (dt > 0 ? dt : 1);
+
+    i64 samples[BENCH_N_SAMPLES];
+    for (u32 i = 0; i < BENCH_N_SAMPLES; i++) {
+        t0 = bench_time_ns();
+        for (u32 j = 0; j < reps; j++)
+            fn(arg);
+        samples[i] = (bench_time_ns() - t0) / reps;
+    }
+    qsort(samples, BENCH_N_SAMPLES, sizeof(i64), bench_compare_i64);
+
+    const i64 p50 = bench_percentile(samples, BENCH_N_SAMPLES, 50);
+    const f64 ns_per_pixel = n_pixels > 0 ? (f64)p50 / (f64)n_pixels : 0.0;
+    const f64 mpix_per_s = p50 > 0 ?
+        (f64)n_pixels * 1000.0 / (f64)p50 : 0.0;
+
+    printf("{\"bench\": \"%s\", \"name\": \"%s\", \"variant\": \"%s\", "
+        "\"w\": %u, \"h\": %u, \"pixels\": %llu, "
+        "\"samples\": %u, \"reps\": %u, "
+        "\"ns_min\": %lld, \"ns_p50\": %lld, "
+        "\"ns_p90\": %lld, \"ns_p99\": %lld, "
+        "\"ns_per_pixel\": %.4f, \"mpix_per_s\": %.2f}\n",
+        MODULE_NAME, name, variant, w, h, (unsigned long long)n_pixels,
+        BENCH_N_SAMPLES, reps,
+        (long long)samples[0], (long long)p50,
+        (long long)bench_percentile(samples, BENCH_N_SAMPLES, 90),
+        (long long)bench_percentile(samples, BENCH_N_SAMPLES, 99),
+        ns_per_pixel, mpix_per_s);
+    fflush(stdout);
+
+    s_log_verbose("%s (%s, %ux%u): %lld ns", name, variant, w, h,
+        (long long)p50);
+}
+
+#endif /* BENCH_UTIL_H_ */
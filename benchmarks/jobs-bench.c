@@ -0,0 +1,173 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <platform/thread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define MODULE_NAME "jobs-bench"
+#include "bench-util.h"
+
+/* Measures how the job system scales with the number of threads:
+ *  - `parallel_for` over compute-bound and memory-bound loops,
+ *  - the overhead of submitting (and waiting for) lots of tiny jobs,
+ *  - a tree of nested jobs that spawn and wait for their children,
+ *    which is only fast if the idle threads steal the work.
+ *
+ * Every case is run with 1, 2, 4, ... threads up to the number of CPUs
+ * (the `variant`). The elements processed by each case are reported
+ * as the `pixels`, so `ns_per_pixel` is really the time per element. */
+
+#define N_COMPUTE_ELEMENTS (1U << 18)
+#define N_HASH_ROUNDS 32
+
+#define N_MEMORY_ELEMENTS (1U << 22)
+
+#define N_TINY_JOBS 4096
+
+#define TREE_DEPTH 12
+#define N_TREE_LEAF_ROUNDS 256
+
+struct bench_args {
+    struct p_mt_jobs *jobs;
+    u32 *buf;
+};
+
+static void bench_pool(u32 n_threads, u32 *buf);
+
+int cgd_main(int argc, char **argv)
+{
+    if (bench_setup(argc, argv))
+        return EXIT_FAILURE;
+
+    u32 *buf = malloc(N_MEMORY_ELEMENTS * sizeof(u32));
+    s_assert(buf != NULL, "malloc() failed for the buffer");
+    memset(buf, 0, N_MEMORY_ELEMENTS * sizeof(u32));
+
+    const u32 n_cpus = p_mt_get_cpu_count();
+    s_log_info("Benchmarking with up to %u threads", n_cpus);
+
+    for (u32 n = 1; n < n_cpus; n *= 2)
+        bench_pool(n, buf);
+    bench_pool(n_cpus, buf);
+
+    free(buf);
+    return EXIT_SUCCESS;
+}
+
+static inline u32 hash(u32 x)
+{
+    for (u32 i = 0; i < N_HASH_ROUNDS; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    return x;
+}
+
+static void compute_range(void *arg, u32 start, u32 end)
+{
+    struct bench_args *a = arg;
+    for (u32 i = start; i < end; i++)
+        a->buf[i] = hash(i + 1);
+}
+
+static void run_compute(void *arg)
+{
+    struct bench_args *a = arg;
+    p_mt_jobs_parallel_for(a->jobs, N_COMPUTE_ELEMENTS, 0, compute_range, a);
+}
+
+static void memory_range(void *arg, u32 start, u32 end)
+{
+    struct bench_args *a = arg;
+    for (u32 i = start; i < end; i++)
+        a->buf[i] = a->buf[i] * 3 + 1;
+}
+
+static void run_memory(void *arg)
+{
+    struct bench_args *a = arg;
+    p_mt_jobs_parallel_for(a->jobs, N_MEMORY_ELEMENTS, 0, memory_range, a);
+}
+
+static void empty_job(void *arg)
+{
+    (void) arg;
+}
+
+static void run_tiny_jobs(void *arg)
+{
+    struct bench_args *a = arg;
+    struct p_mt_job_counter counter = P_MT_JOB_COUNTER_INIT;
+
+    for (u32 i = 0; i < N_TINY_JOBS; i++)
+        p_mt_jobs_submit(a->jobs, empty_job, NULL, &counter);
+    p_mt_jobs_wait(a->jobs, &counter);
+}
+
+struct tree_node {
+    struct p_mt_jobs *jobs;
+    u32 depth;
+    u32 result;
+};
+
+static void tree_node_job(void *arg)
+{
+    struct tree_node *n = arg;
+    if (n->depth == 0) {
+        n->result = hash(N_TREE_LEAF_ROUNDS);
+        for (u32 i = 0; i < N_TREE_LEAF_ROUNDS / N_HASH_ROUNDS; i++)
+            n->result = hash(n->result);
+        return;
+    }
+
+    struct tree_node children[2] = {
+        { .jobs = n->jobs, .depth = n->depth - 1 },
+        { .jobs = n->jobs, .depth = n->depth - 1 },
+    };
+    struct p_mt_job_counter counter = P_MT_JOB_COUNTER_INIT;
+    p_mt_jobs_submit(n->jobs, tree_node_job, &children[0], &counter);
+    p_mt_jobs_submit(n->jobs, tree_node_job, &children[1], &counter);
+    p_mt_jobs_wait(n->jobs, &counter);
+
+    n->result = children[0].result ^ children[1].result;
+}
+
+static void run_tree(void *arg)
+{
+    struct bench_args *a = arg;
+    struct tree_node root = { .jobs = a->jobs, .depth = TREE_DEPTH };
+    struct p_mt_job_counter counter = P_MT_JOB_COUNTER_INIT;
+
+    p_mt_jobs_submit(a->jobs, tree_node_job, &root, &counter);
+    p_mt_jobs_wait(a->jobs, &counter);
+    a->buf[0] = root.result;
+}
+
+static void bench_pool(u32 n_threads, u32 *buf)
+{
+    struct bench_args args = {
+        .jobs = p_mt_jobs_create(n_threads),
+        .buf = buf,
+    };
+    if (args.jobs == NULL) {
+        s_log_error("Failed to create a pool of %u threads", n_threads);
+        return;
+    }
+
+    char variant[32];
+    snprintf(variant, sizeof(variant), "threads=%u", n_threads);
+
+    bench_run("parallel_for/compute", variant, N_COMPUTE_ELEMENTS, 1,
+        N_COMPUTE_ELEMENTS, run_compute, &args);
+    bench_run("parallel_for/memory", variant, N_MEMORY_ELEMENTS, 1,
+        N_MEMORY_ELEMENTS, run_memory, &args);
+    bench_run("submit/tiny-jobs", variant, N_TINY_JOBS, 1,
+        N_TINY_JOBS, run_tiny_jobs, &args);
+    bench_run("nested/tree", variant, 1U << TREE_DEPTH, 1,
+        1U << TREE_DEPTH, run_tree, &args);
+
+    p_mt_jobs_destroy(&args.jobs);
+}
@@ -0,0 +1,350 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <platform/thread.h>
+#include <platform/platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#if (PLATFORM == PLATFORM_LINUX)
+#include <pthread.h>
+#endif /* PLATFORM_LINUX */
+
+#define MODULE_NAME "mutex-bench"
+#include "bench-util.h"
+
+/* Compares `p_mt_mutex_t`/`p_mt_cond_t` against plain pthreads
+ * used the same way as the previous `p_mt_*` wrappers did
+ * (`p_mt_cond_wait` unlocking the mutex after `pthread_cond_wait`,
+ * and `p_mt_cond_signal` being a broadcast):
+ *  - locking and unlocking a mutex that no one else uses,
+ *  - 1, 2, 4, ... threads (up to the number of CPUs) fighting
+ *    over a single mutex with a tiny critical section,
+ *  - 2 threads taking turns with a condition variable,
+ *  - a producer handing out items one by one to a few consumers,
+ *    where waking all of them up for each item is wasted work.
+ *
+ * The `pixels` are the lock acquisitions (or hand-offs, or items),
+ * so `ns_per_pixel` is the time per each of them. The `variant`
+ * is the implementation (and the number of threads). */
+
+#define N_UNCONTENDED_LOCKS 100000
+#define N_CONTENDED_LOCKS_PER_THREAD 20000
+#define N_PING_PONGS 2000
+
+#define N_CONSUMERS 4
+#define N_ITEMS 4000
+
+/* The uncontended case is short enough that whichever implementation
+ * runs first would otherwise be measured before the CPU clocks up */
+#define WARMUP_ns 300000000LL
+
+/* The mutex and condition variable operations of an implementation.
+ * `wait` returns with the mutex UNLOCKED, like `p_mt_cond_wait` */
+struct impl {
+    const char *name;
+    void *mutex;
+    void *cond;
+    void (*lock)(void *mutex);
+    void (*unlock)(void *mutex);
+    void (*wait)(void *cond, void *mutex);
+    void (*signal)(void *cond);
+    void (*broadcast)(void *cond);
+};
+
+struct bench_args {
+    const struct impl *impl;
+    u32 n_threads;
+
+    /* Protected by `impl->mutex` */
+    u64 counter;
+    u32 turn;
+    u32 n_items;
+    bool done;
+};
+
+static void bench_impl(const struct impl *impl);
+
+/* glibc leaves out the atomic instructions in its mutexes while
+ * the process only has one thread, which the engine never does,
+ * so one is kept around (asleep) for the whole time */
+static p_mt_mutex_t g_idle_mutex = P_MT_MUTEX_INITIALIZER;
+static p_mt_cond_t g_idle_cond = P_MT_COND_INITIALIZER;
+static bool g_idle_exit = false;
+static void idle_thread_fn(void *arg);
+
+static void p_mt_lock_(void *mutex) { p_mt_mutex_lock(mutex); }
+static void p_mt_unlock_(void *mutex) { p_mt_mutex_unlock(mutex); }
+static void p_mt_wait_(void *cond, void *mutex)
+{
+    p_mt_cond_wait(cond, mutex);
+}
+static void p_mt_signal_(void *cond) { p_mt_cond_signal(cond); }
+static void p_mt_broadcast_(void *cond) { p_mt_cond_broadcast(cond); }
+
+#if (PLATFORM == PLATFORM_LINUX)
+static void pthread_lock_(void *mutex) { pthread_mutex_lock(mutex); }
+static void pthread_unlock_(void *mutex) { pthread_mutex_unlock(mutex); }
+static void pthread_wait_(void *cond, void *mutex)
+{
+    (void) pthread_cond_wait(cond, mutex);
+    pthread_mutex_unlock(mutex);
+}
+static void pthread_broadcast_(void *cond)
+{
+    (void) pthread_cond_broadcast(cond);
+}
+#endif /* PLATFORM_LINUX */
+
+int cgd_main(int argc, char **argv)
+{
+    if (bench_setup(argc, argv))
+        return EXIT_FAILURE;
+
+    s_log_info("Benchmarking with up to %u threads", p_mt_get_cpu_count());
+
+    const i64 warmup_start = bench_time_ns();
+    volatile u64 n_warmup_loops = 0;
+    while (bench_time_ns() - warmup_start < WARMUP_ns)
+        n_warmup_loops++;
+
+    p_mt_thread_t idle_thread;
+    s_assert(p_mt_thread_create(&idle_thread, idle_thread_fn, NULL) == 0,
+        "Failed to start the idle thread");
+
+    static p_mt_mutex_t p_mt_mutex = P_MT_MUTEX_INITIALIZER;
+    static p_mt_cond_t p_mt_cond = P_MT_COND_INITIALIZER;
+    const struct impl p_mt_impl = {
+        .name = "p_mt",
+        .mutex = &p_mt_mutex,
+        .cond = &p_mt_cond,
+        .lock = p_mt_lock_,
+        .unlock = p_mt_unlock_,
+        .wait = p_mt_wait_,
+        .signal = p_mt_signal_,
+        .broadcast = p_mt_broadcast_,
+    };
+    bench_impl(&p_mt_impl);
+
+#if (PLATFORM == PLATFORM_LINUX)
+    static pthread_mutex_t pthread_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static pthread_cond_t pthread_cond = PTHREAD_COND_INITIALIZER;
+    const struct impl pthread_impl = {
+        .name = "pthread",
+        .mutex = &pthread_mutex,
+        .cond = &pthread_cond,
+        .lock = pthread_lock_,
+        .unlock = pthread_unlock_,
+        .wait = pthread_wait_,
+        .signal = pthread_broadcast_,
+        .broadcast = pthread_broadcast_,
+    };
+    bench_impl(&pthread_impl);
+#endif /* PLATFORM_LINUX */
+
+    p_mt_mutex_lock(&g_idle_mutex);
+    g_idle_exit = true;
+    p_mt_cond_signal(&g_idle_cond);
+    p_mt_mutex_unlock(&g_idle_mutex);
+    p_mt_thread_wait(&idle_thread);
+
+    return EXIT_SUCCESS;
+}
+
+static void idle_thread_fn(void *arg)
+{
+    (void) arg;
+
+    p_mt_mutex_lock(&g_idle_mutex);
+    while (!g_idle_exit) {
+        p_mt_cond_wait(&g_idle_cond, &g_idle_mutex);
+        p_mt_mutex_lock(&g_idle_mutex);
+    }
+    p_mt_mutex_unlock(&g_idle_mutex);
+
+    p_mt_thread_exit();
+}
+
+static void run_uncontended(void *arg)
+{
+    struct bench_args *a = arg;
+    const struct impl *const impl = a->impl;
+
+    for (u32 i = 0; i < N_UNCONTENDED_LOCKS; i++) {
+        impl->lock(impl->mutex);
+        a->counter++;
+        impl->unlock(impl->mutex);
+    }
+}
+
+static void contended_thread_fn(void *arg)
+{
+    struct bench_args *a = arg;
+    const struct impl *const impl = a->impl;
+
+    for (u32 i = 0; i < N_CONTENDED_LOCKS_PER_THREAD; i++) {
+        impl->lock(impl->mutex);
+        a->counter++;
+        impl->unlock(impl->mutex);
+    }
+
+    p_mt_thread_exit();
+}
+
+/* Runs `thread_fn` in `a->n_threads` threads and waits for all of them */
+static void run_threads(struct bench_args *a, p_mt_thread_fn_t thread_fn)
+{
+    p_mt_thread_t threads[256];
+    const u32 n_threads = a->n_threads;
+    s_assert(n_threads <= u_arr_size(threads), "Too many threads (%u)",
+        n_threads);
+
+    u32 n_started = 0;
+    for (u32 i = 0; i < n_threads; i++) {
+        if (p_mt_thread_create(&threads[i], thread_fn, a))
+            break;
+        n_started++;
+    }
+    s_assert(n_started == n_threads, "Failed to start the threads");
+
+    for (u32 i = 0; i < n_started; i++)
+        p_mt_thread_wait(&threads[i]);
+}
+
+static void run_contended(void *arg)
+{
+    run_threads(arg, contended_thread_fn);
+}
+
+/* Waits for `turn` to be odd and makes it even again */
+static void pong_thread_fn(void *arg)
+{
+    struct bench_args *a = arg;
+    const struct impl *const impl = a->impl;
+
+    for (u32 i = 0; i < N_PING_PONGS; i++) {
+        impl->lock(impl->mutex);
+        while (a->turn % 2 == 0) {
+            impl->wait(impl->cond, impl->mutex);
+            impl->lock(impl->mutex);
+        }
+        a->turn++;
+        impl->signal(impl->cond);
+        impl->unlock(impl->mutex);
+    }
+
+    p_mt_thread_exit();
+}
+
+static void run_ping_pong(void *arg)
+{
+    struct bench_args *a = arg;
+    const struct impl *const impl = a->impl;
+
+    a->turn = 0;
+
+    p_mt_thread_t thread;
+    s_assert(p_mt_thread_create(&thread, pong_thread_fn, a) == 0,
+        "Failed to start the pong thread");
+
+    for (u32 i = 0; i < N_PING_PONGS; i++) {
+        impl->lock(impl->mutex);
+        while (a->turn % 2 == 1) {
+            impl->wait(impl->cond, impl->mutex);
+            impl->lock(impl->mutex);
+        }
+        a->turn++;
+        impl->signal(impl->cond);
+        impl->unlock(impl->mutex);
+    }
+
+    p_mt_thread_wait(&thread);
+}
+
+/* Takes the items one by one until the producer is done */
+static void consumer_thread_fn(void *arg)
+{
+    struct bench_args *a = arg;
+    const struct impl *const impl = a->impl;
+
+    impl->lock(impl->mutex);
+    while (true) {
+        while (a->n_items == 0 && !a->done) {
+            impl->wait(impl->cond, impl->mutex);
+            impl->lock(impl->mutex);
+        }
+        if (a->n_items == 0)
+            break;
+
+        a->n_items--;
+        a->counter++;
+    }
+    impl->unlock(impl->mutex);
+
+    p_mt_thread_exit();
+}
+
+static void run_producer(void *arg)
+{
+    struct bench_args *a = arg;
+    const struct impl *const impl = a->impl;
+
+    a->n_items = 0;
+    a->done = false;
+
+    p_mt_thread_t threads[N_CONSUMERS];
+    for (u32 i = 0; i < N_CONSUMERS; i++) {
+        s_assert(p_mt_thread_create(&threads[i], consumer_thread_fn, a) == 0,
+            "Failed to start the consumer threads");
+    }
+
+    /* One item only needs one consumer */
+    for (u32 i = 0; i < N_ITEMS; i++) {
+        impl->lock(impl->mutex);
+        a->n_items++;
+        impl->signal(impl->cond);
+        impl->unlock(impl->mutex);
+    }
+
+    impl->lock(impl->mutex);
+    a->done = true;
+    impl->broadcast(impl->cond);
+    impl->unlock(impl->mutex);
+
+    for (u32 i = 0; i < N_CONSUMERS; i++)
+        p_mt_thread_wait(&threads[i]);
+}
+
+static void bench_contended(struct bench_args *args, u32 n_threads)
+{
+    char variant[32];
+    snprintf(variant, sizeof(variant), "%s threads=%u",
+        args->impl->name, n_threads);
+
+    args->n_threads = n_threads;
+    bench_run("mutex/contended", variant,
+        n_threads * N_CONTENDED_LOCKS_PER_THREAD, 1,
+        n_threads * N_CONTENDED_LOCKS_PER_THREAD, run_contended, args);
+}
+
+static void bench_impl(const struct impl *impl)
+{
+    struct bench_args args = { .impl = impl };
+    char variant[32];
+
+    bench_run("mutex/uncontended", impl->name, N_UNCONTENDED_LOCKS, 1,
+        N_UNCONTENDED_LOCKS, run_uncontended, &args);
+
+    const u32 n_cpus = p_mt_get_cpu_count();
+    for (u32 n = 1; n < n_cpus; n *= 2)
+        bench_contended(&args, n);
+    bench_contended(&args, n_cpus);
+
+    bench_run("cond/ping-pong", impl->name, 2 * N_PING_PONGS, 1,
+        2 * N_PING_PONGS, run_ping_pong, &args);
+
+    snprintf(variant, sizeof(variant), "%s consumers=%u",
+        impl->name, N_CONSUMERS);
+    bench_run("cond/producer", variant, N_ITEMS, 1,
+        N_ITEMS, run_producer, &args);
+}
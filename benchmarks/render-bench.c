@@ -0,0 +1,402 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <core/math.h>
+#include <core/pixel.h>
+#include <core/shapes.h>
+#include <platform/window.h>
+#include <render/line.h>
+#include <render/rctx.h>
+#include <render/rect.h>
+#include <render/surface.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#define R_INTERNAL_GUARD__
+#include <render/blit-kernels.h>
+#undef R_INTERNAL_GUARD__
+
+#define MODULE_NAME "render-bench"
+#include "bench-util.h"
+
+/* Measures the throughput of the software renderer without a display:
+ *  - the row kernels of every instruction set that the CPU supports,
+ *  - the surface blits (unscaled/scaled, copied/blended, with and without
+ *    the R and B channels swapped, and premultiplied), on offscreen surfaces,
+ *  - whole frames of the draw calls, drawn by an `r_ctx`
+ *    into a dummy window. */
+
+static const struct bench_size {
+    u32 w, h;
+} sizes[] = {
+    { 64, 64 },
+    { 256, 256 },
+    { 1280, 720 },
+};
+#define N_SIZES (sizeof(sizes) / sizeof(*sizes))
+
+#define ALPHA_MIX_LIST                      \
+    X_(ALPHA_OPAQUE, "opaque")              \
+    X_(ALPHA_TRANSPARENT, "transparent")    \
+    X_(ALPHA_TRANSLUCENT, "translucent")    \
+    X_(ALPHA_MIXED, "mixed")                \
+
+#define X_(name, str) name,
+enum alpha_mix {
+    ALPHA_MIX_LIST
+    ALPHA_MIX_MAX_
+};
+#undef X_
+
+#define X_(name, str) str,
+static const char *const alpha_mix_strings[ALPHA_MIX_MAX_] = {
+    ALPHA_MIX_LIST
+};
+#undef X_
+
+/* The frame benchmarks draw this many primitives per frame */
+#define N_PRIMITIVES_PER_FRAME 64
+
+#define FRAME_W 1280
+#define FRAME_H 720
+
+static void bench_kernels(void);
+static void bench_blits(void);
+static void bench_frames(void);
+
+static void fill_pixels(pixel_t *buf, u32 n, enum alpha_mix mix);
+
+int cgd_main(int argc, char **argv)
+{
+    if (bench_setup(argc, argv))
+        return EXIT_FAILURE;
+
+    srand(1234);
+    r_blit_kernels_init();
+    s_log_info("Selected blit kernels: \"%s\"",
+        r_blit_kernels_get_active()->name);
+
+    bench_kernels();
+    bench_blits();
+    bench_frames();
+
+    return EXIT_SUCCESS;
+}
+
+struct kernel_args {
+    r_blit_row_fn_t *fn;
+    pixel_t *dst;
+    const pixel_t *src;
+    u32 w, h;
+};
+
+static void run_kernel(void *arg)
+{
+    const struct kernel_args *a = arg;
+    for (u32 y = 0; y < a->h; y++)
+        a->fn(a->dst + (u64)y * a->w, a->src + (u64)y * a->w, a->w);
+}
+
+static void bench_kernels(void)
+{
+    static const struct kernel_fn {
+        const char *name;
+        size_t offset;
+        bool blends;
+    } fns[] = {
+#define FN_(name, blends) { "kernel/" #name, \
+        offsetof(struct r_blit_kernels, name), blends }
+        FN_(copy, false),
+        FN_(copy_swizzle, false),
+        FN_(blend, true),
+        FN_(blend_swizzle, true),
+        FN_(blend_premul, true),
+        FN_(blend_premul_swizzle, true),
+#undef FN_
+    };
+
+    for (u32 s = 0; s < N_SIZES; s++) {
+        const u32 w = sizes[s].w, h = sizes[s].h;
+        pixel_t *src = malloc((u64)w * h * sizeof(pixel_t));
+        pixel_t *dst = malloc((u64)w * h * sizeof(pixel_t));
+        s_assert(src != NULL && dst != NULL, "malloc() failed");
+        fill_pixels(dst, w * h, ALPHA_OPAQUE);
+
+        for (u32 m = 0; m < ALPHA_MIX_MAX_; m++) {
+            fill_pixels(src, w * h, m);
+
+            for (u32 f = 0; f < sizeof(fns) / sizeof(*fns); f++) {
+                /* The alpha doesn't matter for the copies */
+                if (!fns[f].blends && m != ALPHA_OPAQUE)
+                    continue;
+
+                for (u32 k = 0; k < R_BLIT_KERNEL_MAX_; k++) {
+                    const struct r_blit_kernels *kernels =
+                        r_blit_kernels_get(k);
+                    if (kernels == NULL)
+                        continue;
+
+                    struct kernel_args args = {
+                        .fn = *(r_blit_row_fn_t *const *)
+                            ((const u8 *)kernels + fns[f].offset),
+                        .dst = dst,
+                        .src = src,
+                        .w = w,
+                        .h = h,
+                    };
+
+                    char variant[64];
+                    snprintf(variant, sizeof(variant), "%s/%s",
+                        kernels->name, alpha_mix_strings[m]);
+                    bench_run(fns[f].name, variant, w, h, (u64)w * h,
+                        run_kernel, &args);
+                }
+            }
+        }
+
+        free(src);
+        free(dst);
+    }
+}
+
+struct blit_args {
+    struct r_surface *dst;
+    const struct r_surface *src;
+    enum r_surface_filter filter;
+};
+
+static void run_blit(void *arg)
+{
+    const struct blit_args *a = arg;
+    r_surface_blit_filtered(a->dst, a->src, NULL, NULL, a->filter);
+}
+
+static void bench_blits(void)
+{
+    static const struct blit_scale {
+        const char *name;
+        bool scaled;
+        enum r_surface_filter filter;
+    } scales[] = {
+        { "unscaled", false, R_SURFACE_FILTER_NEAREST },
+        { "scaled", true, R_SURFACE_FILTER_NEAREST },
+        { "scaled-bilinear", true, R_SURFACE_FILTER_BILINEAR },
+    };
+    static const struct blit_formats {
+        const char *name;
+        pixelfmt_t src_fmt, dst_fmt;
+    } formats[] = {
+        { "same", RGBA32, RGBA32 },
+        { "swizzle", RGBA32, BGRA32 },
+        { "premul", RGBA32_PREMUL, RGBA32 },
+        { "premul-swizzle", RGBA32_PREMUL, BGRA32 },
+    };
+
+    for (u32 s = 0; s < N_SIZES; s++) {
+        const u32 w = sizes[s].w, h = sizes[s].h;
+
+        for (u32 sc = 0; sc < sizeof(scales) / sizeof(*scales); sc++) {
+            /* The scaled blits stretch a source of half the size */
+            const u32 src_w = scales[sc].scaled ? w / 2 : w;
+            const u32 src_h = scales[sc].scaled ? h / 2 : h;
+
+            for (u32 f = 0; f < sizeof(formats) / sizeof(*formats); f++) {
+                struct r_surface *src =
+                    r_surface_create(src_w, src_h, formats[f].src_fmt);
+                struct r_surface *dst =
+                    r_surface_create(w, h, formats[f].dst_fmt);
+                s_assert(src != NULL && dst != NULL,
+                    "Failed to create the surfaces");
+                fill_pixels(dst->data.buf, w * h, ALPHA_OPAQUE);
+
+                char name[64];
+                snprintf(name, sizeof(name), "blit/%s/%s",
+                    scales[sc].name, formats[f].name);
+
+                for (u32 m = 0; m < ALPHA_MIX_MAX_; m++) {
+                    fill_pixels(src->data.buf, src_w * src_h, m);
+                    r_surface_update_opacity(src);
+
+                    struct blit_args args = {
+                        .dst = dst,
+                        .src = src,
+                        .filter = scales[sc].filter,
+                    };
+                    bench_run(name, alpha_mix_strings[m], w, h,
+                        (u64)w * h, run_blit, &args);
+                }
+
+                r_surface_destroy(&src);
+                r_surface_destroy(&dst);
+            }
+        }
+    }
+}
+
+#define FRAME_CONTENT_LIST                  \
+    X_(FRAME_RESET, "frame/reset")          \
+    X_(FRAME_FILL_RECT, "frame/fill_rect")  \
+    X_(FRAME_DRAW_RECT, "frame/draw_rect")  \
+    X_(FRAME_DRAW_LINE, "frame/draw_line")  \
+    X_(FRAME_SURFACE, "frame/surface")      \
+    X_(FRAME_UNCHANGED, "frame/unchanged")  \
+
+#define X_(name, str) name,
+enum frame_content {
+    FRAME_CONTENT_LIST
+    FRAME_CONTENT_MAX_
+};
+#undef X_
+
+#define X_(name, str) str,
+static const char *const frame_content_strings[FRAME_CONTENT_MAX_] = {
+    FRAME_CONTENT_LIST
+};
+#undef X_
+
+struct frame_args {
+    struct r_ctx *rctx;
+    enum frame_content content;
+    const struct r_surface *bg, *sprite;
+    rect_t rects[N_PRIMITIVES_PER_FRAME];
+};
+
+/* Records, draws and "presents" a whole frame */
+static void run_frame(void *arg)
+{
+    const struct frame_args *a = arg;
+
+    r_reset(a->rctx);
+
+    /* Make sure that everything is actually redrawn,
+     * except for when measuring how long it takes not to */
+    if (a->content != FRAME_UNCHANGED)
+        r_invalidate(a->rctx);
+
+    const u32 n_primitives = a->content == FRAME_RESET ?
+        0 : N_PRIMITIVES_PER_FRAME;
+    for (u32 i = 0; i < n_primitives; i++) {
+        const rect_t *const r = &a->rects[i];
+        switch (a->content) {
+        case FRAME_FILL_RECT:
+            r_fill_rect(a->rctx, r->x, r->y, r->w, r->h);
+            break;
+        case FRAME_DRAW_RECT:
+            r_draw_rect(a->rctx, r->x, r->y, r->w, r->h);
+            break;
+        case FRAME_DRAW_LINE:
+            r_draw_line(a->rctx, (vec2d_t) { r->x, r->y },
+                (vec2d_t) { r->x + r->w, r->y + r->h });
+            break;
+        case FRAME_SURFACE:
+        case FRAME_UNCHANGED:
+            /* Like the menu: a background stretched over the whole
+             * window (scaled), with some sprites on top of it */
+            if (i == 0)
+                r_surface_render(a->rctx, a->bg, NULL, NULL);
+            r_surface_render(a->rctx, a->sprite, NULL, r);
+            break;
+        default:
+            break;
+        }
+    }
+
+    r_flush(a->rctx);
+    r_finish(a->rctx);
+}
+
+static void bench_frames(void)
+{
+    const rect_t win_rect = { 0, 0, FRAME_W, FRAME_H };
+    struct p_window *win = p_window_open(MODULE_NAME, &win_rect,
+        P_WINDOW_TYPE_DUMMY);
+    if (win == NULL) {
+        s_log_error("Failed to open a dummy window, "
+            "skipping the frame benchmarks");
+        return;
+    }
+
+    struct r_surface *bg = r_surface_create(FRAME_W / 4, FRAME_H / 4,
+        RGBA32_PREMUL);
+    struct r_surface *sprite = r_surface_create(64, 64, RGBA32_PREMUL);
+    s_assert(bg != NULL && sprite != NULL, "Failed to create the surfaces");
+    fill_pixels(bg->data.buf, bg->data.w * bg->data.h, ALPHA_OPAQUE);
+    fill_pixels(sprite->data.buf, sprite->data.w * sprite->data.h,
+        ALPHA_MIXED);
+    r_surface_update_opacity(bg);
+    r_surface_update_opacity(sprite);
+
+    struct frame_args args = { .bg = bg, .sprite = sprite };
+    for (u32 i = 0; i < N_PRIMITIVES_PER_FRAME; i++) {
+        args.rects[i] = (rect_t) {
+            .x = rand() % FRAME_W - 32,
+            .y = rand() % FRAME_H - 32,
+            .w = 16 + rand() % 256,
+            .h = 16 + rand() % 256,
+        };
+    }
+
+    /* Once with just the renderer thread, and once with
+     * one rasterizer thread per CPU */
+    static const struct thread_config {
+        const char *name;
+        u32 flags;
+    } thread_configs[] = {
+        { "threads=1", R_CTX_N_THREADS(1) },
+        { "threads=auto", 0 },
+    };
+
+    for (u32 t = 0; t < sizeof(thread_configs) / sizeof(*thread_configs); t++)
+    {
+        args.rctx = r_ctx_init(win, R_TYPE_SOFTWARE, thread_configs[t].flags);
+        if (args.rctx == NULL) {
+            s_log_error("Failed to initialize the renderer");
+            break;
+        }
+
+        r_ctx_set_color(args.rctx, (color_RGBA32_t) { 200, 100, 50, 255 });
+        for (u32 c = 0; c < FRAME_CONTENT_MAX_; c++) {
+            args.content = c;
+            bench_run(frame_content_strings[c], thread_configs[t].name,
+                FRAME_W, FRAME_H, (u64)FRAME_W * FRAME_H, run_frame, &args);
+        }
+
+        r_ctx_destroy(&args.rctx);
+    }
+
+    r_surface_destroy(&sprite);
+    r_surface_destroy(&bg);
+    p_window_close(&win);
+}
+
+/* Fills `buf` with random (validly premultiplied) pixels,
+ * whose alphas are given by `mix` */
+static void fill_pixels(pixel_t *buf, u32 n, enum alpha_mix mix)
+{
+    u32 i = 0;
+    while (i < n) {
+        /* The "mixed" pixels come in runs of random length,
+         * like in the sprites, which have opaque and transparent
+         * areas with translucent edges between them */
+        enum alpha_mix run_mix = mix;
+        u32 run_len = n - i;
+        if (mix == ALPHA_MIXED) {
+            const u32 len = 8 + rand() % 120;
+            run_mix = rand() % ALPHA_MIXED;
+            run_len = u_min(n - i, len);
+        }
+
+        for (u32 j = 0; j < run_len; j++, i++) {
+            u8 a = 0;
+            switch (run_mix) {
+            case ALPHA_OPAQUE: a = 255; break;
+            case ALPHA_TRANSPARENT: a = 0; break;
+            default: a = 1 + rand() % 254; break;
+            }
+            buf[i] = (pixel_t) {
+                rand() % (a + 1), rand() % (a + 1), rand() % (a + 1), a
+            };
+        }
+    }
+}
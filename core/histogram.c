@@ -0,0 +1,86 @@
+#include "histogram.h"
+#include "int.h"
+#include <stdlib.h>
+#include <string.h>
+
+static u32 get_bucket(u64 value);
+static u64 get_percentile(const u64 *sorted, u32 n, u32 percent);
+static int compare_u64(const void *a, const void *b);
+
+void histogram_clear(struct histogram *h)
+{
+    if (h == NULL) return;
+
+    h->n_samples = 0;
+    h->next = 0;
+    h->total_samples = 0;
+}
+
+void histogram_add(struct histogram *h, u64 value)
+{
+    if (h == NULL) return;
+
+    h->samples[h->next] = value;
+    h->next = (h->next + 1) % HISTOGRAM_MAX_SAMPLES;
+    if (h->n_samples < HISTOGRAM_MAX_SAMPLES)
+        h->n_samples++;
+    h->total_samples++;
+}
+
+void histogram_summarize(const struct histogram *h,
+    struct histogram_summary *out)
+{
+    if (out == NULL) return;
+    memset(out, 0, sizeof(struct histogram_summary));
+    if (h == NULL || h->n_samples == 0) {
+        if (h != NULL) out->total_samples = h->total_samples;
+        return;
+    }
+
+    out->n_samples = h->n_samples;
+    out->total_samples = h->total_samples;
+
+    /* The order of the samples doesn't matter anymore */
+    u64 sorted[HISTOGRAM_MAX_SAMPLES];
+    memcpy(sorted, h->samples, h->n_samples * sizeof(u64));
+    qsort(sorted, h->n_samples, sizeof(u64), compare_u64);
+
+    u64 sum = 0;
+    for (u32 i = 0; i < h->n_samples; i++) {
+        sum += sorted[i];
+        out->buckets[get_bucket(sorted[i])]++;
+    }
+
+    out->min = sorted[0];
+    out->max = sorted[h->n_samples - 1];
+    out->mean = sum / h->n_samples;
+    out->p50 = get_percentile(sorted, h->n_samples, 50);
+    out->p90 = get_percentile(sorted, h->n_samples, 90);
+    out->p99 = get_percentile(sorted, h->n_samples, 99);
+}
+
+static u32 get_bucket(u64 value)
+{
+    /* The number of significant bits is the index of the bucket */
+    u32 n_bits = 0;
+    while (value != 0 && n_bits < HISTOGRAM_N_BUCKETS - 1) {
+        value >>= 1;
+        n_bits++;
+    }
+    return n_bits;
+}
+
+/* The smallest sample that at least `percent`% of the samples
+ * are less than or equal to */
+static u64 get_percentile(const u64 *sorted, u32 n, u32 percent)
+{
+    u64 rank = ((u64)n * percent + 99) / 100;
+    if (rank == 0) rank = 1;
+    return sorted[rank - 1];
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    const u64 x = *(const u64 *)a, y = *(const u64 *)b;
+    return (x > y) - (x < y);
+}
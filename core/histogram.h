@@ -0,0 +1,55 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+#include "static-tests.h"
+
+#include "int.h"
+
+/* A rolling histogram of (unsigned integer) samples, e.g. durations
+ * in nanoseconds. Only the last `HISTOGRAM_MAX_SAMPLES` samples are kept,
+ * so the statistics always describe the recent past rather than
+ * the whole lifetime of whatever is being measured.
+ *
+ * The samples are only sorted into buckets when a summary is requested,
+ * so adding one is cheap enough to do on every frame. */
+
+#define HISTOGRAM_MAX_SAMPLES 256
+
+/* The buckets are powers of 2: `buckets[0]` counts the samples equal to 0,
+ * and `buckets[i]` the ones in the range [2^(i-1), 2^i).
+ * The last bucket also counts everything above its range. */
+#define HISTOGRAM_N_BUCKETS 32
+
+struct histogram {
+    u64 samples[HISTOGRAM_MAX_SAMPLES];
+    u32 n_samples; /* The number of valid samples in `samples` */
+    u32 next; /* Where the next sample gets written */
+
+    /* All the samples ever added (since the last `histogram_clear`) */
+    u64 total_samples;
+};
+
+struct histogram_summary {
+    /* The number of samples that the statistics were computed from */
+    u32 n_samples;
+
+    /* All the samples ever added (since the last `histogram_clear`) */
+    u64 total_samples;
+
+    /* All of these are 0 if there are no samples */
+    u64 min, max, mean;
+    u64 p50, p90, p99; /* Percentiles (nearest-rank) */
+
+    u32 buckets[HISTOGRAM_N_BUCKETS];
+};
+
+/* Removes all samples from `h` */
+void histogram_clear(struct histogram *h);
+
+/* Adds `value` to `h`, replacing the oldest sample if `h` is full */
+void histogram_add(struct histogram *h, u64 value);
+
+/* Computes the statistics of the samples currently in `h` into `out` */
+void histogram_summarize(const struct histogram *h,
+    struct histogram_summary *out);
+
+#endif /* HISTOGRAM_H_ */
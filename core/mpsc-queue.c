@@ -0,0 +1,123 @@
+#include "mpsc-queue.h"
+#include "int.h"
+#include "log.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define MODULE_NAME "mpsc-queue"
+
+i32 mpsc_queue_init(struct mpsc_queue *q, u64 capacity, u32 elem_size)
+{
+    u_check_params(q != NULL && capacity > 0 && elem_size > 0);
+
+    memset(q, 0, sizeof(struct mpsc_queue));
+
+    /* So that the positions can just be masked instead of using `%` */
+    u64 real_capacity = 1;
+    while (real_capacity < capacity)
+        real_capacity <<= 1;
+
+    q->data = malloc(real_capacity * elem_size);
+    q->seqs = malloc(real_capacity * sizeof(_Atomic u64));
+    if (q->data == NULL || q->seqs == NULL) {
+        s_log_error("Failed to allocate a queue of %lu %u-byte elements",
+            real_capacity, elem_size);
+        mpsc_queue_destroy(q);
+        return 1;
+    }
+
+    q->capacity = real_capacity;
+    q->elem_size = elem_size;
+
+    /* Slot `i` is free for whoever gets position `i` */
+    for (u64 i = 0; i < real_capacity; i++)
+        atomic_init(&q->seqs[i], i);
+
+    atomic_init(&q->tail, 0);
+    q->head = 0;
+    atomic_init(&q->n_overflows, 0);
+
+    return 0;
+}
+
+void mpsc_queue_destroy(struct mpsc_queue *q)
+{
+    if (q == NULL) return;
+
+    if (q->data != NULL) u_nfree(&q->data);
+    if (q->seqs != NULL) u_nfree(&q->seqs);
+    q->capacity = 0;
+    q->elem_size = 0;
+}
+
+i32 mpsc_queue_push(struct mpsc_queue *q, const void *elem)
+{
+    u64 pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    u64 slot = 0;
+
+    while (true) {
+        slot = pos & (q->capacity - 1);
+        const u64 seq =
+            atomic_load_explicit(&q->seqs[slot], memory_order_acquire);
+        const i64 diff = (i64)(seq - pos);
+
+        if (diff == 0) {
+            /* The slot is free - try to claim it.
+             * On failure, `pos` gets updated to the current tail. */
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        } else if (diff < 0) {
+            /* The slot still has the element from one lap ago,
+             * which the consumer hasn't gotten to yet */
+            atomic_fetch_add_explicit(&q->n_overflows, 1,
+                memory_order_relaxed);
+            return 1;
+        } else {
+            /* Another producer claimed this position in the meantime */
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(q->data + slot * q->elem_size, elem, q->elem_size);
+
+    /* Hand the slot over to the consumer */
+    atomic_store_explicit(&q->seqs[slot], pos + 1, memory_order_release);
+    return 0;
+}
+
+i32 mpsc_queue_pop(struct mpsc_queue *q, void *o)
+{
+    const u64 slot = q->head & (q->capacity - 1);
+    const u64 seq = atomic_load_explicit(&q->seqs[slot], memory_order_acquire);
+
+    /* Either nothing was pushed there yet,
+     * or the producer hasn't finished writing the element */
+    if (seq != q->head + 1)
+        return 1;
+
+    memcpy(o, q->data + slot * q->elem_size, q->elem_size);
+
+    /* Free the slot for the producer that gets it on the next lap */
+    atomic_store_explicit(&q->seqs[slot], q->head + q->capacity,
+        memory_order_release);
+    q->head++;
+
+    return 0;
+}
+
+u64 mpsc_queue_size(const struct mpsc_queue *q)
+{
+    const u64 tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    return tail - q->head;
+}
+
+u64 mpsc_queue_get_n_overflows(const struct mpsc_queue *q)
+{
+    return atomic_load_explicit(&q->n_overflows, memory_order_relaxed);
+}
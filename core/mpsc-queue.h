@@ -0,0 +1,61 @@
+#ifndef MPSC_QUEUE_H_
+#define MPSC_QUEUE_H_
+#include "static-tests.h"
+
+#include "int.h"
+#include <stdatomic.h>
+
+/* A bounded, lock-free FIFO queue of fixed-size elements,
+ * with any number of producer threads and a single consumer thread.
+ *
+ * Each slot has a sequence number that says whether it's free
+ * for the producer whose turn it is, or ready for the consumer.
+ * The producers claim slots by advancing `tail` with a CAS,
+ * and the consumer is the only one that ever touches `head`.
+ *
+ * Overflow policy: when the queue is full, `mpsc_queue_push` fails
+ * right away (the new element is dropped) and `n_overflows` is
+ * incremented. The producers never wait for the consumer. */
+struct mpsc_queue {
+    u8 *data;
+    _Atomic u64 *seqs;
+    u64 capacity; /* Always a power of 2 */
+    u32 elem_size;
+
+    /* On separate cache lines, so that the producers
+     * and the consumer don't keep stealing them from each other */
+    _Alignas(64) _Atomic u64 tail;
+    _Alignas(64) u64 head;
+
+    _Alignas(64) _Atomic u64 n_overflows;
+};
+
+/* Initializes `q` to hold (at least) `capacity` elements
+ * of `elem_size` bytes each. The capacity is rounded up
+ * to the next power of 2. Returns 0 on success and non-zero on failure. */
+i32 mpsc_queue_init(struct mpsc_queue *q, u64 capacity, u32 elem_size);
+
+/* Frees all the memory used by `q`.
+ * No other thread may use the queue anymore at that point. */
+void mpsc_queue_destroy(struct mpsc_queue *q);
+
+/* Copies `elem` to the back of the queue.
+ * Safe to call from any number of threads at once.
+ * Returns 0 on success and non-zero if the queue was full. */
+i32 mpsc_queue_push(struct mpsc_queue *q, const void *elem);
+
+/* Moves the element at the front of the queue to `o`.
+ * Must only ever be called by one thread at a time (the consumer).
+ * Returns 0 on success and non-zero if the queue was empty
+ * (or if the next element is still being written). */
+i32 mpsc_queue_pop(struct mpsc_queue *q, void *o);
+
+/* Returns the number of elements in the queue, including the ones
+ * that are still being written. Only exact if called by the consumer
+ * while no producers are pushing. */
+u64 mpsc_queue_size(const struct mpsc_queue *q);
+
+/* Returns the number of elements dropped because the queue was full */
+u64 mpsc_queue_get_n_overflows(const struct mpsc_queue *q);
+
+#endif /* MPSC_QUEUE_H_ */
@@ -51,6 +51,7 @@ void pixel_data_row2flat(struct pixel_row_data *in, struct pixel_flat_data *out)
 
     out->w = in->w;
     out->h = in->h;
+    out->stride = in->w;
 }
 
 void pixel_data_flat2row(struct pixel_flat_data *in, struct pixel_row_data *out)
@@ -63,7 +64,8 @@ void pixel_data_flat2row(struct pixel_flat_data *in, struct pixel_row_data *out)
     for (u32 y = 0; y < in->h; y++) {
         out->rows[y] = malloc(in->w * sizeof(pixel_t));
         s_assert(out->rows != NULL, "malloc() failed for pixel data row %i", y);
-        memcpy(out->rows[y], &in->buf[y * in->w], in->w * sizeof(pixel_t));
+        memcpy(out->rows[y], pixel_flat_data_at(in, 0, y),
+            in->w * sizeof(pixel_t));
     }
 
     out->w = in->w;
@@ -26,13 +26,33 @@ typedef enum pixelfmt {
     RGBX8888 = RGBX32,
     BGRX32,
     BGRX888 = BGRX32,
+
+    /* Same as RGBA32 and BGRA32, except that the color channels
+     * are premultiplied by the alpha, i.e. `r = R * a / 255`.
+     * None of the color channels may be greater than the alpha.
+     *
+     * Blending such pixels is cheaper, and unlike with the "straight"
+     * formats, the result is also correct when the destination
+     * itself is translucent (e.g. when surfaces are composed together). */
+    RGBA32_PREMUL,
+    BGRA32_PREMUL,
 } pixelfmt_t;
 
 struct pixel_flat_data {
     pixel_t *buf;
     u32 w, h;
+
+    /* The number of pixels between the starts of 2 consecutive rows.
+     * Always >= `w`. The buffers that we allocate ourselves are tightly
+     * packed (`stride == w`), but ones that come from elsewhere
+     * (e.g. mapped framebuffers) may have padding at the end of each row. */
+    u32 stride;
 };
 
+/* Returns a pointer to the pixel at (`x`, `y`) in `data` */
+#define pixel_flat_data_at(data, x, y) \
+    ((data)->buf + ((u64)(y) * (data)->stride) + (x))
+
 struct pixel_row_data {
     pixel_t **rows;
     u32 w, h;
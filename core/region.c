@@ -0,0 +1,138 @@
+#include "region.h"
+#include "int.h"
+#include "math.h"
+#include "shapes.h"
+#include <stdbool.h>
+#include <string.h>
+
+static inline u64 rect_area(const rect_t *r);
+static inline rect_t rect_union(const rect_t *a, const rect_t *b);
+static inline bool rect_contains(const rect_t *outer, const rect_t *inner);
+
+void region_clear(struct region *r)
+{
+    if (r == NULL) return;
+    r->n_rects = 0;
+}
+
+void region_add_rect(struct region *r, const rect_t *rect)
+{
+    if (r == NULL || rect == NULL || rect->w == 0 || rect->h == 0)
+        return;
+
+    rect_t curr = *rect;
+
+    /* Keep merging `curr` with any existing rect for which doing so
+     * doesn't cost us anything. Every merge removes a rect, so
+     * this always terminates. */
+    u32 i = 0;
+    while (i < r->n_rects) {
+        const rect_t *const other = &r->rects[i];
+
+        if (rect_contains(other, &curr))
+            return;
+
+        const rect_t merged = rect_union(&curr, other);
+        if (rect_area(&merged) <= rect_area(&curr) + rect_area(other)) {
+            curr = merged;
+
+            /* Remove `other` and start over,
+             * since `curr` might now be mergeable with other rects */
+            r->rects[i] = r->rects[--r->n_rects];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (r->n_rects < REGION_MAX_RECTS) {
+        r->rects[r->n_rects++] = curr;
+        return;
+    }
+
+    /* The region is full; merge with the rect that grows the least */
+    u32 best = 0;
+    u64 best_growth = (u64)-1;
+    for (i = 0; i < r->n_rects; i++) {
+        const rect_t merged = rect_union(&curr, &r->rects[i]);
+        const u64 growth = rect_area(&merged) - rect_area(&r->rects[i]);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+
+    curr = rect_union(&curr, &r->rects[best]);
+    r->rects[best] = r->rects[--r->n_rects];
+
+    /* Re-add the result, since it may now overlap with other rects */
+    region_add_rect(r, &curr);
+}
+
+void region_add_region(struct region *r, const struct region *other)
+{
+    if (r == NULL || other == NULL || r == other) return;
+
+    for (u32 i = 0; i < other->n_rects; i++)
+        region_add_rect(r, &other->rects[i]);
+}
+
+void region_clip(struct region *r, const rect_t *bounds)
+{
+    if (r == NULL || bounds == NULL) return;
+
+    u32 n = 0;
+    for (u32 i = 0; i < r->n_rects; i++) {
+        rect_t tmp;
+        if (rect_intersect(&r->rects[i], bounds, &tmp))
+            r->rects[n++] = tmp;
+    }
+    r->n_rects = n;
+}
+
+rect_t region_bounding_box(const struct region *r)
+{
+    if (r == NULL || r->n_rects == 0)
+        return (rect_t) { 0 };
+
+    rect_t ret = r->rects[0];
+    for (u32 i = 1; i < r->n_rects; i++)
+        ret = rect_union(&ret, &r->rects[i]);
+
+    return ret;
+}
+
+bool region_intersects(const struct region *r, const rect_t *rect)
+{
+    if (r == NULL || rect == NULL) return false;
+
+    rect_t tmp;
+    for (u32 i = 0; i < r->n_rects; i++) {
+        if (rect_intersect(&r->rects[i], rect, &tmp))
+            return true;
+    }
+
+    return false;
+}
+
+static inline u64 rect_area(const rect_t *r)
+{
+    return (u64)r->w * (u64)r->h;
+}
+
+static inline rect_t rect_union(const rect_t *a, const rect_t *b)
+{
+    const i64 x0 = u_min((i64)a->x, (i64)b->x);
+    const i64 y0 = u_min((i64)a->y, (i64)b->y);
+    const i64 x1 = u_max((i64)a->x + a->w, (i64)b->x + b->w);
+    const i64 y1 = u_max((i64)a->y + a->h, (i64)b->y + b->h);
+
+    return (rect_t) { x0, y0, x1 - x0, y1 - y0 };
+}
+
+static inline bool rect_contains(const rect_t *outer, const rect_t *inner)
+{
+    return inner->x >= outer->x && inner->y >= outer->y &&
+        (i64)inner->x + inner->w <= (i64)outer->x + outer->w &&
+        (i64)inner->y + inner->h <= (i64)outer->y + outer->h;
+}
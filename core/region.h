@@ -0,0 +1,50 @@
+#ifndef REGION_H_
+#define REGION_H_
+#include "static-tests.h"
+
+#include "int.h"
+#include "shapes.h"
+#include <stdbool.h>
+
+/* A region is a small set of rectangles, used mostly to describe
+ * which parts of a frame have changed ("damage").
+ *
+ * The rects may overlap, but rects that would be cheaper to handle
+ * as one (i.e. when their bounding box isn't bigger than the two of them
+ * combined) are merged as they are added.
+ * When there are too many of them, new rects get merged with whichever
+ * existing rect grows the least, so a region never loses any area;
+ * it can only become less precise. */
+
+#define REGION_MAX_RECTS 16
+
+struct region {
+    rect_t rects[REGION_MAX_RECTS];
+    u32 n_rects;
+};
+
+/* Removes all rects from `r` */
+void region_clear(struct region *r);
+
+/* Adds the area of `rect` to `r`. Empty rects are ignored. */
+void region_add_rect(struct region *r, const rect_t *rect);
+
+/* Adds all the rects of `other` to `r` */
+void region_add_region(struct region *r, const struct region *other);
+
+/* Cuts off any part of `r` that's outside of `bounds` */
+void region_clip(struct region *r, const rect_t *bounds);
+
+/* Returns the smallest rect that contains the whole region
+ * (or an empty rect if the region is empty) */
+rect_t region_bounding_box(const struct region *r);
+
+/* Returns true if any of the rects in `r` overlap with `rect` */
+bool region_intersects(const struct region *r, const rect_t *rect);
+
+static inline bool region_empty(const struct region *r)
+{
+    return r->n_rects == 0;
+}
+
+#endif /* REGION_H_ */
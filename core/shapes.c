@@ -6,15 +6,29 @@ void rect_clip(rect_t *r, const rect_t *max)
 {
     if (r == NULL || max == NULL) return;
 
-    vec2d_t a1, b1;
+    /* Use 64-bit math, otherwise the mix of signed `x` & `y`
+     * and unsigned `w` & `h` gets converted to unsigned and
+     * rects that end at negative coordinates can't be handled properly */
+    const i64 a_x = u_max((i64)r->x, (i64)max->x);
+    const i64 a_y = u_max((i64)r->y, (i64)max->y);
+    const i64 b_x = u_min((i64)r->x + r->w, (i64)max->x + max->w);
+    const i64 b_y = u_min((i64)r->y + r->h, (i64)max->y + max->h);
 
-    a1.x = u_max(r->x, max->x);
-    a1.y = u_max(r->y, max->y);
-    b1.x = u_min(r->x + r->w, max->x + max->w);
-    b1.y = u_min(r->y + r->h, max->y + max->h);
+    r->x = a_x;
+    r->y = a_y;
+    r->w = u_max(0, b_x - a_x);
+    r->h = u_max(0, b_y - a_y);
+}
+
+bool rect_intersect(const rect_t *a, const rect_t *b, rect_t *o)
+{
+    if (a == NULL || b == NULL || o == NULL) return false;
+
+    rect_t tmp = *a;
+    rect_clip(&tmp, b);
+    if (tmp.w == 0 || tmp.h == 0)
+        return false;
 
-    r->x = a1.x;
-    r->y = a1.y;
-    r->w = u_max(0, b1.x - a1.x);
-    r->h = u_max(0, b1.y - a1.y);
+    *o = tmp;
+    return true;
 }
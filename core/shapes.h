@@ -4,6 +4,7 @@
 
 #include "int.h"
 #include <assert.h>
+#include <stdbool.h>
 
 typedef struct {
     f32 x, y;
@@ -30,4 +31,8 @@ static_assert(sizeof(color_RGBA32_t) == 4,
 
 void rect_clip(rect_t *r, const rect_t *max);
 
+/* Writes the overlapping part of `a` and `b` to `o`.
+ * Returns false (and leaves `o` untouched) if they don't overlap. */
+bool rect_intersect(const rect_t *a, const rect_t *b, rect_t *o);
+
 #endif /* U_SHAPES_H_ */
@@ -54,7 +54,7 @@ i32 do_gui_init(struct gui_ctx *gui, const struct platform_ctx *p)
         goto_error("Failed to initialize the renderer");
 
     gui->mmgr = menu_mgr_init(&menu_manager_cfg,
-        p->keyboard, p->mouse);
+        p->keyboard, p->mouse, gui->r);
     if (gui->mmgr == NULL)
         goto_error("Failed to initialize the menu manager!");
 
@@ -76,6 +76,8 @@ void do_platform_cleanup(struct platform_ctx *ctx)
 
 void do_gui_cleanup(struct gui_ctx *gui)
 {
-    if (gui->mmgr != NULL) menu_mgr_destroy(&gui->mmgr);
+    /* The renderer thread might still be drawing the menus' surfaces,
+     * so it has to be stopped first */
     if (gui->r != NULL) r_ctx_destroy(&gui->r);
+    if (gui->mmgr != NULL) menu_mgr_destroy(&gui->mmgr);
 }
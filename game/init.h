@@ -22,6 +22,9 @@ struct gui_ctx {
     struct r_ctx *r;
     struct MenuManager *mmgr;
     bool paused;
+
+    /* The window has to be redrawn completely in the next frame */
+    bool exposed;
 };
 
 i32 do_platform_init(i32 argc, const char *const *argv,
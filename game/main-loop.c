@@ -2,6 +2,7 @@
 #include "init.h"
 #include <core/shapes.h>
 #include <platform/event.h>
+#include <platform/ptime.h>
 #include <platform/mouse.h>
 #include <platform/keyboard.h>
 #include <render/rctx.h>
@@ -13,6 +14,38 @@
 
 #define MODULE_NAME "main"
 
+void wait_for_next_tick(struct p_time_frame_sched *sched, bool idle)
+{
+    timestamp_t period_start, deadline;
+    p_time_frame_sched_get_period(sched, &period_start, &deadline);
+
+    /* If waiting for input (or an event) isn't possible,
+     * idle ticks just keep going at the usual rate */
+    i32 woken_up = idle ? p_event_wait(NULL) : -1;
+    if (woken_up < 0) {
+        /* Leave the last bit before the deadline to the frame scheduler,
+         * which can hit it much more precisely */
+        timestamp_t wake_time = deadline;
+        timestamp_add_ns(wake_time, -P_TIME_SPIN_MARGIN_us * 1000LL);
+        woken_up = p_event_wait(&wake_time);
+    }
+
+    if (!woken_up) {
+        p_time_frame_sched_wait(sched);
+        return;
+    }
+
+    /* Input that arrives before the next period starts has to wait for it,
+     * as otherwise there could be more than one tick per period
+     * (and everything that counts ticks would speed up).
+     * `p_event_wait` can't be used for that, as it returns right away
+     * for as long as a caught SIGTERM/SIGINT isn't handled. */
+    if (p_time_delta_us(&period_start) < 0)
+        p_time_sleep_until(&period_start);
+
+    p_time_frame_sched_begin_frame(sched);
+}
+
 void process_events(struct platform_ctx *p, struct gui_ctx *gui)
 {
     struct p_event ev;
@@ -21,6 +54,8 @@ void process_events(struct platform_ctx *p, struct gui_ctx *gui)
             p->running = false;
         } else if (ev.type == P_EVENT_PAUSE) {
             gui->paused = !gui->paused;
+        } else if (ev.type == P_EVENT_EXPOSE) {
+            gui->exposed = true;
         }
     }
 
@@ -37,6 +72,12 @@ void render_gui(struct gui_ctx *gui)
 {
     r_reset(gui->r);
 
+    /* What's on the screen can't be compared to the previous frame */
+    if (gui->exposed) {
+        r_invalidate(gui->r);
+        gui->exposed = false;
+    }
+
     menu_mgr_draw(gui->mmgr, gui->r);
 
     /* Draw the game rect */
@@ -45,3 +86,24 @@ void render_gui(struct gui_ctx *gui)
 
     r_flush(gui->r);
 }
+
+bool gui_is_idle(const struct platform_ctx *p, const struct gui_ctx *gui)
+{
+    if (gui->exposed || menu_mgr_is_animated(gui->mmgr, gui->paused))
+        return false;
+
+    /* Held keys and buttons are counted in ticks,
+     * and `up`/`down` are only reset by the next one */
+    for (u32 i = 0; i < P_KEYBOARD_N_KEYS; i++) {
+        const pressable_obj_t *const key = p_keyboard_get_key(p->keyboard, i);
+        if (key->pressed || key->up || key->down)
+            return false;
+    }
+    for (u32 i = 0; i < P_MOUSE_N_BUTTONS; i++) {
+        const pressable_obj_t *const button = p_mouse_get_button(p->mouse, i);
+        if (button->pressed || button->up || button->down)
+            return false;
+    }
+
+    return true;
+}
@@ -2,9 +2,19 @@
 #define MAIN_LOOP_H_
 
 #include "init.h"
+#include <platform/ptime.h>
+
+/* Blocks until the next tick is due (according to `sched`),
+ * or there's input (or an event) to handle in the meantime.
+ * If `idle` is true, no tick is due until there's input or an event. */
+void wait_for_next_tick(struct p_time_frame_sched *sched, bool idle);
 
 void process_events(struct platform_ctx *p, struct gui_ctx *gui);
 void update_gui(struct gui_ctx *gui);
 void render_gui(struct gui_ctx *gui);
 
+/* Returns true if another tick wouldn't change anything
+ * until there's new input (or an event) */
+bool gui_is_idle(const struct platform_ctx *p, const struct gui_ctx *gui);
+
 #endif /* MAIN_LOOP_H_ */
@@ -30,21 +30,28 @@ int cgd_main(int argc, char **argv)
 
     s_log_info("Init OK! Entering main loop...");
     /* MAIN LOOP */
+    struct p_time_frame_sched frame_sched;
+    p_time_frame_sched_init(&frame_sched, FRAME_DURATION_us, 0);
     while (true) {
-        timestamp_t start_time;
-        p_time_get_ticks(&start_time);
-
         process_events(&platform_ctx, &gui_ctx);
         if (!platform_ctx.running) break;
 
         update_gui(&gui_ctx);
         render_gui(&gui_ctx);
 
-        i64 delta_time = p_time_delta_us(&start_time);
-        if(delta_time <= FRAME_DURATION_us)
-            p_time_usleep(FRAME_DURATION_us - delta_time);
+        /* Block until the next tick is due, or there's input to handle */
+        wait_for_next_tick(&frame_sched,
+            gui_is_idle(&platform_ctx, &gui_ctx));
     }
 
+    struct p_time_frame_stats frame_stats;
+    p_time_frame_sched_get_stats(&frame_sched, &frame_stats);
+    s_log_verbose("Frame pacing: %lu frames (%lu started early on input), "
+        "%lu periods skipped, drift %li ns, lateness p50/p99 %lu/%lu ns",
+        frame_stats.n_frames, frame_stats.n_early_frames,
+        frame_stats.n_skipped_periods, frame_stats.drift_ns,
+        frame_stats.lateness_ns.p50, frame_stats.lateness_ns.p99);
+
     s_log_verbose("Exited from the main loop, starting cleanup...");
     do_gui_cleanup(&gui_ctx);
     do_platform_cleanup(&platform_ctx);
@@ -16,14 +16,15 @@
 
 #define MODULE_NAME "button"
 
-struct button * button_init(const struct button_config *cfg)
+struct button * button_init(const struct button_config *cfg,
+    const struct r_ctx *rctx)
 {
     u_check_params(cfg != NULL);
 
     struct button *btn = calloc(1, sizeof(struct button));
     s_assert(btn != NULL, "calloc() failed for struct button!");
 
-    btn->sprite = sprite_init(&cfg->sprite_cfg);
+    btn->sprite = sprite_init(&cfg->sprite_cfg, rctx);
     if (btn->sprite == NULL) {
         s_log_error("Failed to initialize the sprite!");
         free(btn);
@@ -64,8 +64,11 @@ struct button {
 };
 
 /* Creates a new button based on the configuration in `cfg`.
+ * `rctx` (optional) is the renderer that the button will be drawn with
+ * (see `sprite_init`).
  * Returns `NULL` on failure. */
-struct button * button_init(const struct button_config *cfg);
+struct button * button_init(const struct button_config *cfg,
+    const struct r_ctx *rctx);
 
 /* Updates `btn` based on the state of `mouse`. */
 void button_update(struct button *btn, const struct p_mouse *mouse);
@@ -10,16 +10,28 @@
 #include <render/rctx.h>
 #include <platform/keyboard.h>
 #include <platform/mouse.h>
+#include <platform/thread.h>
 #include <stdlib.h>
 #include <error.h>
 #include <string.h>
 
 #define MODULE_NAME "menu-mgr"
 
+struct init_menus_arg {
+    const struct menu_config *menu_info;
+    const struct p_keyboard *keyboard;
+    const struct p_mouse *mouse;
+    const struct r_ctx *rctx;
+
+    struct Menu *menus[MENUMGR_MAX_MENU_COUNT];
+};
+static void init_menus(void *arg, u32 start, u32 end);
+
 struct MenuManager * menu_mgr_init(
     const struct menu_manager_config *cfg,
     struct p_keyboard *keyboard,
-    struct p_mouse *mouse
+    struct p_mouse *mouse,
+    const struct r_ctx *rctx
 )
 {
     u_check_params(cfg != NULL && keyboard != NULL && mouse != NULL);
@@ -37,23 +49,46 @@ struct MenuManager * menu_mgr_init(
     if (cfg->magic != MENU_CONFIG_MAGIC)
         goto_error("%s: missing magic value in config struct", __func__);
 
-    /* Initialize the menus */
-    u32 i = 0;
-    while (cfg->menu_info[i].magic == MENU_CONFIG_MAGIC &&
-        i < MENUMGR_MAX_MENU_COUNT)
+    /* Initialize the menus. They're independent of each other,
+     * and most of the time goes into loading their assets,
+     * so they're all initialized in parallel. */
+    u32 n_menus = 0;
+    while (cfg->menu_info[n_menus].magic == MENU_CONFIG_MAGIC &&
+        n_menus < MENUMGR_MAX_MENU_COUNT)
     {
-        struct Menu *new_menu = menu_init(&cfg->menu_info[i], keyboard, mouse);
-        if (new_menu == NULL) {
-            goto_error("menu_init for menu no. %u failed",
-                cfg->menu_info[i].ID);
-        }
+        n_menus++;
+    }
 
-        vector_push_back(&mmgr->full_menu_list, new_menu);
-        i++;
+    struct init_menus_arg init_arg = {
+        .menu_info = cfg->menu_info,
+        .keyboard = keyboard,
+        .mouse = mouse,
+        .rctx = rctx,
+    };
+    struct p_mt_jobs *jobs = p_mt_jobs_create(0);
+    if (jobs != NULL) {
+        p_mt_jobs_parallel_for(jobs, n_menus, 1, init_menus, &init_arg);
+        p_mt_jobs_destroy(&jobs);
+    } else {
+        s_log_warn("Failed to create a job pool, "
+            "initializing the menus one by one");
+        init_menus(&init_arg, 0, n_menus);
+    }
+
+    /* Add all of them to the list first,
+     * so that they are cleaned up even if some others failed */
+    u32 n_failed = 0;
+    for (u32 i = 0; i < n_menus; i++) {
+        if (init_arg.menus[i] != NULL)
+            vector_push_back(&mmgr->full_menu_list, init_arg.menus[i]);
+        else
+            n_failed++;
     }
+    if (n_failed > 0)
+        goto_error("Failed to initialize %u menu(s)", n_failed);
 
     /* Initialize the global event listeners */
-    i = 0;
+    u32 i = 0;
     while (cfg->global_event_listener_info[i].magic == MENU_CONFIG_MAGIC &&
         i < MENUMGR_MAX_MENU_COUNT) {
         struct event_listener_config tmp_cfg = { 0 };
@@ -130,6 +165,13 @@ void menu_mgr_update(struct MenuManager *mmgr, bool paused)
     }
 }
 
+bool menu_mgr_is_animated(const struct MenuManager *mmgr, bool paused)
+{
+    if (mmgr == NULL || paused) return false;
+
+    return menu_is_animated(mmgr->curr_menu);
+}
+
 void menu_mgr_draw(struct MenuManager *mmgr, struct r_ctx *rctx)
 {
     u_check_params(mmgr != NULL && rctx != NULL);
@@ -137,6 +179,19 @@ void menu_mgr_draw(struct MenuManager *mmgr, struct r_ctx *rctx)
     menu_draw(mmgr->curr_menu, rctx);
 }
 
+static void init_menus(void *arg, u32 start, u32 end)
+{
+    struct init_menus_arg *a = arg;
+
+    for (u32 i = start; i < end; i++) {
+        a->menus[i] = menu_init(&a->menu_info[i],
+            a->keyboard, a->mouse, a->rctx);
+        if (a->menus[i] == NULL)
+            s_log_error("menu_init for menu no. %lu failed",
+                a->menu_info[i].ID);
+    }
+}
+
 void menu_mgr_destroy(struct MenuManager **mmgr_p)
 {
     if (mmgr_p == NULL || *mmgr_p == NULL) return;
@@ -50,17 +50,24 @@ struct menu_manager_config {
 };
 
 /* Initializes a new `struct MenuManager` based on the configuration `cfg`,
- * setting `keyboard` and `mouse` as the input sources. */
+ * setting `keyboard` and `mouse` as the input sources.
+ * `rctx` (optional) is the renderer that the menus will be drawn with
+ * (see `menu_init`). */
 struct MenuManager * menu_mgr_init(
     const struct menu_manager_config *cfg,
     struct p_keyboard *keyboard,
-    struct p_mouse *mouse
+    struct p_mouse *mouse,
+    const struct r_ctx *rctx
 );
 
 /* Updates the menu manager `mmgr` - polls on the global event listeners,
  * and if not `paused`, updates the current menu. */
 void menu_mgr_update(struct MenuManager *mmgr, bool paused);
 
+/* Returns true if updating `mmgr` (with the same `paused`) would change
+ * anything on its own, without any input (see `menu_is_animated`). */
+bool menu_mgr_is_animated(const struct MenuManager *mmgr, bool paused);
+
 /* Draws the current menu of `mmgr` with the renderer `rctx`. */
 void menu_mgr_draw(struct MenuManager *mmgr, struct r_ctx *rctx);
 
@@ -34,7 +34,8 @@ static i32 menu_onevent_api_execute_other(const u64 arg[ONEVENT_OBJ_ARG_LEN]);
 struct Menu * menu_init(
     const struct menu_config *cfg,
     const struct p_keyboard *keyboard,
-    const struct p_mouse *mouse
+    const struct p_mouse *mouse,
+    const struct r_ctx *rctx
 )
 {
     u_check_params(cfg != NULL && keyboard != NULL && mouse != NULL);
@@ -64,7 +65,7 @@ struct Menu * menu_init(
             menu_init_onevent_obj(&tmp_cfg.on_click,
                 &cfg->button_info[i].on_click_cfg, mn);
 
-            struct button *new_btn = button_init(&tmp_cfg);
+            struct button *new_btn = button_init(&tmp_cfg, rctx);
             if (new_btn == NULL)
                 goto_error("Button init failed!");
 
@@ -120,7 +121,8 @@ struct Menu * menu_init(
         while (cfg->sprite_info[i].magic == MENU_CONFIG_MAGIC &&
             i < MENU_CONFIG_MAX_LEN)
         {
-            struct sprite *s = sprite_init(&cfg->sprite_info[i].sprite_cfg);
+            struct sprite *s = sprite_init(&cfg->sprite_info[i].sprite_cfg,
+                rctx);
             if (s == NULL)
                 goto_error("Sprite init failed!");
 
@@ -132,7 +134,7 @@ struct Menu * menu_init(
 
     /* Initialize the background */
     if (cfg->bg_config.magic == MENU_CONFIG_MAGIC) {
-        mn->bg = parallax_bg_init(&cfg->bg_config.bg_cfg);
+        mn->bg = parallax_bg_init(&cfg->bg_config.bg_cfg, rctx);
         if (mn->bg == NULL)
             goto_error("Background init failed!");
 
@@ -165,6 +167,13 @@ void menu_update(struct Menu *mn, const struct p_mouse *mouse)
         parallax_bg_update(mn->bg);
 }
 
+bool menu_is_animated(const struct Menu *mn)
+{
+    u_check_params(mn != NULL);
+
+    return mn->bg != NULL && parallax_bg_is_animated(mn->bg);
+}
+
 void menu_draw(struct Menu *mn, struct r_ctx *rctx)
 {
     u_check_params(mn != NULL && rctx != NULL);
@@ -225,16 +225,23 @@ struct menu_config {
 /** FUNCTION PROTOTYPES **/
 
 /* Initializes a new `struct Menu` based on the configuration data in `cfg`,
- * while setting `keyboard` and `mouse` as the sources of user input. */
+ * while setting `keyboard` and `mouse` as the sources of user input.
+ * `rctx` (optional) is the renderer that the menu will be drawn with;
+ * all of the menu's images get converted to its pixel format. */
 struct Menu * menu_init(
     const struct menu_config *cfg,
     const struct p_keyboard *keyboard,
-    const struct p_mouse *mouse
+    const struct p_mouse *mouse,
+    const struct r_ctx *rctx
 );
 
 /* Updates the `menu` with the state of the `mouse` */
 void menu_update(struct Menu *menu, const struct p_mouse *mouse);
 
+/* Returns true if the `menu` changes with each update on its own
+ * (i.e. without any input), e.g. because of a scrolling background. */
+bool menu_is_animated(const struct Menu *menu);
+
 /* Draws all the relevant elements of the `menu` using the renderer `rctx`. */
 void menu_draw(struct Menu *menu, struct r_ctx *rctx);
 
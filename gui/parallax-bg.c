@@ -9,7 +9,8 @@
 
 #define MODULE_NAME "parallax-bg"
 
-struct parallax_bg * parallax_bg_init(const struct parallax_bg_config *cfg)
+struct parallax_bg * parallax_bg_init(const struct parallax_bg_config *cfg,
+    const struct r_ctx *rctx)
 {
     u_check_params(cfg != NULL);
 
@@ -41,6 +42,15 @@ struct parallax_bg * parallax_bg_init(const struct parallax_bg_config *cfg)
             return NULL;
         }
 
+        /* Convert it once now, instead of on every single frame */
+        if (rctx != NULL && r_surface_optimize(asset->surface, rctx)) {
+            s_log_error("Failed to optimize the surface of \"%s\"",
+                cfg->layer_cfgs[i].filepath);
+            asset_destroy(&asset);
+            parallax_bg_destroy(&bg);
+            return NULL;
+        }
+
         /* Get the texture parameters */
         vector_push_back(&bg->layers, (struct parallax_bg_layer) {
             .asset = asset,
@@ -74,6 +84,18 @@ void parallax_bg_update(struct parallax_bg *bg)
     }
 }
 
+bool parallax_bg_is_animated(const struct parallax_bg *bg)
+{
+    u_check_params(bg != NULL);
+
+    for (u32 i = 0; i < vector_size(bg->layers); i++) {
+        if (bg->layers[i].speed != 0)
+            return true;
+    }
+
+    return false;
+}
+
 void parallax_bg_draw(struct parallax_bg *bg, struct r_ctx *rctx)
 {
     if (bg == NULL || bg->layers == NULL || rctx == NULL) return;
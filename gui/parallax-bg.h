@@ -51,12 +51,18 @@ struct parallax_bg_config {
 };
 
 /* Creates a new parralax background based on the information in `cfg`.
+ * If `rctx` is not `NULL`, the layers are converted to the format
+ * that `rctx` draws in (see `r_surface_optimize`).
  * Returns `NULL` on failure. */
-struct parallax_bg * parallax_bg_init(const struct parallax_bg_config *cfg);
+struct parallax_bg * parallax_bg_init(const struct parallax_bg_config *cfg,
+    const struct r_ctx *rctx);
 
 /* Updates all the layer positions in `bg`. */
 void parallax_bg_update(struct parallax_bg *bg);
 
+/* Returns true if any of the layers of `bg` move when it's updated. */
+bool parallax_bg_is_animated(const struct parallax_bg *bg);
+
 /* Draws all the layers of `bg` with the rendering context `rctx`. */
 void parallax_bg_draw(struct parallax_bg *bg, struct r_ctx *rctx);
 
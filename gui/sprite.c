@@ -7,7 +7,8 @@
 
 #define MODULE_NAME "sprite"
 
-struct sprite * sprite_init(const struct sprite_config *cfg)
+struct sprite * sprite_init(const struct sprite_config *cfg,
+    const struct r_ctx *rctx)
 {
     u_check_params(cfg != NULL);
 
@@ -25,6 +26,13 @@ struct sprite * sprite_init(const struct sprite_config *cfg)
         return NULL;
     }
 
+    if (rctx != NULL && r_surface_optimize(spr->asset->surface, rctx)) {
+        s_log_error("Failed to optimize the surface of \"%s\"",
+            cfg->texture_filepath);
+        sprite_destroy(&spr);
+        return NULL;
+    }
+
     return spr;
 }
 
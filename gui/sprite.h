@@ -42,8 +42,11 @@ struct sprite_config {
 };
 
 /* Creates a new sprite with the information in `cfg`.
+ * If `rctx` is not `NULL`, the image is converted to the format
+ * that `rctx` draws in, so that drawing the sprite is as cheap as possible.
  * Returns `NULL` on failure. */
-struct sprite * sprite_init(const struct sprite_config *cfg);
+struct sprite * sprite_init(const struct sprite_config *cfg,
+    const struct r_ctx *rctx);
 
 /* Draws the sprite `spr` with the renderer `rctx`. */
 void sprite_draw(struct sprite *spr, struct r_ctx *rctx);
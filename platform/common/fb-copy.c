@@ -0,0 +1,237 @@
+#define P_INTERNAL_GUARD__
+#include "fb-copy.h"
+#undef P_INTERNAL_GUARD__
+#include <core/int.h>
+#include <core/log.h>
+#include <core/util.h>
+#include <core/math.h>
+#include <platform/ptime.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PC_FB_COPY_X86_ 1
+#include <immintrin.h>
+#define TARGET_SSE2_ __attribute__((target("sse2")))
+#else
+#define PC_FB_COPY_X86_ 0
+#endif /* x86 && GNUC */
+
+#define MODULE_NAME "fb-copy"
+
+/* Enough to get past the write-combining buffers and any caches
+ * that might still be involved, without taking ages on slow memory */
+#define BENCHMARK_MAX_SIZE (1024 * 1024)
+#define BENCHMARK_N_RUNS 4
+
+static const char *const method_names[PC_FB_COPY_METHOD_MAX_] = {
+    [PC_FB_COPY_MEMCPY] = "memcpy",
+    [PC_FB_COPY_STREAM] = "stream",
+};
+
+static void copy_row(enum pc_fb_copy_method method,
+    u8 *restrict dst, const u8 *restrict src, u64 size);
+static void finish_copy(enum pc_fb_copy_method method);
+
+static i64 time_method(enum pc_fb_copy_method method,
+    void *dst, const void *src, u64 size);
+static i64 get_time_ns(const timestamp_t *t0);
+
+#if (PC_FB_COPY_X86_ == 1)
+static void stream_copy_row(u8 *restrict dst, const u8 *restrict src,
+    u64 size);
+#endif /* PC_FB_COPY_X86_ */
+
+enum pc_fb_copy_method pc_fb_copy_select(void *dst, u64 size)
+{
+    u_check_params(dst != NULL);
+
+    /* Let the user decide if they know better */
+    const char *env = getenv(PC_FB_COPY_ENV);
+    if (env != NULL && strcmp(env, "auto") && *env != '\0') {
+        for (u32 i = 0; i < PC_FB_COPY_METHOD_MAX_; i++) {
+            if (strcmp(env, method_names[i]))
+                continue;
+
+            if (!pc_fb_copy_is_available(i)) {
+                s_log_warn("The \"%s\" copy method (from %s) "
+                    "isn't available; falling back to memcpy",
+                    env, PC_FB_COPY_ENV);
+                return PC_FB_COPY_MEMCPY;
+            }
+            s_log_verbose("Using the \"%s\" framebuffer copy method "
+                "(from %s)", env, PC_FB_COPY_ENV);
+            return i;
+        }
+        s_log_warn("Invalid value of %s: \"%s\"; choosing automatically",
+            PC_FB_COPY_ENV, env);
+    }
+
+    size = u_min(size, BENCHMARK_MAX_SIZE);
+    if (size == 0)
+        return PC_FB_COPY_MEMCPY;
+
+    /* Write back what's already there, so that nothing changes
+     * if the memory happens to be on the screen */
+    void *src = malloc(size);
+    if (src == NULL) {
+        s_log_error("Failed to allocate the benchmark buffer; "
+            "falling back to memcpy");
+        return PC_FB_COPY_MEMCPY;
+    }
+    memcpy(src, dst, size);
+
+    enum pc_fb_copy_method best = PC_FB_COPY_MEMCPY;
+    i64 best_time_ns = INT64_MAX;
+    for (u32 i = 0; i < PC_FB_COPY_METHOD_MAX_; i++) {
+        if (!pc_fb_copy_is_available(i))
+            continue;
+
+        const i64 time_ns = time_method(i, dst, src, size);
+        s_log_debug("%s: %li ns for %lu bytes",
+            method_names[i], time_ns, size);
+        if (time_ns < best_time_ns) {
+            best_time_ns = time_ns;
+            best = i;
+        }
+    }
+
+    u_nfree(&src);
+
+    s_log_verbose("Using the \"%s\" framebuffer copy method",
+        method_names[best]);
+    return best;
+}
+
+bool pc_fb_copy_is_available(enum pc_fb_copy_method method)
+{
+    switch (method) {
+    case PC_FB_COPY_MEMCPY:
+        return true;
+#if (PC_FB_COPY_X86_ == 1)
+    case PC_FB_COPY_STREAM:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+#endif /* PC_FB_COPY_X86_ */
+    default:
+        return false;
+    }
+}
+
+void pc_fb_copy_rows(enum pc_fb_copy_method method,
+    void *restrict dst, u64 dst_stride,
+    const void *restrict src, u64 src_stride,
+    u64 row_size, u32 n_rows)
+{
+    u8 *restrict dst_mem = dst;
+    const u8 *restrict src_mem = src;
+
+    for (u32 y = 0; y < n_rows; y++) {
+        copy_row(method, dst_mem + (u64)y * dst_stride,
+            src_mem + (u64)y * src_stride, row_size);
+    }
+    finish_copy(method);
+}
+
+void pc_fb_copy(enum pc_fb_copy_method method,
+    void *restrict dst, const void *restrict src, u64 size)
+{
+    copy_row(method, dst, src, size);
+    finish_copy(method);
+}
+
+static void copy_row(enum pc_fb_copy_method method,
+    u8 *restrict dst, const u8 *restrict src, u64 size)
+{
+    switch (method) {
+#if (PC_FB_COPY_X86_ == 1)
+    case PC_FB_COPY_STREAM:
+        stream_copy_row(dst, src, size);
+        break;
+#endif /* PC_FB_COPY_X86_ */
+    case PC_FB_COPY_MEMCPY:
+    default:
+        memcpy(dst, src, size);
+        break;
+    }
+}
+
+static void finish_copy(enum pc_fb_copy_method method)
+{
+#if (PC_FB_COPY_X86_ == 1)
+    /* The non-temporal stores are weakly ordered,
+     * so they have to be fenced before anyone else can see them */
+    if (method == PC_FB_COPY_STREAM)
+        _mm_sfence();
+#else
+    (void) method;
+#endif /* PC_FB_COPY_X86_ */
+}
+
+static i64 time_method(enum pc_fb_copy_method method,
+    void *dst, const void *src, u64 size)
+{
+    /* The first run also takes care of any page faults */
+    pc_fb_copy(method, dst, src, size);
+
+    i64 best_ns = INT64_MAX;
+    for (u32 i = 0; i < BENCHMARK_N_RUNS; i++) {
+        timestamp_t start;
+        p_time_get_ticks(&start);
+        pc_fb_copy(method, dst, src, size);
+        const i64 time_ns = get_time_ns(&start);
+        best_ns = u_min(best_ns, time_ns);
+    }
+
+    return best_ns;
+}
+
+static i64 get_time_ns(const timestamp_t *t0)
+{
+    timestamp_t now;
+    p_time_get_ticks(&now);
+    return (now.s - t0->s) * 1000000000LL + (now.ns - t0->ns);
+}
+
+#if (PC_FB_COPY_X86_ == 1)
+/* Writes whole 16-byte aligned blocks with non-temporal stores,
+ * which bypass the caches (and get combined into full cache lines
+ * in the write-combining buffers), and the unaligned ends with `memcpy` */
+TARGET_SSE2_
+static void stream_copy_row(u8 *restrict dst, const u8 *restrict src,
+    u64 size)
+{
+    const u64 misalignment = (16 - ((uintptr_t)dst & 15)) & 15;
+    const u64 head = u_min(misalignment, size);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    /* One cache line per iteration */
+    while (size >= 64) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(src + 0));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        const __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+        const __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+        _mm_stream_si128((__m128i *)(dst + 0), a);
+        _mm_stream_si128((__m128i *)(dst + 16), b);
+        _mm_stream_si128((__m128i *)(dst + 32), c);
+        _mm_stream_si128((__m128i *)(dst + 48), d);
+        dst += 64;
+        src += 64;
+        size -= 64;
+    }
+    while (size >= 16) {
+        _mm_stream_si128((__m128i *)dst,
+            _mm_loadu_si128((const __m128i *)src));
+        dst += 16;
+        src += 16;
+        size -= 16;
+    }
+
+    memcpy(dst, src, size);
+}
+#endif /* PC_FB_COPY_X86_ */
@@ -0,0 +1,56 @@
+#ifndef PLATFORM_FB_COPY_H_
+#define PLATFORM_FB_COPY_H_
+
+#include "guard.h"
+#include <core/int.h>
+#include <stdbool.h>
+
+/* Framebuffers, KMS dumb buffers and the like are usually mapped
+ * write-combined or uncached. Writing to such memory is only fast
+ * when whole cache lines are written at once, and reading from it
+ * is extremely slow, which throws off the heuristics of `memcpy`.
+ * These functions copy pixels into such memory with whichever method
+ * turned out to be the fastest for it. */
+
+#define PC_FB_COPY_METHOD_LIST  \
+    X_(PC_FB_COPY_MEMCPY)       \
+    X_(PC_FB_COPY_STREAM)       \
+
+#define X_(name) name,
+enum pc_fb_copy_method {
+    PC_FB_COPY_METHOD_LIST
+    PC_FB_COPY_METHOD_MAX_
+};
+#undef X_
+
+#ifndef PC_FB_COPY_METHOD_LIST_DEF__
+#undef PC_FB_COPY_METHOD_LIST
+#endif /* PC_FB_COPY_METHOD_LIST_DEF__ */
+
+/* The name of the environment variable that overrides the method
+ * chosen by `pc_fb_copy_select`. It can be set to
+ * "memcpy", "stream" or "auto" (the default). */
+#define PC_FB_COPY_ENV "CGD_FB_COPY"
+
+/* Picks the method to use for copying into the memory at `dst`
+ * (`size` bytes), by timing all of the available ones against each other
+ * on (at most the first megabyte of) it, unless `PC_FB_COPY_ENV` says
+ * otherwise. The contents of `dst` are read and written back unchanged. */
+enum pc_fb_copy_method pc_fb_copy_select(void *dst, u64 size);
+
+/* Returns whether `method` can be used on this CPU */
+bool pc_fb_copy_is_available(enum pc_fb_copy_method method);
+
+/* Copies `n_rows` rows of `row_size` bytes each from `src` to `dst`.
+ * The strides are in bytes. The buffers must not overlap.
+ * All of the data is visible to other devices once this returns. */
+void pc_fb_copy_rows(enum pc_fb_copy_method method,
+    void *restrict dst, u64 dst_stride,
+    const void *restrict src, u64 src_stride,
+    u64 row_size, u32 n_rows);
+
+/* Same as `pc_fb_copy_rows` with a single row */
+void pc_fb_copy(enum pc_fb_copy_method method,
+    void *restrict dst, const void *restrict src, u64 size);
+
+#endif /* PLATFORM_FB_COPY_H_ */
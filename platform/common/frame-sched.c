@@ -0,0 +1,149 @@
+#include "../ptime.h"
+#include <core/int.h>
+#include <core/log.h>
+#include <core/util.h>
+#include <core/histogram.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define MODULE_NAME "frame-sched"
+
+/* After a long stall, the accumulator would otherwise make the caller
+ * run so many updates in a row that it would fall behind even more */
+#define MAX_ACCUMULATED_STEPS 5
+
+static inline i64 timestamp_to_ns(const timestamp_t *t);
+static inline void ns_to_timestamp(i64 ns, timestamp_t *o);
+static inline i64 get_ticks_ns(void);
+
+void p_time_frame_sched_init(struct p_time_frame_sched *s,
+    u32 frame_duration_us, u32 update_step_us)
+{
+    u_check_params(s != NULL && frame_duration_us > 0);
+
+    memset(s, 0, sizeof(struct p_time_frame_sched));
+    s->frame_duration_ns = frame_duration_us * 1000LL;
+    s->update_step_ns = update_step_us * 1000LL;
+
+    const i64 now = get_ticks_ns();
+    s->first_frame_ns = s->last_frame_ns = now;
+    s->period_start_ns = now;
+    s->deadline_ns = now + s->frame_duration_ns;
+    s->n_frames = 1;
+
+    histogram_clear(&s->lateness_ns);
+    histogram_clear(&s->frame_interval_ns);
+}
+
+void p_time_frame_sched_wait(struct p_time_frame_sched *s)
+{
+    u_check_params(s != NULL);
+
+    timestamp_t deadline;
+    ns_to_timestamp(s->deadline_ns, &deadline);
+    p_time_sleep_until(&deadline);
+
+    p_time_frame_sched_begin_frame(s);
+}
+
+void p_time_frame_sched_begin_frame(struct p_time_frame_sched *s)
+{
+    u_check_params(s != NULL);
+
+    const i64 now = get_ticks_ns();
+
+    if (now < s->deadline_ns)
+        s->n_early_frames++;
+    else
+        histogram_add(&s->lateness_ns, now - s->deadline_ns);
+
+    const i64 interval = now - s->last_frame_ns;
+    histogram_add(&s->frame_interval_ns, interval);
+    s->last_frame_ns = now;
+    s->n_frames++;
+
+    /* The next period starts where this one ended, unless we're already
+     * past its deadline too, in which case the periods we missed
+     * are skipped (while staying aligned to the same deadlines) */
+    i64 n_skipped = 0;
+    if (now >= s->deadline_ns + s->frame_duration_ns)
+        n_skipped = (now - s->deadline_ns) / s->frame_duration_ns;
+    s->n_skipped_periods += n_skipped;
+
+    s->period_start_ns = s->deadline_ns + n_skipped * s->frame_duration_ns;
+    s->deadline_ns = s->period_start_ns + s->frame_duration_ns;
+
+    if (s->update_step_ns > 0) {
+        s->accumulator_ns += interval;
+        if (s->accumulator_ns > MAX_ACCUMULATED_STEPS * s->update_step_ns)
+            s->accumulator_ns = MAX_ACCUMULATED_STEPS * s->update_step_ns;
+    }
+}
+
+void p_time_frame_sched_get_period(const struct p_time_frame_sched *s,
+    timestamp_t *period_start_o, timestamp_t *deadline_o)
+{
+    u_check_params(s != NULL);
+
+    if (period_start_o != NULL)
+        ns_to_timestamp(s->period_start_ns, period_start_o);
+    if (deadline_o != NULL)
+        ns_to_timestamp(s->deadline_ns, deadline_o);
+}
+
+bool p_time_frame_sched_step(struct p_time_frame_sched *s)
+{
+    u_check_params(s != NULL);
+
+    if (s->update_step_ns <= 0 || s->accumulator_ns < s->update_step_ns)
+        return false;
+
+    s->accumulator_ns -= s->update_step_ns;
+    return true;
+}
+
+f32 p_time_frame_sched_get_alpha(const struct p_time_frame_sched *s)
+{
+    u_check_params(s != NULL);
+
+    if (s->update_step_ns <= 0)
+        return 0.f;
+
+    return (f32)s->accumulator_ns / (f32)s->update_step_ns;
+}
+
+void p_time_frame_sched_get_stats(const struct p_time_frame_sched *s,
+    struct p_time_frame_stats *o)
+{
+    u_check_params(s != NULL && o != NULL);
+
+    o->n_frames = s->n_frames;
+    o->n_early_frames = s->n_early_frames;
+    o->n_skipped_periods = s->n_skipped_periods;
+
+    /* The first frame doesn't have a period of its own */
+    const i64 n_periods = (s->n_frames - 1) + s->n_skipped_periods;
+    o->drift_ns = (s->last_frame_ns - s->first_frame_ns)
+        - n_periods * s->frame_duration_ns;
+
+    histogram_summarize(&s->lateness_ns, &o->lateness_ns);
+    histogram_summarize(&s->frame_interval_ns, &o->frame_interval_ns);
+}
+
+static inline i64 timestamp_to_ns(const timestamp_t *t)
+{
+    return t->s * 1000000000LL + t->ns;
+}
+
+static inline void ns_to_timestamp(i64 ns, timestamp_t *o)
+{
+    o->s = ns / 1000000000LL;
+    o->ns = ns % 1000000000LL;
+}
+
+static inline i64 get_ticks_ns(void)
+{
+    timestamp_t now;
+    p_time_get_ticks(&now);
+    return timestamp_to_ns(&now);
+}
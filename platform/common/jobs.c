@@ -0,0 +1,565 @@
+#include "../thread.h"
+#include "../ptime.h"
+#include <core/int.h>
+#include <core/log.h>
+#include <core/math.h>
+#include <core/util.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define MODULE_NAME "jobs"
+
+/* The maximum number of jobs in each worker's deque.
+ * When it's full, the new jobs are run right away instead. */
+#define DEQUE_CAPACITY 4096
+#define DEQUE_MASK (DEQUE_CAPACITY - 1)
+static_assert((DEQUE_CAPACITY & DEQUE_MASK) == 0,
+    "The deque capacity must be a power of 2");
+
+/* How many times a thread that ran out of jobs looks for new ones
+ * before it goes to sleep */
+#define N_IDLE_SPINS 64
+
+/* How many ranges each thread gets in a `parallel_for` with no grain */
+#define RANGES_PER_THREAD 4
+
+/* The maximum number of workers */
+#define MAX_WORKERS 255
+
+/* Keeps the parts of a deque that are written by different threads
+ * on separate cache lines, without requiring an aligned allocation */
+#define CACHE_LINE_SIZE 64
+
+struct job {
+    p_mt_job_fn_t fn;
+    void *arg;
+    struct p_mt_job_counter *counter;
+
+    /* The next job in the shared queue */
+    struct job *next;
+
+    /* Whether the job was allocated by `p_mt_jobs_submit`,
+     * in which case it's freed once it's done */
+    bool owned;
+};
+
+/* A Chase-Lev work-stealing deque, with the memory orderings from
+ * "Correct and Efficient Work-Stealing for Weak Memory Models"
+ * (Lê et al., 2013). Only the owner pushes and pops at the `bottom`,
+ * while any thread can steal from the `top`. */
+struct deque {
+    _Atomic i64 top;
+    u8 pad0_[CACHE_LINE_SIZE - sizeof(i64)];
+    _Atomic i64 bottom;
+    u8 pad1_[CACHE_LINE_SIZE - sizeof(i64)];
+    _Atomic(struct job *) items[DEQUE_CAPACITY];
+};
+
+struct worker {
+    struct deque dq;
+
+    struct p_mt_jobs *jobs;
+    p_mt_thread_t thread;
+    u32 index;
+
+    /* The state of the random number generator
+     * that picks the victims to steal from */
+    u32 rng;
+};
+
+struct p_mt_jobs {
+    /* `n_workers` is set before any of them are started,
+     * so that it never changes while they look at each other's deques */
+    struct worker *workers;
+    u32 n_workers;
+    u32 n_started;
+
+    /* Protects the shared queue and `running`,
+     * and is used by the sleeping threads */
+    p_mt_mutex_t mutex;
+
+    /* The jobs submitted from outside of the pool */
+    struct job *queue_head, *queue_tail;
+    /* The number of jobs in the shared queue, so that it can be
+     * checked without locking the mutex */
+    _Atomic u32 queue_size;
+
+    /* Signaled when new jobs are submitted while some workers sleep */
+    p_mt_cond_t work_cond;
+    /* Incremented whenever a job is submitted */
+    _Atomic u64 work_epoch;
+    _Atomic u32 n_sleeping;
+
+    /* Signaled when a counter drops to 0 while some threads wait for it */
+    p_mt_cond_t done_cond;
+    _Atomic u32 n_waiting;
+
+    bool running;
+};
+
+/* The worker that the current thread is (if any) */
+static _Thread_local struct worker *tl_worker = NULL;
+
+static void worker_main(void *arg);
+
+static struct job * find_job(struct p_mt_jobs *jobs, struct worker *self);
+static void run_job(struct p_mt_jobs *jobs, struct job *job);
+static void push_job(struct p_mt_jobs *jobs, struct job *job);
+static void enqueue_jobs(struct p_mt_jobs *jobs,
+    struct job *first, struct job *last, u32 n);
+static struct job * dequeue_job(struct p_mt_jobs *jobs);
+static void wake_workers(struct p_mt_jobs *jobs, u32 n_jobs);
+
+static i32 deque_push(struct deque *dq, struct job *job);
+static struct job * deque_pop(struct deque *dq);
+static struct job * deque_steal(struct deque *dq);
+
+static inline struct worker * get_own_worker(const struct p_mt_jobs *jobs);
+static inline u32 next_random(u32 *state);
+
+struct p_mt_jobs * p_mt_jobs_create(u32 n_threads)
+{
+    if (n_threads == 0)
+        n_threads = p_mt_get_cpu_count();
+    const u32 n_workers = u_min(n_threads - 1, MAX_WORKERS);
+
+    struct p_mt_jobs *jobs = calloc(1, sizeof(struct p_mt_jobs));
+    s_assert(jobs != NULL, "calloc() failed for struct p_mt_jobs");
+
+    jobs->mutex = p_mt_mutex_create();
+    jobs->work_cond = p_mt_cond_create();
+    jobs->done_cond = p_mt_cond_create();
+    jobs->running = true;
+
+    jobs->n_workers = n_workers;
+    if (n_workers > 0) {
+        jobs->workers = calloc(n_workers, sizeof(struct worker));
+        s_assert(jobs->workers != NULL, "calloc() failed for the workers");
+    }
+
+    for (u32 i = 0; i < n_workers; i++) {
+        struct worker *w = &jobs->workers[i];
+        w->jobs = jobs;
+        w->index = i;
+        w->rng = 0x9E3779B9U * (i + 1);
+
+        if (p_mt_thread_create(&w->thread, worker_main, w))
+            goto_error("Failed to spawn worker thread %u", i);
+        jobs->n_started++;
+    }
+
+    s_log_debug("Created a job pool with %u worker(s)", jobs->n_workers);
+
+    return jobs;
+
+err:
+    p_mt_jobs_destroy(&jobs);
+    return NULL;
+}
+
+void p_mt_jobs_destroy(struct p_mt_jobs **jobs_p)
+{
+    if (jobs_p == NULL || *jobs_p == NULL) return;
+    struct p_mt_jobs *jobs = *jobs_p;
+
+    p_mt_mutex_lock(&jobs->mutex);
+    jobs->running = false;
+    p_mt_cond_broadcast(&jobs->work_cond);
+    p_mt_mutex_unlock(&jobs->mutex);
+
+    for (u32 i = 0; i < jobs->n_started; i++)
+        p_mt_thread_wait(&jobs->workers[i].thread);
+    jobs->n_started = 0;
+
+    if (jobs->queue_head != NULL)
+        s_log_warn("Destroying a job pool with pending jobs");
+    while (jobs->queue_head != NULL) {
+        struct job *next = jobs->queue_head->next;
+        if (jobs->queue_head->owned)
+            free(jobs->queue_head);
+        jobs->queue_head = next;
+    }
+
+    if (jobs->workers != NULL)
+        u_nfree(&jobs->workers);
+
+    p_mt_cond_destroy(&jobs->done_cond);
+    p_mt_cond_destroy(&jobs->work_cond);
+    p_mt_mutex_destroy(&jobs->mutex);
+
+    u_nzfree(jobs_p);
+}
+
+u32 p_mt_jobs_get_n_threads(const struct p_mt_jobs *jobs)
+{
+    u_check_params(jobs != NULL);
+    return jobs->n_workers + 1;
+}
+
+void p_mt_jobs_submit(struct p_mt_jobs *jobs, p_mt_job_fn_t fn, void *arg,
+    struct p_mt_job_counter *counter)
+{
+    u_check_params(jobs != NULL && fn != NULL);
+
+    struct job *job = malloc(sizeof(struct job));
+    s_assert(job != NULL, "malloc() failed for struct job");
+    job->fn = fn;
+    job->arg = arg;
+    job->counter = counter;
+    job->next = NULL;
+    job->owned = true;
+
+    if (counter != NULL)
+        atomic_fetch_add_explicit(&counter->n_pending, 1,
+            memory_order_relaxed);
+
+    push_job(jobs, job);
+    wake_workers(jobs, 1);
+}
+
+void p_mt_jobs_wait(struct p_mt_jobs *jobs, struct p_mt_job_counter *counter)
+{
+    u_check_params(jobs != NULL && counter != NULL);
+
+    struct worker *const self = get_own_worker(jobs);
+
+    u32 n_idle_spins = 0;
+    while (atomic_load_explicit(&counter->n_pending, memory_order_acquire)) {
+        struct job *job = find_job(jobs, self);
+        if (job != NULL) {
+            run_job(jobs, job);
+            n_idle_spins = 0;
+            continue;
+        }
+
+        if (++n_idle_spins < N_IDLE_SPINS)
+            continue;
+
+        /* There's nothing left to help with, so just wait
+         * for the remaining jobs (that are already running) to finish */
+        p_mt_mutex_lock(&jobs->mutex);
+        atomic_fetch_add(&jobs->n_waiting, 1);
+        while (atomic_load(&counter->n_pending) > 0) {
+            p_mt_cond_wait(&jobs->done_cond, &jobs->mutex);
+            p_mt_mutex_lock(&jobs->mutex);
+        }
+        atomic_fetch_sub(&jobs->n_waiting, 1);
+        p_mt_mutex_unlock(&jobs->mutex);
+        break;
+    }
+}
+
+/* A range of a `parallel_for`. They're all allocated at once,
+ * and so they aren't `owned` by the jobs. */
+struct range_job {
+    struct job job;
+    p_mt_job_range_fn_t fn;
+    void *arg;
+    u32 start, end;
+};
+
+static void run_range(void *arg)
+{
+    struct range_job *r = arg;
+    r->fn(r->arg, r->start, r->end);
+}
+
+void p_mt_jobs_parallel_for(struct p_mt_jobs *jobs, u32 n, u32 grain,
+    p_mt_job_range_fn_t fn, void *arg)
+{
+    u_check_params(jobs != NULL && fn != NULL);
+
+    if (n == 0)
+        return;
+
+    const u32 n_threads = jobs->n_workers + 1;
+    if (grain == 0)
+        grain = u_max(1, n / (n_threads * RANGES_PER_THREAD));
+
+    const u32 n_ranges = n / grain + (n % grain != 0);
+    if (n_ranges == 1 || jobs->n_workers == 0) {
+        fn(arg, 0, n);
+        return;
+    }
+
+    struct range_job *ranges = calloc(n_ranges, sizeof(struct range_job));
+    s_assert(ranges != NULL, "calloc() failed for the ranges");
+
+    struct p_mt_job_counter counter = P_MT_JOB_COUNTER_INIT;
+    atomic_store_explicit(&counter.n_pending, n_ranges, memory_order_relaxed);
+
+    for (u32 i = 0; i < n_ranges; i++) {
+        ranges[i].fn = fn;
+        ranges[i].arg = arg;
+        ranges[i].start = i * grain;
+        ranges[i].end = u_min(n, (u64)(i + 1) * grain);
+        ranges[i].job = (struct job) {
+            .fn = run_range,
+            .arg = &ranges[i],
+            .counter = &counter,
+            .next = i + 1 < n_ranges ? &ranges[i + 1].job : NULL,
+            .owned = false,
+        };
+    }
+
+    /* Only the workers have deques, and pushing the ranges one by one
+     * to the shared queue would mean locking the mutex every time */
+    if (get_own_worker(jobs) != NULL) {
+        for (u32 i = 0; i < n_ranges; i++)
+            push_job(jobs, &ranges[i].job);
+    } else {
+        enqueue_jobs(jobs, &ranges[0].job, &ranges[n_ranges - 1].job,
+            n_ranges);
+    }
+    wake_workers(jobs, n_ranges);
+
+    p_mt_jobs_wait(jobs, &counter);
+    free(ranges);
+}
+
+static void worker_main(void *arg)
+{
+    struct worker *const self = arg;
+    struct p_mt_jobs *const jobs = self->jobs;
+    tl_worker = self;
+
+    u32 n_idle_spins = 0;
+    while (true) {
+        struct job *job = find_job(jobs, self);
+        if (job != NULL) {
+            run_job(jobs, job);
+            n_idle_spins = 0;
+            continue;
+        }
+
+        if (++n_idle_spins < N_IDLE_SPINS)
+            continue;
+        n_idle_spins = 0;
+
+        /* Announce that we're going to sleep before checking for work
+         * one last time. `wake_workers` does it the other way around,
+         * so at least one of us is guaranteed to see the other */
+        atomic_fetch_add(&jobs->n_sleeping, 1);
+        const u64 epoch = atomic_load(&jobs->work_epoch);
+        job = find_job(jobs, self);
+
+        bool running = true;
+        if (job == NULL) {
+            p_mt_mutex_lock(&jobs->mutex);
+            while (jobs->running && atomic_load(&jobs->work_epoch) == epoch) {
+                p_mt_cond_wait(&jobs->work_cond, &jobs->mutex);
+                p_mt_mutex_lock(&jobs->mutex);
+            }
+            running = jobs->running;
+            p_mt_mutex_unlock(&jobs->mutex);
+        }
+        atomic_fetch_sub(&jobs->n_sleeping, 1);
+
+        if (job != NULL)
+            run_job(jobs, job);
+        else if (!running)
+            break;
+    }
+
+    tl_worker = NULL;
+    p_mt_thread_exit();
+}
+
+/* Looks for a job in the deque of `self` (if it's not NULL),
+ * then in the shared queue, and then in the deques of the other workers */
+static struct job * find_job(struct p_mt_jobs *jobs, struct worker *self)
+{
+    struct job *job = NULL;
+
+    if (self != NULL && (job = deque_pop(&self->dq)) != NULL)
+        return job;
+
+    if (atomic_load_explicit(&jobs->queue_size, memory_order_relaxed) > 0 &&
+        (job = dequeue_job(jobs)) != NULL)
+    {
+        return job;
+    }
+
+    if (jobs->n_workers == 0)
+        return NULL;
+
+    /* Start at a random worker, so that the thieves
+     * don't all go for the same victim */
+    u32 start = 0;
+    if (self != NULL)
+        start = next_random(&self->rng) % jobs->n_workers;
+
+    for (u32 i = 0; i < jobs->n_workers; i++) {
+        struct worker *victim = &jobs->workers[(start + i) % jobs->n_workers];
+        if (victim != self && (job = deque_steal(&victim->dq)) != NULL)
+            return job;
+    }
+
+    return NULL;
+}
+
+static void run_job(struct p_mt_jobs *jobs, struct job *job)
+{
+    struct p_mt_job_counter *const counter = job->counter;
+
+    job->fn(job->arg);
+
+    /* A job that isn't owned might be freed by its waiter
+     * as soon as the counter is decremented */
+    if (job->owned)
+        free(job);
+
+    /* Same as with `n_sleeping` (see `worker_main`), the waiters
+     * increment `n_waiting` before checking the counter */
+    if (counter == NULL || atomic_fetch_sub(&counter->n_pending, 1) != 1)
+        return;
+
+    if (atomic_load(&jobs->n_waiting) > 0) {
+        /* Each of the waiters might be waiting for a different counter */
+        p_mt_mutex_lock(&jobs->mutex);
+        p_mt_cond_broadcast(&jobs->done_cond);
+        p_mt_mutex_unlock(&jobs->mutex);
+    }
+}
+
+/* Pushes `job` to the deque of the current thread,
+ * or to the shared queue if it isn't one of the workers of `jobs` */
+static void push_job(struct p_mt_jobs *jobs, struct job *job)
+{
+    struct worker *const self = get_own_worker(jobs);
+    if (self == NULL) {
+        enqueue_jobs(jobs, job, job, 1);
+    } else if (deque_push(&self->dq, job)) {
+        /* There's plenty of work queued up anyway */
+        run_job(jobs, job);
+    }
+}
+
+static void enqueue_jobs(struct p_mt_jobs *jobs,
+    struct job *first, struct job *last, u32 n)
+{
+    last->next = NULL;
+
+    p_mt_mutex_lock(&jobs->mutex);
+    if (jobs->queue_tail == NULL)
+        jobs->queue_head = first;
+    else
+        jobs->queue_tail->next = first;
+    jobs->queue_tail = last;
+    atomic_fetch_add_explicit(&jobs->queue_size, n, memory_order_relaxed);
+    p_mt_mutex_unlock(&jobs->mutex);
+}
+
+static struct job * dequeue_job(struct p_mt_jobs *jobs)
+{
+    p_mt_mutex_lock(&jobs->mutex);
+
+    struct job *job = jobs->queue_head;
+    if (job != NULL) {
+        jobs->queue_head = job->next;
+        if (jobs->queue_head == NULL)
+            jobs->queue_tail = NULL;
+        atomic_fetch_sub_explicit(&jobs->queue_size, 1, memory_order_relaxed);
+    }
+
+    p_mt_mutex_unlock(&jobs->mutex);
+    return job;
+}
+
+static void wake_workers(struct p_mt_jobs *jobs, u32 n_jobs)
+{
+    /* The other half of the handshake in `worker_main` */
+    atomic_fetch_add(&jobs->work_epoch, 1);
+    if (atomic_load(&jobs->n_sleeping) == 0)
+        return;
+
+    /* A single job only needs a single worker */
+    p_mt_mutex_lock(&jobs->mutex);
+    if (n_jobs == 1)
+        p_mt_cond_signal(&jobs->work_cond);
+    else
+        p_mt_cond_broadcast(&jobs->work_cond);
+    p_mt_mutex_unlock(&jobs->mutex);
+}
+
+static i32 deque_push(struct deque *dq, struct job *job)
+{
+    const i64 b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+    const i64 t = atomic_load_explicit(&dq->top, memory_order_acquire);
+    if (b - t >= DEQUE_CAPACITY)
+        return 1;
+
+    atomic_store_explicit(&dq->items[b & DEQUE_MASK], job,
+        memory_order_relaxed);
+    /* Publishes the job (and its contents) to the thieves */
+    atomic_store_explicit(&dq->bottom, b + 1, memory_order_release);
+
+    return 0;
+}
+
+static struct job * deque_pop(struct deque *dq)
+{
+    const i64 b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    i64 t = atomic_load_explicit(&dq->top, memory_order_relaxed);
+
+    if (t > b) {
+        /* Empty */
+        atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    struct job *job = atomic_load_explicit(&dq->items[b & DEQUE_MASK],
+        memory_order_relaxed);
+    if (t == b) {
+        /* The last job, which a thief might be trying to take as well */
+        if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+        {
+            job = NULL;
+        }
+        atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    }
+
+    return job;
+}
+
+static struct job * deque_steal(struct deque *dq)
+{
+    i64 t = atomic_load_explicit(&dq->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    const i64 b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+
+    if (t >= b)
+        return NULL;
+
+    struct job *job = atomic_load_explicit(&dq->items[t & DEQUE_MASK],
+        memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+    {
+        /* Lost the race to the owner or another thief */
+        return NULL;
+    }
+
+    return job;
+}
+
+static inline struct worker * get_own_worker(const struct p_mt_jobs *jobs)
+{
+    if (tl_worker != NULL && tl_worker->jobs == jobs)
+        return tl_worker;
+    return NULL;
+}
+
+static inline u32 next_random(u32 *state)
+{
+    /* xorshift32 */
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
@@ -0,0 +1,181 @@
+#include <platform/window.h>
+#define P_INTERNAL_GUARD__
+#include "present-timing.h"
+#undef P_INTERNAL_GUARD__
+#include <core/int.h>
+#include <core/util.h>
+#include <core/histogram.h>
+#include <core/spinlock.h>
+#include <platform/ptime.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define MODULE_NAME "present-timing"
+
+static inline u64 timestamp_to_ns(const timestamp_t *t);
+static inline u64 get_ticks_ns(void);
+
+void pc_present_timing_init(struct pc_present_timing *t)
+{
+    u_check_params(t != NULL);
+
+    memset(t, 0, sizeof(struct pc_present_timing));
+    spinlock_init(&t->lock);
+    histogram_clear(&t->swap_to_flip_ns);
+    histogram_clear(&t->flip_interval_ns);
+    histogram_clear(&t->missed_vblanks);
+}
+
+void pc_present_timing_set_refresh_interval(struct pc_present_timing *t,
+    u64 refresh_interval_ns)
+{
+    u_check_params(t != NULL);
+
+    spinlock_acquire(&t->lock);
+    t->refresh_interval_ns = refresh_interval_ns;
+    spinlock_release(&t->lock);
+}
+
+void pc_present_timing_record_swap(struct pc_present_timing *t)
+{
+    u_check_params(t != NULL);
+
+    const u64 now = get_ticks_ns();
+
+    spinlock_acquire(&t->lock);
+    if (t->n_pending_swaps == PC_PRESENT_TIMING_MAX_PENDING) {
+        /* The backend never reported the oldest one's flip */
+        memmove(&t->pending_swaps[0], &t->pending_swaps[1],
+            (PC_PRESENT_TIMING_MAX_PENDING - 1) * sizeof(u64));
+        t->n_pending_swaps--;
+    }
+    t->pending_swaps[t->n_pending_swaps++] = now;
+    t->n_swaps++;
+    spinlock_release(&t->lock);
+}
+
+void pc_present_timing_cancel_swap(struct pc_present_timing *t)
+{
+    u_check_params(t != NULL);
+
+    spinlock_acquire(&t->lock);
+    if (t->n_pending_swaps > 0) {
+        t->n_pending_swaps--;
+        t->n_swaps--;
+    }
+    spinlock_release(&t->lock);
+}
+
+void pc_present_timing_record_coalesced(struct pc_present_timing *t)
+{
+    u_check_params(t != NULL);
+
+    /* The newest pending swap is the one that replaced the frame,
+     * so it's the one before it that has to go */
+    spinlock_acquire(&t->lock);
+    if (t->n_pending_swaps >= 2) {
+        t->pending_swaps[t->n_pending_swaps - 2] =
+            t->pending_swaps[t->n_pending_swaps - 1];
+        t->n_pending_swaps--;
+    }
+    spinlock_release(&t->lock);
+}
+
+void pc_present_timing_record_flip(struct pc_present_timing *t, bool status,
+    const struct pc_present_flip_info *info)
+{
+    u_check_params(t != NULL);
+
+    const u64 flip_ns = info != NULL ?
+        timestamp_to_ns(&info->time) : get_ticks_ns();
+    const u64 msc = info != NULL ? info->msc : 0;
+
+    spinlock_acquire(&t->lock);
+
+    /* Either way, the oldest frame won't be waiting anymore */
+    bool have_swap = false;
+    u64 swap_ns = 0;
+    if (t->n_pending_swaps > 0) {
+        have_swap = true;
+        swap_ns = t->pending_swaps[0];
+        memmove(&t->pending_swaps[0], &t->pending_swaps[1],
+            (t->n_pending_swaps - 1) * sizeof(u64));
+        t->n_pending_swaps--;
+    }
+
+    if (status != 0) {
+        t->n_failed_flips++;
+        spinlock_release(&t->lock);
+        return;
+    }
+    t->n_flips++;
+
+    /* The flip timestamps may come from a different source
+     * than the swap ones, so they might be slightly off */
+    if (have_swap)
+        histogram_add(&t->swap_to_flip_ns,
+            flip_ns > swap_ns ? flip_ns - swap_ns : 0);
+
+    if (t->have_last_flip) {
+        const u64 interval_ns = flip_ns > t->last_flip_ns ?
+            flip_ns - t->last_flip_ns : 0;
+        histogram_add(&t->flip_interval_ns, interval_ns);
+
+        /* Prefer the actual sequence numbers over an estimate */
+        u64 n_vblanks = 0;
+        if (msc != 0 && t->last_flip_msc != 0) {
+            if (msc > t->last_flip_msc)
+                n_vblanks = msc - t->last_flip_msc;
+        } else if (t->refresh_interval_ns != 0) {
+            n_vblanks = (interval_ns + t->refresh_interval_ns / 2) /
+                t->refresh_interval_ns;
+        }
+
+        /* 0 means that both flips happened within the same vblank
+         * (i.e. without vsync), in which case nothing was missed */
+        if (n_vblanks > 0)
+            histogram_add(&t->missed_vblanks, n_vblanks - 1);
+    }
+
+    t->have_last_flip = true;
+    t->last_flip_ns = flip_ns;
+    t->last_flip_msc = msc;
+
+    spinlock_release(&t->lock);
+}
+
+void pc_present_timing_get(struct pc_present_timing *t,
+    struct p_window_present_timing *out)
+{
+    u_check_params(t != NULL && out != NULL);
+
+    /* Sorting the samples takes a while,
+     * so it's done on copies, outside of the lock */
+    struct histogram swap_to_flip_ns, flip_interval_ns, missed_vblanks;
+
+    spinlock_acquire(&t->lock);
+    out->n_swaps = t->n_swaps;
+    out->n_flips = t->n_flips;
+    out->n_failed_flips = t->n_failed_flips;
+    out->refresh_interval_ns = t->refresh_interval_ns;
+    swap_to_flip_ns = t->swap_to_flip_ns;
+    flip_interval_ns = t->flip_interval_ns;
+    missed_vblanks = t->missed_vblanks;
+    spinlock_release(&t->lock);
+
+    histogram_summarize(&swap_to_flip_ns, &out->swap_to_flip_ns);
+    histogram_summarize(&flip_interval_ns, &out->flip_interval_ns);
+    histogram_summarize(&missed_vblanks, &out->missed_vblanks);
+}
+
+static inline u64 timestamp_to_ns(const timestamp_t *t)
+{
+    return (u64)t->s * 1000000000ULL + (u64)t->ns;
+}
+
+static inline u64 get_ticks_ns(void)
+{
+    timestamp_t now;
+    p_time_get_ticks(&now);
+    return timestamp_to_ns(&now);
+}
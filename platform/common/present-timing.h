@@ -0,0 +1,88 @@
+#ifndef PLATFORM_PRESENT_TIMING_H_
+#define PLATFORM_PRESENT_TIMING_H_
+
+#include "guard.h"
+#include <core/int.h>
+#include <core/histogram.h>
+#include <core/spinlock.h>
+#include <platform/ptime.h>
+#include <platform/window.h>
+#include <stdbool.h>
+
+/* How many swaps can be waiting for their page flips at once.
+ * If a backend never reports some of its flips (or there are none at all,
+ * like with dummy windows), the oldest swaps are just forgotten. */
+#define PC_PRESENT_TIMING_MAX_PENDING 8
+
+/* Matches the `p_window_swap_buffers` calls with their page flips
+ * (in the order they were made) to collect the statistics
+ * for `p_window_get_present_timing`.
+ *
+ * The swaps are recorded by the generic window code, and the flips
+ * by whichever backend thread finds out about them, so all of the
+ * functions below can be called from any thread. */
+struct pc_present_timing {
+    spinlock_t lock;
+
+    /* The timestamps of the swaps (in ns) whose frames
+     * haven't been flipped to yet, oldest first */
+    u64 pending_swaps[PC_PRESENT_TIMING_MAX_PENDING];
+    u32 n_pending_swaps;
+
+    /* The last successful flip, to compute the intervals */
+    bool have_last_flip;
+    u64 last_flip_ns;
+    u64 last_flip_msc;
+
+    u64 refresh_interval_ns;
+
+    u64 n_swaps, n_flips, n_failed_flips;
+    struct histogram swap_to_flip_ns;
+    struct histogram flip_interval_ns;
+    struct histogram missed_vblanks;
+};
+
+/* When and at which vblank a page flip actually happened */
+struct pc_present_flip_info {
+    /* On the same clock as `p_time_get_ticks` (CLOCK_MONOTONIC) */
+    timestamp_t time;
+
+    /* The vblank sequence number ("media stream counter"),
+     * or 0 if the backend doesn't know it */
+    u64 msc;
+};
+
+/* Resets `t` to its initial state (with no refresh interval known) */
+void pc_present_timing_init(struct pc_present_timing *t);
+
+/* Sets the display's nominal refresh interval (in ns), used to estimate
+ * the missed vblanks when the backend can't report the sequence numbers.
+ * 0 means that it's unknown. */
+void pc_present_timing_set_refresh_interval(struct pc_present_timing *t,
+    u64 refresh_interval_ns);
+
+/* Records a swap made just now. Must be called before the swap is handed
+ * over to the backend, as its page flip may happen before it returns. */
+void pc_present_timing_record_swap(struct pc_present_timing *t);
+
+/* Forgets the last recorded swap, because it failed */
+void pc_present_timing_cancel_swap(struct pc_present_timing *t);
+
+/* Forgets the frame that's been waiting for its page flip
+ * the shortest, because it got replaced by a newer one.
+ * Must be called by the backend while the swap of the newer frame
+ * (which was already recorded) is still in progress. */
+void pc_present_timing_record_coalesced(struct pc_present_timing *t);
+
+/* Matches the oldest pending swap with a page flip that just completed.
+ * `status` is 0 if the flip succeeded (like `page_flip_status`).
+ * If `info` is NULL, the flip is assumed to have happened just now,
+ * at an unknown vblank. */
+void pc_present_timing_record_flip(struct pc_present_timing *t, bool status,
+    const struct pc_present_flip_info *info);
+
+/* Retrieves the current statistics of `t` into `out` */
+void pc_present_timing_get(struct pc_present_timing *t,
+    struct p_window_present_timing *out);
+
+#endif /* PLATFORM_PRESENT_TIMING_H_ */
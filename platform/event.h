@@ -12,6 +12,10 @@ enum p_event_type {
 
     P_EVENT_PAGE_FLIP,
 
+    /* (Parts of) the window have to be drawn again,
+     * e.g. because it was covered by another window */
+    P_EVENT_EXPOSE,
+
     P_EVENT_CTL_INIT_,
     P_EVENT_CTL_DESTROY_,
 };
@@ -25,12 +29,37 @@ struct p_event {
     } info;
 };
 
-/* Reads the last event from the queue, if it exists
- * Returns the number of events left in the queue
- * (return value 0 means that there are no more events left) */
+/* Reads the oldest event from the queue into `o`, if there is one.
+ * Returns the number of events that were in the queue
+ * (including the one that was just read), so 0 means
+ * that there were no events and `o` wasn't written to.
+ *
+ * The queue is lock-free, but it has only one consumer,
+ * so this must only be called from one thread at a time
+ * (normally the main loop). */
 i32 p_event_poll(struct p_event *o);
 
-/* Pushes an event to the queue. */
+/* Pushes an event to the back of the queue.
+ * Safe to call from any thread, and never blocks.
+ *
+ * If the queue is full, the event is dropped (see `p_event_get_n_dropped`),
+ * except for `P_EVENT_QUIT`, which is then delivered
+ * once the queue is drained. */
 void p_event_send(const struct p_event *ev);
 
+/* Blocks until an event is sent, there's new input,
+ * or the `deadline` (as returned by `p_time_get_ticks`) passes,
+ * whichever comes first. If `deadline` is `NULL`, there's no time limit.
+ *
+ * Returns a positive value if it was woken up by an event or input
+ * (that arrived since the last call), and 0 if the deadline passed.
+ * If `deadline` is `NULL` and there's no way to wait for events
+ * (e.g. because setting it up failed), returns a negative value
+ * right away; the caller then has to pick a deadline itself.
+ * Like `p_event_poll`, this must only be called from the consumer thread. */
+i32 p_event_wait(const timestamp_t *deadline);
+
+/* Returns how many events have been dropped because the queue was full */
+u64 p_event_get_n_dropped(void);
+
 #endif /* P_EVENT_H_ */
@@ -0,0 +1,23 @@
+#ifndef EVENT_INTERNAL_H_
+#define EVENT_INTERNAL_H_
+
+#include <platform/common/guard.h>
+
+#include <core/int.h>
+
+/* Makes `p_event_wait` return when there's new data to read from `fd`.
+ * The fd is watched edge-triggered, so data that's left unread
+ * (e.g. until the next `p_keyboard_update`) won't keep
+ * waking the main loop up.
+ * Returns 0 on success and non-zero on failure. */
+i32 event_add_wait_fd(i32 fd);
+
+/* Stops watching `fd`. Must be called before `fd` is closed. */
+void event_remove_wait_fd(i32 fd);
+
+/* Makes `p_event_wait` return, e.g. when input was received
+ * in another thread. Safe to call from any thread
+ * (and from signal handlers). */
+void event_wake(void);
+
+#endif /* EVENT_INTERNAL_H_ */
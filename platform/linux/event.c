@@ -5,22 +5,65 @@
 #include <core/int.h>
 #include <core/log.h>
 #include <core/util.h>
-#include <core/vector.h>
+#include <core/mpsc-queue.h>
+#include <time.h>
 #include <errno.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdatomic.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#define P_INTERNAL_GUARD__
+#include "event-internal.h"
+#undef P_INTERNAL_GUARD__
 
 #define MODULE_NAME "event"
 
-static VECTOR(struct p_event) g_event_queue = NULL;
+/* Enough for a few frames' worth of input and page flips
+ * even if the main loop stalls for a while */
+#define EVENT_QUEUE_CAPACITY 1024
+
+/* The queue itself is lock-free. The mutex only guards its creation
+ * and destruction, which the fast paths check for with
+ * `g_event_queue_initialized` */
+static struct mpsc_queue g_event_queue;
+static _Atomic bool g_event_queue_initialized = false;
 static p_mt_mutex_t g_event_queue_mutex = P_MT_MUTEX_INITIALIZER;
+
+/* A QUIT event that didn't fit into the queue.
+ * It's delivered after everything that's already in there,
+ * as losing it would make the app impossible to close. */
+static _Atomic bool g_quit_overflowed = false;
+
+/* `p_event_wait` blocks on `g_epoll_fd`, which watches:
+ *  - `g_wake_fd`, an eventfd that's written to by `event_wake`
+ *    (on every `p_event_send`, and on input from other threads),
+ *  - `g_timer_fd`, which expires at the deadline,
+ *  - the input device fds added with `event_add_wait_fd`.
+ *
+ * `g_wake_pending` makes sure that a burst of events only writes
+ * to the eventfd once, until the next `p_event_wait` reads it. */
+static i32 g_epoll_fd = -1;
+static i32 g_timer_fd = -1;
+static _Atomic i32 g_wake_fd = -1;
+static _Atomic bool g_wake_pending = false;
+
+/* Input fds and the wake/timer fds all become ready at about the same time
+ * only very rarely, so this doesn't need to be big */
+#define MAX_WAIT_EVENTS 8
+
 static atomic_flag g_signal_handler_running = ATOMIC_FLAG_INIT;
 static _Atomic bool g_caught_SIGTERM = false;
 
 static void setup_event_queue(bool warn);
 static void destroy_event_queue(void);
+static void ensure_event_queue(void);
+static i32 setup_wait_fds(void);
+static void destroy_wait_fds(void);
+static void sleep_until(const timestamp_t *deadline);
 static void SIGTERM_handler(i32 sig_num);
 
 i32 p_event_poll(struct p_event *o)
@@ -29,47 +72,43 @@ i32 p_event_poll(struct p_event *o)
         p_event_send(&(const struct p_event) { .type = P_EVENT_QUIT });
 
     u_check_params(o != NULL);
-    u32 n_events = 0;
-
-    p_mt_mutex_lock(&g_event_queue_mutex);
-    {
-        if (g_event_queue == NULL)
-            setup_event_queue(true);
 
-        n_events = vector_size(g_event_queue);
-        if (n_events == 0)
-            goto ret;
+    ensure_event_queue();
 
-        memcpy(o,
-            (u8 *)vector_end(g_event_queue) - sizeof(struct p_event),
-            sizeof(struct p_event)
-        );
-        vector_pop_back(&g_event_queue);
+    /* Count the event that's about to be popped too */
+    const u64 n_events = mpsc_queue_size(&g_event_queue);
+    if (mpsc_queue_pop(&g_event_queue, o)) {
+        if (!atomic_exchange(&g_quit_overflowed, false))
+            return 0;
 
-        if (o->type == P_EVENT_QUIT)
-            s_log_verbose("Caught QUIT event");
+        memset(o, 0, sizeof(struct p_event));
+        o->type = P_EVENT_QUIT;
+        p_time(&o->time);
     }
-ret:
-    p_mt_mutex_unlock(&g_event_queue_mutex);
-    return n_events;
+
+    if (o->type == P_EVENT_QUIT)
+        s_log_verbose("Caught QUIT event");
+
+    return n_events > 0 ? (i32)n_events : 1;
 }
 
 void p_event_send(const struct p_event *ev)
 {
     u_check_params(ev != NULL);
 
-    p_mt_mutex_lock(&g_event_queue_mutex);
-
     switch (ev->type) {
         case P_EVENT_CTL_INIT_:
+            p_mt_mutex_lock(&g_event_queue_mutex);
             setup_event_queue(false);
+            p_mt_mutex_unlock(&g_event_queue_mutex);
             break;
         case P_EVENT_CTL_DESTROY_:
+            p_mt_mutex_lock(&g_event_queue_mutex);
             destroy_event_queue();
+            p_mt_mutex_unlock(&g_event_queue_mutex);
             break;
         default:
-            if (g_event_queue == NULL)
-                setup_event_queue(true);
+            ensure_event_queue();
 
             struct p_event tmp_ev;
             memcpy(&tmp_ev, ev, sizeof(struct p_event));
@@ -78,16 +117,149 @@ void p_event_send(const struct p_event *ev)
             s_log_trace("new event type %u, data %u, time %u.%u",
                 tmp_ev.type, tmp_ev.info, tmp_ev.time.s, tmp_ev.time.ns);
             */
-            vector_push_back(&g_event_queue, *ev);
+            if (mpsc_queue_push(&g_event_queue, &tmp_ev)) {
+                /* Only warn once per burst of dropped events */
+                if (mpsc_queue_get_n_overflows(&g_event_queue) % 256 == 1)
+                    s_log_warn("The event queue is full; dropping events");
+
+                if (tmp_ev.type != P_EVENT_QUIT)
+                    break;
+                atomic_store(&g_quit_overflowed, true);
+            }
+            event_wake();
             break;
     }
+}
 
-    p_mt_mutex_unlock(&g_event_queue_mutex);
+i32 p_event_wait(const timestamp_t *deadline)
+{
+    ensure_event_queue();
+
+    if (atomic_load(&g_caught_SIGTERM))
+        return 1;
+
+    if (g_epoll_fd == -1) {
+        if (deadline == NULL)
+            return -1;
+
+        sleep_until(deadline);
+        return 0;
+    }
+
+    /* With `TFD_TIMER_ABSTIME` the deadline is in `CLOCK_MONOTONIC`,
+     * just like `p_time_get_ticks`. An all-zero `it_value` would
+     * disarm the timer instead of making it expire right away. */
+    struct itimerspec its = { 0 };
+    if (deadline != NULL) {
+        its.it_value.tv_sec = deadline->s;
+        its.it_value.tv_nsec = deadline->ns;
+        if (its.it_value.tv_sec <= 0 && its.it_value.tv_nsec <= 0)
+            its.it_value.tv_nsec = 1;
+    }
+    if (timerfd_settime(g_timer_fd, TFD_TIMER_ABSTIME, &its, NULL)) {
+        s_log_error("Failed to arm the wait timer: %s", strerror(errno));
+        if (deadline == NULL)
+            return -1;
+
+        sleep_until(deadline);
+        return 0;
+    }
+
+    struct epoll_event evs[MAX_WAIT_EVENTS];
+    i32 n_evs = 0;
+    do {
+        n_evs = epoll_wait(g_epoll_fd, evs, MAX_WAIT_EVENTS, -1);
+    } while (n_evs == -1 && errno == EINTR && !atomic_load(&g_caught_SIGTERM));
+
+    if (n_evs == -1) {
+        if (errno == EINTR) /* Interrupted by SIGTERM/SIGINT */
+            return 1;
+
+        s_log_error("Failed to wait for events: %s", strerror(errno));
+        return deadline == NULL ? -1 : 0;
+    }
+
+    bool woken_up = false;
+    for (i32 i = 0; i < n_evs; i++) {
+        u64 val = 0;
+        if (evs[i].data.fd == g_timer_fd) {
+            /* Only here to reset the timer's readiness */
+            (void) read(g_timer_fd, &val, sizeof(u64));
+        } else if (evs[i].data.fd == atomic_load(&g_wake_fd)) {
+            /* Anything sent from now on has to write to the eventfd again.
+             * Clearing the flag before the read could lose such a write,
+             * while this way the event is already in the queue. */
+            (void) read(evs[i].data.fd, &val, sizeof(u64));
+            atomic_store(&g_wake_pending, false);
+            woken_up = true;
+        } else {
+            woken_up = true;
+        }
+    }
+
+    return woken_up;
+}
+
+i32 event_add_wait_fd(i32 fd)
+{
+    u_check_params(fd >= 0);
+
+    ensure_event_queue();
+    if (g_epoll_fd == -1)
+        return 1;
+
+    struct epoll_event ev = {
+        .events = EPOLLIN | EPOLLET,
+        .data.fd = fd,
+    };
+    if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+        s_log_error("Failed to add fd %i to the epoll instance: %s",
+            fd, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+void event_remove_wait_fd(i32 fd)
+{
+    if (fd < 0 || g_epoll_fd == -1)
+        return;
+
+    /* Not an error if the fd wasn't added in the first place */
+    if (epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, fd, NULL) && errno != ENOENT) {
+        s_log_warn("Failed to remove fd %i from the epoll instance: %s",
+            fd, strerror(errno));
+    }
+}
+
+void event_wake(void)
+{
+    /* Somebody else already did it and `p_event_wait` hasn't returned yet */
+    if (atomic_exchange(&g_wake_pending, true))
+        return;
+
+    const i32 fd = atomic_load(&g_wake_fd);
+    if (fd == -1)
+        return;
+
+    /* The only way this can fail is if the counter is about to overflow,
+     * in which case the eventfd is already readable anyway */
+    const u64 val = 1;
+    (void) write(fd, &val, sizeof(u64));
+}
+
+u64 p_event_get_n_dropped(void)
+{
+    if (!atomic_load(&g_event_queue_initialized))
+        return 0;
+
+    return mpsc_queue_get_n_overflows(&g_event_queue);
 }
 
 static void setup_event_queue(bool warn)
 {
-    if (g_event_queue != NULL) {
+    if (atomic_load(&g_event_queue_initialized)) {
         s_log_warn("%s: Event queue already initialized!", __func__);
         return;
     } else if (warn) {
@@ -96,7 +268,21 @@ static void setup_event_queue(bool warn)
         s_log_verbose("Initializing the event queue...");
     }
 
-    g_event_queue = vector_new(struct p_event);
+    if (mpsc_queue_init(&g_event_queue, EVENT_QUEUE_CAPACITY,
+            sizeof(struct p_event)))
+    {
+        s_log_fatal("Failed to set up the event queue!");
+    }
+    atomic_store(&g_quit_overflowed, false);
+
+    /* Not fatal - `p_event_wait` can always just sleep until the deadline */
+    if (setup_wait_fds()) {
+        s_log_error("Failed to set up the wait file descriptors; "
+            "p_event_wait will only wake up at the deadline");
+        destroy_wait_fds();
+    }
+
+    atomic_store(&g_event_queue_initialized, true);
 
     /** Set the signal handler for SIGTERM and SIGINT **/
     struct sigaction sa = { 0 };
@@ -124,7 +310,7 @@ static void setup_event_queue(bool warn)
 
 static void destroy_event_queue(void)
 {
-    if (g_event_queue == NULL) {
+    if (!atomic_load(&g_event_queue_initialized)) {
         s_log_warn("%s: Event queue already destroyed!", __func__);
         return;
     }
@@ -132,12 +318,95 @@ static void destroy_event_queue(void)
 
     atomic_flag_test_and_set(&g_signal_handler_running);
 
-    vector_destroy(&g_event_queue);
-    g_event_queue = NULL;
+    const u64 n_dropped = mpsc_queue_get_n_overflows(&g_event_queue);
+    if (n_dropped > 0)
+        s_log_warn("%lu event(s) were dropped because the queue was full",
+            n_dropped);
+
+    atomic_store(&g_event_queue_initialized, false);
+    mpsc_queue_destroy(&g_event_queue);
+    destroy_wait_fds();
 
     /* Do NOT restore the default signal handlers */
 }
 
+static void ensure_event_queue(void)
+{
+    if (atomic_load(&g_event_queue_initialized))
+        return;
+
+    p_mt_mutex_lock(&g_event_queue_mutex);
+    if (!atomic_load(&g_event_queue_initialized))
+        setup_event_queue(true);
+    p_mt_mutex_unlock(&g_event_queue_mutex);
+}
+
+static i32 setup_wait_fds(void)
+{
+    atomic_store(&g_wake_pending, false);
+
+    g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_epoll_fd == -1) {
+        s_log_error("Failed to create an epoll instance: %s", strerror(errno));
+        return 1;
+    }
+
+    const i32 wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd == -1) {
+        s_log_error("Failed to create the wake eventfd: %s", strerror(errno));
+        return 1;
+    }
+    atomic_store(&g_wake_fd, wake_fd);
+
+    g_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_timer_fd == -1) {
+        s_log_error("Failed to create the wait timer: %s", strerror(errno));
+        return 1;
+    }
+
+    /* The eventfd and the timer are drained by `p_event_wait`,
+     * so unlike the input fds they can be level-triggered */
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = wake_fd };
+    if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev)) {
+        s_log_error("Failed to add the wake eventfd to the epoll instance: %s",
+            strerror(errno));
+        return 1;
+    }
+    ev.data.fd = g_timer_fd;
+    if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, g_timer_fd, &ev)) {
+        s_log_error("Failed to add the wait timer to the epoll instance: %s",
+            strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+static void destroy_wait_fds(void)
+{
+    const i32 wake_fd = atomic_exchange(&g_wake_fd, -1);
+    if (wake_fd != -1)
+        close(wake_fd);
+    if (g_timer_fd != -1) {
+        close(g_timer_fd);
+        g_timer_fd = -1;
+    }
+    if (g_epoll_fd != -1) {
+        close(g_epoll_fd);
+        g_epoll_fd = -1;
+    }
+}
+
+static void sleep_until(const timestamp_t *deadline)
+{
+    const struct timespec ts = {
+        .tv_sec = deadline->s,
+        .tv_nsec = deadline->ns,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
 static void SIGTERM_handler(i32 sig_num)
 {
     if (!(sig_num == SIGTERM || sig_num == SIGINT))
@@ -149,5 +418,8 @@ static void SIGTERM_handler(i32 sig_num)
     if (!atomic_load(&g_caught_SIGTERM))
         atomic_store(&g_caught_SIGTERM, true);
 
+    /* Don't wait until the next deadline to quit */
+    event_wake();
+
     atomic_flag_clear(&g_signal_handler_running);
 }
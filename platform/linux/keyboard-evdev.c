@@ -22,6 +22,9 @@
 #define P_INTERNAL_GUARD__
 #include "evdev.h"
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include "event-internal.h"
+#undef P_INTERNAL_GUARD__
 
 #define MODULE_NAME "keyboard-evdev"
 
@@ -45,6 +48,12 @@ i32 keyboard_evdev_init(struct keyboard_evdev *kb)
             .events = POLLIN,
             .revents = 0
         });
+
+        /* Without this the keys still work, just with more latency */
+        if (event_add_wait_fd(kb->kbdevs[i].fd)) {
+            s_log_warn("Keypresses from \"%s\" won't wake up the main loop",
+                kb->kbdevs[i].name);
+        }
     }
 
     return 0;
@@ -60,7 +69,9 @@ void keyboard_evdev_destroy(struct keyboard_evdev *kb)
 
     if (kb->kbdevs != NULL) {
         for (u32 i = 0; i < vector_size(kb->kbdevs); i++) {
-            if (kb->kbdevs[i].fd != -1) close(kb->kbdevs[i].fd);
+            if (kb->kbdevs[i].fd == -1) continue;
+            event_remove_wait_fd(kb->kbdevs[i].fd);
+            close(kb->kbdevs[i].fd);
         }
         vector_destroy(&kb->kbdevs);
     }
@@ -5,6 +5,9 @@
 #define P_INTERNAL_GUARD__
 #include "tty.h"
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include "event-internal.h"
+#undef P_INTERNAL_GUARD__
 #include "../keyboard.h"
 #include <core/log.h>
 #include <core/util.h>
@@ -27,6 +30,10 @@ i32 keyboard_tty_init(struct keyboard_tty *kb)
     if (tty_set_raw_mode(&kb->ttydev_ctx))
         goto_error("Failed to set the tty to raw mode");
 
+    /* Without this the keys still work, just with more latency */
+    if (event_add_wait_fd(kb->ttydev_ctx.fd))
+        s_log_warn("Keypresses won't wake up the main loop");
+
     return 0;
 
 err:
@@ -58,6 +65,7 @@ void keyboard_tty_destroy(struct keyboard_tty *kb)
     if (kb == NULL)
         return;
 
+    event_remove_wait_fd(kb->ttydev_ctx.fd);
     tty_ctx_cleanup(&kb->ttydev_ctx);
     memset(kb->esc_seq_buf, 0, sizeof(kb->esc_seq_buf));
 }
@@ -23,6 +23,8 @@ static struct p_lib *g_libxcb_shm_lib = NULL;
 static bool g_libxcb_shm_ok = true;
 static struct p_lib *g_libxcb_present_lib = NULL;
 static bool g_libxcb_present_ok = true;
+static struct p_lib *g_libxcb_xfixes_lib = NULL;
+static bool g_libxcb_xfixes_ok = true;
 
 static struct libxcb g_libxcb_syms = { 0 };
 static i32 g_n_active_handles = 0;
@@ -60,6 +62,11 @@ static const char *libxcb_present_sym_names[] = {
     NULL
 };
 
+static const char *libxcb_xfixes_sym_names[] = {
+    LIBXCB_XFIXES_SYM_LIST
+    NULL
+};
+
 #undef X_FN_
 #undef X_V_
 
@@ -86,7 +93,8 @@ i32 libxcb_load(struct libxcb *o)
         g_libxcb_keysyms_lib == NULL ||
         (g_libxcb_input_lib == NULL && g_libxcb_input_ok) ||
         (g_libxcb_shm_lib == NULL && g_libxcb_shm_ok) ||
-        (g_libxcb_present_lib == NULL && g_libxcb_present_ok)
+        (g_libxcb_present_lib == NULL && g_libxcb_present_ok) ||
+        (g_libxcb_xfixes_lib == NULL && g_libxcb_xfixes_ok)
     ) {
         if (do_load_libraries()) {
             ret = 1;
@@ -164,6 +172,11 @@ static i32 do_load_libraries(void)
     if (g_libxcb_present_lib == NULL)
         g_libxcb_present_ok = false;
 
+    g_libxcb_xfixes_lib = p_librtld_load(LIBXCB_XFIXES_SO_NAME,
+        libxcb_xfixes_sym_names);
+    if (g_libxcb_xfixes_lib == NULL)
+        g_libxcb_xfixes_ok = false;
+
 #define X_FN_(ret_type, name, ...) curr_syms._voidp_##name = \
             p_librtld_load_sym(curr_lib, #name);
 #define X_V_(type, name) curr_syms.name = p_librtld_load_sym(curr_lib, #name);
@@ -219,6 +232,18 @@ static i32 do_load_libraries(void)
         g_libxcb_syms.present.loaded_ = false;
     }
 
+    if (g_libxcb_xfixes_ok) {
+#define curr_syms g_libxcb_syms.xfixes
+#define curr_lib g_libxcb_xfixes_lib
+        LIBXCB_XFIXES_SYM_LIST
+#undef curr_lib
+#undef curr_syms
+        g_libxcb_syms.xfixes.loaded_ = true;
+    } else {
+        memset(&g_libxcb_syms.xfixes, 0, sizeof(struct libxcb_xfixes));
+        g_libxcb_syms.xfixes.loaded_ = false;
+    }
+
     return 0;
 }
 
@@ -232,6 +257,7 @@ static void do_unload_libraries(void)
     p_librtld_close(&g_libxcb_input_lib);
     p_librtld_close(&g_libxcb_shm_lib);
     p_librtld_close(&g_libxcb_present_lib);
+    p_librtld_close(&g_libxcb_xfixes_lib);
 
     memset(&g_libxcb_syms, 0, sizeof(struct libxcb));
 }
@@ -11,6 +11,7 @@
 #include <xcb/xinput.h>
 #include <xcb/xcbext.h>
 #include <xcb/bigreq.h>
+#include <xcb/xfixes.h>
 #include <xcb/present.h>
 #include <xcb/xcb_image.h>
 #include <xcb/xcb_icccm.h>
@@ -47,6 +48,7 @@
         xcb_connection_t *c, xcb_window_t window                               \
     )                                                                          \
     X_FN_(int, xcb_flush, xcb_connection_t *c)                                 \
+    X_FN_(int, xcb_get_file_descriptor, xcb_connection_t *c)                   \
     X_FN_(xcb_void_cookie_t, xcb_destroy_window,                               \
         xcb_connection_t *c, xcb_window_t window                               \
     )                                                                          \
@@ -70,16 +72,12 @@
     X_FN_(xcb_void_cookie_t, xcb_free_pixmap_checked,                          \
         xcb_connection_t *conn, xcb_pixmap_t pixmap                            \
     )                                                                          \
-    X_FN_(xcb_query_extension_cookie_t, xcb_query_extension,                   \
-        xcb_connection_t *conn, uint16_t name_len, const char *name            \
-    )                                                                          \
-    X_FN_(xcb_query_extension_reply_t *, xcb_query_extension_reply,            \
-        xcb_connection_t *c, xcb_query_extension_cookie_t cookie,              \
-        xcb_generic_error_t **e                                                \
-    )                                                                          \
     X_FN_(const struct xcb_query_extension_reply_t *, xcb_get_extension_data,  \
         xcb_connection_t *c, xcb_extension_t *ext                              \
     )                                                                          \
+    X_FN_(void, xcb_prefetch_extension_data,                                   \
+        xcb_connection_t *c, xcb_extension_t *ext                              \
+    )                                                                          \
     X_FN_(xcb_big_requests_enable_cookie_t, xcb_big_requests_enable,           \
         xcb_connection_t *c                                                    \
     )                                                                          \
@@ -94,6 +92,7 @@
         uint32_t data_len, const uint8_t *data                                 \
     )                                                                          \
     X_FN_(uint32_t, xcb_get_maximum_request_length, xcb_connection_t *conn)    \
+    X_FN_(void, xcb_prefetch_maximum_request_length, xcb_connection_t *conn)   \
 
 #define LIBXCB_ICCCM_SO_NAME "libxcb-icccm"
 #define LIBXCB_ICCCM_SYM_LIST                                                  \
@@ -160,6 +159,10 @@
         xcb_connection_t *c, xcb_shm_seg_t shmseg,                             \
         uint32_t shmid, uint8_t read_only                                      \
     )                                                                          \
+    X_FN_(xcb_void_cookie_t, xcb_shm_attach_fd_checked,                        \
+        xcb_connection_t *c, xcb_shm_seg_t shmseg,                             \
+        int32_t shm_fd, uint8_t read_only                                      \
+    )                                                                          \
     X_FN_(xcb_void_cookie_t, xcb_shm_put_image,                                \
         xcb_connection_t *c, xcb_drawable_t drawable, xcb_gcontext_t gc,       \
         uint16_t total_width, uint16_t total_height,                           \
@@ -210,6 +213,31 @@
     )                                                                          \
     X_V_(xcb_extension_t, xcb_present_id)                                      \
 
+#define X11_XFIXES_EXT_NAME "XFIXES"
+#define LIBXCB_XFIXES_SO_NAME "libxcb-xfixes"
+#define LIBXCB_XFIXES_SYM_LIST                                                 \
+    X_FN_(xcb_xfixes_query_version_cookie_t, xcb_xfixes_query_version,         \
+        xcb_connection_t *c, uint32_t client_major_version,                    \
+        uint32_t client_minor_version                                          \
+    )                                                                          \
+    X_FN_(xcb_xfixes_query_version_reply_t *,                                  \
+            xcb_xfixes_query_version_reply,                                    \
+        xcb_connection_t *c, xcb_xfixes_query_version_cookie_t cookie,         \
+        xcb_generic_error_t **e                                                \
+    )                                                                          \
+    X_FN_(xcb_void_cookie_t, xcb_xfixes_create_region_checked,                 \
+        xcb_connection_t *c, xcb_xfixes_region_t region,                       \
+        uint32_t rectangles_len, const xcb_rectangle_t *rectangles             \
+    )                                                                          \
+    X_FN_(xcb_void_cookie_t, xcb_xfixes_set_region,                            \
+        xcb_connection_t *c, xcb_xfixes_region_t region,                       \
+        uint32_t rectangles_len, const xcb_rectangle_t *rectangles             \
+    )                                                                          \
+    X_FN_(xcb_void_cookie_t, xcb_xfixes_destroy_region,                        \
+        xcb_connection_t *c, xcb_xfixes_region_t region                        \
+    )                                                                          \
+    X_V_(xcb_extension_t, xcb_xfixes_id)                                       \
+
 struct libxcb {
 #define X_FN_(ret_type, name, ...) \
     union { ret_type (*name) (__VA_ARGS__); void *_voidp_##name; };
@@ -233,6 +261,10 @@ struct libxcb {
         bool loaded_;
         LIBXCB_PRESENT_SYM_LIST
     } present;
+    struct libxcb_xfixes {
+        bool loaded_;
+        LIBXCB_XFIXES_SYM_LIST
+    } xfixes;
 #undef X_V_
 #undef X_FN_
 
@@ -20,6 +20,9 @@
 #define P_INTERNAL_GUARD__
 #include "mouse-internal.h"
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include "event-internal.h"
+#undef P_INTERNAL_GUARD__
 
 #define MODULE_NAME "mouse-evdev"
 
@@ -45,6 +48,12 @@ i32 mouse_evdev_init(struct mouse_evdev *mouse)
             .events = POLLIN,
             .revents = 0
         });
+
+        /* Without this the mouse still works, just with more latency */
+        if (event_add_wait_fd(mouse->mouse_devs[i].fd)) {
+            s_log_warn("Input from \"%s\" won't wake up the main loop",
+                mouse->mouse_devs[i].name);
+        }
     }
 
     return 0;
@@ -102,6 +111,7 @@ void mouse_evdev_destroy(struct mouse_evdev *mouse)
     if (mouse->mouse_devs != NULL) {
         for (u32 i = 0; i < vector_size(mouse->mouse_devs); i++) {
             if (mouse->mouse_devs[i].fd != -1) {
+                event_remove_wait_fd(mouse->mouse_devs[i].fd);
                 close(mouse->mouse_devs[i].fd);
                 mouse->mouse_devs[i].fd = -1;
             }
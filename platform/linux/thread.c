@@ -3,33 +3,51 @@
 #include <core/int.h>
 #include <core/log.h>
 #include <core/util.h>
-#include <core/vector.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdatomic.h>
 #include <pthread.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #define MODULE_NAME "thread"
 
-struct p_mt_mutex {
-    pthread_mutex_t mutex_handle;
-    bool initialized;
-    bool is_static;
-};
+/* The mutexes and condition variables are implemented directly on futexes
+ * (see "Futexes Are Tricky" by Ulrich Drepper), which makes them
+ * just a few integers that are valid when zeroed. */
 
-static pthread_mutex_t master_mutex = PTHREAD_MUTEX_INITIALIZER;
-static VECTOR(struct p_mt_mutex *) global_mutex_registry = NULL;
+/* The states of a mutex futex word */
+#define MUTEX_UNLOCKED 0
+#define MUTEX_LOCKED 1
+#define MUTEX_CONTENDED 2 /* Locked, and some threads might be sleeping */
 
-struct p_mt_cond {
-    pthread_cond_t cond;
-};
+/* How many times to retry locking a mutex before going to sleep.
+ * Most critical sections are a lot shorter than a syscall. */
+#define MUTEX_N_SPINS 100
 
-static void add_mutex_to_registry(struct p_mt_mutex *m);
+/* `MUTEX_N_SPINS`, or 0 on machines with only one CPU, where the owner
+ * can't possibly unlock the mutex while we're spinning.
+ * `UINT32_MAX` until it's first needed. */
+static _Atomic u32 g_n_mutex_spins = UINT32_MAX;
 
-static volatile atomic_flag registered_atexit_cleanup = ATOMIC_FLAG_INIT;
-static void cleanup_global_mutexes(void);
+static_assert(sizeof(((p_mt_mutex_t *)0)->impl_.zero_) >=
+    sizeof(((p_mt_mutex_t *)0)->impl_.futex_),
+    "The zero member must cover the whole mutex");
+static_assert(sizeof(((p_mt_cond_t *)0)->impl_.zero_) >=
+    sizeof(((p_mt_cond_t *)0)->impl_.futex_),
+    "The zero member must cover the whole condition variable");
+
+static void mutex_lock_slow(_Atomic u32 *futex);
+static u32 get_n_mutex_spins(void);
+
+static inline void futex_wait(_Atomic u32 *addr, u32 expected_val);
+static inline void futex_wake(_Atomic u32 *addr, i32 n_threads);
+static inline void cpu_relax(void);
 
 i32 p_mt_thread_create(p_mt_thread_t *o,
     p_mt_thread_fn_t thread_fn, void *arg)
@@ -78,134 +96,167 @@ void p_mt_thread_terminate(p_mt_thread_t *thread_p)
         s_log_error("Failed to kill thread: %s", strerror(e));
 }
 
-p_mt_mutex_t p_mt_mutex_create(void)
+u32 p_mt_get_cpu_count(void)
 {
-    struct p_mt_mutex *m = calloc(1, sizeof(struct p_mt_mutex));
-    s_assert(m != NULL, "calloc() failed for struct mutex");
+    const long ret = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ret < 1) {
+        s_log_error("Failed to get the number of online CPUs: %s",
+            strerror(errno));
+        return 1;
+    }
 
-    /* Always returns 0 */
-    (void) pthread_mutex_init(&m->mutex_handle, NULL);
-    m->initialized = true;
-    m->is_static = false;
+    return ret;
+}
 
-    return m;
+p_mt_mutex_t p_mt_mutex_create(void)
+{
+    return (p_mt_mutex_t) P_MT_MUTEX_INITIALIZER;
 }
 
 void p_mt_mutex_lock(p_mt_mutex_t *mutex_p)
 {
     u_check_params(mutex_p != NULL);
-    if (*mutex_p == P_MT_MUTEX_INITIALIZER) {
-        *mutex_p = p_mt_mutex_create();
-        (*mutex_p)->is_static = true;
-        add_mutex_to_registry(*mutex_p);
-    } else if (*mutex_p == NULL || !(*mutex_p)->initialized) {
-        *mutex_p = p_mt_mutex_create();
-    }
 
-    pthread_mutex_lock(&(*mutex_p)->mutex_handle);
+    /* The uncontended case is just one atomic instruction */
+    u32 expected = MUTEX_UNLOCKED;
+    if (!atomic_compare_exchange_strong_explicit(&mutex_p->impl_.futex_,
+            &expected, MUTEX_LOCKED,
+            memory_order_acquire, memory_order_relaxed))
+        mutex_lock_slow(&mutex_p->impl_.futex_);
 }
 
 void p_mt_mutex_unlock(p_mt_mutex_t *mutex_p)
 {
     u_check_params(mutex_p != NULL);
-    if (*mutex_p == NULL || !(*mutex_p)->initialized)
-        return;
 
-    pthread_mutex_unlock(&(*mutex_p)->mutex_handle);
+    /* Only make the syscall if someone might actually be sleeping */
+    if (atomic_exchange_explicit(&mutex_p->impl_.futex_, MUTEX_UNLOCKED,
+            memory_order_release) == MUTEX_CONTENDED)
+        futex_wake(&mutex_p->impl_.futex_, 1);
 }
 
 void p_mt_mutex_destroy(p_mt_mutex_t *mutex_p)
 {
-    if (mutex_p == NULL || *mutex_p == NULL) return;
-
-    struct p_mt_mutex *m = *mutex_p;
-
-    if (!m->initialized) return;
+    if (mutex_p == NULL) return;
 
-    /* Static pthread mutexes don't need to be destroyed */
-    if (!m->is_static) {
-        /* If the mutex is locked, block until it gets unlocked */
-        pthread_mutex_lock(&m->mutex_handle);
-
-        /* Once we are sure that the mutex is not in use,
-         * unlock it so that it can be destroyed */
-        pthread_mutex_unlock(&m->mutex_handle);
-
-        pthread_mutex_destroy(&m->mutex_handle);
-    }
+    /* If the mutex is locked, block until it gets unlocked */
+    p_mt_mutex_lock(mutex_p);
+    p_mt_mutex_unlock(mutex_p);
 
-    /* Also sets `m->initialized` to false */
-    memset(m, 0, sizeof(struct p_mt_mutex));
-    u_nfree(mutex_p);
+    *mutex_p = (p_mt_mutex_t) P_MT_MUTEX_INITIALIZER;
 }
 
-void p_mt_mutex_global_cleanup(void)
+p_mt_cond_t p_mt_cond_create(void)
 {
-    pthread_mutex_lock(&master_mutex);
-    cleanup_global_mutexes();
-    pthread_mutex_unlock(&master_mutex);
+    return (p_mt_cond_t) P_MT_COND_INITIALIZER;
 }
 
-p_mt_cond_t p_mt_cond_create(void)
+void p_mt_cond_wait(p_mt_cond_t *cond, p_mt_mutex_t *mutex)
 {
-    p_mt_cond_t cond = calloc(1, sizeof(struct p_mt_cond));
-    s_assert(cond != NULL, "calloc() failed for struct cond");
+    u_check_params(cond != NULL && mutex != NULL);
 
-    (void) pthread_cond_init(&cond->cond, NULL);
+    /* Any signal that comes after we unlock the mutex changes `seq`,
+     * in which case the kernel won't let us go to sleep */
+    const u32 seq = atomic_load_explicit(&cond->impl_.futex_.seq,
+        memory_order_relaxed);
+    atomic_fetch_add_explicit(&cond->impl_.futex_.n_waiters, 1,
+        memory_order_relaxed);
+    p_mt_mutex_unlock(mutex);
 
-    return cond;
+    futex_wait(&cond->impl_.futex_.seq, seq);
+
+    atomic_fetch_sub_explicit(&cond->impl_.futex_.n_waiters, 1,
+        memory_order_relaxed);
 }
 
-void p_mt_cond_wait(p_mt_cond_t cond, p_mt_mutex_t mutex)
+void p_mt_cond_signal(p_mt_cond_t *cond)
 {
-    u_check_params(cond != NULL && mutex != NULL && mutex->initialized);
-    (void) pthread_cond_wait(&cond->cond, &mutex->mutex_handle);
-    /* Ensure the mutex is unlocked */
-    pthread_mutex_unlock(&mutex->mutex_handle);
+    u_check_params(cond != NULL);
+
+    atomic_fetch_add(&cond->impl_.futex_.seq, 1);
+    if (atomic_load(&cond->impl_.futex_.n_waiters) > 0)
+        futex_wake(&cond->impl_.futex_.seq, 1);
 }
 
-void p_mt_cond_signal(p_mt_cond_t cond)
+void p_mt_cond_broadcast(p_mt_cond_t *cond)
 {
     u_check_params(cond != NULL);
-    (void) pthread_cond_broadcast(&cond->cond);
+
+    atomic_fetch_add(&cond->impl_.futex_.seq, 1);
+    if (atomic_load(&cond->impl_.futex_.n_waiters) > 0)
+        futex_wake(&cond->impl_.futex_.seq, INT_MAX);
 }
 
 void p_mt_cond_destroy(p_mt_cond_t *cond_p)
 {
-    if (cond_p == NULL || *cond_p == NULL)
+    if (cond_p == NULL)
         return;
 
-    (void) pthread_cond_destroy(&(*cond_p)->cond);
-    u_nzfree(cond_p);
+    *cond_p = (p_mt_cond_t) P_MT_COND_INITIALIZER;
 }
 
-static void add_mutex_to_registry(struct p_mt_mutex *m)
+static void mutex_lock_slow(_Atomic u32 *futex)
 {
-    pthread_mutex_lock(&master_mutex);
-    if (global_mutex_registry == NULL)
-        global_mutex_registry = vector_new(struct p_mt_mutex *);
+    /* Spin for a bit first, in case the owner is about to unlock it,
+     * unless there already are other threads sleeping on it */
+    const u32 n_spins = get_n_mutex_spins();
+    for (u32 i = 0; i < n_spins; i++) {
+        const u32 state = atomic_load_explicit(futex, memory_order_relaxed);
+        if (state == MUTEX_CONTENDED)
+            break;
+
+        u32 expected = MUTEX_UNLOCKED;
+        if (state == MUTEX_UNLOCKED &&
+            atomic_compare_exchange_weak_explicit(futex, &expected,
+                MUTEX_LOCKED, memory_order_acquire, memory_order_relaxed))
+            return;
+
+        cpu_relax();
+    }
 
-    if (!atomic_flag_test_and_set(&registered_atexit_cleanup)) {
-        s_log_debug("Registering global mutex cleanup function...");
-        if (atexit(cleanup_global_mutexes)) {
-            s_log_fatal("Failed to atexit() "
-                "the global mutex cleanup function.");
-        }
+    /* From now on the mutex is marked as contended, because we can't know
+     * whether there are other sleepers, and so whoever unlocks it
+     * has to wake one of us up */
+    while (atomic_exchange_explicit(futex, MUTEX_CONTENDED,
+            memory_order_acquire) != MUTEX_UNLOCKED)
+        futex_wait(futex, MUTEX_CONTENDED);
+}
+
+static u32 get_n_mutex_spins(void)
+{
+    /* Many threads might do this at once, but they all get the same value */
+    u32 n_spins = atomic_load_explicit(&g_n_mutex_spins, memory_order_relaxed);
+    if (n_spins == UINT32_MAX) {
+        n_spins = p_mt_get_cpu_count() > 1 ? MUTEX_N_SPINS : 0;
+        atomic_store_explicit(&g_n_mutex_spins, n_spins,
+            memory_order_relaxed);
     }
 
-    vector_push_back(&global_mutex_registry, m);
+    return n_spins;
+}
 
-    pthread_mutex_unlock(&master_mutex);
+static inline void futex_wait(_Atomic u32 *addr, u32 expected_val)
+{
+    /* Returns right away (with `EAGAIN`) if `*addr` != `expected_val`,
+     * and can also be interrupted (`EINTR`) - both are fine,
+     * as the callers always check their condition again */
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected_val,
+            NULL, NULL, 0) == -1 && errno != EAGAIN && errno != EINTR)
+        s_log_fatal("FUTEX_WAIT failed: %s", strerror(errno));
 }
 
-static void cleanup_global_mutexes(void)
+static inline void futex_wake(_Atomic u32 *addr, i32 n_threads)
 {
-    for (u32 i = 0; i < vector_size(global_mutex_registry); i++) {
-        p_mt_mutex_destroy(&global_mutex_registry[i]);
-    }
-    s_log_debug("Cleaned up all (%u) global mutexes.",
-        vector_size(global_mutex_registry)
-    );
+    if (syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n_threads,
+            NULL, NULL, 0) == -1)
+        s_log_fatal("FUTEX_WAKE failed: %s", strerror(errno));
+}
 
-    vector_destroy(&global_mutex_registry);
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile ("yield");
+#endif
 }
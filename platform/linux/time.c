@@ -106,3 +106,26 @@ void p_time_sleep(u32 seconds)
     };
     (void) clock_nanosleep(CLOCK_TAI, 0, &ts_req, NULL);
 }
+
+void p_time_sleep_until(const timestamp_t *deadline)
+{
+    u_check_params(deadline != NULL);
+
+    timestamp_t wake_time = *deadline;
+    timestamp_add_ns(wake_time, -P_TIME_SPIN_MARGIN_us * 1000LL);
+
+    /* The ticks are on CLOCK_MONOTONIC too */
+    const struct timespec ts_req = {
+        .tv_sec = wake_time.s,
+        .tv_nsec = wake_time.ns,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts_req, NULL)
+        == EINTR)
+        ;
+
+    timestamp_t now, remaining;
+    do {
+        p_time_get_ticks(&now);
+        timestamp_delta(remaining, now, *deadline);
+    } while (remaining.s >= 0 && (remaining.s > 0 || remaining.ns > 0));
+}
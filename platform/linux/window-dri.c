@@ -12,11 +12,15 @@
 #include <core/log.h>
 #include <core/util.h>
 #include <core/pixel.h>
+#include <core/region.h>
 #include <core/shapes.h>
 #include <core/vector.h>
 #define P_INTERNAL_GUARD__
 #include <platform/common/util-window.h>
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include <platform/common/present-timing.h>
+#undef P_INTERNAL_GUARD__
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
@@ -72,13 +76,19 @@ static void render_destroy_egl(struct egl_render_ctx *egl_rctx,
 
 static i32 render_init_software(struct software_render_ctx *sw_rctx,
     const struct drm_device *drm_dev, const struct libdrm_functions *drm,
-    const rect_t *win_rect);
+    const rect_t *win_rect, pixelfmt_t win_fmt, u32 n_buffers);
+static bool can_draw_into_dumb_buffers(const struct drm_device *drm_dev,
+    const rect_t *win_rect, pixelfmt_t win_fmt, u32 dumb_stride);
 static void render_destroy_software(struct software_render_ctx *sw_rctx,
     const struct libdrm_functions *drm, const struct drm_device *drm_dev);
 
 static struct pixel_flat_data * render_prepare_frame_software(
-    struct software_render_ctx *sw_rctx, const struct p_window_info *win_info
+    struct software_render_ctx *sw_rctx, const struct p_window_info *win_info,
+    const struct region *damage
 );
+static void render_copy_to_dumb_buffer(struct software_render_ctx *sw_rctx,
+    struct software_render_buf *buf, const struct p_window_info *win_info,
+    const struct region *damage);
 static i32 render_prepare_frame_egl(
     struct egl_render_ctx *egl_rctx, const struct drm_device *drm_dev,
     const struct libdrm_functions *drm, const struct libgbm_functions *gbm
@@ -86,11 +96,20 @@ static i32 render_prepare_frame_egl(
 
 static i32 render_present_frame(struct window_dri *win, u32 fb_handle,
     const enum p_window_present_mode present_mode);
+static struct pixel_flat_data * render_present_frame_queued(
+    struct window_dri *win, const enum p_window_present_mode present_mode,
+    const struct region *damage);
+static u32 get_page_flip_flags(const struct window_dri *win,
+    const enum p_window_present_mode present_mode);
 
 #define OK 0
 #define NOT_OK 1
 static void render_finish_frame(struct window_dri_listener_thread *listener,
+    bool status, const struct pc_present_flip_info *flip_info);
+
+static bool flip_queued_frame(struct window_dri_listener_thread *listener,
     bool status);
+static void wait_for_page_flip(struct window_dri_listener_thread *listener);
 
 static void * window_dri_listener_fn(void *arg);
 static void page_flip_handler(int fd, unsigned int frame,
@@ -104,7 +123,8 @@ static void do_nothing(i32 sig_num)
 }
 
 i32 window_dri_open(struct window_dri *win, const rect_t *area,
-    const u32 flags, struct p_window_info *info)
+    const u32 flags, struct p_window_info *info,
+    struct pc_present_timing *present_timing)
 {
     VECTOR(struct file) files = NULL;
     memset(win, 0, sizeof(struct window_dri));
@@ -138,7 +158,7 @@ i32 window_dri_open(struct window_dri *win, const rect_t *area,
     info->display_rect.x = info->display_rect.y = 0;
     info->display_rect.w = win->dev.width;
     info->display_rect.h = win->dev.height;
-    info->display_color_format = BGRX32;
+    info->display_color_format = DRI_SW_DUMB_BUFFER_FORMAT;
 
     memcpy(&info->client_area, area, sizeof(rect_t));
 
@@ -148,6 +168,8 @@ i32 window_dri_open(struct window_dri *win, const rect_t *area,
     if (flags & P_WINDOW_POS_CENTERED_Y)
         info->client_area.y = (info->display_rect.h - info->client_area.h) / 2;
 
+    win->triple_buffered = flags & P_WINDOW_TRIPLE_BUFFERED;
+
     info->gpu_acceleration = P_WINDOW_ACCELERATION_UNSET_;
     /* Initialize the GPU acceleration.
      * This will also set the value of `info->vsync_supported`. */
@@ -162,12 +184,19 @@ i32 window_dri_open(struct window_dri *win, const rect_t *area,
 
     /* Initialize the listener thread */
     win->listener.fd_p = &win->dev.fd;
+    win->listener.crtc_id_p = &win->dev.crtc->crtc_id;
     win->listener.acceleration_p = &info->gpu_acceleration;
     win->listener.drm = &win->drm;
     win->listener.gbm = &win->gbm;
     win->listener.render_ctx = &win->render;
+    win->listener.present_timing = present_timing;
+    pc_present_timing_set_refresh_interval(present_timing,
+        win->dev.refresh_rate != 0 ? 1000000000ULL / win->dev.refresh_rate : 0);
     s_log_trace("page_flip_pending -> false");
     atomic_store(&win->listener.page_flip_pending, false);
+    /* Always returns 0 */
+    (void) pthread_mutex_init(&win->listener.page_flip_mutex, NULL);
+    (void) pthread_cond_init(&win->listener.page_flip_done, NULL);
     atomic_store(&win->listener.running, true);
 
     i32 ret = pthread_create(&win->listener.thread, NULL,
@@ -236,6 +265,9 @@ kill_thread:
         }
     }
 
+    (void) pthread_cond_destroy(&win->listener.page_flip_done);
+    (void) pthread_mutex_destroy(&win->listener.page_flip_mutex);
+
     /* Clean up of acceleration-specific stuff */
     switch (win->generic_info_p->gpu_acceleration) {
         case P_WINDOW_ACCELERATION_NONE:
@@ -267,17 +299,26 @@ kill_thread:
 }
 
 struct pixel_flat_data * window_dri_swap_buffers(struct window_dri *win,
-    const enum p_window_present_mode present_mode)
+    const enum p_window_present_mode present_mode,
+    const struct region *damage)
 {
     struct pixel_flat_data *ret = NULL;
     u32 fb_id = -1; /* The new front buffer, after the swap */
 
+    /* With more than 2 buffers, the frame never has to wait
+     * for the previous page flip, so it's handled separately */
+    if (win->generic_info_p->gpu_acceleration == P_WINDOW_ACCELERATION_NONE &&
+        win->render.sw.n_buffers > 2)
+    {
+        return render_present_frame_queued(win, present_mode, damage);
+    }
+
     /* Do acceleration-specific preparations
      * (like actually swapping the buffers) */
     switch (win->generic_info_p->gpu_acceleration) {
     case P_WINDOW_ACCELERATION_NONE:
         ret = render_prepare_frame_software(&win->render.sw,
-            win->generic_info_p);
+            win->generic_info_p, damage);
         fb_id = win->render.sw.front_buf->fb_id;
         break;
     case P_WINDOW_ACCELERATION_OPENGL:
@@ -302,8 +343,26 @@ struct pixel_flat_data * window_dri_swap_buffers(struct window_dri *win,
     }
 
     /* Request a page flip with the new front buffer */
-    if (render_present_frame(win, fb_id, present_mode))
+    if (render_present_frame(win, fb_id, present_mode)) {
+        /* The frame was never presented, so the buffer that's
+         * on the screen is still the front buffer */
+        if (win->generic_info_p->gpu_acceleration ==
+            P_WINDOW_ACCELERATION_NONE)
+        {
+            struct software_render_ctx *const sw_rctx = &win->render.sw;
+            struct software_render_buf *const tmp = sw_rctx->front_buf;
+            sw_rctx->front_buf = sw_rctx->back_buf;
+            sw_rctx->back_buf = tmp;
+        }
         ret = P_WINDOW_SWAP_BUFFERS_FAIL;
+    } else if (win->generic_info_p->gpu_acceleration ==
+            P_WINDOW_ACCELERATION_NONE &&
+        win->render.sw.back_buf->user_ret_mapped)
+    {
+        /* The new back buffer stays on the screen until the flip is done,
+         * so it can't be drawn to before that */
+        wait_for_page_flip(&win->listener);
+    }
 
     return ret;
 }
@@ -346,7 +405,9 @@ i32 window_dri_set_acceleration(struct window_dri *win,
         break;
     case P_WINDOW_ACCELERATION_NONE:
         if (render_init_software(&win->render.sw, &win->dev,
-            &win->drm, &win->generic_info_p->client_area))
+            &win->drm, &win->generic_info_p->client_area,
+            win->generic_info_p->display_color_format,
+            win->triple_buffered ? DRI_SW_MAX_BUFFERS : 2))
         {
             s_log_error("Failed to set up the window for software rendering.");
             return 1;
@@ -386,6 +447,19 @@ void window_dri_set_egl_buffers_swapped(struct window_dri *win)
     atomic_store(&win->render.egl.buffers_swapped, true);
 }
 
+void window_dri_get_present_stats(const struct window_dri *win,
+    struct p_window_present_stats *out)
+{
+    u_check_params(win != NULL && out != NULL);
+
+    memset(out, 0, sizeof(struct p_window_present_stats));
+    if (win->generic_info_p->gpu_acceleration == P_WINDOW_ACCELERATION_NONE) {
+        out->n_coalesced_frames =
+            atomic_load(&win->render.sw.n_coalesced_frames);
+        out->n_dropped_frames = atomic_load(&win->render.sw.n_dropped_frames);
+    }
+}
+
 static i32 load_libdrm(struct window_dri *win)
 {
     if (win->drm.loaded_ || win->libdrm != NULL) {
@@ -572,6 +646,13 @@ static i32 select_and_init_device(VECTOR(struct file) files,
         s_log_debug("Async page flip support: %lli", cap_value);
         tmp_dev.async_page_flip_supported = cap_value || 0;
 
+        /* Not knowing this isn't a problem, so it's not an error */
+        cap_value = 0;
+        if (drm->drmGetCap(tmp_dev.fd, DRM_CAP_DUMB_PREFER_SHADOW, &cap_value))
+            cap_value = 0;
+        s_log_debug("Dumb buffers prefer shadow: %lli", cap_value);
+        tmp_dev.dumb_prefer_shadow = cap_value || 0;
+
         /* (Try to) become the DRM master */
         if (drm->drmSetMaster(tmp_dev.fd)) {
             s_log_warn("Failed to become the DRM master: %s. "
@@ -797,13 +878,18 @@ static void render_destroy_egl(struct egl_render_ctx *egl_rctx,
 
 static i32 render_init_software(struct software_render_ctx *sw_rctx,
     const struct drm_device *drm_dev, const struct libdrm_functions *drm,
-    const rect_t *win_rect)
+    const rect_t *win_rect, pixelfmt_t win_fmt, u32 n_buffers)
 {
+    s_assert(n_buffers >= 2 && n_buffers <= DRI_SW_MAX_BUFFERS,
+        "Invalid number of buffers: %u", n_buffers);
+
     memset(sw_rctx, 0, sizeof(struct software_render_ctx));
     sw_rctx->initialized_ = true;
+    sw_rctx->n_buffers = n_buffers;
     i32 ret = 0;
+    bool draw_directly = false;
 
-    for (u32 i = 0; i < 2; i++) {
+    for (u32 i = 0; i < n_buffers; i++) {
         struct software_render_buf *const buf = &sw_rctx->buffers[i];
 
         /* Create the buffer */
@@ -848,21 +934,51 @@ static i32 render_init_software(struct software_render_ctx *sw_rctx,
             goto_error("Failed to map dumb buffer: %s", strerror(errno));
         buf->fb_mapped = true;
 
-        /* Allocate the window pixel buffers */
         buf->user_ret.w = win_rect->w;
         buf->user_ret.h = win_rect->h;
 
+        /* If possible, the window is drawn straight into the dumb buffer,
+         * and presenting it is then just a page flip.
+         * All the buffers are the same, so only the first one is checked. */
+        if (i == 0) {
+            draw_directly = can_draw_into_dumb_buffers(drm_dev,
+                win_rect, win_fmt, buf->stride);
+            if (!draw_directly) {
+                sw_rctx->copy_method =
+                    pc_fb_copy_select(buf->map, buf->map_size);
+            }
+        }
+        if (draw_directly) {
+            buf->user_ret.stride = buf->stride / sizeof(pixel_t);
+            buf->user_ret.buf = (pixel_t *)buf->map +
+                ((u64)win_rect->y * buf->user_ret.stride) + win_rect->x;
+            buf->user_ret_mapped = true;
+            continue;
+        }
+
+        /* Otherwise, allocate a separate window pixel buffer */
+        buf->user_ret.stride = win_rect->w;
         buf->user_ret.buf = calloc(win_rect->w * win_rect->h, sizeof(pixel_t));
         if (buf->user_ret.buf == NULL)
             goto_error("Failed to allocate the window pixel buffer");
     }
 
+
     sw_rctx->back_buf = &sw_rctx->buffers[0];
     sw_rctx->front_buf = &sw_rctx->buffers[1];
 
+    /* With more buffers, the one that's drawn to first
+     * must not be the one that's on the screen */
+    if (n_buffers > 2) {
+        sw_rctx->scanout_buf = &sw_rctx->buffers[0];
+        sw_rctx->back_buf = &sw_rctx->buffers[1];
+        sw_rctx->front_buf = NULL;
+        s_log_debug("Using %u buffers", n_buffers);
+    }
+
     /* Set the back dumb framebuffer as the scanout buffer */
     ret = drm->drmModeSetCrtc(drm_dev->fd, drm_dev->crtc->crtc_id,
-        sw_rctx->back_buf->fb_id, 0, 0, &drm_dev->conn->connector_id, 1,
+        sw_rctx->buffers[0].fb_id, 0, 0, &drm_dev->conn->connector_id, 1,
         drm_dev->mode);
     if (ret != 0)
         goto_error("Failed to set CRTC: %s", strerror(errno));
@@ -874,17 +990,68 @@ err:
     return 1;
 }
 
+static bool can_draw_into_dumb_buffers(const struct drm_device *drm_dev,
+    const rect_t *win_rect, pixelfmt_t win_fmt, u32 dumb_stride)
+{
+    /* Otherwise the window would have to be clipped */
+    const rect_t display_rect = { 0, 0, drm_dev->width, drm_dev->height };
+    rect_t visible_rect = *win_rect;
+    rect_clip(&visible_rect, &display_rect);
+    if (memcmp(&visible_rect, win_rect, sizeof(rect_t))) {
+        s_log_debug("The window isn't fully on the screen; "
+            "copying it into the dumb buffers");
+        return false;
+    }
+
+    /* Otherwise the pixels would have to be converted */
+    if (win_fmt != DRI_SW_DUMB_BUFFER_FORMAT) {
+        s_log_debug("The window's pixel format isn't the dumb buffers' one; "
+            "copying it into the dumb buffers");
+        return false;
+    }
+
+    /* The window pixel buffer's stride is in pixels, not bytes */
+    if (dumb_stride % sizeof(pixel_t) != 0) {
+        s_log_debug("The dumb buffer stride (%u) isn't a multiple "
+            "of the pixel size; copying the window into the dumb buffers",
+            dumb_stride);
+        return false;
+    }
+
+    /* Blending reads back the pixels under what's being drawn,
+     * which can be many times slower than drawing into a shadow buffer
+     * in system memory and copying only the damage */
+    if (drm_dev->dumb_prefer_shadow) {
+        s_log_debug("The driver prefers shadow buffers; "
+            "copying the window into the dumb buffers");
+        return false;
+    }
+
+    if (win_rect->x == 0 && win_rect->y == 0 &&
+        win_rect->w == drm_dev->width && win_rect->h == drm_dev->height)
+    {
+        s_log_debug("The window covers the whole CRTC; "
+            "drawing directly into the dumb buffers");
+    } else {
+        s_log_debug("Drawing directly into the dumb buffers");
+    }
+    return true;
+}
+
 static void render_destroy_software(struct software_render_ctx *sw_rctx,
     const struct libdrm_functions *drm, const struct drm_device *drm_dev)
 {
     if (!sw_rctx->initialized_) return;
 
-    for (u32 i = 0; i < 2; i++) {
+    for (u32 i = 0; i < sw_rctx->n_buffers; i++) {
         struct software_render_buf *const buf = &sw_rctx->buffers[i];
 
-        if (buf->user_ret.buf != NULL)
+        if (buf->user_ret_mapped)
+            buf->user_ret.buf = NULL;
+        else if (buf->user_ret.buf != NULL)
             u_nfree(&buf->user_ret.buf);
-        buf->user_ret.w = buf->user_ret.h = 0;
+        buf->user_ret.w = buf->user_ret.h = buf->user_ret.stride = 0;
+        buf->user_ret_mapped = false;
 
         if (buf->fb_mapped) {
             munmap(buf->map, buf->map_size);
@@ -913,11 +1080,14 @@ static void render_destroy_software(struct software_render_ctx *sw_rctx,
     }
 
     sw_rctx->front_buf = sw_rctx->back_buf = NULL;
+    sw_rctx->scanout_buf = sw_rctx->flip_buf = sw_rctx->queued_buf = NULL;
+    sw_rctx->n_buffers = 0;
     sw_rctx->initialized_ = false;
 }
 
 static struct pixel_flat_data * render_prepare_frame_software(
-    struct software_render_ctx *sw_rctx, const struct p_window_info *win_info
+    struct software_render_ctx *sw_rctx, const struct p_window_info *win_info,
+    const struct region *damage
 )
 {
     /* Swap the buffers */
@@ -925,50 +1095,72 @@ static struct pixel_flat_data * render_prepare_frame_software(
     sw_rctx->front_buf = sw_rctx->back_buf;
     sw_rctx->back_buf = tmp;
 
-    /* Clip the window rect to be within the screen */
-    const rect_t win_rect = win_info->client_area;
-    rect_t dst = win_rect;
-    rect_clip(&dst, &win_info->display_rect);
-
-    /* "Project" the changes made to dst onto src */
-    rect_t src = {
-        .x = dst.x - win_rect.x,
-        .y = dst.y - win_rect.y,
-        .w = dst.w,
-        .h = dst.h
-    };
+    render_copy_to_dumb_buffer(sw_rctx, sw_rctx->front_buf, win_info, damage);
 
-    /* Convert src and dst to bytes (instead of pixels) */
-    src.x *= sizeof(pixel_t);
-    src.w *= sizeof(pixel_t);
-    dst.x *= sizeof(pixel_t);
-    dst.w *= sizeof(pixel_t);
+    return &sw_rctx->back_buf->user_ret;
+}
 
-    /* C Pointer arithmetic is useless & stupid, change my mind */
-    u8 *const restrict dst_mem = (u8 *)sw_rctx->front_buf->map;
-    const u8 *const restrict src_mem = (u8 *)sw_rctx->front_buf->user_ret.buf;
-    const u32 src_stride = src.w;
-    const u32 dst_stride = sw_rctx->front_buf->stride;
-
-    /* Finally, copy the window buffer to the screen */
-    for (u32 y = 0; y < src.h; y++) {
-        const u32 dst_offset = (
-            ((dst.y + y) * dst_stride)
-            + dst.x
-        );
-        const u32 src_offset = (
-            ((src.y + y) * src_stride)
-            + src.x
-        );
-
-        memcpy(
-            dst_mem + dst_offset,
-            src_mem + src_offset,
-            src_stride
-        );
+/* Brings the dumb buffer of `buf` up to date with its window pixel buffer
+ * (unless the window is drawn straight into the dumb buffers) */
+static void render_copy_to_dumb_buffer(struct software_render_ctx *sw_rctx,
+    struct software_render_buf *buf, const struct p_window_info *win_info,
+    const struct region *damage)
+{
+    /* The buffer was drawn to directly,
+     * so there's nothing to copy */
+    if (buf->user_ret_mapped)
+        return;
+
+    const rect_t win_rect = win_info->client_area;
+    const rect_t user_rect = { 0, 0, buf->user_ret.w, buf->user_ret.h };
+
+    /* The map of each buffer lags behind by however many frames
+     * were presented since it was last written to, so all of them
+     * get the new damage, but only `buf` is updated now */
+    for (u32 i = 0; i < sw_rctx->n_buffers; i++) {
+        if (damage != NULL)
+            region_add_region(&sw_rctx->buffers[i].pending_damage, damage);
+        else
+            region_add_rect(&sw_rctx->buffers[i].pending_damage, &user_rect);
     }
 
-    return &sw_rctx->back_buf->user_ret;
+    /* C Pointer arithmetic is useless & stupid, change my mind */
+    u8 *const restrict dst_mem = (u8 *)buf->map;
+    const u8 *const restrict src_mem = (u8 *)buf->user_ret.buf;
+    const u32 src_stride = buf->user_ret.stride * sizeof(pixel_t);
+    const u32 dst_stride = buf->stride;
+
+    for (u32 i = 0; i < buf->pending_damage.n_rects; i++) {
+        rect_t src = buf->pending_damage.rects[i];
+        rect_clip(&src, &user_rect);
+
+        /* Clip the damaged rect to be within the screen */
+        rect_t dst = {
+            .x = win_rect.x + src.x,
+            .y = win_rect.y + src.y,
+            .w = src.w,
+            .h = src.h,
+        };
+        rect_clip(&dst, &win_info->display_rect);
+        if (dst.w == 0 || dst.h == 0)
+            continue;
+
+        /* "Project" the changes made to dst onto src */
+        src.x = dst.x - win_rect.x;
+        src.y = dst.y - win_rect.y;
+
+        /* Finally, copy the damaged part of the window buffer to the screen */
+        const u32 row_size = dst.w * sizeof(pixel_t);
+        const u64 dst_offset = ((u64)dst.y * dst_stride)
+            + (dst.x * sizeof(pixel_t));
+        const u64 src_offset = ((u64)src.y * src_stride)
+            + (src.x * sizeof(pixel_t));
+        pc_fb_copy_rows(sw_rctx->copy_method,
+            dst_mem + dst_offset, dst_stride,
+            src_mem + src_offset, src_stride,
+            row_size, dst.h);
+    }
+    region_clear(&buf->pending_damage);
 }
 
 static i32 render_prepare_frame_egl(
@@ -1048,14 +1240,7 @@ static i32 render_present_frame(struct window_dri *win, u32 fb_handle,
     s_log_trace("page_flip_pending -> true");
     atomic_store(&win->listener.page_flip_pending, true);
 
-    u32 flags = 0;
-    flags |= DRM_MODE_PAGE_FLIP_EVENT;
-    if (present_mode == P_WINDOW_PRESENT_NOW &&
-        win->dev.async_page_flip_supported)
-    {
-        flags |= DRM_MODE_PAGE_FLIP_ASYNC;
-    }
-
+    const u32 flags = get_page_flip_flags(win, present_mode);
     i32 ret = win->drm.drmModePageFlip(win->dev.fd, win->dev.crtc->crtc_id,
         fb_handle, flags, &win->listener);
     if (ret != 0) {
@@ -1072,8 +1257,77 @@ static i32 render_present_frame(struct window_dri *win, u32 fb_handle,
     return 0;
 }
 
+/* Presents the back buffer of a software context with more than 2 buffers.
+ * If a page flip is already pending, the frame is queued up instead,
+ * and the listener thread flips to it once the pending flip completes.
+ * Either way, the new back buffer is one that's neither on the screen
+ * nor waiting to get there, so it never has to wait for anything. */
+static struct pixel_flat_data * render_present_frame_queued(
+    struct window_dri *win, const enum p_window_present_mode present_mode,
+    const struct region *damage)
+{
+    struct software_render_ctx *const sw_rctx = &win->render.sw;
+    struct software_render_buf *const buf = sw_rctx->back_buf;
+
+    render_copy_to_dumb_buffer(sw_rctx, buf, win->generic_info_p, damage);
+
+    /* The listener thread only touches the buffer pointers
+     * with the mutex locked, so it can't finish the pending flip
+     * between checking for it and queueing the frame */
+    pthread_mutex_lock(&win->listener.page_flip_mutex);
+
+    struct software_render_buf *new_back_buf = NULL;
+    if (!atomic_load(&win->listener.page_flip_pending)) {
+        if (render_present_frame(win, buf->fb_id, present_mode)) {
+            pthread_mutex_unlock(&win->listener.page_flip_mutex);
+            return P_WINDOW_SWAP_BUFFERS_FAIL;
+        }
+        sw_rctx->flip_buf = buf;
+    } else {
+        /* The queued frame never made it to the screen,
+         * so its buffer can just be drawn to again */
+        if (sw_rctx->queued_buf != NULL) {
+            s_log_trace("Replacing the queued frame");
+            new_back_buf = sw_rctx->queued_buf;
+            atomic_fetch_add(&sw_rctx->n_coalesced_frames, 1);
+            pc_present_timing_record_coalesced(win->listener.present_timing);
+        }
+        sw_rctx->queued_buf = buf;
+        sw_rctx->queued_flip_flags = get_page_flip_flags(win, present_mode);
+    }
+
+    for (u32 i = 0; i < sw_rctx->n_buffers && new_back_buf == NULL; i++) {
+        struct software_render_buf *const b = &sw_rctx->buffers[i];
+        if (b != sw_rctx->scanout_buf && b != sw_rctx->flip_buf &&
+            b != sw_rctx->queued_buf)
+        {
+            new_back_buf = b;
+        }
+    }
+    s_assert(new_back_buf != NULL, "No free buffer to draw to");
+    sw_rctx->back_buf = new_back_buf;
+
+    pthread_mutex_unlock(&win->listener.page_flip_mutex);
+
+    return &new_back_buf->user_ret;
+}
+
+static u32 get_page_flip_flags(const struct window_dri *win,
+    const enum p_window_present_mode present_mode)
+{
+    u32 flags = 0;
+    flags |= DRM_MODE_PAGE_FLIP_EVENT;
+    if (present_mode == P_WINDOW_PRESENT_NOW &&
+        win->dev.async_page_flip_supported)
+    {
+        flags |= DRM_MODE_PAGE_FLIP_ASYNC;
+    }
+
+    return flags;
+}
+
 static void render_finish_frame(struct window_dri_listener_thread *listener,
-    bool status)
+    bool status, const struct pc_present_flip_info *flip_info)
 {
     s_assert(listener->fd_p != NULL && *listener->fd_p != -1,
         "The DRM device file descriptor is not initialized!");
@@ -1112,9 +1366,21 @@ static void render_finish_frame(struct window_dri_listener_thread *listener,
         atomic_store(&listener->render_ctx->egl.front_buffer_in_use, false);
     }
 
-    /* Inform everyone about the page flip */
-    s_log_trace("page_flip_pending -> false");
-    atomic_store(&listener->page_flip_pending, false);
+    pc_present_timing_record_flip(listener->present_timing, status, flip_info);
+
+    /* Inform everyone about the page flip,
+     * unless the next one was already waiting for it */
+    pthread_mutex_lock(&listener->page_flip_mutex);
+    if (*listener->acceleration_p == P_WINDOW_ACCELERATION_NONE &&
+        flip_queued_frame(listener, status))
+    {
+        s_log_trace("Flipping to the queued frame");
+    } else {
+        s_log_trace("page_flip_pending -> false");
+        atomic_store(&listener->page_flip_pending, false);
+        pthread_cond_broadcast(&listener->page_flip_done);
+    }
+    pthread_mutex_unlock(&listener->page_flip_mutex);
 
     const struct p_event ev = {
         .type = P_EVENT_PAGE_FLIP,
@@ -1123,6 +1389,65 @@ static void render_finish_frame(struct window_dri_listener_thread *listener,
     p_event_send(&ev);
 }
 
+/* Must be called with `listener->page_flip_mutex` locked.
+ * Makes the buffer that was flipped to the one on the screen
+ * (if `status` is OK), and schedules a flip to the queued frame,
+ * if there is one. Returns true if it did. */
+static bool flip_queued_frame(struct window_dri_listener_thread *listener,
+    bool status)
+{
+    struct software_render_ctx *const sw_rctx = &listener->render_ctx->sw;
+    if (sw_rctx->n_buffers <= 2)
+        return false;
+
+    if (sw_rctx->flip_buf != NULL) {
+        if (status == OK)
+            sw_rctx->scanout_buf = sw_rctx->flip_buf;
+        sw_rctx->flip_buf = NULL;
+    }
+
+    struct software_render_buf *const buf = sw_rctx->queued_buf;
+    if (buf == NULL)
+        return false;
+    sw_rctx->queued_buf = NULL;
+
+    if (listener->drm->drmModePageFlip(*listener->fd_p, *listener->crtc_id_p,
+            buf->fb_id, sw_rctx->queued_flip_flags, listener))
+    {
+        s_log_error("Failed to schedule a page flip to the queued frame: %s",
+            strerror(errno));
+        atomic_fetch_add(&sw_rctx->n_dropped_frames, 1);
+        pc_present_timing_record_flip(listener->present_timing, NOT_OK, NULL);
+        return false;
+    }
+    sw_rctx->flip_buf = buf;
+
+    return true;
+}
+
+static void wait_for_page_flip(struct window_dri_listener_thread *listener)
+{
+    struct timespec timeout;
+    if (clock_gettime(CLOCK_REALTIME, &timeout)) {
+        s_log_error("Failed to get the current time: %s", strerror(errno));
+        return;
+    }
+
+    /* Don't hang forever if the page flip event never comes */
+    timeout.tv_sec += 1;
+
+    pthread_mutex_lock(&listener->page_flip_mutex);
+    while (atomic_load(&listener->page_flip_pending)) {
+        const i32 ret = pthread_cond_timedwait(&listener->page_flip_done,
+            &listener->page_flip_mutex, &timeout);
+        if (ret == ETIMEDOUT) {
+            s_log_warn("Timed out while waiting for the page flip");
+            break;
+        }
+    }
+    pthread_mutex_unlock(&listener->page_flip_mutex);
+}
+
 static void * window_dri_listener_fn(void *arg)
 {
     struct window_dri_listener_thread *listener = arg;
@@ -1172,19 +1497,19 @@ static void * window_dri_listener_fn(void *arg)
              * in the page flip handler */
             if (listener->drm->drmHandleEvent(*listener->fd_p, &ev_ctx) != 0) {
                 s_log_error("drmHandleEvent failed: I/O error");
-                render_finish_frame(listener, NOT_OK);
+                render_finish_frame(listener, NOT_OK, NULL);
             }
         } else if (ret == 0 && atomic_load(&listener->page_flip_pending)) {
             /* The fd isn't ready for I/O,
              * which means that the timeout expired */
             s_log_warn("Timeout for vblank expired; dropping frame");
-            render_finish_frame(listener, NOT_OK);
+            render_finish_frame(listener, NOT_OK, NULL);
         } else if (ret == -1) {
             if (errno == EINTR) { /* Interrupted by signal */
                 s_log_trace("%s: poll() interrupted by signal", __func__);
                 if (atomic_load(&listener->page_flip_pending)) {
                     s_log_trace("Dropping current frame due to interruption.");
-                    render_finish_frame(listener, NOT_OK);
+                    render_finish_frame(listener, NOT_OK, NULL);
                 }
                 continue;
             } else {
@@ -1201,19 +1526,22 @@ static void page_flip_handler(int fd, unsigned int frame,
     unsigned int tv_sec, unsigned int tv_usec, void *user_data)
 {
     (void) fd;
-    (void) frame;
-    (void) tv_sec;
-    (void) tv_usec;
     struct window_dri_listener_thread *listener = user_data;
 
     if (!atomic_load(&listener->page_flip_pending)) {
         s_log_error("%s: Nothing is waiting for the vblank event "
             "(or another frame is being displayed)!", __func__);
-        render_finish_frame(listener, NOT_OK);
+        render_finish_frame(listener, NOT_OK, NULL);
         return;
     }
 
-    render_finish_frame(listener, OK);
+    /* The kernel timestamps the vblank itself (on CLOCK_MONOTONIC) */
+    const struct pc_present_flip_info flip_info = {
+        .time.s = tv_sec,
+        .time.ns = (i64)tv_usec * 1000,
+        .msc = frame,
+    };
+    render_finish_frame(listener, OK, &flip_info);
 }
 
 static void cleanup_page_flip_handler(int fd, unsigned int frame,
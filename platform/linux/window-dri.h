@@ -7,9 +7,16 @@
 #define P_INTERNAL_GUARD__
 #include "tty.h"
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include <platform/common/present-timing.h>
+#undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include <platform/common/fb-copy.h>
+#undef P_INTERNAL_GUARD__
 #include <core/int.h>
 #include <core/util.h>
 #include <core/pixel.h>
+#include <core/region.h>
 #include <core/shapes.h>
 #include <stdbool.h>
 #include <xf86drm.h>
@@ -115,9 +122,23 @@ struct drm_device {
     u32 refresh_rate;
     bool async_page_flip_supported;
 
+    /* Whether the driver says that the dumb buffers are slow to read from
+     * (e.g. uncached VRAM), and so shouldn't be drawn into directly */
+    bool dumb_prefer_shadow;
+
     bool initialized_;
 };
 
+/* The dumb buffers are created as XRGB8888 (depth 24, 32 bpp),
+ * which is laid out in memory as BGRX */
+#define DRI_SW_DUMB_BUFFER_FORMAT BGRX32
+
+/* The number of dumb buffers with `P_WINDOW_TRIPLE_BUFFERED`.
+ * Neither the buffer on the screen nor the one that's being flipped to
+ * can be touched until the flip completes, so on top of those,
+ * one is needed for the queued frame and one for drawing the next one. */
+#define DRI_SW_MAX_BUFFERS 4
+
 struct software_render_ctx {
     struct software_render_buf {
         bool initialized_;
@@ -135,7 +156,34 @@ struct software_render_ctx {
         bool fb_mapped;
 
         struct pixel_flat_data user_ret;
-    } buffers[2], *front_buf, *back_buf;
+
+        /* Whether `user_ret` points straight into `map`. If not, it has
+         * its own pixel buffer, which is copied to `map` when presented. */
+        bool user_ret_mapped;
+
+        /* The parts of the window that changed since `map`
+         * was last written to (in window coordinates).
+         * Unused if `user_ret_mapped` is true. */
+        struct region pending_damage;
+    } buffers[DRI_SW_MAX_BUFFERS], *front_buf, *back_buf;
+    u32 n_buffers;
+
+    /* How the window pixel buffers are copied to the maps
+     * (see `pc_fb_copy_select`), if they aren't drawn to directly */
+    enum pc_fb_copy_method copy_method;
+
+    /* Only used with more than 2 buffers, where `front_buf` isn't used.
+     * The buffer that's on the screen, the one that's being flipped to
+     * (NULL if none) and the frame that waits for that flip to complete
+     * (NULL if none), along with the flags of its page flip.
+     * Protected by the listener's `page_flip_mutex`. */
+    struct software_render_buf *scanout_buf, *flip_buf, *queued_buf;
+    u32 queued_flip_flags;
+
+    /* Queued frames that were replaced by a newer one,
+     * and ones that couldn't be flipped to */
+    _Atomic u64 n_coalesced_frames, n_dropped_frames;
+
     bool initialized_;
 };
 
@@ -158,13 +206,21 @@ struct window_dri_listener_thread {
 
     /* The values of these should be read-only for the thread */
     const i32 *fd_p;
+    const u32 *crtc_id_p;
     const enum p_window_acceleration *acceleration_p;
     const struct libdrm_functions *drm;
     const struct libgbm_functions *gbm;
 
     _Atomic bool page_flip_pending;
 
+    /* Signaled whenever `page_flip_pending` is cleared */
+    pthread_mutex_t page_flip_mutex;
+    pthread_cond_t page_flip_done;
+
     union window_dri_render_ctx *render_ctx;
+
+    /* Where the page flips (and their vblank timestamps) are reported */
+    struct pc_present_timing *present_timing;
 };
 
 struct window_dri {
@@ -181,6 +237,9 @@ struct window_dri {
 
     struct p_window_info *generic_info_p;
 
+    /* Whether `P_WINDOW_TRIPLE_BUFFERED` was set */
+    bool triple_buffered;
+
     struct window_dri_listener_thread listener;
 
     struct tty_ctx ttydev_ctx;
@@ -190,15 +249,20 @@ struct window_dri {
 
 i32 window_dri_open(struct window_dri *win,
     const rect_t *area, const u32 flags,
-    struct p_window_info *info);
+    struct p_window_info *info, struct pc_present_timing *present_timing);
 
 void window_dri_close(struct window_dri *win);
 
+/* `damage` may be NULL, in which case the whole window is updated */
 struct pixel_flat_data * window_dri_swap_buffers(struct window_dri *win,
-    const enum p_window_present_mode present_mode);
+    const enum p_window_present_mode present_mode,
+    const struct region *damage);
 
 i32 window_dri_set_acceleration(struct window_dri *win,
     enum p_window_acceleration val);
 void window_dri_set_egl_buffers_swapped(struct window_dri *win);
 
+void window_dri_get_present_stats(const struct window_dri *win,
+    struct p_window_present_stats *out);
+
 #endif /* P_WINDOW_DRI_H_ */
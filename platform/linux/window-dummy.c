@@ -1,6 +1,10 @@
 #include "../window.h"
 #include <core/log.h>
+#include <core/util.h>
 #include <core/pixel.h>
+#include <core/region.h>
+#include <core/shapes.h>
+#include <stdlib.h>
 #include <string.h>
 #define P_INTERNAL_GUARD__
 #include "window-dummy.h"
@@ -8,7 +12,8 @@
 
 #define MODULE_NAME "window-dummy"
 
-i32 window_dummy_init(struct window_dummy *win, const u32 flags)
+i32 window_dummy_init(struct window_dummy *win, const rect_t *area,
+    const u32 flags)
 {
     memset(win, 0, sizeof(struct window_dummy));
 
@@ -18,10 +23,42 @@ i32 window_dummy_init(struct window_dummy *win, const u32 flags)
         return 1;
     }
 
+    win->front_buffer.w = win->back_buffer.w = area->w;
+    win->front_buffer.h = win->back_buffer.h = area->h;
+    win->front_buffer.stride = win->back_buffer.stride = area->w;
+    win->front_buffer.buf = calloc((u64)area->w * area->h, sizeof(pixel_t));
+    win->back_buffer.buf = calloc((u64)area->w * area->h, sizeof(pixel_t));
+    if (win->front_buffer.buf == NULL || win->back_buffer.buf == NULL) {
+        s_log_error("Failed to allocate the buffers (%ux%u)",
+            area->w, area->h);
+        window_dummy_destroy(win);
+        return 1;
+    }
+
     return 0;
 }
 
 void window_dummy_destroy(struct window_dummy *win)
 {
+    if (win->front_buffer.buf != NULL)
+        u_nfree(&win->front_buffer.buf);
+    if (win->back_buffer.buf != NULL)
+        u_nfree(&win->back_buffer.buf);
+
     memset(win, 0, sizeof(struct window_dummy));
 }
+
+struct pixel_flat_data * window_dummy_swap_buffers(struct window_dummy *win,
+    const enum p_window_present_mode present_mode,
+    const struct region *damage)
+{
+    u_check_params(win != NULL);
+    (void) present_mode;
+    (void) damage;
+
+    pixel_t *const new_back_buffer = win->front_buffer.buf;
+    win->front_buffer.buf = win->back_buffer.buf;
+    win->back_buffer.buf = new_back_buffer;
+
+    return &win->back_buffer;
+}
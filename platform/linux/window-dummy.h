@@ -2,13 +2,25 @@
 #define WINDOW_DUMMY_H_
 
 #include <platform/common/guard.h>
+#include "../window.h"
 #include <core/pixel.h>
+#include <core/region.h>
+#include <core/shapes.h>
 
+/* A window that isn't displayed anywhere. Its buffers are just
+ * plain memory, so it can be used to run the renderer without a display
+ * (e.g. in benchmarks). */
 struct window_dummy {
-    u64 dummy;
+    /* Nothing is ever presented, so the buffers are simply swapped around */
+    struct pixel_flat_data front_buffer, back_buffer;
 };
 
-i32 window_dummy_init(struct window_dummy *win, const u32 flags);
+i32 window_dummy_init(struct window_dummy *win, const rect_t *area,
+    const u32 flags);
 void window_dummy_destroy(struct window_dummy *win);
 
+struct pixel_flat_data * window_dummy_swap_buffers(struct window_dummy *win,
+    const enum p_window_present_mode present_mode,
+    const struct region *damage);
+
 #endif /* WINDOW_DUMMY_H_ */
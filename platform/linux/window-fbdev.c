@@ -8,10 +8,14 @@
 #include "../ptime.h"
 #include "../event.h"
 #include "../window.h"
+#define P_INTERNAL_GUARD__
+#include <platform/common/present-timing.h>
+#undef P_INTERNAL_GUARD__
 #include <core/log.h>
 #include <core/math.h>
 #include <core/util.h>
 #include <core/pixel.h>
+#include <core/region.h>
 #include <core/shapes.h>
 #include <errno.h>
 #include <stdatomic.h>
@@ -36,12 +40,27 @@
 static void * window_fbdev_listener_fn(void *arg);
 static void empty_handler(i32 sig_num);
 static void write_to_fb(void *map, const u32 stride, const rect_t *display_rect,
-    const rect_t *win_rect, const struct pixel_flat_data *pixels);
+    const rect_t *win_rect, const struct pixel_flat_data *pixels,
+    const struct region *damage, enum pc_fb_copy_method copy_method);
+static void write_rect_to_fb(void *map, const u32 stride,
+    const rect_t *display_rect, const rect_t *win_rect,
+    const struct pixel_flat_data *pixels, const rect_t *src_rect,
+    enum pc_fb_copy_method copy_method);
 static i32 post_sem_if_blocked(sem_t *sem);
+static void wait_for_page_flip(struct window_fbdev_listener *listener);
+
+static bool try_enable_panning(struct window_fbdev *win,
+    const rect_t *win_rect, const rect_t *display_rect, u32 n_pages);
+static void restore_display(struct window_fbdev *win);
+static i32 pan_display(i32 fd, const struct fb_var_screeninfo *var_info,
+    u32 yoffset);
+static pixel_t * get_page_pixels(const struct window_fbdev *win,
+    u32 yoffset, const rect_t *win_rect);
+static void swap_buffers(struct window_fbdev *win);
 
 i32 window_fbdev_open(struct window_fbdev *win,
     const rect_t *area, const u32 flags,
-    struct p_window_info *info)
+    struct p_window_info *info, struct pc_present_timing *present_timing)
 {
     memset(win, 0, sizeof(struct window_fbdev));
     win->closed = false;
@@ -85,18 +104,11 @@ i32 window_fbdev_open(struct window_fbdev *win,
 
     info->display_color_format = BGRX32;
 
-    win->mem_size = win->fixed_info.smem_len;
-    win->mem = mmap(0, win->mem_size, PROT_READ | PROT_WRITE,
-        MAP_SHARED, win->fd, 0);
-    if (win->mem == MAP_FAILED)
-        goto_error("Failed to mmap() framebuffer device to program memory: %s",
-            strerror(errno));
+    memcpy(&win->orig_var_info, &win->var_info,
+        sizeof(struct fb_var_screeninfo));
 
     win->xres = win->var_info.xres;
     win->yres = win->var_info.yres;
-    win->padding = (win->fixed_info.line_length / sizeof(u32))
-        - win->var_info.xres;
-    win->stride = win->xres + win->padding;
 
     /* Calculate the refresh rate */
     const u64 total_px_horizontal = win->var_info.xres + win->var_info.hsync_len
@@ -110,10 +122,15 @@ i32 window_fbdev_open(struct window_fbdev *win,
         s_log_debug("The pixel clock is set to 0; "
             "monitor refresh rate cannot be calculated.");
         win->refresh_rate = 0;
+        pc_present_timing_set_refresh_interval(present_timing, 0);
     } else {
         const f64 pixel_clock_hz = 1000000000000.F / win->var_info.pixclock;
         s_assert(total_px != 0, "Division by zero");
         win->refresh_rate = (u32)(pixel_clock_hz / total_px);
+
+        /* The pixel clock is in picoseconds */
+        pc_present_timing_set_refresh_interval(present_timing,
+            (u64)win->var_info.pixclock * total_px / 1000);
     }
 
     info->display_rect.x = 0;
@@ -128,6 +145,34 @@ i32 window_fbdev_open(struct window_fbdev *win,
     if (flags & P_WINDOW_POS_CENTERED_Y)
         info->client_area.y = abs((i32)win->yres - (i32)area->h) / 2;
 
+    /* This has to be done before mapping the memory,
+     * as it changes the size of the framebuffer.
+     * A third page lets the next frame be drawn while the previous one
+     * is still waiting for vsync, but 2 will do if that's all we get. */
+    if (flags & P_WINDOW_TRIPLE_BUFFERED) {
+        win->panning = try_enable_panning(win,
+            &info->client_area, &info->display_rect, 3);
+    }
+    if (!win->panning) {
+        win->panning = try_enable_panning(win,
+            &info->client_area, &info->display_rect, 2);
+    }
+
+    win->mem_size = win->fixed_info.smem_len;
+    win->mem = mmap(0, win->mem_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, win->fd, 0);
+    if (win->mem == MAP_FAILED) {
+        win->mem = NULL;
+        goto_error("Failed to mmap() framebuffer device to program memory: %s",
+            strerror(errno));
+    }
+
+    win->copy_method = pc_fb_copy_select(win->mem, win->mem_size);
+
+    win->padding = (win->fixed_info.line_length / sizeof(u32))
+        - win->var_info.xres;
+    win->stride = win->xres + win->padding;
+
     /* Set the terminal to raw mode to avoid echoing user input
      * on the console */
     if (tty_ctx_init(&win->ttydev_ctx, NULL) ||
@@ -141,28 +186,54 @@ i32 window_fbdev_open(struct window_fbdev *win,
     if (ioctl(win->fd, FBIO_WAITFORVSYNC, &dummy))
         goto_error("Failed to wait for vsync: %s", strerror(errno));
 
-    /* Allocate the buffers */
+    /* Set up the buffers */
     win->back_buffer.w = win->front_buffer.w = area->w;
     win->back_buffer.h = win->front_buffer.h = area->h;
-    const u64 n_pixels = win->xres * win->yres;
-    win->back_buffer.buf = calloc(n_pixels, sizeof(pixel_t));
-    win->front_buffer.buf = calloc(n_pixels, sizeof(pixel_t));
-    if (win->back_buffer.buf == NULL || win->front_buffer.buf == NULL)
-        goto_error("Failed to allocate the pixel buffers");
+    if (win->panning) {
+        /* Start with the same picture on all pages, so that
+         * the parts outside of the window don't flicker */
+        const u64 page_size = (u64)win->fixed_info.line_length * win->yres;
+        for (u32 i = 1; i < win->n_pages; i++) {
+            pc_fb_copy(win->copy_method,
+                win->mem + (i * page_size), win->mem, page_size);
+        }
+
+        win->front_yoffset = 0;
+        win->back_yoffset = win->yres;
+        win->back_buffer.stride = win->front_buffer.stride = win->stride;
+        win->front_buffer.buf = get_page_pixels(win, win->front_yoffset,
+            &info->client_area);
+        win->back_buffer.buf = get_page_pixels(win, win->back_yoffset,
+            &info->client_area);
+    } else {
+        win->back_buffer.stride = win->front_buffer.stride = area->w;
+        const u64 n_pixels = win->xres * win->yres;
+        win->back_buffer.buf = calloc(n_pixels, sizeof(pixel_t));
+        win->front_buffer.buf = calloc(n_pixels, sizeof(pixel_t));
+        if (win->back_buffer.buf == NULL || win->front_buffer.buf == NULL)
+            goto_error("Failed to allocate the pixel buffers");
+    }
 
     /* Init the listener thread */
     if (sem_init(&win->listener.page_flip_pending, 0, 0))
         goto_error("Failed to init the page flip semaphore");
     atomic_store(&win->listener.front_buffer_p, NULL);
+    win->listener.displayed_yoffset = win->front_yoffset;
     win->listener.map_p = &win->mem;
+    region_clear(&win->listener.pending_damage);
 
     win->listener.fd_p = &win->fd;
     win->listener.win_rect_p = &win->generic_info_p->client_area;
     win->listener.display_rect_p = &win->generic_info_p->display_rect;
     win->listener.stride_p = &win->stride;
+    win->listener.copy_method_p = &win->copy_method;
+    win->listener.panning_p = &win->panning;
+    win->listener.var_info_p = &win->var_info;
+    win->listener.present_timing = present_timing;
 
     /* Always returns 0 */
     (void) pthread_mutex_init(&win->listener.buf_mutex, NULL);
+    (void) pthread_cond_init(&win->listener.page_flip_done, NULL);
     atomic_store(&win->listener.running, true);
 
     i32 ret = pthread_create(&win->listener.thread, NULL,
@@ -170,8 +241,11 @@ i32 window_fbdev_open(struct window_fbdev *win,
     if (ret != 0)
         goto_error("Failed to spawn the listener thread: %s", strerror(ret));
 
-    s_log_debug("%s() OK; Screen is %ux%u@%uHz, with %upx of padding", __func__,
-        win->xres, win->yres, win->refresh_rate, win->padding);
+    s_log_debug("%s() OK; Screen is %ux%u@%uHz, with %upx of padding%s",
+        __func__, win->xres, win->yres, win->refresh_rate, win->padding,
+        win->panning ? " (page flipping by panning)" : "");
+    if (win->panning)
+        s_log_debug("Panning between %u pages", win->n_pages);
 
     return 0;
 
@@ -221,18 +295,27 @@ kill_thread:
         }
     }
 
+    (void) pthread_cond_destroy(&win->listener.page_flip_done);
     (void) pthread_mutex_destroy(&win->listener.buf_mutex);
     (void) sem_destroy(&win->listener.page_flip_pending);
 
-    /* Free the pixel buffers */
-    if (win->front_buffer.buf != NULL)
-        u_nfree(&win->front_buffer.buf);
-    if (win->back_buffer.buf != NULL)
-        u_nfree(&win->back_buffer.buf);
+    /* Free the pixel buffers (unless they are in the framebuffer) */
+    if (win->panning) {
+        win->front_buffer.buf = win->back_buffer.buf = NULL;
+    } else {
+        if (win->front_buffer.buf != NULL)
+            u_nfree(&win->front_buffer.buf);
+        if (win->back_buffer.buf != NULL)
+            u_nfree(&win->back_buffer.buf);
+    }
 
     /* Reset the tty back to its normal state */
     tty_ctx_cleanup(&win->ttydev_ctx);
 
+    /* Put the original screen back on the display */
+    if (win->var_info_changed || win->panning)
+        restore_display(win);
+
     /* Unmap and close the device */
     if (win->mem != NULL) {
         if (munmap(win->mem, win->mem_size)) {
@@ -255,86 +338,172 @@ kill_thread:
 
 /* Swaps the buffers and informs the listener thread to perform a page flip */
 struct pixel_flat_data * window_fbdev_swap_buffers(struct window_fbdev *win,
-    const enum p_window_present_mode present_mode)
+    const enum p_window_present_mode present_mode,
+    const struct region *damage)
 {
     u_check_params(win != NULL);
 
-    /* If another page flip request is in progress, wait for it to finish */
+    const rect_t full = { 0, 0, win->back_buffer.w, win->back_buffer.h };
+
+    /* The listener thread only holds the mutex for as long
+     * as it takes to flip the pages, not while it waits for vsync */
     pthread_mutex_lock(&win->listener.buf_mutex);
-    {
-        /* If vsync is on, let the listener thread do the rendering
-         * when it receives a vblank event.
-         * Otherwise, just copy the front buffer to the screen. */
-        switch (present_mode) {
-        case P_WINDOW_PRESENT_VSYNC:
-            atomic_store(&win->listener.front_buffer_p, &win->front_buffer);
-            if (post_sem_if_blocked(&win->listener.page_flip_pending)) {
-                s_log_error("Failed to post the page flip semaphore");
-                pthread_mutex_unlock(&win->listener.buf_mutex);
-                return P_WINDOW_SWAP_BUFFERS_FAIL;
-            }
-            break;
-        case P_WINDOW_PRESENT_NOW:
+
+    /* Restored if the frame can't be presented */
+    const struct pixel_flat_data orig_front_buffer = win->front_buffer;
+    const struct pixel_flat_data orig_back_buffer = win->back_buffer;
+    const u32 orig_front_yoffset = win->front_yoffset;
+    const u32 orig_back_yoffset = win->back_yoffset;
+
+    /* This has to happen first, as the frame that we are supposed
+     * to present is the one that was just drawn to the back buffer. */
+    swap_buffers(win);
+
+    /* If the listener didn't get to the previous frame yet,
+     * it gets replaced by this one, but its damage
+     * still has to be written out */
+    const bool replaced_frame =
+        atomic_load(&win->listener.front_buffer_p) != NULL;
+    if (replaced_frame) {
+        atomic_fetch_add(&win->n_coalesced_frames, 1);
+        pc_present_timing_record_coalesced(win->listener.present_timing);
+    }
+
+    /* If vsync is on, let the listener thread do the rendering
+     * when it receives a vblank event.
+     * Otherwise, just copy the front buffer to the screen. */
+    switch (present_mode) {
+    case P_WINDOW_PRESENT_VSYNC:
+        if (damage != NULL)
+            region_add_region(&win->listener.pending_damage, damage);
+        else
+            region_add_rect(&win->listener.pending_damage, &full);
+
+        win->listener.pan_yoffset = win->front_yoffset;
+        atomic_store(&win->listener.front_buffer_p, &win->front_buffer);
+        if (post_sem_if_blocked(&win->listener.page_flip_pending)) {
+            s_log_error("Failed to post the page flip semaphore");
+            atomic_store(&win->listener.front_buffer_p, NULL);
+            goto undo_swap;
+        }
+
+        /* With only 2 pages, the new back buffer stays on the screen
+         * until the listener pans away from it,
+         * so it can't be drawn to before that */
+        if (win->panning && win->n_pages == 2)
+            wait_for_page_flip(&win->listener);
+        break;
+    case P_WINDOW_PRESENT_NOW:
+        /* The frame that's still waiting for vsync is older
+         * than this one, so it's written out right now along with it */
+        if (replaced_frame) {
+            atomic_store(&win->listener.front_buffer_p, NULL);
+            if (damage != NULL)
+                region_add_region(&win->listener.pending_damage, damage);
+            else
+                region_add_rect(&win->listener.pending_damage, &full);
+            damage = &win->listener.pending_damage;
+        }
+
+        if (!win->panning) {
             write_to_fb(win->mem, win->stride,
                 &win->generic_info_p->display_rect,
                 &win->generic_info_p->client_area,
-                &win->front_buffer);
-            break;
+                &win->front_buffer, damage, win->copy_method);
+        } else if (pan_display(win->fd, &win->var_info,
+                win->front_yoffset))
+        {
+            goto undo_swap;
+        } else {
+            win->listener.displayed_yoffset = win->front_yoffset;
         }
+        region_clear(&win->listener.pending_damage);
 
-        /* Only swap the buffers on successful presentation */
-        /* We can just swap the pixel data pointers themselves
-         * since the rest (width and height) stay the same */
-        pixel_t *new_back_buffer = win->front_buffer.buf;
-        win->front_buffer.buf = win->back_buffer.buf;
-        win->back_buffer.buf = new_back_buffer;
-
+        /* There's no page flip event to wait for */
+        pc_present_timing_record_flip(win->listener.present_timing, 0, NULL);
+        break;
     }
-    pthread_mutex_unlock(&win->listener.buf_mutex);
 
+    pthread_mutex_unlock(&win->listener.buf_mutex);
     return &win->back_buffer;
+
+undo_swap:
+    /* The frame was never presented */
+    win->front_buffer = orig_front_buffer;
+    win->back_buffer = orig_back_buffer;
+    win->front_yoffset = orig_front_yoffset;
+    win->back_yoffset = orig_back_yoffset;
+    pthread_mutex_unlock(&win->listener.buf_mutex);
+    return P_WINDOW_SWAP_BUFFERS_FAIL;
+}
+
+void window_fbdev_get_present_stats(const struct window_fbdev *win,
+    struct p_window_present_stats *out)
+{
+    u_check_params(win != NULL && out != NULL);
+
+    memset(out, 0, sizeof(struct p_window_present_stats));
+    out->n_coalesced_frames = atomic_load(&win->n_coalesced_frames);
 }
 
 static void write_to_fb(void *map, const u32 stride, const rect_t *display_rect,
-    const rect_t *win_rect, const struct pixel_flat_data *pixels)
+    const rect_t *win_rect, const struct pixel_flat_data *pixels,
+    const struct region *damage, enum pc_fb_copy_method copy_method)
 {
     if (map == NULL || display_rect == NULL || win_rect == NULL
         || pixels == NULL || pixels->buf == NULL) return;
 
-    rect_t dst;
-    memcpy(&dst, win_rect, sizeof(rect_t));
+    if (damage == NULL) {
+        const rect_t full = { 0, 0, pixels->w, pixels->h };
+        write_rect_to_fb(map, stride, display_rect, win_rect, pixels, &full,
+            copy_method);
+        return;
+    }
+
+    for (u32 i = 0; i < damage->n_rects; i++) {
+        write_rect_to_fb(map, stride, display_rect, win_rect, pixels,
+            &damage->rects[i], copy_method);
+    }
+}
+
+static void write_rect_to_fb(void *map, const u32 stride,
+    const rect_t *display_rect, const rect_t *win_rect,
+    const struct pixel_flat_data *pixels, const rect_t *src_rect,
+    enum pc_fb_copy_method copy_method)
+{
+    /* Make sure we don't read out of bounds... */
+    rect_t src = *src_rect;
+    const rect_t pixels_rect = { 0, 0, pixels->w, pixels->h };
+    rect_clip(&src, &pixels_rect);
+
+    /* ...and that we don't write out of bounds */
+    rect_t dst = {
+        .x = win_rect->x + src.x,
+        .y = win_rect->y + src.y,
+        .w = src.w,
+        .h = src.h,
+    };
     rect_clip(&dst, display_rect);
+    if (dst.w == 0 || dst.h == 0)
+        return;
 
     /* "Project" the changes made to dst onto src */
-    const rect_t src = {
-        .x = dst.x - win_rect->x,
-        .y = dst.y - win_rect->y,
-        .w = pixels->w + (dst.w - win_rect->w),
-        .h = pixels->h + (dst.h - win_rect->h),
-    };
+    src.x = dst.x - win_rect->x;
+    src.y = dst.y - win_rect->y;
 
     /* Fix pointer arithmetic shenanigans */
     u8 *src_mem = (u8 *)pixels->buf;
     u8 *dst_mem = (u8 *)map;
-    const u32 src_stride_bytes = src.w * sizeof(pixel_t);
-
-    /* Blit the window to the screen */
-    for (u32 y = 0; y < src.h; y++) {
-        const u32 dst_offset = (
-            ((dst.y + y) * stride)
-            + dst.x
-        ) * sizeof(pixel_t);
-        const u32 src_offset = (
-            ((src.y + y) * src.w)
-            + src.x
-        ) * sizeof(pixel_t);
-
-        memcpy(
-            dst_mem + dst_offset,
-            src_mem + src_offset,
-            src_stride_bytes
-        );
-    }
+    const u32 row_size_bytes = dst.w * sizeof(pixel_t);
+
+    /* Blit the rect to the screen */
+    const u64 dst_offset = (((u64)dst.y * stride) + dst.x) * sizeof(pixel_t);
+    const u64 src_offset = (((u64)src.y * pixels->stride) + src.x)
+        * sizeof(pixel_t);
+    pc_fb_copy_rows(copy_method,
+        dst_mem + dst_offset, (u64)stride * sizeof(pixel_t),
+        src_mem + src_offset, (u64)pixels->stride * sizeof(pixel_t),
+        row_size_bytes, dst.h);
 }
 
 static void * window_fbdev_listener_fn(void *arg)
@@ -381,26 +550,53 @@ static void * window_fbdev_listener_fn(void *arg)
                 break;
             }
         }
-        pthread_mutex_lock(&listener->buf_mutex);
 
-        /* Wait for VSync */
+        /* Wait for VSync. The mutex isn't locked yet,
+         * so that a newer frame can still replace this one. */
         i32 dummy = 0;
         if (ioctl(*listener->fd_p, FBIO_WAITFORVSYNC, &dummy)) {
-            if (errno == EINTR) /* Interrupted by signal */
+            if (errno == EINTR) { /* Interrupted by signal */
                 continue;
-            else
+            } else {
                 s_log_error("Failed to wait for vsync: %s", strerror(errno));
+            }
         }
 
-        write_to_fb(*listener->map_p, *listener->stride_p,
-            listener->display_rect_p, listener->win_rect_p,
-            atomic_load(&listener->front_buffer_p));
+        /* fbdev doesn't timestamp the vblanks,
+         * so this is as close as it gets */
+        struct pc_present_flip_info flip_info = { .msc = 0 };
+        p_time_get_ticks(&flip_info.time);
+
+        pthread_mutex_lock(&listener->buf_mutex);
+
+        /* The frame might have been presented right away in the meantime */
+        const struct pixel_flat_data *const front_buffer =
+            atomic_load(&listener->front_buffer_p);
+        if (front_buffer == NULL) {
+            pthread_mutex_unlock(&listener->buf_mutex);
+            continue;
+        }
+
+        /* Flip the pages while the display is in vblank */
+        if (*listener->panning_p) {
+            if (pan_display(*listener->fd_p, listener->var_info_p,
+                    listener->pan_yoffset) == 0)
+            {
+                listener->displayed_yoffset = listener->pan_yoffset;
+            }
+        } else {
+            write_to_fb(*listener->map_p, *listener->stride_p,
+                listener->display_rect_p, listener->win_rect_p,
+                front_buffer, &listener->pending_damage,
+                *listener->copy_method_p);
+        }
+        region_clear(&listener->pending_damage);
 
         atomic_store(&listener->front_buffer_p, NULL);
+        pthread_cond_broadcast(&listener->page_flip_done);
         pthread_mutex_unlock(&listener->buf_mutex);
 
-        timestamp_t time;
-        p_time(&time);
+        pc_present_timing_record_flip(listener->present_timing, 0, &flip_info);
 
         /* Inform everyone that a page flip has occured */
         const struct p_event ev = {
@@ -436,3 +632,172 @@ static i32 post_sem_if_blocked(sem_t *sem)
 
     return 0;
 }
+
+/* Must be called with `listener->buf_mutex` locked */
+static void wait_for_page_flip(struct window_fbdev_listener *listener)
+{
+    struct timespec timeout;
+    if (clock_gettime(CLOCK_REALTIME, &timeout)) {
+        s_log_error("Failed to get the current time: %s", strerror(errno));
+        return;
+    }
+
+    /* Don't hang forever if the listener thread gets stuck */
+    timeout.tv_sec += 1;
+
+    while (atomic_load(&listener->front_buffer_p) != NULL) {
+        const i32 ret = pthread_cond_timedwait(&listener->page_flip_done,
+            &listener->buf_mutex, &timeout);
+        if (ret == ETIMEDOUT) {
+            s_log_warn("Timed out while waiting for the page flip");
+            break;
+        }
+    }
+}
+
+/* Tries to make the virtual resolution `n_pages` times as tall
+ * as the screen, so that the pages can be flipped by panning the display.
+ * Returns true on success, and false if the driver doesn't allow it
+ * (in which case everything is left as it was). */
+static bool try_enable_panning(struct window_fbdev *win,
+    const rect_t *win_rect, const rect_t *display_rect, u32 n_pages)
+{
+    /* The window can only be drawn straight into the framebuffer
+     * if the whole of it is on the screen */
+    rect_t visible_rect = *win_rect;
+    rect_clip(&visible_rect, display_rect);
+    if (memcmp(&visible_rect, win_rect, sizeof(rect_t))) {
+        s_log_debug("The window isn't entirely on the screen; not panning");
+        return false;
+    }
+
+    if (win->fixed_info.ypanstep == 0 ||
+        win->yres % win->fixed_info.ypanstep != 0)
+    {
+        s_log_debug("The driver can't pan to the other pages");
+        return false;
+    }
+
+    if (win->var_info.yres_virtual < win->yres * n_pages) {
+        struct fb_var_screeninfo var = win->var_info;
+        var.yres_virtual = win->yres * n_pages;
+        var.xoffset = var.yoffset = 0;
+        var.activate = FB_ACTIVATE_NOW;
+        if (ioctl(win->fd, FBIOPUT_VSCREENINFO, &var)) {
+            s_log_debug("Failed to set the virtual resolution to %ux%u: %s",
+                var.xres_virtual, var.yres_virtual, strerror(errno));
+            return false;
+        }
+        win->var_info_changed = true;
+    }
+
+    /* The driver may have adjusted some of the values,
+     * and the size of the memory might have changed */
+    if (ioctl(win->fd, FBIOGET_VSCREENINFO, &win->var_info) ||
+        ioctl(win->fd, FBIOGET_FSCREENINFO, &win->fixed_info))
+    {
+        s_log_error("Failed to get the screen info: %s", strerror(errno));
+        goto fail;
+    }
+
+    if (win->var_info.xres != win->xres || win->var_info.yres != win->yres ||
+        win->var_info.bits_per_pixel != 32 ||
+        win->var_info.yres_virtual < win->yres * n_pages ||
+        win->fixed_info.line_length % sizeof(pixel_t) != 0 ||
+        (u64)win->fixed_info.line_length * win->yres * n_pages >
+            win->fixed_info.smem_len)
+    {
+        s_log_debug("The driver didn't set up %u pages", n_pages);
+        goto fail;
+    }
+
+    /* Make sure that the first page is the one on the screen */
+    if (pan_display(win->fd, &win->var_info, 0))
+        goto fail;
+
+    win->n_pages = n_pages;
+    return true;
+
+fail:
+    restore_display(win);
+    return false;
+}
+
+/* Undoes whatever `try_enable_panning` did to the screen */
+static void restore_display(struct window_fbdev *win)
+{
+    if (win->var_info_changed) {
+        struct fb_var_screeninfo var = win->orig_var_info;
+        var.activate = FB_ACTIVATE_NOW;
+        if (ioctl(win->fd, FBIOPUT_VSCREENINFO, &var))
+            s_log_error("Failed to restore the screen info: %s",
+                strerror(errno));
+        win->var_info_changed = false;
+    } else if (win->panning) {
+        (void) pan_display(win->fd, &win->orig_var_info,
+            win->orig_var_info.yoffset);
+    }
+
+    if (ioctl(win->fd, FBIOGET_VSCREENINFO, &win->var_info) ||
+        ioctl(win->fd, FBIOGET_FSCREENINFO, &win->fixed_info))
+        s_log_error("Failed to get the screen info: %s", strerror(errno));
+}
+
+static i32 pan_display(i32 fd, const struct fb_var_screeninfo *var_info,
+    u32 yoffset)
+{
+    struct fb_var_screeninfo var = *var_info;
+    var.xoffset = 0;
+    var.yoffset = yoffset;
+    if (ioctl(fd, FBIOPAN_DISPLAY, &var)) {
+        s_log_error("Failed to pan the display to y = %u: %s",
+            yoffset, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Returns the pixels of the window in the page that starts at `yoffset` */
+static pixel_t * get_page_pixels(const struct window_fbdev *win,
+    u32 yoffset, const rect_t *win_rect)
+{
+    pixel_t *const page = (pixel_t *)(win->mem +
+        (u64)yoffset * win->fixed_info.line_length);
+    return page + ((u64)win_rect->y * win->stride) + win_rect->x;
+}
+
+/* We can just swap the pixel data pointers themselves
+ * since the rest (width, height and stride) stay the same.
+ * Must be called with `win->listener.buf_mutex` locked. */
+static void swap_buffers(struct window_fbdev *win)
+{
+    /* With more pages, the new back buffer is the one that's neither
+     * on the screen nor about to be. The page of a frame that's replaced
+     * before the listener pans to it is free again. */
+    if (win->panning && win->n_pages > 2) {
+        win->front_buffer.buf = win->back_buffer.buf;
+        win->front_yoffset = win->back_yoffset;
+
+        for (u32 i = 0; i < win->n_pages; i++) {
+            const u32 yoffset = i * win->yres;
+            if (yoffset != win->front_yoffset &&
+                yoffset != win->listener.displayed_yoffset)
+            {
+                win->back_yoffset = yoffset;
+                break;
+            }
+        }
+        win->back_buffer.buf = get_page_pixels(win, win->back_yoffset,
+            &win->generic_info_p->client_area);
+        return;
+    }
+
+    pixel_t *const new_back_buffer = win->front_buffer.buf;
+    win->front_buffer.buf = win->back_buffer.buf;
+    win->back_buffer.buf = new_back_buffer;
+
+    const u32 new_back_yoffset = win->front_yoffset;
+    win->front_yoffset = win->back_yoffset;
+    win->back_yoffset = new_back_yoffset;
+}
@@ -7,8 +7,15 @@
 #define P_INTERNAL_GUARD__
 #include "tty.h"
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include <platform/common/present-timing.h>
+#undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include <platform/common/fb-copy.h>
+#undef P_INTERNAL_GUARD__
 #include <core/int.h>
 #include <core/pixel.h>
+#include <core/region.h>
 #include <core/shapes.h>
 #include <stdbool.h>
 #include <termios.h>
@@ -24,14 +31,33 @@ struct window_fbdev_listener {
 
     sem_t page_flip_pending;
     /* The thread only needs to read from the buffer
-     * and write to the map */
+     * and write to the map. Set back to NULL (and `page_flip_done`
+     * is signaled) once the frame is on the screen. */
     const struct pixel_flat_data *_Atomic front_buffer_p;
+    pthread_cond_t page_flip_done;
     u8 *const *map_p;
 
+    /* When panning, the y offset of the page that should be
+     * displayed next (see `window_fbdev.panning`), and the one
+     * that's on the screen right now.
+     * Protected by `buf_mutex`. */
+    u32 pan_yoffset, displayed_yoffset;
+
+    /* The parts of the window that changed since the last time
+     * the thread wrote to the map (in window coordinates).
+     * Protected by `buf_mutex`. */
+    struct region pending_damage;
+
     /* All of these should be read-only for the thread */
     const i32 *fd_p;
     const rect_t *win_rect_p, *display_rect_p;
     const u32 *stride_p;
+    const enum pc_fb_copy_method *copy_method_p;
+    const bool *panning_p;
+    const struct fb_var_screeninfo *var_info_p;
+
+    /* Where the page flips are reported */
+    struct pc_present_timing *present_timing;
 };
 
 struct window_fbdev {
@@ -39,14 +65,36 @@ struct window_fbdev {
     struct fb_fix_screeninfo fixed_info;
     struct fb_var_screeninfo var_info;
 
+    /* Restored when the window is closed */
+    struct fb_var_screeninfo orig_var_info;
+    bool var_info_changed;
+
     struct p_window_info *generic_info_p;
 
     u8 *mem;
     u64 mem_size;
 
+    /* How the window is copied to `mem` (see `pc_fb_copy_select`) */
+    enum pc_fb_copy_method copy_method;
+
     struct pixel_flat_data back_buffer;
     struct pixel_flat_data front_buffer;
 
+    /* If the driver lets the virtual resolution be `n_pages` times
+     * as tall as the screen, the pages of the framebuffer memory are used
+     * as the front and back buffers, and the display is panned between
+     * them to flip the pages. The window is then drawn straight into
+     * an off-screen page, and nothing needs to be copied.
+     * Otherwise, the buffers are allocated separately and copied
+     * to the framebuffer when presented. */
+    bool panning;
+    u32 n_pages;
+    u32 front_yoffset, back_yoffset;
+
+    /* Frames that were replaced by a newer one
+     * before the listener thread got to them */
+    _Atomic u64 n_coalesced_frames;
+
     struct window_fbdev_listener listener;
 
     u32 xres, yres;
@@ -61,10 +109,15 @@ struct window_fbdev {
 
 i32 window_fbdev_open(struct window_fbdev *win,
     const rect_t *area, const u32 flags,
-    struct p_window_info *info);
+    struct p_window_info *info, struct pc_present_timing *present_timing);
 void window_fbdev_close(struct window_fbdev *win);
 
+/* `damage` may be NULL, in which case the whole window is updated */
 struct pixel_flat_data * window_fbdev_swap_buffers(struct window_fbdev *win,
-    const enum p_window_present_mode present_mode);
+    const enum p_window_present_mode present_mode,
+    const struct region *damage);
+
+void window_fbdev_get_present_stats(const struct window_fbdev *win,
+    struct p_window_present_stats *out);
 
 #endif /* P_WINDOW_FBDEV_H_ */
@@ -19,6 +19,9 @@
 #define P_INTERNAL_GUARD__
 #include "window-dummy.h"
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include <platform/common/present-timing.h>
+#undef P_INTERNAL_GUARD__
 
 #define N_WINDOW_TYPES 4
 #define WINDOW_TYPE_LIST    \
@@ -58,6 +61,10 @@ struct p_window {
     struct p_window_info info;
     vec2d_t mouse_ev_offset;
     enum window_type type;
+
+    /* Shared with the backend, which reports the page flips */
+    struct pc_present_timing present_timing;
+
     union {
         struct window_x11 x11;
         struct window_dri dri;
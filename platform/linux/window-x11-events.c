@@ -29,6 +29,9 @@
 #include "window-x11-present-sw.h"
 #undef P_INTERNAL_GUARD__
 #define P_INTERNAL_GUARD__
+#include "event-internal.h"
+#undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
 #include "libxcb-rtld.h"
 #undef P_INTERNAL_GUARD__
 #define P_INTERNAL_GUARD__
@@ -103,6 +106,10 @@ static void handle_event(struct window_x11 *win, xcb_generic_event_t *ev)
         handle_ge_event(win, (xcb_ge_generic_event_t *)ev);
         break;
     case XCB_EXPOSE:
+        /* Only the last one in a series, and not the dummy event
+         * that we send to ourselves to wake this thread up */
+        if (((xcb_expose_event_t *)ev)->count == 0 && !XCB_EVENT_SENT(ev))
+            p_event_send(&(struct p_event) { .type = P_EVENT_EXPOSE });
         break;
     case 0:
         if (acceleration == P_WINDOW_ACCELERATION_NONE &&
@@ -174,7 +181,7 @@ static void handle_ge_event(struct window_x11 *win,
         }
         handle_present_event(win, ge_ev);
         break;
-    default: case X11_EXT_SHM: case X11_EXT_NULL_:
+    default: case X11_EXT_SHM: case X11_EXT_XFIXES: case X11_EXT_NULL_:
         s_log_error("Unhandled extension %u event %u",
             ge_ev->extension, ge_ev->response_type);
         break;
@@ -217,6 +224,8 @@ static void handle_xi2_event(struct window_x11 *win,
         );
         keyboard_X11_store_key_event(keyboard,
             press_keysym, KEYBOARD_X11_PRESS);
+        /* Let the main loop handle it right away */
+        event_wake();
 
         break;
     case XCB_INPUT_KEY_RELEASE:
@@ -232,6 +241,7 @@ static void handle_xi2_event(struct window_x11 *win,
         );
         keyboard_X11_store_key_event(keyboard,
             release_keysym, KEYBOARD_X11_RELEASE);
+        event_wake();
 
         break;
     case XCB_INPUT_BUTTON_PRESS:
@@ -251,6 +261,7 @@ static void handle_xi2_event(struct window_x11 *win,
         }
 
         atomic_store(&mouse->button_bits, button_bits);
+        event_wake();
 
         break;
     case XCB_INPUT_BUTTON_RELEASE:
@@ -270,6 +281,7 @@ static void handle_xi2_event(struct window_x11 *win,
         }
 
         atomic_store(&mouse->button_bits, button_bits);
+        event_wake();
 
         break;
     case XCB_INPUT_MOTION:
@@ -280,6 +292,7 @@ static void handle_xi2_event(struct window_x11 *win,
 
         atomic_store(&mouse->x, u_fp1616_to_f32(ev.motion->event_x));
         atomic_store(&mouse->y, u_fp1616_to_f32(ev.motion->event_y));
+        event_wake();
 
         break;
     default:
@@ -316,6 +329,14 @@ static void handle_present_event(struct window_x11 *win,
         }
         spinlock_release(&win->render.sw.swap_lock);
 
+        /* The X server reports the UST in microseconds
+         * (on CLOCK_MONOTONIC), and the MSC of the vblank itself */
+        const struct pc_present_flip_info flip_info = {
+            .time.s = ev.complete->ust / 1000000,
+            .time.ns = (ev.complete->ust % 1000000) * 1000,
+            .msc = ev.complete->msc,
+        };
+
         const u32 stored_serial = atomic_load(&shared_data->serial);
         if (stored_serial != ev.complete->serial) {
             if (stored_serial > ev.complete->serial) {
@@ -327,15 +348,17 @@ static void handle_present_event(struct window_x11 *win,
                 const u32 diff = ev.complete->serial - stored_serial;
                 s_log_warn("Dropped %u frame(s)", diff);
                 for (u32 i = 0; i < diff - 1; i++) {
+                    pc_present_timing_record_flip(win->present_timing,
+                        1, NULL);
                     p_event_send(&(const struct p_event) {
                         .type = P_EVENT_PAGE_FLIP,
                         .info.page_flip_status = 1,
                     });
                 }
             }
-            X11_render_software_finish_frame(&win->render.sw, 1);
+            X11_render_software_finish_frame(&win->render.sw, 1, &flip_info);
         } else {
-            X11_render_software_finish_frame(&win->render.sw, 0);
+            X11_render_software_finish_frame(&win->render.sw, 0, &flip_info);
         }
         break;
     }
@@ -358,6 +381,7 @@ static void handle_shm_completion_event(struct window_x11 *win,
             "some frames were possibly dropped",
             stored_sequence_number, ev->full_sequence
         );
+        pc_present_timing_record_flip(win->present_timing, 1, NULL);
         p_event_send(&(const struct p_event) {
             .type = P_EVENT_PAGE_FLIP,
             .info.page_flip_status = 1,
@@ -368,7 +392,7 @@ static void handle_shm_completion_event(struct window_x11 *win,
          * we should also finish the frame as if everything was OK */
     }
 
-    X11_render_software_finish_frame(&win->render.sw, 0);
+    X11_render_software_finish_frame(&win->render.sw, 0, NULL);
 }
 
 static void handle_shm_error(struct window_x11 *win, xcb_generic_error_t *e)
@@ -380,6 +404,7 @@ static void handle_shm_error(struct window_x11 *win, xcb_generic_error_t *e)
             atomic_load(&shared_data->blit_request_sequence_number)
     ) {
         s_log_error("A ShmPutImage frame presentation failed (frame dropped)");
+        pc_present_timing_record_flip(win->present_timing, 1, NULL);
         p_event_send(&(const struct p_event) {
             .type = P_EVENT_PAGE_FLIP,
             .info.page_flip_status = 1,
@@ -14,15 +14,29 @@
 
 #define MODULE_NAME "window-x11-extensions"
 
-static xcb_query_extension_reply_t * query_extension(const char *name,
-    xcb_connection_t *conn, const struct libxcb *xcb);
+static xcb_extension_t * get_extension_id(enum x11_extension_name ext_name,
+    const struct libxcb *xcb);
+
+void X11_extension_store_prefetch(xcb_connection_t *conn,
+    const struct libxcb *xcb)
+{
+    u_check_params(conn != NULL && xcb != NULL &&
+        xcb->_voidp_xcb_prefetch_extension_data != NULL);
+
+    /* libxcb caches the replies, so they don't have to be waited for
+     * here, and the extension requests sent later don't block either */
+    for (u32 i = 0; i < X11_EXT_MAX_; i++) {
+        xcb_extension_t *const ext_id = get_extension_id(i, xcb);
+        if (ext_id != NULL)
+            xcb->xcb_prefetch_extension_data(conn, ext_id);
+    }
+}
 
 void X11_extension_store_init(struct x11_extension_store *ext_store,
     xcb_connection_t *conn, const struct libxcb *xcb)
 {
     u_check_params(ext_store != NULL && conn != NULL && xcb != NULL &&
-        xcb->_voidp_xcb_query_extension != NULL &&
-        xcb->_voidp_xcb_query_extension_reply != NULL);
+        xcb->_voidp_xcb_get_extension_data != NULL);
 
     atomic_store(&ext_store->ready_, false);
     atomic_store(&ext_store->initialized_, true);
@@ -31,12 +45,12 @@ void X11_extension_store_init(struct x11_extension_store *ext_store,
         [X11_EXT_XINPUT] = X11_XINPUT_EXT_NAME,
         [X11_EXT_SHM] = X11_SHM_EXT_NAME,
         [X11_EXT_PRESENT] = X11_PRESENT_EXT_NAME,
+        [X11_EXT_XFIXES] = X11_XFIXES_EXT_NAME,
     };
-    const bool ext_lib_loaded[X11_EXT_MAX_] = {
-        [X11_EXT_XINPUT] = xcb->xinput.loaded_,
-        [X11_EXT_SHM] = xcb->shm.loaded_,
-        [X11_EXT_PRESENT] = xcb->present.loaded_,
-    };
+
+    /* Send all the queries before waiting for any of the replies
+     * (unless that was already done) */
+    X11_extension_store_prefetch(conn, xcb);
 
     for (u32 i = 0; i < X11_EXT_MAX_; i++) {
         struct x11_extension *const curr_ext = &ext_store->extensions[i];
@@ -47,21 +61,30 @@ void X11_extension_store_init(struct x11_extension_store *ext_store,
         curr_ext->first_event = 0;
         curr_ext->first_error = 0;
 
-        if (!ext_lib_loaded[i]) {
+        xcb_extension_t *const ext_id = get_extension_id(i, xcb);
+        if (ext_id == NULL) {
             s_log_debug("X \"%s\" extension library not loaded",
                 ext_names[i]);
             continue;
         }
 
-        xcb_query_extension_reply_t *reply =
-            query_extension(ext_names[i], conn, xcb);
-        if (reply != NULL) {
-            curr_ext->available = reply->present;
-            curr_ext->major_opcode = reply->major_opcode;
-            curr_ext->first_event = reply->first_event;
-            curr_ext->first_error = reply->first_error;
-            u_nfree(&reply);
-        } /* else extension not available */
+        /* Owned by libxcb */
+        const xcb_query_extension_reply_t *const reply =
+            xcb->xcb_get_extension_data(conn, ext_id);
+        if (reply == NULL) {
+            s_log_error("Failed to query the \"%s\" extension", ext_names[i]);
+            continue;
+        }
+
+        s_log_debug("extension \"%s\" present: %d, opcode: %u, "
+            "first event: %u, first error: %u",
+            ext_names[i], reply->present, reply->major_opcode,
+            reply->first_event, reply->first_error);
+
+        curr_ext->available = reply->present;
+        curr_ext->major_opcode = reply->major_opcode;
+        curr_ext->first_event = reply->first_event;
+        curr_ext->first_error = reply->first_error;
     }
 
     atomic_store(&ext_store->ready_, true);
@@ -116,22 +139,20 @@ void X11_extension_store_destroy(struct x11_extension_store *ext_store)
     atomic_store(&ext_store->ready_, false);
 }
 
-static xcb_query_extension_reply_t * query_extension(const char *name,
-    xcb_connection_t *conn, const struct libxcb *xcb)
+/* Returns NULL if the extension's library isn't loaded */
+static xcb_extension_t * get_extension_id(enum x11_extension_name ext_name,
+    const struct libxcb *xcb)
 {
-    xcb_query_extension_cookie_t cookie = xcb->xcb_query_extension(conn,
-        strlen(name), name);
-    xcb_query_extension_reply_t *reply =
-        xcb->xcb_query_extension_reply(conn, cookie, NULL);
-    if (reply == NULL) {
-        s_log_error("xcb_query_extension(\"%s\") failed!", name);
+    switch (ext_name) {
+    case X11_EXT_XINPUT:
+        return xcb->xinput.loaded_ ? xcb->xinput.xcb_input_id : NULL;
+    case X11_EXT_SHM:
+        return xcb->shm.loaded_ ? xcb->shm.xcb_shm_id : NULL;
+    case X11_EXT_PRESENT:
+        return xcb->present.loaded_ ? xcb->present.xcb_present_id : NULL;
+    case X11_EXT_XFIXES:
+        return xcb->xfixes.loaded_ ? xcb->xfixes.xcb_xfixes_id : NULL;
+    default:
         return NULL;
     }
-
-    s_log_debug("extension \"%s\" present: %d, opcode: %u, "
-        "first event: %u, first error: %u",
-        name, reply->present, reply->major_opcode,
-        reply->first_event, reply->first_error);
-
-    return reply;
 }
@@ -15,6 +15,7 @@ enum x11_extension_name {
     X11_EXT_XINPUT = 0,
     X11_EXT_SHM,
     X11_EXT_PRESENT,
+    X11_EXT_XFIXES,
     X11_EXT_MAX_
 };
 
@@ -41,6 +42,13 @@ struct x11_extension_store {
  * because it's assumed that the store was initialized before any "side" thread
  * even started. */
 
+/* Sends the queries for all the extensions without waiting for the replies,
+ * so that other independent requests can be sent in the meantime.
+ * The replies are then collected by `X11_extension_store_init`
+ * (which also sends the queries itself if this wasn't called). */
+void X11_extension_store_prefetch(xcb_connection_t *conn,
+    const struct libxcb *xcb);
+
 void X11_extension_store_init(struct x11_extension_store *ext_store,
     xcb_connection_t *conn, const struct libxcb *xcb);
 
@@ -14,7 +14,10 @@
 #include "../window.h"
 #include <core/int.h>
 #include <core/log.h>
+#include <core/math.h>
 #include <core/util.h>
+#include <core/region.h>
+#include <core/shapes.h>
 #include <core/spinlock.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -23,8 +26,11 @@
 #include <signal.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <unistd.h>
 #include <sys/shm.h>
 #include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
@@ -50,12 +56,14 @@ static i32 software_init_buffer_pixmap(
 
 static i32 software_present_malloced(
     const struct x11_render_software_malloced_image_buf *buf,
-    struct x11_render_shared_malloced_data *shared_data
+    struct x11_render_shared_malloced_data *shared_data,
+    const struct region *damage
 );
 static i32 software_present_shm(
     const struct x11_render_software_shm_buf *buf,
     struct x11_render_shared_shm_data *shared_data,
     const struct x11_render_software_generic_window_info *win_info,
+    const struct region *damage,
     xcb_connection_t *conn, const struct libxcb *xcb
 );
 static i32 software_present_pixmap(
@@ -63,6 +71,7 @@ static i32 software_present_pixmap(
     struct x11_render_shared_present_data *shared_data,
     enum p_window_present_mode present_mode,
     const struct x11_render_software_generic_window_info *win_info,
+    const struct region *damage,
     xcb_connection_t *conn, const struct libxcb *xcb
 );
 static void software_destroy_buffer_malloced(
@@ -100,27 +109,55 @@ static void destroy_shm_shared_data(
 
 static i32 init_present_shared_data(
     struct x11_render_shared_present_data *shared_data,
-    xcb_window_t win_handle, xcb_connection_t *conn, const struct libxcb *xcb
+    const struct x11_render_software_generic_window_info *win_info,
+    xcb_connection_t *conn, const struct libxcb *xcb
 );
 static void destroy_present_shared_data(
     struct x11_render_shared_present_data *shared_data,
     xcb_window_t win_handle, xcb_connection_t *conn, const struct libxcb *xcb
 );
 
-static i32 attach_shm(xcb_shm_segment_info_t *shm_o, u32 w, u32 h,
+static i32 create_update_region(_Atomic xcb_xfixes_region_t *region_o,
+    const struct x11_extension_store *ext_store,
+    xcb_connection_t *conn, const struct libxcb *xcb);
+
+static i32 attach_shm(struct x11_shm_segment *shm_o, u32 w, u32 h,
     const struct x11_extension_store *ext_store,
     xcb_connection_t *conn, const struct libxcb *xcb);
-static void detach_shm(xcb_shm_segment_info_t *shm,
+static i32 attach_shm_memfd(struct x11_shm_segment *shm_o,
     xcb_connection_t *conn, const struct libxcb *xcb);
+static bool can_pass_fds(xcb_connection_t *conn, const struct libxcb *xcb);
+static i32 attach_shm_sysv(struct x11_shm_segment *shm_o,
+    xcb_connection_t *conn, const struct libxcb *xcb);
+static void detach_shm(struct x11_shm_segment *shm,
+    xcb_connection_t *conn, const struct libxcb *xcb);
+
+static void queue_frame(struct x11_render_software_ctx *sw_rctx,
+    enum p_window_present_mode present_mode, const struct region *damage);
+static void add_queued_damage(struct x11_render_software_ctx *sw_rctx,
+    const struct region *damage);
+static bool present_queued_frame(struct x11_render_software_ctx *sw_rctx);
+static i32 present_buffer(struct x11_render_software_ctx *sw_rctx,
+    struct x11_render_software_buf *buf,
+    xcb_connection_t *conn, const struct libxcb *xcb,
+    enum p_window_present_mode present_mode, const struct region *damage);
 
 static void * malloced_present_thread_fn(void *arg);
+static i32 upload_malloced_frame(const struct x11_render_malloced_frame *frame,
+    const struct x11_render_software_generic_window_info *win_info,
+    pixel_t *scratch, u64 scratch_size,
+    xcb_connection_t *conn, const struct libxcb *xcb);
 
 i32 X11_render_init_software(struct x11_render_software_ctx *sw_rctx,
     u16 win_w, u16 win_h, u8 root_depth, u64 max_request_size,
     xcb_window_t win_handle, const struct x11_extension_store *ext_store,
     xcb_connection_t *conn, const struct libxcb *xcb,
+    u32 n_buffers, struct pc_present_timing *present_timing,
     bool *o_vsync_supported)
 {
+    s_assert(n_buffers >= 2 && n_buffers <= X11_SW_MAX_BUFFERS,
+        "Invalid number of buffers: %u", n_buffers);
+
     *o_vsync_supported = false;
     atomic_store(&sw_rctx->initialized_, true);
     atomic_flag_clear(&sw_rctx->present_pending);
@@ -158,7 +195,16 @@ i32 X11_render_init_software(struct x11_render_software_ctx *sw_rctx,
     atomic_store(&sw_rctx->shared_buf_data.shm.initialized_, false);
     atomic_store(&sw_rctx->shared_buf_data.present.initialized_, false);
 
-    for (u32 i = 0; i < 2; i++) {
+    sw_rctx->n_buffers = n_buffers;
+    sw_rctx->queued_buf = NULL;
+    region_clear(&sw_rctx->queued_damage);
+    sw_rctx->conn = conn;
+    sw_rctx->xcb = xcb;
+    atomic_store(&sw_rctx->n_coalesced_frames, 0);
+    atomic_store(&sw_rctx->n_dropped_frames, 0);
+    sw_rctx->present_timing = present_timing;
+
+    for (u32 i = 0; i < n_buffers; i++) {
         if (do_init_buffer(&sw_rctx->buffers[i], &sw_rctx->shared_buf_data,
             sw_rctx, &sw_rctx->generic_win_info, conn, xcb))
         {
@@ -180,9 +226,11 @@ i32 X11_render_init_software(struct x11_render_software_ctx *sw_rctx,
     }
 
     /* vsync is only supported by PRESENT_PIXMAP buffers */
-    *o_vsync_supported =
-        sw_rctx->buffers[0].type == X11_SWFB_PRESENT_PIXMAP &&
-        sw_rctx->buffers[1].type == X11_SWFB_PRESENT_PIXMAP;
+    *o_vsync_supported = true;
+    for (u32 i = 0; i < n_buffers; i++) {
+        if (sw_rctx->buffers[i].type != X11_SWFB_PRESENT_PIXMAP)
+            *o_vsync_supported = false;
+    }
 
     sw_rctx->curr_front_buf = &sw_rctx->buffers[0];
     sw_rctx->curr_back_buf = &sw_rctx->buffers[1];
@@ -193,52 +241,50 @@ i32 X11_render_init_software(struct x11_render_software_ctx *sw_rctx,
 struct pixel_flat_data * X11_render_present_software(
     struct x11_render_software_ctx *sw_rctx,
     xcb_connection_t *conn, const struct libxcb *xcb,
-    enum p_window_present_mode present_mode
+    enum p_window_present_mode present_mode, const struct region *damage
 )
 {
     /* We assume that `present_mode` has already been validated */
     u_check_params(atomic_load(&sw_rctx->initialized_));
 
-    if (atomic_flag_test_and_set(&sw_rctx->present_pending)) {
+    i32 swap_ret = 0;
+    struct x11_render_software_buf *const curr_buf = sw_rctx->curr_back_buf;
+    struct region merged_damage;
+
+    /* The malloced buffers are copied into the present thread's own queue,
+     * where a frame that comes in while the previous one is still
+     * being uploaded just waits (or gets merged with the next one),
+     * so there's no need to wait for the page flip.
+     * With more than 2 buffers, the others work the same way. */
+    if (curr_buf->type != X11_SWFB_MALLOCED_IMAGE && sw_rctx->n_buffers > 2) {
+        /* The listener thread only clears `present_pending`
+         * with the lock acquired, once nothing is queued anymore */
+        spinlock_acquire(&sw_rctx->swap_lock);
+        if (atomic_flag_test_and_set(&sw_rctx->present_pending)) {
+            queue_frame(sw_rctx, present_mode, damage);
+            spinlock_release(&sw_rctx->swap_lock);
+            return &sw_rctx->curr_back_buf->pixbuf;
+        }
+
+        /* Also cover the damage of any frames that failed to present */
+        if (damage != NULL && !region_empty(&sw_rctx->queued_damage)) {
+            region_add_region(&sw_rctx->queued_damage, damage);
+            merged_damage = sw_rctx->queued_damage;
+            damage = &merged_damage;
+        }
+        region_clear(&sw_rctx->queued_damage);
+        spinlock_release(&sw_rctx->swap_lock);
+    } else if (curr_buf->type != X11_SWFB_MALLOCED_IMAGE &&
+        atomic_flag_test_and_set(&sw_rctx->present_pending))
+    {
         s_log_trace("Another page flip is already in progress; "
             "droping this frame");
         return P_WINDOW_SWAP_BUFFERS_FAIL;
     }
     /* Reset after the page flip completes */
 
-    i32 swap_ret = 0;
-    struct x11_render_software_buf *const curr_buf = sw_rctx->curr_back_buf;
-
-
-    switch (curr_buf->type) {
-    case X11_SWFB_NULL:
-        s_log_fatal("Attempt to present an uninitialized buffer");
-    case X11_SWFB_MALLOCED_IMAGE:
-        swap_ret = software_present_malloced(&curr_buf->fb.malloced,
-            &sw_rctx->shared_buf_data.malloced);
-        /* `X11_render_software_finish_frame` get called
-         * by the special present thread when it completes a presentation */
-        break;
-    case X11_SWFB_SHMSEG:
-        swap_ret = software_present_shm(&curr_buf->fb.shm,
-            &sw_rctx->shared_buf_data.shm,
-            &sw_rctx->generic_win_info, conn, xcb);
-        /* `X11_render_software_finish_frame` gets called
-         * by the listener thread when it receives a SHM_COMPLETION event */
-        break;
-    case X11_SWFB_PRESENT_PIXMAP:
-        swap_ret = software_present_pixmap(&curr_buf->fb.present_pixmap,
-            &sw_rctx->shared_buf_data.present, present_mode,
-            &sw_rctx->generic_win_info, conn, xcb);
-        /* `X11_render_software_finish_frame` gets called
-         * by the listener thread when it receives a PRESENT_COMPLETE event */
-        break;
-    default:
-        s_log_fatal("Invalid buffer type %d", curr_buf->type);
-    }
-
-    if (xcb->xcb_flush(conn) <= 0)
-        s_log_error("xcb_flush failed!");
+    swap_ret = present_buffer(sw_rctx, curr_buf, conn, xcb,
+        present_mode, damage);
 
     if (swap_ret == 0) {
         /* Swap the buffers only if the page flip succeeded */
@@ -251,7 +297,13 @@ struct pixel_flat_data * X11_render_present_software(
         spinlock_release(&sw_rctx->swap_lock);
         s_log_trace("Page flip OK; swap buffers (new front: %p, new back: %p)",
             sw_rctx->curr_front_buf, sw_rctx->curr_back_buf);
-    } else {
+    } else if (curr_buf->type != X11_SWFB_MALLOCED_IMAGE) {
+        if (sw_rctx->n_buffers > 2) {
+            /* Keep the damage for whichever frame is presented next */
+            spinlock_acquire(&sw_rctx->swap_lock);
+            add_queued_damage(sw_rctx, damage);
+            spinlock_release(&sw_rctx->swap_lock);
+        }
         atomic_flag_clear(&sw_rctx->present_pending);
     }
 
@@ -264,6 +316,11 @@ void X11_render_destroy_software(struct x11_render_software_ctx *sw_rctx,
     if (sw_rctx == NULL || !atomic_exchange(&sw_rctx->initialized_, false))
         return;
 
+    /* Don't let the listener thread present anything new */
+    spinlock_acquire(&sw_rctx->swap_lock);
+    sw_rctx->queued_buf = NULL;
+    spinlock_release(&sw_rctx->swap_lock);
+
     if (atomic_flag_test_and_set(&sw_rctx->present_pending)) {
         s_log_debug("Buffer still in use; waiting...");
 
@@ -297,7 +354,7 @@ void X11_render_destroy_software(struct x11_render_software_ctx *sw_rctx,
         destroy_malloced_shared_data(&sw_rctx->shared_buf_data.malloced);
     }
 
-    for (u32 i = 0; i < 2; i++) {
+    for (u32 i = 0; i < sw_rctx->n_buffers; i++) {
         struct x11_render_software_buf *const curr_buf = &sw_rctx->buffers[i];
         switch (curr_buf->type) {
         case X11_SWFB_NULL: break;
@@ -326,16 +383,23 @@ void X11_render_destroy_software(struct x11_render_software_ctx *sw_rctx,
     }
 
     sw_rctx->curr_back_buf = sw_rctx->curr_front_buf = NULL;
+    sw_rctx->n_buffers = 0;
 }
 
 void X11_render_software_finish_frame(struct x11_render_software_ctx *sw_rctx,
-    bool status)
+    bool status, const struct pc_present_flip_info *flip_info)
 {
-    atomic_flag_clear(&sw_rctx->present_pending);
+    pc_present_timing_record_flip(sw_rctx->present_timing, status, flip_info);
+
+    /* If the next frame was already waiting, it's presented right away
+     * and the presentation stays pending */
+    const bool presented_next = present_queued_frame(sw_rctx);
     p_event_send(&(const struct p_event) {
         .type = P_EVENT_PAGE_FLIP,
         .info.page_flip_status = status
     });
+    if (presented_next)
+        return;
 
     i32 val = 0;
     if (sem_getvalue(&sw_rctx->present_pending_wait, &val))
@@ -348,6 +412,168 @@ void X11_render_software_finish_frame(struct x11_render_software_ctx *sw_rctx,
     }
 }
 
+void X11_render_software_get_present_stats(
+    const struct x11_render_software_ctx *sw_rctx,
+    struct p_window_present_stats *out)
+{
+    u_check_params(sw_rctx != NULL && out != NULL);
+
+    memset(out, 0, sizeof(struct p_window_present_stats));
+
+    const struct x11_render_shared_malloced_data *const malloced =
+        &sw_rctx->shared_buf_data.malloced;
+    if (atomic_load(&malloced->initialized_)) {
+        out->n_coalesced_frames = atomic_load(&malloced->n_coalesced_frames);
+        out->n_dropped_frames = atomic_load(&malloced->n_dropped_frames);
+    }
+
+    out->n_coalesced_frames += atomic_load(&sw_rctx->n_coalesced_frames);
+    out->n_dropped_frames += atomic_load(&sw_rctx->n_dropped_frames);
+}
+
+/* Must be called with `swap_lock` acquired, while a presentation
+ * is pending. Hands the back buffer over to be presented once
+ * the pending presentation completes, replacing the frame that was
+ * queued before (if any), and picks a new back buffer. */
+static void queue_frame(struct x11_render_software_ctx *sw_rctx,
+    enum p_window_present_mode present_mode, const struct region *damage)
+{
+    struct x11_render_software_buf *new_back_buf = NULL;
+
+    /* The damage is relative to the previous frame, so if that one
+     * never made it to the window, its damage has to be kept
+     * (which is why `queued_damage` is only cleared once
+     * a frame is taken out to be presented) */
+    if (sw_rctx->queued_buf != NULL) {
+        s_log_trace("Replacing the queued frame");
+        new_back_buf = sw_rctx->queued_buf;
+        atomic_fetch_add(&sw_rctx->n_coalesced_frames, 1);
+        pc_present_timing_record_coalesced(sw_rctx->present_timing);
+    } else {
+        for (u32 i = 0; i < sw_rctx->n_buffers; i++) {
+            struct x11_render_software_buf *const buf = &sw_rctx->buffers[i];
+            if (buf != sw_rctx->curr_front_buf &&
+                buf != sw_rctx->curr_back_buf)
+            {
+                new_back_buf = buf;
+                break;
+            }
+        }
+    }
+    s_assert(new_back_buf != NULL, "No free buffer to draw to");
+
+    add_queued_damage(sw_rctx, damage);
+    sw_rctx->queued_present_mode = present_mode;
+    sw_rctx->queued_buf = sw_rctx->curr_back_buf;
+    sw_rctx->curr_back_buf = new_back_buf;
+}
+
+/* Must be called with `swap_lock` acquired. Adds `damage`
+ * (or the whole window, if it's NULL) to `queued_damage`. */
+static void add_queued_damage(struct x11_render_software_ctx *sw_rctx,
+    const struct region *damage)
+{
+    if (damage != NULL) {
+        region_add_region(&sw_rctx->queued_damage, damage);
+    } else {
+        const rect_t full = {
+            0, 0, sw_rctx->generic_win_info.win_w,
+            sw_rctx->generic_win_info.win_h
+        };
+        region_add_rect(&sw_rctx->queued_damage, &full);
+    }
+}
+
+/* Called by the listener thread once a presentation completes.
+ * Presents the queued frame (if there is one) and returns true,
+ * or clears `present_pending` and returns false. */
+static bool present_queued_frame(struct x11_render_software_ctx *sw_rctx)
+{
+    while (true) {
+        spinlock_acquire(&sw_rctx->swap_lock);
+        struct x11_render_software_buf *const buf = sw_rctx->queued_buf;
+        const struct region damage = sw_rctx->queued_damage;
+        const enum p_window_present_mode present_mode =
+            sw_rctx->queued_present_mode;
+        sw_rctx->queued_buf = NULL;
+        if (buf == NULL) {
+            atomic_flag_clear(&sw_rctx->present_pending);
+            spinlock_release(&sw_rctx->swap_lock);
+            return false;
+        }
+        region_clear(&sw_rctx->queued_damage);
+
+        /* `buf` must become the front buffer before the lock is released,
+         * or else `queue_frame` could pick it as the next back buffer
+         * while it's being presented. The old front buffer isn't used
+         * anymore, since the presentation of it has just completed. */
+        struct x11_render_software_buf *const old_front_buf =
+            sw_rctx->curr_front_buf;
+        sw_rctx->curr_front_buf = buf;
+        spinlock_release(&sw_rctx->swap_lock);
+
+        if (present_buffer(sw_rctx, buf, sw_rctx->conn, sw_rctx->xcb,
+                present_mode, &damage) == 0)
+            return true;
+
+        /* Roll back, unless `queue_frame` has taken
+         * the old front buffer in the meantime. The window still shows
+         * the frame before this one, so whatever gets presented next
+         * also has to cover the damage of this frame. */
+        spinlock_acquire(&sw_rctx->swap_lock);
+        if (sw_rctx->curr_back_buf != old_front_buf &&
+            sw_rctx->queued_buf != old_front_buf)
+            sw_rctx->curr_front_buf = old_front_buf;
+        add_queued_damage(sw_rctx, &damage);
+        spinlock_release(&sw_rctx->swap_lock);
+
+        /* A newer frame might have been queued in the meantime */
+        s_log_error("Failed to present the queued frame");
+        atomic_fetch_add(&sw_rctx->n_dropped_frames, 1);
+        pc_present_timing_record_flip(sw_rctx->present_timing, 1, NULL);
+    }
+}
+
+static i32 present_buffer(struct x11_render_software_ctx *sw_rctx,
+    struct x11_render_software_buf *buf,
+    xcb_connection_t *conn, const struct libxcb *xcb,
+    enum p_window_present_mode present_mode, const struct region *damage)
+{
+    i32 ret = 0;
+
+    switch (buf->type) {
+    case X11_SWFB_NULL:
+        s_log_fatal("Attempt to present an uninitialized buffer");
+    case X11_SWFB_MALLOCED_IMAGE:
+        ret = software_present_malloced(&buf->fb.malloced,
+            &sw_rctx->shared_buf_data.malloced, damage);
+        /* `X11_render_software_finish_frame` get called
+         * by the special present thread when it completes a presentation */
+        break;
+    case X11_SWFB_SHMSEG:
+        ret = software_present_shm(&buf->fb.shm,
+            &sw_rctx->shared_buf_data.shm,
+            &sw_rctx->generic_win_info, damage, conn, xcb);
+        /* `X11_render_software_finish_frame` gets called
+         * by the listener thread when it receives a SHM_COMPLETION event */
+        break;
+    case X11_SWFB_PRESENT_PIXMAP:
+        ret = software_present_pixmap(&buf->fb.present_pixmap,
+            &sw_rctx->shared_buf_data.present, present_mode,
+            &sw_rctx->generic_win_info, damage, conn, xcb);
+        /* `X11_render_software_finish_frame` gets called
+         * by the listener thread when it receives a PRESENT_COMPLETE event */
+        break;
+    default:
+        s_log_fatal("Invalid buffer type %d", buf->type);
+    }
+
+    if (xcb->xcb_flush(conn) <= 0)
+        s_log_error("xcb_flush failed!");
+
+    return ret;
+}
+
 static i32 software_init_buffer_malloced(
     struct x11_render_software_malloced_image_buf *buffer_o,
     struct pixel_flat_data *pixbuf_o,
@@ -368,6 +594,7 @@ static i32 software_init_buffer_malloced(
     /* Fill in the pixel data struct */
     pixbuf_o->w = win_info->win_w;
     pixbuf_o->h = win_info->win_h;
+    pixbuf_o->stride = win_info->win_w;
     pixbuf_o->buf = buffer_o->buf;
 
     return 0;
@@ -393,7 +620,7 @@ static i32 software_init_buffer_shm(
     buffer_o->h = win_info->win_h;
 
     /* Initialize the shm segment */
-    if (attach_shm(&buffer_o->shm_info, win_info->win_w, win_info->win_h,
+    if (attach_shm(&buffer_o->shm, win_info->win_w, win_info->win_h,
             win_info->ext_store, conn, xcb))
     {
         s_log_error("Failed to initialize the shared memory segment");
@@ -403,7 +630,8 @@ static i32 software_init_buffer_shm(
     /* Fill in the pixel data struct */
     pixbuf_o->w = win_info->win_w;
     pixbuf_o->h = win_info->win_h;
-    pixbuf_o->buf = (pixel_t *)buffer_o->shm_info.shmaddr;
+    pixbuf_o->stride = win_info->win_w;
+    pixbuf_o->buf = buffer_o->shm.addr;
 
     return 0;
 }
@@ -428,7 +656,7 @@ static i32 software_init_buffer_pixmap(
         return -1;
     }
 
-    if (attach_shm(&buffer_o->shm_info, win_info->win_w, win_info->win_h,
+    if (attach_shm(&buffer_o->shm, win_info->win_w, win_info->win_h,
             win_info->ext_store, conn, xcb))
     {
         s_log_error("Failed to initialize the shared memory segment");
@@ -445,7 +673,7 @@ static i32 software_init_buffer_pixmap(
     xcb_void_cookie_t vc = xcb->shm.xcb_shm_create_pixmap_checked(
         conn, buffer_o->pixmap, win_info->win_handle,
         win_info->win_w, win_info->win_h, win_info->root_depth,
-        buffer_o->shm_info.shmseg, 0
+        buffer_o->shm.shmseg, 0
     );
     xcb_generic_error_t *e = xcb->xcb_request_check(conn, vc);
     if (e != NULL) {
@@ -456,30 +684,69 @@ static i32 software_init_buffer_pixmap(
 
     pixbuf_o->w = win_info->win_w;
     pixbuf_o->h = win_info->win_h;
-    pixbuf_o->buf = (pixel_t *)buffer_o->shm_info.shmaddr;
+    pixbuf_o->stride = win_info->win_w;
+    pixbuf_o->buf = buffer_o->shm.addr;
 
     return 0;
 }
 
 static i32 software_present_malloced(
     const struct x11_render_software_malloced_image_buf *buf,
-    struct x11_render_shared_malloced_data *shared_data
+    struct x11_render_shared_malloced_data *shared_data,
+    const struct region *damage
 )
 {
     if (!atomic_load(&shared_data->present_thread_ready)) {
         s_log_warn("Present thread is not yet ready; dropping frame");
+        atomic_fetch_add(&shared_data->n_dropped_frames, 1);
         return 1;
     }
 
-    if (atomic_load(&shared_data->present_request_buffer) != NULL) {
-        (void) pthread_cond_signal(&shared_data->present_request_cond);
-        s_log_warn("Present thread is busy; dropping frame");
-        return 1;
+    const rect_t buf_rect = { 0, 0, buf->w, buf->h };
+
+    (void) pthread_mutex_lock(&shared_data->present_request_mutex);
+
+    i32 index = shared_data->queued_frame;
+    struct x11_render_malloced_frame *frame = NULL;
+    if (index != -1) {
+        /* The previous frame hasn't even started uploading yet,
+         * so instead of waiting, merge this one into it.
+         * Its damage is only relative to the previous frame,
+         * so the changes of both of them have to be uploaded. */
+        frame = &shared_data->frames[index];
+        atomic_fetch_add(&shared_data->n_coalesced_frames, 1);
+        pc_present_timing_record_coalesced(
+            shared_data->const_data.ro_sw_rctx_handle->present_timing);
+        s_log_trace("Present thread is busy; merging with the queued frame");
+    } else {
+        index = (shared_data->uploading_frame + 1) % X11_MALLOCED_N_FRAMES;
+        frame = &shared_data->frames[index];
+        region_clear(&frame->damage);
     }
 
-    atomic_store(&shared_data->present_request_buffer, buf);
-    s_log_trace("present_pending -> true");
+    if (damage != NULL) {
+        region_add_region(&frame->damage, damage);
+        region_clip(&frame->damage, &buf_rect);
+    } else {
+        region_clear(&frame->damage);
+        region_add_rect(&frame->damage, &buf_rect);
+    }
+
+    /* The rects may get merged into bigger ones when they're added,
+     * so copy everything that the region covers now.
+     * `buf` has all of the pixels of the latest frame, so that's fine. */
+    for (u32 i = 0; i < frame->damage.n_rects; i++) {
+        const rect_t *const r = &frame->damage.rects[i];
+        for (i32 y = r->y; y < r->y + (i32)r->h; y++) {
+            const u64 offset = (u64)y * buf->w + r->x;
+            memcpy(frame->buf + offset, buf->buf + offset,
+                r->w * sizeof(pixel_t));
+        }
+    }
+
+    shared_data->queued_frame = index;
     (void) pthread_cond_signal(&shared_data->present_request_cond);
+    (void) pthread_mutex_unlock(&shared_data->present_request_mutex);
 
     return 0;
 }
@@ -488,32 +755,55 @@ static i32 software_present_shm(
     const struct x11_render_software_shm_buf *buf,
     struct x11_render_shared_shm_data *shared_data,
     const struct x11_render_software_generic_window_info *win_info,
+    const struct region *damage,
     xcb_connection_t *conn, const struct libxcb *xcb
 )
 {
     const xcb_drawable_t TARGET_DRAWABLE = win_info->win_handle;
     const xcb_gcontext_t TARGET_GC = win_info->win_gc;
 
+    /* Only upload the parts of the image that actually changed,
+     * with one request per damaged rect. Even if nothing changed,
+     * we still have to send something to get the completion event,
+     * so in that case just send one (unchanged) pixel. */
+    const rect_t buf_rect = { 0, 0, buf->w, buf->h };
+    struct region upload;
+    region_clear(&upload);
+    if (damage != NULL) {
+        region_add_region(&upload, damage);
+        region_clip(&upload, &buf_rect);
+    } else {
+        region_add_rect(&upload, &buf_rect);
+    }
+    if (region_empty(&upload))
+        region_add_rect(&upload, &(const rect_t) { 0, 0, 1, 1 });
+
     const u16 TOTAL_SRC_IMAGE_W = buf->w;
     const u16 TOTAL_SRC_IMAGE_H = buf->h;
-    const u16 SRC_X = 0, SRC_Y = 0;
-    const u16 SRC_W = buf->w;
-    const u16 SRC_H = buf->h;
-
-    const i16 DST_X = 0, DST_Y = 0;
     const u8 DST_DEPTH = buf->root_depth;
     const u8 DST_IMAGE_FORMAT = XCB_IMAGE_FORMAT_Z_PIXMAP;
-
-    const u8 SEND_BLIT_COMPLETE_EVENT = true;
-    const xcb_shm_seg_t SHMSEG = buf->shm_info.shmseg;
+    const xcb_shm_seg_t SHMSEG = buf->shm.shmseg;
     const u32 SRC_START_OFFSET = 0;
 
-    xcb_void_cookie_t cookie = xcb->shm.xcb_shm_put_image(
-        conn, TARGET_DRAWABLE, TARGET_GC,
-        TOTAL_SRC_IMAGE_W, TOTAL_SRC_IMAGE_H, SRC_X, SRC_Y, SRC_W, SRC_H,
-        DST_X, DST_Y, DST_DEPTH, DST_IMAGE_FORMAT,
-        SEND_BLIT_COMPLETE_EVENT, SHMSEG, SRC_START_OFFSET
-    );
+    xcb_void_cookie_t cookie = { 0 };
+    for (u32 i = 0; i < upload.n_rects; i++) {
+        const rect_t *const r = &upload.rects[i];
+
+        const u16 SRC_X = r->x, SRC_Y = r->y;
+        const u16 SRC_W = r->w, SRC_H = r->h;
+        const i16 DST_X = r->x, DST_Y = r->y;
+
+        /* The requests are processed in order, so the completion
+         * of the last one means that all of them are done */
+        const u8 SEND_BLIT_COMPLETE_EVENT = i == upload.n_rects - 1;
+
+        cookie = xcb->shm.xcb_shm_put_image(
+            conn, TARGET_DRAWABLE, TARGET_GC,
+            TOTAL_SRC_IMAGE_W, TOTAL_SRC_IMAGE_H, SRC_X, SRC_Y, SRC_W, SRC_H,
+            DST_X, DST_Y, DST_DEPTH, DST_IMAGE_FORMAT,
+            SEND_BLIT_COMPLETE_EVENT, SHMSEG, SRC_START_OFFSET
+        );
+    }
     atomic_store(&shared_data->blit_request_sequence_number, cookie.sequence);
 
     return 0;
@@ -524,6 +814,7 @@ static i32 software_present_pixmap(
     struct x11_render_shared_present_data *shared_data,
     enum p_window_present_mode present_mode,
     const struct x11_render_software_generic_window_info *win_info,
+    const struct region *damage,
     xcb_connection_t *conn, const struct libxcb *xcb
 )
 {
@@ -536,9 +827,33 @@ static i32 software_present_pixmap(
      * (the whole pixmap) */
     const xcb_xfixes_region_t VALID_PIXMAP_REGION = XCB_NONE;
 
-    /* The region of the window that we mark as "ready for update"
-     * (the whole window) */
-    const xcb_xfixes_region_t WINDOW_UPDATE_REGION = XCB_NONE;
+    /* The region of the window that we mark as "ready for update".
+     * The X server only copies this part of the pixmap, so make it
+     * the damage of the frame whenever we can (the whole window otherwise).
+     * Only one presentation is ever pending, and the server takes a copy
+     * of the region anyway, so we can just keep reusing the same one. */
+    xcb_xfixes_region_t WINDOW_UPDATE_REGION = XCB_NONE;
+    const xcb_xfixes_region_t update_region =
+        atomic_load(&shared_data->update_region);
+    if (damage != NULL && update_region != XCB_NONE) {
+        const rect_t win_rect = { 0, 0, buf->w, buf->h };
+        struct region clipped = *damage;
+        region_clip(&clipped, &win_rect);
+
+        xcb_rectangle_t rects[REGION_MAX_RECTS];
+        for (u32 i = 0; i < clipped.n_rects; i++) {
+            rects[i] = (xcb_rectangle_t) {
+                .x = clipped.rects[i].x,
+                .y = clipped.rects[i].y,
+                .width = clipped.rects[i].w,
+                .height = clipped.rects[i].h,
+            };
+        }
+
+        (void) xcb->xfixes.xcb_xfixes_set_region(conn, update_region,
+            clipped.n_rects, rects);
+        WINDOW_UPDATE_REGION = update_region;
+    }
 
     /* The offset (from the top-left corner of the window)
      * at which the pixmap will be drawn */
@@ -600,7 +915,7 @@ static void software_destroy_buffer_shm(
 {
     buf->root_depth = buf->w = buf->h = 0;
 
-    detach_shm(&buf->shm_info, conn, xcb);
+    detach_shm(&buf->shm, conn, xcb);
 }
 
 static void software_destroy_buffer_pixmap(
@@ -621,7 +936,7 @@ static void software_destroy_buffer_pixmap(
         buf->pixmap = XCB_NONE;
     }
 
-    detach_shm(&buf->shm_info, conn, xcb);
+    detach_shm(&buf->shm, conn, xcb);
 }
 
 static i32 do_init_buffer(struct x11_render_software_buf *buf,
@@ -641,7 +956,7 @@ static i32 do_init_buffer(struct x11_render_software_buf *buf,
          * between all buffers (related to the present extension) */
         if (!atomic_load(&shared_buf_data->present.initialized_) &&
             init_present_shared_data(&shared_buf_data->present,
-                win_info->win_handle, conn, xcb)
+                win_info, conn, xcb)
         ) {
             s_log_error("Failed to init SWFB_PRESENT_PIXMAP shared data");
             destroy_present_shared_data(&shared_buf_data->present,
@@ -717,11 +1032,44 @@ static i32 init_malloced_shared_data(
     shared_data->const_data.ro_sw_rctx_handle = ro_sw_rctx_handle;
     shared_data->const_data.conn = conn;
 
+    /* Always returns 0 */
     (void) pthread_mutex_init(&shared_data->present_request_mutex, NULL);
     (void) pthread_cond_init(&shared_data->present_request_cond, NULL);
-    atomic_store(&shared_data->present_request_buffer, NULL);
     atomic_store(&shared_data->present_thread_ready, false);
-    (void) atomic_flag_test_and_set(&shared_data->present_thread_running);
+    atomic_store(&shared_data->present_thread_running, false);
+
+    shared_data->queued_frame = shared_data->uploading_frame = -1;
+    atomic_store(&shared_data->n_coalesced_frames, 0);
+    atomic_store(&shared_data->n_dropped_frames, 0);
+
+    for (u32 i = 0; i < X11_MALLOCED_N_FRAMES; i++)
+        shared_data->frames[i].buf = NULL;
+    shared_data->upload_scratch = NULL;
+
+    const u64 n_pixels = (u64)win_info->win_w * win_info->win_h;
+    for (u32 i = 0; i < X11_MALLOCED_N_FRAMES; i++) {
+        region_clear(&shared_data->frames[i].damage);
+        shared_data->frames[i].buf = calloc(n_pixels, sizeof(pixel_t));
+        if (shared_data->frames[i].buf == NULL) {
+            s_log_error("Failed to allocate the upload queue");
+            return 1;
+        }
+    }
+
+    /* A single request never carries more than this */
+    u64 max_data_size = 0;
+    if (win_info->max_request_size > sizeof(xcb_put_image_request_t)) {
+        max_data_size =
+            win_info->max_request_size - sizeof(xcb_put_image_request_t);
+    }
+    shared_data->upload_scratch_size =
+        u_min(max_data_size / sizeof(pixel_t), n_pixels);
+    shared_data->upload_scratch =
+        malloc(u_max(shared_data->upload_scratch_size, 1) * sizeof(pixel_t));
+    if (shared_data->upload_scratch == NULL) {
+        s_log_error("Failed to allocate the upload scratch buffer");
+        return 1;
+    }
 
     struct x11_render_software_malloced_present_thread_arg *thread_arg =
         malloc(sizeof(struct x11_render_software_malloced_present_thread_arg));
@@ -734,10 +1082,12 @@ static i32 init_malloced_shared_data(
         sizeof(struct x11_render_software_generic_window_info));
     thread_arg->xcb = xcb;
 
+    atomic_store(&shared_data->present_thread_running, true);
     i32 ret = pthread_create(&shared_data->present_thread, NULL,
         malloced_present_thread_fn, thread_arg);
     if (ret != 0) {
-        atomic_flag_clear(&shared_data->present_thread_running);
+        atomic_store(&shared_data->present_thread_running, false);
+        u_nfree(&thread_arg);
         s_log_error("Failed to create the malloced buffer present thread: %s",
             strerror(ret));
         return 1;
@@ -756,11 +1106,16 @@ static void destroy_malloced_shared_data(
         return;
     atomic_store(&shared_data->initialized_, false);
 
-    atomic_flag_clear(&shared_data->present_thread_running);
+    /* The thread might've never been started */
+    if (!atomic_exchange(&shared_data->present_thread_running, false))
+        goto thread_joined;
 
+    /* Lock the mutex so that the thread can't miss the signal
+     * between checking `present_thread_running` and waiting */
+    (void) pthread_mutex_lock(&shared_data->present_request_mutex);
     /* always successful */
     (void) pthread_cond_signal(&shared_data->present_request_cond);
-
+    (void) pthread_mutex_unlock(&shared_data->present_request_mutex);
 
     struct timespec thread_timeout;
     if (clock_gettime(CLOCK_REALTIME, &thread_timeout)) {
@@ -783,6 +1138,7 @@ static void destroy_malloced_shared_data(
         pthread_kill(shared_data->present_thread, SIGKILL);
     } /* else OK */
 
+thread_joined:
     shared_data->present_thread = 0;
     atomic_store(&shared_data->present_thread_ready, false);
 
@@ -797,7 +1153,13 @@ static void destroy_malloced_shared_data(
     s_assert(pthread_cond_destroy(&shared_data->present_request_cond) == 0,
         "impossible outcome");
 
-    atomic_store(&shared_data->present_request_buffer, NULL);
+    for (u32 i = 0; i < X11_MALLOCED_N_FRAMES; i++) {
+        if (shared_data->frames[i].buf != NULL)
+            u_nfree(&shared_data->frames[i].buf);
+    }
+    if (shared_data->upload_scratch != NULL)
+        u_nfree(&shared_data->upload_scratch);
+    shared_data->queued_frame = shared_data->uploading_frame = -1;
 
     shared_data->const_data.ro_sw_rctx_handle = NULL;
     shared_data->const_data.conn = NULL;
@@ -829,7 +1191,8 @@ static void destroy_shm_shared_data(
 
 static i32 init_present_shared_data(
     struct x11_render_shared_present_data *shared_data,
-    xcb_window_t win_handle, xcb_connection_t *conn, const struct libxcb *xcb
+    const struct x11_render_software_generic_window_info *win_info,
+    xcb_connection_t *conn, const struct libxcb *xcb
 )
 {
     if (atomic_load(&shared_data->initialized_)) {
@@ -845,7 +1208,7 @@ static i32 init_present_shared_data(
     atomic_store(&shared_data->event_context_id, XCB_NONE);
     xcb_present_event_t tmp_event_context_id = xcb->xcb_generate_id(conn);
     xcb_void_cookie_t vc = xcb->present.xcb_present_select_input_checked(
-        conn, tmp_event_context_id, win_handle,
+        conn, tmp_event_context_id, win_info->win_handle,
         XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY
     );
     xcb_generic_error_t *e = NULL;
@@ -858,6 +1221,16 @@ static i32 init_present_shared_data(
         atomic_store(&shared_data->event_context_id, tmp_event_context_id);
     }
 
+    /* Without an update region, every presentation
+     * just copies the whole pixmap */
+    atomic_store(&shared_data->update_region, XCB_NONE);
+    if (ret == 0 && create_update_region(&shared_data->update_region,
+            win_info->ext_store, conn, xcb))
+    {
+        s_log_warn("Failed to create the Present update region; "
+            "the whole window will be updated on every frame");
+    }
+
     return ret;
 }
 
@@ -890,61 +1263,195 @@ static void destroy_present_shared_data(
         }
     }
 
+    const xcb_xfixes_region_t update_region_value =
+        atomic_load(&shared_data->update_region);
+    if (update_region_value != XCB_NONE) {
+        atomic_store(&shared_data->update_region, XCB_NONE);
+        (void) xcb->xfixes.xcb_xfixes_destroy_region(conn,
+            update_region_value);
+    }
+
     atomic_store(&shared_data->serial, 0);
 }
 
-static i32 attach_shm(xcb_shm_segment_info_t *shm_o, u32 w, u32 h,
+static i32 create_update_region(_Atomic xcb_xfixes_region_t *region_o,
     const struct x11_extension_store *ext_store,
     xcb_connection_t *conn, const struct libxcb *xcb)
 {
+    if (!X11_extension_is_available(ext_store, X11_EXT_XFIXES)) {
+        s_log_debug("The XFixes extension is not available");
+        return 1;
+    }
+
+    /* The client has to tell the server which version of XFixes
+     * it supports before making any other requests.
+     * Regions were added in 2.0. */
+    xcb_xfixes_query_version_cookie_t cookie =
+        xcb->xfixes.xcb_xfixes_query_version(conn, 2, 0);
+    xcb_xfixes_query_version_reply_t *reply =
+        xcb->xfixes.xcb_xfixes_query_version_reply(conn, cookie, NULL);
+    if (reply == NULL) {
+        s_log_error("xcb_xfixes_query_version failed!");
+        return 1;
+    } else if (reply->major_version < 2) {
+        s_log_error("The XFixes extension version (%u.%u) is too old - "
+            "the required is at least 2.0",
+            reply->major_version, reply->minor_version);
+        u_nfree(&reply);
+        return 1;
+    }
+    u_nfree(&reply);
+
+    const xcb_xfixes_region_t region = xcb->xcb_generate_id(conn);
+    xcb_void_cookie_t vc = xcb->xfixes.xcb_xfixes_create_region_checked(
+        conn, region, 0, NULL);
+    xcb_generic_error_t *e = NULL;
+    if (e = xcb->xcb_request_check(conn, vc), e != NULL) {
+        s_log_error("xcb_xfixes_create_region failed");
+        u_nfree(&e);
+        return 1;
+    }
+
+    atomic_store(region_o, region);
+    return 0;
+}
+
+static i32 attach_shm(struct x11_shm_segment *shm_o, u32 w, u32 h,
+    const struct x11_extension_store *ext_store,
+    xcb_connection_t *conn, const struct libxcb *xcb)
+{
+    shm_o->shmseg = XCB_NONE;
+    shm_o->addr = NULL;
+    shm_o->size = (u64)w * h * sizeof(pixel_t);
+    shm_o->is_sysv = false;
+
     if (!X11_extension_is_available(ext_store, X11_EXT_SHM)) {
         s_log_error("The MIT-SHM extension is not available!");
         return -1;
     }
 
-    shm_o->shmaddr = (void *)-1;
-    shm_o->shmseg = -1;
+    /* A memfd isn't limited by `shmmax`, and it goes away together
+     * with the last process that has it mapped, even after a crash.
+     * Passing file descriptors needs MIT-SHM 1.2 though,
+     * so fall back to SysV shared memory if the server can't do that. */
+    if (attach_shm_memfd(shm_o, conn, xcb) == 0)
+        return 0;
 
-    const u64 seg_size = w * h * sizeof(pixel_t);
+    s_log_debug("Couldn't share a memfd with the X server; "
+        "falling back to SysV shared memory");
+    detach_shm(shm_o, conn, xcb);
+    shm_o->is_sysv = true;
 
+    if (attach_shm_sysv(shm_o, conn, xcb) == 0)
+        return 0;
+
+    detach_shm(shm_o, conn, xcb);
+    return 1;
+}
+
+static i32 attach_shm_memfd(struct x11_shm_segment *shm_o,
+    xcb_connection_t *conn, const struct libxcb *xcb)
+{
+    /* libxcb shuts down the whole connection if the fd can't be sent */
+    if (!can_pass_fds(conn, xcb)) {
+        s_log_debug("The X server connection isn't local");
+        return 1;
+    }
+
+    i32 fd = memfd_create("cgd-x11-shm", MFD_CLOEXEC);
+    if (fd == -1)
+        goto_error("Failed to create the memfd: %s", strerror(errno));
+
+    if (ftruncate(fd, shm_o->size))
+        goto_error("Failed to resize the memfd: %s", strerror(errno));
+
+    /* The memfd starts out filled with zeroes,
+     * so there's no need to clear it */
+    void *const addr = mmap(NULL, shm_o->size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        goto_error("Failed to map the memfd: %s", strerror(errno));
+    shm_o->addr = addr;
+
+    /* libxcb takes over (and closes) the fd once it's sent */
+    shm_o->shmseg = xcb->xcb_generate_id(conn);
+    xcb_void_cookie_t vc = xcb->shm.xcb_shm_attach_fd_checked(conn,
+        shm_o->shmseg, fd, false);
+    fd = -1;
+
+    xcb_generic_error_t *e = NULL;
+    if (e = xcb->xcb_request_check(conn, vc), e != NULL) {
+        u_nzfree(&e);
+        shm_o->shmseg = XCB_NONE;
+        goto_error("XCB failed to attach the memfd");
+    }
+
+    return 0;
+
+err:
+    if (fd != -1)
+        close(fd);
+    return 1;
+}
+
+/* File descriptors can only be sent over unix domain sockets */
+static bool can_pass_fds(xcb_connection_t *conn, const struct libxcb *xcb)
+{
+    struct sockaddr_storage addr = { 0 };
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(xcb->xcb_get_file_descriptor(conn),
+            (struct sockaddr *)&addr, &addr_len))
+        return false;
+
+    return addr.ss_family == AF_UNIX;
+}
+
+static i32 attach_shm_sysv(struct x11_shm_segment *shm_o,
+    xcb_connection_t *conn, const struct libxcb *xcb)
+{
     /* Create the shmseg */
-    shm_o->shmid = shmget(IPC_PRIVATE, seg_size, IPC_CREAT | 0600);
-    if ((i32)shm_o->shmid == -1)
+    const i32 shmid = shmget(IPC_PRIVATE, shm_o->size, IPC_CREAT | 0600);
+    if (shmid == -1)
         goto_error("Failed to create shared memory: %s", strerror(errno));
 
     /* Attach (map) the segment to our address space */
-    shm_o->shmaddr = shmat(shm_o->shmid, NULL, 0);
-    if (shm_o->shmaddr == (void *)-1)
+    void *const addr = shmat(shmid, NULL, 0);
+    if (addr == (void *)-1) {
+        (void) shmctl(shmid, IPC_RMID, NULL);
         goto_error("Failed to attach shared memory: %s", strerror(errno));
+    }
+    shm_o->addr = addr;
 
     /* Fill the shmseg (pixel buffer) with zeroes */
-    memset(shm_o->shmaddr, 0, seg_size);
+    memset(shm_o->addr, 0, shm_o->size);
 
     shm_o->shmseg = xcb->xcb_generate_id(conn);
 
     /* Attach the segment to the X server */
-    xcb_void_cookie_t vc = xcb->shm.xcb_shm_attach_checked( conn,
-        shm_o->shmseg, shm_o->shmid, false);
+    xcb_void_cookie_t vc = xcb->shm.xcb_shm_attach_checked(conn,
+        shm_o->shmseg, shmid, false);
     xcb_generic_error_t *e = NULL;
     if (e = xcb->xcb_request_check(conn, vc), e != NULL) {
         u_nzfree(&e);
-        goto_error("XCB failed to attach the shm segment"); }
+        shm_o->shmseg = XCB_NONE;
+        (void) shmctl(shmid, IPC_RMID, NULL);
+        goto_error("XCB failed to attach the shm segment");
+    }
 
-    if (shmctl(shm_o->shmid, IPC_RMID, NULL))
+    if (shmctl(shmid, IPC_RMID, NULL))
         goto_error("Failed to mark the shm segment to be destroyed "
             "(after the last process detaches): %s", strerror(errno));
 
     return 0;
 
 err:
-    detach_shm(shm_o, conn, xcb);
     return 1;
 }
 
-static void detach_shm(xcb_shm_segment_info_t *shm,
+static void detach_shm(struct x11_shm_segment *shm,
     xcb_connection_t *conn, const struct libxcb *xcb)
 {
-    if (xcb->shm.loaded_) {
+    if (xcb->shm.loaded_ && shm->shmseg != XCB_NONE) {
         xcb_void_cookie_t vc = xcb->shm.xcb_shm_detach(conn, shm->shmseg);
         xcb_generic_error_t *e = xcb->xcb_request_check(conn, vc);
         if (e) {
@@ -955,12 +1462,14 @@ static void detach_shm(xcb_shm_segment_info_t *shm,
             s_log_error("xcb_flush failed!");
     }
 
-    if (shm->shmaddr != (void *)-1 && shm->shmaddr != NULL) {
-        shmdt(shm->shmaddr);
-        shm->shmaddr = (void *)-1;
+    if (shm->addr != NULL) {
+        if (shm->is_sysv)
+            shmdt(shm->addr);
+        else
+            munmap(shm->addr, shm->size);
+        shm->addr = NULL;
     }
-    shm->shmid = -1;
-    shm->shmseg = -1;
+    shm->shmseg = XCB_NONE;
 }
 
 static void * malloced_present_thread_fn(void *arg_voidp_)
@@ -982,69 +1491,97 @@ static void * malloced_present_thread_fn(void *arg_voidp_)
 
     (void) pthread_mutex_lock(&sd->present_request_mutex);
     atomic_store(&sd->present_thread_ready, true);
-    goto first_run_entry;
 
     while (true) {
-        (void) pthread_mutex_lock(&sd->present_request_mutex);
-first_run_entry:
-        (void) pthread_cond_wait(&sd->present_request_cond,
-            &sd->present_request_mutex);
-        (void) pthread_mutex_unlock(&sd->present_request_mutex);
-        if (!atomic_flag_test_and_set(&sd->present_thread_running)) {
-            atomic_flag_clear(&sd->present_thread_running);
-            break;
+        while (sd->queued_frame == -1 &&
+            atomic_load(&sd->present_thread_running))
+        {
+            (void) pthread_cond_wait(&sd->present_request_cond,
+                &sd->present_request_mutex);
         }
+        if (!atomic_load(&sd->present_thread_running))
+            break;
+
+        /* Take the queued frame, so that the next one
+         * can be copied into the other slot in the meantime */
+        const i32 index = sd->queued_frame;
+        sd->uploading_frame = index;
+        sd->queued_frame = -1;
+        (void) pthread_mutex_unlock(&sd->present_request_mutex);
+
+        s_log_trace("THREAD: uploading frame %i", index);
+        const i32 ret = upload_malloced_frame(&sd->frames[index], &wi,
+            sd->upload_scratch, sd->upload_scratch_size, conn, xcb);
+        if (ret != 0)
+            atomic_fetch_add(&sd->n_dropped_frames, 1);
+
+        s_log_trace("THREAD: done presenting frame %i", index);
+        X11_render_software_finish_frame(sw_rctx_handle__, ret != 0, NULL);
+
+        (void) pthread_mutex_lock(&sd->present_request_mutex);
+        sd->uploading_frame = -1;
+    }
+    (void) pthread_mutex_unlock(&sd->present_request_mutex);
+
+    s_log_debug("Exiting...");
+    pthread_exit(NULL);
+}
 
-        s_assert(atomic_load(&sd->present_request_buffer) != NULL,
-            "Present request cond signaled without a buffer to present");
+/* Sends the damaged parts of `frame` to the window with `xcb_put_image`,
+ * split up into requests that fit into the maximum request size */
+static i32 upload_malloced_frame(const struct x11_render_malloced_frame *frame,
+    const struct x11_render_software_generic_window_info *win_info,
+    pixel_t *scratch, u64 scratch_size,
+    xcb_connection_t *conn, const struct libxcb *xcb)
+{
+    const u8 FORMAT = XCB_IMAGE_FORMAT_Z_PIXMAP;
+    const xcb_drawable_t DST_DRAWABLE = win_info->win_handle;
+    const xcb_gcontext_t GC = win_info->win_gc;
+    const u8 LEFT_PAD = 0;
+    const u8 DEPTH = win_info->root_depth;
 
-        const struct x11_render_software_malloced_image_buf *const buf =
-            atomic_load(&sd->present_request_buffer);
+    for (u32 i = 0; i < frame->damage.n_rects; i++) {
+        const rect_t *const r = &frame->damage.rects[i];
 
         /* Check that we can at least send a single row of pixels */
-        const u64 max_data_size =
-            wi.max_request_size - sizeof(xcb_put_image_request_t);
-        const u64 rows_per_request = max_data_size / (buf->w * sizeof(pixel_t));
+        const u64 rows_per_request = scratch_size / r->w;
         if (rows_per_request == 0) {
-            s_log_error("The maximum request size is too small to send even"
+            s_log_error("The maximum request size is too small to send even "
                 "1 row of pixels. Dropping the frame.");
-            s_log_trace("THREAD: present_pending -> false");
-            atomic_store(&sd->present_request_buffer, NULL);
-            X11_render_software_finish_frame(sw_rctx_handle__, 1);
-            continue;
+            return 1;
         }
 
-        const u8 FORMAT = XCB_IMAGE_FORMAT_Z_PIXMAP;
-        const xcb_drawable_t DST_DRAWABLE = wi.win_handle;
-        const xcb_gcontext_t GC = wi.win_gc;
-        const u16 WIDTH = buf->w;
-        const i16 DST_X = 0;
-        const u8 LEFT_PAD = 0;
-        const u8 DEPTH = 24;
-
-        /* Split up the request into smaller chunks so that it can
-         * be handle by the X socket connection */
-        for (u32 y = 0; y < buf->h; y++) {
-            u16 height = buf->h - y;
-            if (height > rows_per_request)
-                height = rows_per_request;
-
-            const u32 data_len = height * WIDTH * sizeof(pixel_t);
-            u8 *const data = (u8 *)buf->buf + (y * WIDTH * sizeof(pixel_t));
-
+        /* Split up the rect into smaller chunks so that they can
+         * be handled by the X socket connection */
+        u16 height = 0;
+        for (u32 y = 0; y < r->h; y += height) {
+            height = u_min(r->h - y, rows_per_request);
+
+            /* The rows of a chunk only follow one another in the frame
+             * if they're as wide as the window; otherwise they have to be
+             * put together first */
+            const pixel_t *data =
+                frame->buf + (u64)(r->y + y) * win_info->win_w + r->x;
+            if (r->w != win_info->win_w) {
+                for (u32 row = 0; row < height; row++) {
+                    memcpy(scratch + (u64)row * r->w,
+                        data + (u64)row * win_info->win_w,
+                        r->w * sizeof(pixel_t));
+                }
+                data = scratch;
+            }
+
+            const u32 data_len = height * r->w * sizeof(pixel_t);
             xcb->xcb_put_image(conn, FORMAT, DST_DRAWABLE, GC,
-                WIDTH, height, DST_X, y, LEFT_PAD, DEPTH,
-                data_len, data);
+                r->w, height, r->x, r->y + y, LEFT_PAD, DEPTH,
+                data_len, (const u8 *)data);
         }
-        if (xcb->xcb_flush(conn))
-            s_log_error("xcb_flush failed!");
+    }
 
-        s_log_trace("THREAD: done presenting %p", sd->present_request_buffer);
-        s_log_trace("THREAD: present_pending -> false");
-        atomic_store(&sd->present_request_buffer, NULL);
-        X11_render_software_finish_frame(sw_rctx_handle__, 0);
+    if (xcb->xcb_flush(conn) <= 0) {
+        s_log_error("xcb_flush failed!");
+        return 1;
     }
 
-    s_log_debug("Exiting...");
-    pthread_exit(NULL);
+    return 0;
 }
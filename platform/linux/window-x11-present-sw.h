@@ -7,8 +7,12 @@
 #define P_INTERNAL_GUARD__
 #include "libxcb-rtld.h"
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include <platform/common/present-timing.h>
+#undef P_INTERNAL_GUARD__
 #include <core/int.h>
 #include <core/pixel.h>
+#include <core/region.h>
 #include <core/spinlock.h>
 #include <stdbool.h>
 #include <stdatomic.h>
@@ -18,6 +22,14 @@
 #include <xcb/present.h>
 #include <xcb/xcb_image.h>
 
+/* The length of the upload queue of the `X11_SWFB_MALLOCED_IMAGE` buffers */
+#define X11_MALLOCED_N_FRAMES 2
+
+/* The number of buffers with `P_WINDOW_TRIPLE_BUFFERED`:
+ * one that's being presented, one that waits for that to complete,
+ * and one that's being drawn to */
+#define X11_SW_MAX_BUFFERS 3
+
 #define X11_RENDER_SOFTWARE_FB_TYPE_LIST    \
     X_(X11_SWFB_NULL)                       \
     X_(X11_SWFB_MALLOCED_IMAGE)             \
@@ -35,6 +47,16 @@ enum x11_render_software_fb_type {
 #undef X11_RENDER_SOFTWARE_FB_TYPE_LIST
 #endif /* X11_RENDER_SOFTWARE_FB_TYPE_LIST_DEF__ */
 
+/* A MIT-SHM segment that holds the pixels of a buffer.
+ * It's shared with the X server through a memfd, or if the server
+ * can't take file descriptors, through SysV shared memory. */
+struct x11_shm_segment {
+    xcb_shm_seg_t shmseg;
+    pixel_t *addr;
+    u64 size;
+    bool is_sysv;
+};
+
 struct x11_render_software_ctx {
     _Atomic bool initialized_;
     xcb_gcontext_t window_gc;
@@ -49,20 +71,43 @@ struct x11_render_software_ctx {
             } malloced;
             struct x11_render_software_shm_buf {
                 u16 w, h;
-                xcb_shm_segment_info_t shm_info;
+                struct x11_shm_segment shm;
                 u8 root_depth;
             } shm;
             struct x11_render_software_present_pixmap_buf {
                 u16 w, h;
-                xcb_shm_segment_info_t shm_info;
+                struct x11_shm_segment shm;
                 u8 root_depth;
                 xcb_pixmap_t pixmap;
             } present_pixmap;
         } fb;
         struct pixel_flat_data pixbuf;
-    } buffers[2], *curr_front_buf, *curr_back_buf;
+    } buffers[X11_SW_MAX_BUFFERS], *curr_front_buf, *curr_back_buf;
+    u32 n_buffers;
     spinlock_t swap_lock;
 
+    /* Only used with more than 2 buffers (and not by the malloced ones,
+     * which have their own queue). The frame that waits for the
+     * presentation in progress to complete (NULL if none), along with
+     * its damage and present mode. The damage is relative to the last
+     * frame that was presented successfully, so it also keeps
+     * the damage of the frames that failed to present (even while
+     * nothing is queued). Protected by `swap_lock`. */
+    struct x11_render_software_buf *queued_buf;
+    struct region queued_damage;
+    enum p_window_present_mode queued_present_mode;
+
+    /* Used to present the queued frame from the listener thread */
+    xcb_connection_t *conn;
+    const struct libxcb *xcb;
+
+    /* Queued frames that were replaced by a newer one,
+     * and ones that couldn't be presented at all */
+    _Atomic u64 n_coalesced_frames, n_dropped_frames;
+
+    /* Where the completed presentations are reported */
+    struct pc_present_timing *present_timing;
+
     struct x11_render_shared_buffer_data {
         struct x11_render_shared_malloced_data {
             _Atomic bool initialized_;
@@ -73,14 +118,35 @@ struct x11_render_software_ctx {
             } const_data;
 
             pthread_t present_thread;
-            atomic_flag present_thread_running;
+            _Atomic bool present_thread_running;
             _Atomic bool present_thread_ready;
 
             pthread_mutex_t present_request_mutex;
             pthread_cond_t present_request_cond;
-            const struct x11_render_software_malloced_image_buf
-                *_Atomic present_request_buffer;
 
+            /* The frames handed over to the present thread.
+             * Each one holds a copy of the damaged parts of a window buffer
+             * (in a buffer as big as the window), so that the renderer
+             * can draw to the window buffer again right away.
+             * One frame can be uploaded while the next one is waiting. */
+            struct x11_render_malloced_frame {
+                pixel_t *buf;
+                struct region damage;
+            } frames[X11_MALLOCED_N_FRAMES];
+
+            /* The indices of the frame that's waiting to be uploaded
+             * and the one that's being uploaded (-1 if none).
+             * Protected by `present_request_mutex`. */
+            i32 queued_frame, uploading_frame;
+
+            /* Used by the present thread to put together the rows
+             * of rects that are narrower than the window */
+            pixel_t *upload_scratch;
+            u64 upload_scratch_size;
+
+            /* Frames that were merged into the one still waiting
+             * to be uploaded, and frames that couldn't be uploaded at all */
+            _Atomic u64 n_coalesced_frames, n_dropped_frames;
         } malloced;
         struct x11_render_shared_shm_data {
             _Atomic bool initialized_;
@@ -91,6 +157,11 @@ struct x11_render_software_ctx {
             _Atomic xcb_present_event_t event_context_id;
 
             _Atomic u32 serial;
+
+            /* The region of the window that gets updated by each
+             * presentation (set to the damage of the frame before it's
+             * presented), or `XCB_NONE` if XFixes isn't available */
+            _Atomic xcb_xfixes_region_t update_region;
         } present;
     } shared_buf_data;
 
@@ -123,18 +194,25 @@ i32 X11_render_init_software(struct x11_render_software_ctx *sw_rctx,
     u16 win_w, u16 win_h, u8 root_depth, u64 max_request_size,
     xcb_window_t win_handle, const struct x11_extension_store *ext_store,
     xcb_connection_t *conn, const struct libxcb *xcb,
+    u32 n_buffers, struct pc_present_timing *present_timing,
     bool *o_vsync_supported);
 
 struct pixel_flat_data * X11_render_present_software(
     struct x11_render_software_ctx *sw_rctx,
     xcb_connection_t *conn, const struct libxcb *xcb,
-    enum p_window_present_mode present_mode
+    enum p_window_present_mode present_mode, const struct region *damage
 );
 
 void X11_render_destroy_software(struct x11_render_software_ctx *sw_rctx,
     xcb_connection_t *conn, xcb_window_t win_hadle, const struct libxcb *xcb);
 
+/* `flip_info` may be NULL if the presentation completed just now
+ * (see `pc_present_timing_record_flip`) */
 void X11_render_software_finish_frame(struct x11_render_software_ctx *sw_rctx,
-    bool status);
+    bool status, const struct pc_present_flip_info *flip_info);
+
+void X11_render_software_get_present_stats(
+    const struct x11_render_software_ctx *sw_rctx,
+    struct p_window_present_stats *out);
 
 #endif /* WINDOW_X11_RENDER_SW_H_ */
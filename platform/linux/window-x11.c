@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include "../window.h"
+#include "../ptime.h"
 #include <core/log.h>
 #include <core/util.h>
 #include <core/pixel.h>
@@ -49,28 +50,101 @@
 
 #define MODULE_NAME "window-x11"
 
+/* The atoms in `struct window_x11_atoms` (field name, atom name) */
+#define X11_ATOM_LIST                                                       \
+    X_(UTF8_STRING,         "UTF8_STRING")                                  \
+    X_(WM_CLASS,            "WM_CLASS")                                     \
+    X_(NET_WM_NAME,         "_NET_WM_NAME")                                 \
+    X_(NET_WM_STATE_ABOVE,  "_NET_WM_STATE_ABOVE")                          \
+    X_(WM_PROTOCOLS,        "WM_PROTOCOLS")                                 \
+    X_(WM_DELETE_WINDOW,    "WM_DELETE_WINDOW")                             \
+
+#define X_(field, name) X11_ATOM_##field,
+enum x11_atom_index {
+    X11_ATOM_LIST
+    X11_N_ATOMS_
+};
+#undef X_
+
+/* Each round trip to the X server can take milliseconds (e.g. over SSH),
+ * so the errors of the `*_checked` requests made during initialization
+ * are all checked at once, after all of them have been sent */
+#define X11_MAX_REQUEST_CHECKS 16
+struct x11_request_checks {
+    struct {
+        xcb_void_cookie_t cookie;
+        const char *what; /* For the error message ("Failed to <what>") */
+    } requests[X11_MAX_REQUEST_CHECKS];
+    u32 n_requests;
+};
+
+/* The replies needed to set up XInput2, requested before
+ * the window is created (so that they arrive in the meantime) */
+struct xi2_input_cookies {
+    xcb_input_xi_query_version_cookie_t version;
+    xcb_input_xi_query_device_cookie_t devices;
+};
+
+/* The parts of `window_X11_open` that get timed */
+enum x11_startup_phase {
+    X11_STARTUP_CONNECT,
+    X11_STARTUP_QUERIES,
+    X11_STARTUP_WINDOW,
+    X11_STARTUP_INPUT,
+    X11_STARTUP_ACCELERATION,
+    X11_STARTUP_N_PHASES_
+};
+struct x11_startup_timer {
+    timestamp_t phase_start;
+    i64 phase_us[X11_STARTUP_N_PHASES_];
+};
+
 static void init_info(struct p_window_info *info_p,
     const xcb_screen_t *screen, const rect_t *area, const u32 flags);
 static xcb_window_t create_window(
     const xcb_screen_t *screen, const struct p_window_info *info,
+    struct x11_request_checks *checks,
     xcb_connection_t *conn, const struct libxcb *xcb
 );
-static i32 set_window_properties(struct window_x11_atoms *atoms,
+static void set_window_properties(const struct window_x11_atoms *atoms,
     const struct p_window_info *info, const char *title, xcb_window_t win,
+    struct x11_request_checks *checks,
     xcb_connection_t *conn, const struct libxcb *xcb);
-static i32 init_xi2_input(struct window_x11_input *i, xcb_window_t win,
+static i32 request_xi2_input_info(struct window_x11_input *i,
     const struct x11_extension_store *ext_store,
+    struct xi2_input_cookies *o_cookies,
+    xcb_connection_t *conn, const struct libxcb *xcb);
+static i32 init_xi2_input(struct window_x11_input *i, xcb_window_t win,
+    const struct xi2_input_cookies *cookies,
+    struct x11_request_checks *checks,
     xcb_connection_t *conn, const struct libxcb *xcb);
 
-static i32 intern_atom(const char *atom_name, xcb_atom_t *o,
+static void request_atoms(xcb_intern_atom_cookie_t o_cookies[X11_N_ATOMS_],
+    xcb_connection_t *conn, const struct libxcb *xcb);
+static i32 collect_atoms(struct window_x11_atoms *o,
+    const xcb_intern_atom_cookie_t cookies[X11_N_ATOMS_],
+    xcb_connection_t *conn, const struct libxcb *xcb);
+static i32 collect_atom(const char *atom_name, xcb_atom_t *o,
+    xcb_intern_atom_cookie_t cookie,
     xcb_connection_t *conn, const struct libxcb *xcb);
 
 static i32 get_master_input_devices(
     xcb_input_device_id_t *master_mouse_id,
     xcb_input_device_id_t *master_keyboard_id,
+    xcb_input_xi_query_device_cookie_t cookie,
     xcb_connection_t *conn, const struct libxcb *xcb
 );
 
+static void add_request_check(struct x11_request_checks *checks,
+    xcb_void_cookie_t cookie, const char *what);
+static i32 check_requests(struct x11_request_checks *checks,
+    xcb_connection_t *conn, const struct libxcb *xcb);
+
+static void start_startup_timer(struct x11_startup_timer *t);
+static void end_startup_phase(struct x11_startup_timer *t,
+    enum x11_startup_phase phase);
+static void log_startup_timing(const struct x11_startup_timer *t);
+
 static i32 send_dummy_event_to_self(xcb_window_t win,
     xcb_connection_t *conn, const struct libxcb *xcb);
 
@@ -90,11 +164,14 @@ static const char *const input_object_type_strings[X11_INPUT_REG_MAX_] = {
 #undef X_
 
 i32 window_X11_open(struct window_x11 *win, struct p_window_info *info,
+    struct pc_present_timing *present_timing,
     const char *title, const rect_t *area, const u32 flags)
 {
-    /* Used for error checking */
-    xcb_generic_error_t *e = NULL;
-    xcb_void_cookie_t vc = { 0 };
+    struct x11_startup_timer timer;
+    start_startup_timer(&timer);
+
+    /* The errors of the requests that are checked all at once */
+    struct x11_request_checks checks = { .n_requests = 0 };
 
     /* Reset the window struct, just in case */
     memset(win, 0, sizeof(struct window_x11));
@@ -130,14 +207,27 @@ i32 window_X11_open(struct window_x11 *win, struct p_window_info *info,
         }
         goto_error("Failed to connect to the X server");
     }
+    end_startup_phase(&timer, X11_STARTUP_CONNECT);
+
+    /* None of these depend on each other, so all the requests
+     * are sent first, and only then are the replies waited for */
+    X11_extension_store_prefetch(win->conn, &win->xcb);
+    win->xcb.xcb_prefetch_maximum_request_length(win->conn);
+    xcb_intern_atom_cookie_t atom_cookies[X11_N_ATOMS_];
+    request_atoms(atom_cookies, win->conn, &win->xcb);
 
     /* Query all relevant extension metadata (`win->ext_store`) */
     X11_extension_store_init(&win->ext_store, win->conn, &win->xcb);
 
-    /* Note that this macro should only be used right after calling
-     * a `*_checked` xcb function. Otherwise it's useless */
-#define libxcb_error() \
-    (e = win->xcb.xcb_request_check(win->conn, vc), e != NULL)
+    /* The XInput2 requests can only be sent once the extension's
+     * opcode is known, but their replies aren't needed
+     * until after the window is created */
+    struct xi2_input_cookies xi2_cookies;
+    if (request_xi2_input_info(&win->input, &win->ext_store, &xi2_cookies,
+            win->conn, &win->xcb))
+    {
+        goto_error("Failed to initialize input");
+    }
 
     /* Get the server screen configuration (`win->screen`) */
 
@@ -151,42 +241,50 @@ i32 window_X11_open(struct window_x11 *win, struct p_window_info *info,
     win->max_request_size =
         win->xcb.xcb_get_maximum_request_length(win->conn) * 4;
 
+    /* Get the atoms used by the window properties (`win->atoms`) */
+    if (collect_atoms(&win->atoms, atom_cookies, win->conn, &win->xcb))
+        goto_error("Failed to intern the atoms");
+
     /* Get the current screen */
     xcb_screen_iterator_t scr_iter = win->xcb.xcb_setup_roots_iterator(setup);
     win->screen = scr_iter.data;
+    end_startup_phase(&timer, X11_STARTUP_QUERIES);
 
     /* Initialize the generic window info struct
      * (`win->generic_info_p`) */
     win->generic_info_p = info;
+    win->present_timing = present_timing;
     init_info(win->generic_info_p, win->screen, area, flags);
 
     /* Create the window (`win->win_handle`) */
     win->win_handle = create_window(win->screen, win->generic_info_p,
-        win->conn, &win->xcb);
-    if (win->win_handle == XCB_NONE)
-        goto err;
+        &checks, win->conn, &win->xcb);
 
     /* Set window properties such as the title, floating state,
-     * minimal and maximal size hints, etc
-     * (`win->atoms`) */
-    if (set_window_properties(&win->atoms, win->generic_info_p, title,
-            win->win_handle, win->conn, &win->xcb)
-    ) {
-        goto_error("Failed to set window properties");
-    }
+     * minimal and maximal size hints, etc */
+    set_window_properties(&win->atoms, win->generic_info_p, title,
+        win->win_handle, &checks, win->conn, &win->xcb);
 
     /* Map the window to make it visible */
-    vc = win->xcb.xcb_map_window_checked(win->conn, win->win_handle);
-    if (libxcb_error())
-        goto_error("Failed to map (show) the window");
+    add_request_check(&checks,
+        win->xcb.xcb_map_window_checked(win->conn, win->win_handle),
+        "map (show) the window");
+    end_startup_phase(&timer, X11_STARTUP_WINDOW);
 
     /* Initialize input stuff (`win->input`) */
-    if (init_xi2_input(&win->input, win->win_handle,
-            &win->ext_store, win->conn, &win->xcb))
+    if (init_xi2_input(&win->input, win->win_handle, &xi2_cookies,
+            &checks, win->conn, &win->xcb))
     {
         goto_error("Failed to initialize input");
     }
 
+    /* Only now wait for the window to actually be set up */
+    if (check_requests(&checks, win->conn, &win->xcb))
+        goto_error("Failed to set up the window");
+    end_startup_phase(&timer, X11_STARTUP_INPUT);
+
+    win->triple_buffered = flags & P_WINDOW_TRIPLE_BUFFERED;
+
     /* Initialize the GPU acceleration based on the flags.
      * This populates `win->render` as well as
      *  the `gpu_acceleration` and `vsync_supported` fields in
@@ -203,6 +301,7 @@ i32 window_X11_open(struct window_x11 *win, struct p_window_info *info,
     /* Flush all the commands that are still queued */
     if (win->xcb.xcb_flush(win->conn) <= 0)
         goto_error("Failed to flush xcb requests");
+    end_startup_phase(&timer, X11_STARTUP_ACCELERATION);
 
     /* Create the thread that listens for events
      * (`win->listener`) */
@@ -218,15 +317,13 @@ i32 window_X11_open(struct window_x11 *win, struct p_window_info *info,
         win->screen->width_in_pixels, win->screen->height_in_pixels,
         win->xcb.shm.loaded_, win->generic_info_p->vsync_supported
     );
+    log_startup_timing(&timer);
     return 0;
 
 err:
-    if (e != NULL) u_nzfree(&e);
     /* window_X11_close() will later be called by p_window_close,
      * so there's no need to do it here */
     return 1;
-
-#undef libxcb_error
 }
 
 void window_X11_close(struct window_x11 *win)
@@ -331,7 +428,7 @@ thread_terminated:
 }
 
 struct pixel_flat_data * window_X11_swap_buffers(struct window_x11 *win,
-    enum p_window_present_mode present_mode)
+    enum p_window_present_mode present_mode, const struct region *damage)
 {
     u_check_params(win != NULL);
 
@@ -345,7 +442,7 @@ struct pixel_flat_data * window_X11_swap_buffers(struct window_x11 *win,
             return P_WINDOW_SWAP_BUFFERS_FAIL;
         }
         return X11_render_present_software(&win->render.sw,
-            win->conn, &win->xcb, present_mode);
+            win->conn, &win->xcb, present_mode, damage);
     case P_WINDOW_ACCELERATION_OPENGL:
         return NULL;
     case P_WINDOW_ACCELERATION_VULKAN:
@@ -461,7 +558,8 @@ i32 window_X11_set_acceleration(struct window_x11 *win,
                 win->generic_info_p->client_area.h,
                 win->screen->root_depth, win->max_request_size,
                 win->win_handle, &win->ext_store, win->conn, &win->xcb,
-                &new_vsync_supported))
+                win->triple_buffered ? X11_SW_MAX_BUFFERS : 2,
+                win->present_timing, &new_vsync_supported))
         {
             s_log_error("Failed to set up the window for software rendering.");
             return 1;
@@ -486,6 +584,15 @@ i32 window_X11_set_acceleration(struct window_x11 *win,
     return 0;
 }
 
+void window_X11_get_present_stats(const struct window_x11 *win,
+    struct p_window_present_stats *out)
+{
+    if (win->generic_info_p->gpu_acceleration == P_WINDOW_ACCELERATION_NONE)
+        X11_render_software_get_present_stats(&win->render.sw, out);
+    else
+        memset(out, 0, sizeof(struct p_window_present_stats));
+}
+
 static void init_info(struct p_window_info *info_p,
     const xcb_screen_t *screen, const rect_t *area, const u32 flags)
 {
@@ -512,6 +619,7 @@ static void init_info(struct p_window_info *info_p,
 
 static xcb_window_t create_window(
     const xcb_screen_t *screen, const struct p_window_info *info,
+    struct x11_request_checks *checks,
     xcb_connection_t *conn, const struct libxcb *xcb
 )
 {
@@ -535,30 +643,17 @@ static xcb_window_t create_window(
     xcb_void_cookie_t vc = xcb->xcb_create_window_checked(conn,
         DEPTH, NEW_WINDOW_ID, PARENT_WINDOW_ID, X, Y, W, H,
         BORDER_WIDTH, WINDOW_CLASS, VISUAL, VALUE_MASK, VALUE_LIST);
-    xcb_generic_error_t *e = NULL;
-    if (e = xcb->xcb_request_check(conn, vc), e != NULL) {
-        s_log_error("Failed to create the window!");
-        u_nfree(&e);
-        return XCB_NONE;
-    }
+    add_request_check(checks, vc, "create the window");
 
     return tmp_window_id;
 }
 
-static i32 set_window_properties(struct window_x11_atoms *atoms,
+static void set_window_properties(const struct window_x11_atoms *atoms,
     const struct p_window_info *info, const char *title, xcb_window_t win,
+    struct x11_request_checks *checks,
     xcb_connection_t *conn, const struct libxcb *xcb)
 {
     xcb_void_cookie_t vc;
-    xcb_generic_error_t *e = NULL;
-    char *wm_class_string = NULL;
-
-#define libxcb_error() \
-    (e = xcb->xcb_request_check(conn, vc), e != NULL)
-
-    /* Get the UTF8 string atom */
-    if (intern_atom("UTF8_STRING", &atoms->UTF8_STRING, conn, xcb))
-        goto err;
 
     /* Set the window class */
     /* By (the `icccm`) convention, the `WM_CLASS` atom must be set
@@ -573,52 +668,39 @@ static i32 set_window_properties(struct window_x11_atoms *atoms,
      */
     const u32 title_len = strlen(title);
     const u32 wm_class_size = (title_len + 1) * 2;
-    wm_class_string = malloc(wm_class_size);
+    char *wm_class_string = malloc(wm_class_size);
     s_assert(wm_class_string != NULL,
         "malloc failed for window instance/class string");
     memcpy(wm_class_string, title, title_len + 1);
     memcpy(wm_class_string + title_len + 1, title, title_len + 1);
 
-    if (intern_atom("WM_CLASS", &atoms->WM_CLASS, conn, xcb))
-        goto err;
+    /* The request data is copied into xcb's buffer right away */
     vc = xcb->xcb_change_property_checked(conn, XCB_PROP_MODE_REPLACE,
         win, atoms->WM_CLASS, XCB_ATOM_STRING, 8,
         wm_class_size, wm_class_string);
-    if (libxcb_error())
-        goto_error("Failed to set the window class");
+    add_request_check(checks, vc, "set the window class");
 
     u_nfree(&wm_class_string);
 
     /* Set the window title */
     vc = xcb->xcb_change_property_checked(conn, XCB_PROP_MODE_REPLACE,
         win, XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, strlen(title), title);
-    if (libxcb_error())
-        goto_error("Failed to change window name");
+    add_request_check(checks, vc, "change window name");
 
-    if (intern_atom("_NET_WM_NAME", &atoms->NET_WM_NAME, conn, xcb))
-        goto err;
     vc = xcb->xcb_change_property_checked(conn, XCB_PROP_MODE_REPLACE,
         win, atoms->NET_WM_NAME, atoms->UTF8_STRING, 8,
         strlen((char *)title), title
     );
-    if (libxcb_error())
-        goto_error("Failed to set the _NET_WM_NAME property");
+    add_request_check(checks, vc, "set the _NET_WM_NAME property");
 
     /* Set the window to floating */
-    if (intern_atom("_NET_WM_STATE_ABOVE", &atoms->NET_WM_STATE_ABOVE,
-            conn, xcb)
-    ) {
-        goto err;
-    }
-
     i32 net_wm_state_above_val = 1;
     vc = xcb->xcb_change_property_checked(conn, XCB_PROP_MODE_REPLACE,
         win, atoms->NET_WM_STATE_ABOVE, XCB_ATOM_INTEGER, 32,
         1, &net_wm_state_above_val
     );
-    if (libxcb_error())
-        goto_error("Failed to set the NET_WM_STATE_ABOVE "
-            "(floating window) property");
+    add_request_check(checks, vc,
+        "set the NET_WM_STATE_ABOVE (floating window) property");
 
     /* Set the window minimum and maximum size to the same value
      * to mark the window as non-resizable for the window manager */
@@ -628,58 +710,50 @@ static i32 set_window_properties(struct window_x11_atoms *atoms,
     xcb->xcb_icccm_size_hints_set_max_size(&hints,
         info->client_area.w, info->client_area.h);
     vc = xcb->xcb_icccm_set_wm_normal_hints_checked(conn, win, &hints);
-    if (libxcb_error())
-        goto_error("Failed to set WM normal hints");
+    add_request_check(checks, vc, "set WM normal hints");
 
     /* Set the WM_DELETE_WINDOW protocol atom,
      * to enable receiving window close events */
-    if (intern_atom("WM_PROTOCOLS", &atoms->WM_PROTOCOLS, conn, xcb))
-        goto err;
-    if (intern_atom("WM_DELETE_WINDOW", &atoms->WM_DELETE_WINDOW,
-            conn, xcb))
-        goto err;
-
     vc = xcb->xcb_change_property_checked(conn, XCB_PROP_MODE_REPLACE,
         win, atoms->WM_PROTOCOLS, XCB_ATOM_ATOM, 32,
         1, &atoms->WM_DELETE_WINDOW
     );
-    if (libxcb_error())
-        goto_error("Failed to set WM protocols");
-
-    return 0;
+    add_request_check(checks, vc, "set WM protocols");
+}
 
-err:
-    if (wm_class_string != NULL) {
-        u_nfree(&wm_class_string);
-    }
-    if (e != NULL) {
-        u_nfree(&e);
+static i32 request_xi2_input_info(struct window_x11_input *i,
+    const struct x11_extension_store *ext_store,
+    struct xi2_input_cookies *o_cookies,
+    xcb_connection_t *conn, const struct libxcb *xcb)
+{
+    /* Initialize the XInput2 externsion */
+    X11_extension_get_data(ext_store, X11_EXT_XINPUT, &i->xinput_ext_data);
+    if (!i->xinput_ext_data.available) {
+        s_log_error("The XInput extension is not available");
+        return 1;
     }
-    return 1;
 
-#undef libxcb_error
+    /* Check the extension version */
+    o_cookies->version = xcb->xinput.xcb_input_xi_query_version(conn, 2, 0);
+
+    /* Get the master keyboard and master mouse device IDs */
+    o_cookies->devices =
+        xcb->xinput.xcb_input_xi_query_device(conn, XCB_INPUT_DEVICE_ALL);
+
+    return 0;
 }
 
 static i32 init_xi2_input(struct window_x11_input *i, xcb_window_t win,
-    const struct x11_extension_store *ext_store,
+    const struct xi2_input_cookies *cookies,
+    struct x11_request_checks *checks,
     xcb_connection_t *conn, const struct libxcb *xcb)
 {
     xcb_void_cookie_t vc;
-    xcb_generic_error_t *e = NULL;
-
-#define libxcb_error() \
-    (e = xcb->xcb_request_check(conn, vc), e != NULL)
-
-    /* Initialize the XInput2 externsion */
-    X11_extension_get_data(ext_store, X11_EXT_XINPUT, &i->xinput_ext_data);
-    if (!i->xinput_ext_data.available)
-        goto_error("The XInput extension is not available");
 
     /* Check the extension version */
-    xcb_input_xi_query_version_cookie_t cookie =
-        xcb->xinput.xcb_input_xi_query_version(conn, 2, 0);
     xcb_input_xi_query_version_reply_t *reply =
-        xcb->xinput.xcb_input_xi_query_version_reply(conn, cookie, NULL);
+        xcb->xinput.xcb_input_xi_query_version_reply(conn,
+            cookies->version, NULL);
 
     if (reply == NULL) {
         s_log_error("xcb_input_xi_query_version failed!");
@@ -695,10 +769,11 @@ static i32 init_xi2_input(struct window_x11_input *i, xcb_window_t win,
     u_nfree(&reply);
 
     /* Get the master keyboard and master mouse device IDs */
-    if (get_master_input_devices(
-            &i->master_mouse_id, &i->master_keyboard_id, conn, xcb
-    )) {
-        goto_error("Failed to query master input device IDs");
+    if (get_master_input_devices(&i->master_mouse_id,
+            &i->master_keyboard_id, cookies->devices, conn, xcb))
+    {
+        s_log_error("Failed to query master input device IDs");
+        return 1;
     }
 
     /* Select the events we want to receive from Xi2 */
@@ -726,19 +801,20 @@ static i32 init_xi2_input(struct window_x11_input *i, xcb_window_t win,
 
     vc = xcb->xinput.xcb_input_xi_select_events_checked(conn, win,
         1, (const xcb_input_event_mask_t *)&keyboard_mask);
-    if (libxcb_error())
-        goto_error("Failed to enable keyboard input handling with Xi2");
+    add_request_check(checks, vc,
+        "enable keyboard input handling with Xi2");
 
     vc = xcb->xinput.xcb_input_xi_select_events_checked(conn, win,
         1, (const xcb_input_event_mask_t *)&mouse_mask);
-    if (libxcb_error())
-        goto_error("Failed to enable mouse input handling with Xi2");
+    add_request_check(checks, vc, "enable mouse input handling with Xi2");
 
     /* Allocate the key symbols struct, used by keyboard-x11
      * to map keycodes received from events to keysyms */
     i->key_symbols = xcb->xcb_key_symbols_alloc(conn);
-    if (i->key_symbols == NULL)
-        goto_error("Failed to allocate key symbols");
+    if (i->key_symbols == NULL) {
+        s_log_error("Failed to allocate key symbols");
+        return 1;
+    }
 
     /* Initialize the interfaces to `p_keyboard` and `p_mouse` */
     for (u32 type = 0; type < X11_INPUT_REG_MAX_; type++) {
@@ -747,29 +823,51 @@ static i32 init_xi2_input(struct window_x11_input *i, xcb_window_t win,
     }
 
     return 0;
+}
 
-err:
-    if (e != NULL) {
-        u_nfree(&e);
-    }
-    return 1;
+static void request_atoms(xcb_intern_atom_cookie_t o_cookies[X11_N_ATOMS_],
+    xcb_connection_t *conn, const struct libxcb *xcb)
+{
+#define X_(field, name)                                                     \
+    o_cookies[X11_ATOM_##field] = xcb->xcb_intern_atom(conn,                \
+        false, strlen(name), name);
 
-#undef libxcb_error
+    X11_ATOM_LIST
+
+#undef X_
 }
 
-static i32 intern_atom(const char *atom_name, xcb_atom_t *o,
+static i32 collect_atoms(struct window_x11_atoms *o,
+    const xcb_intern_atom_cookie_t cookies[X11_N_ATOMS_],
     xcb_connection_t *conn, const struct libxcb *xcb)
 {
-    xcb_intern_atom_cookie_t cookie = xcb->xcb_intern_atom(conn,
-        false, strlen(atom_name), atom_name);
+    /* All of the replies have to be collected,
+     * even if one of them is an error */
+    i32 ret = 0;
+
+#define X_(field, name)                                                     \
+    if (collect_atom(name, &o->field, cookies[X11_ATOM_##field], conn, xcb)) \
+        ret = 1;
+
+    X11_ATOM_LIST
+
+#undef X_
 
+    return ret;
+}
+
+static i32 collect_atom(const char *atom_name, xcb_atom_t *o,
+    xcb_intern_atom_cookie_t cookie,
+    xcb_connection_t *conn, const struct libxcb *xcb)
+{
     xcb_generic_error_t *err = NULL;
     xcb_intern_atom_reply_t *reply = xcb->xcb_intern_atom_reply(conn,
         cookie, &err);
 
-    if (err) {
+    if (err != NULL || reply == NULL) {
         s_log_error("Failed to intern atom \"%s\"", atom_name);
-        u_nfree(&reply);
+        if (err != NULL) u_nfree(&err);
+        if (reply != NULL) u_nfree(&reply);
         return 1;
     }
 
@@ -781,12 +879,10 @@ static i32 intern_atom(const char *atom_name, xcb_atom_t *o,
 static i32 get_master_input_devices(
     xcb_input_device_id_t *master_mouse_id,
     xcb_input_device_id_t *master_keyboard_id,
+    xcb_input_xi_query_device_cookie_t cookie,
     xcb_connection_t *conn, const struct libxcb *xcb
 )
 {
-    xcb_input_xi_query_device_cookie_t cookie =
-        xcb->xinput.xcb_input_xi_query_device(conn, XCB_INPUT_DEVICE_ALL);
-
     xcb_input_xi_query_device_reply_t *reply =
         xcb->xinput.xcb_input_xi_query_device_reply(conn, cookie, NULL);
     if (reply == NULL)
@@ -814,6 +910,65 @@ static i32 get_master_input_devices(
     return found_mouse && found_keyboard ? 0 : 1;
 }
 
+static void add_request_check(struct x11_request_checks *checks,
+    xcb_void_cookie_t cookie, const char *what)
+{
+    s_assert(checks->n_requests < X11_MAX_REQUEST_CHECKS,
+        "Too many X11 requests to check (max %u)", X11_MAX_REQUEST_CHECKS);
+
+    checks->requests[checks->n_requests].cookie = cookie;
+    checks->requests[checks->n_requests].what = what;
+    checks->n_requests++;
+}
+
+static i32 check_requests(struct x11_request_checks *checks,
+    xcb_connection_t *conn, const struct libxcb *xcb)
+{
+    /* Only the first check actually waits for the server;
+     * all the other requests were sent before it,
+     * so by then their errors (if any) have already arrived */
+    i32 ret = 0;
+    for (u32 i = 0; i < checks->n_requests; i++) {
+        xcb_generic_error_t *e =
+            xcb->xcb_request_check(conn, checks->requests[i].cookie);
+        if (e != NULL) {
+            s_log_error("Failed to %s (X11 error code %u)",
+                checks->requests[i].what, e->error_code);
+            u_nfree(&e);
+            ret = 1;
+        }
+    }
+    checks->n_requests = 0;
+
+    return ret;
+}
+
+static void start_startup_timer(struct x11_startup_timer *t)
+{
+    memset(t, 0, sizeof(struct x11_startup_timer));
+    p_time_get_ticks(&t->phase_start);
+}
+
+static void end_startup_phase(struct x11_startup_timer *t,
+    enum x11_startup_phase phase)
+{
+    t->phase_us[phase] = p_time_delta_us(&t->phase_start);
+    p_time_get_ticks(&t->phase_start);
+}
+
+static void log_startup_timing(const struct x11_startup_timer *t)
+{
+    i64 total_us = 0;
+    for (u32 i = 0; i < X11_STARTUP_N_PHASES_; i++)
+        total_us += t->phase_us[i];
+
+    s_log_verbose("X11 startup took %li us (connect: %li, queries: %li, "
+        "window: %li, input: %li, acceleration: %li)", total_us,
+        t->phase_us[X11_STARTUP_CONNECT], t->phase_us[X11_STARTUP_QUERIES],
+        t->phase_us[X11_STARTUP_WINDOW], t->phase_us[X11_STARTUP_INPUT],
+        t->phase_us[X11_STARTUP_ACCELERATION]);
+}
+
 static i32 send_dummy_event_to_self(xcb_window_t win,
     xcb_connection_t *conn, const struct libxcb *xcb)
 {
@@ -6,6 +6,7 @@
 #include "../window.h"
 #include <core/int.h>
 #include <core/pixel.h>
+#include <core/region.h>
 #include <core/shapes.h>
 #include <assert.h>
 #include <stdbool.h>
@@ -87,6 +88,12 @@ struct window_x11 {
     /* The maximum request size (in bytes) the connection can handle */
     u64 max_request_size;
 
+    /* Whether `P_WINDOW_TRIPLE_BUFFERED` was set */
+    bool triple_buffered;
+
+    /* Where the completed presentations are reported */
+    struct pc_present_timing *present_timing;
+
     /* The handle to the X window */
     xcb_window_t win_handle;
 
@@ -142,14 +149,16 @@ struct window_x11 {
  * Does not clean up if an error happens */
 /* Does not perform any parameter validation! */
 i32 window_X11_open(struct window_x11 *win, struct p_window_info *info,
+    struct pc_present_timing *present_timing,
     const char *title, const rect_t *area, const u32 flags);
 
 /* Also unloads libX11 if there are no open windows left */
 void window_X11_close(struct window_x11 *x11);
 
-/* Does not perform any parameter validation! */
+/* Does not perform any parameter validation!
+ * `damage` may be NULL, in which case the whole window is updated */
 struct pixel_flat_data * window_X11_swap_buffers(struct window_x11 *win,
-    enum p_window_present_mode present_mode);
+    enum p_window_present_mode present_mode, const struct region *damage);
 
 i32 window_X11_register_input_obj(struct window_x11 *win,
     enum x11_registered_input_obj_type type,
@@ -161,4 +170,8 @@ i32 window_X11_deregister_input_obj(struct window_x11 *win,
 i32 window_X11_set_acceleration(struct window_x11 *win,
     enum p_window_acceleration new_val);
 
+/* Does not perform any parameter validation! */
+void window_X11_get_present_stats(const struct window_x11 *win,
+    struct p_window_present_stats *out);
+
 #endif /* P_WINDOW_X11_H_ */
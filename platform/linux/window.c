@@ -6,6 +6,7 @@
 #include <core/log.h>
 #include <core/util.h>
 #include <core/pixel.h>
+#include <core/region.h>
 #include <core/shapes.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +28,9 @@
 #define P_INTERNAL_GUARD__
 #include <platform/common/util-window.h>
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include <platform/common/present-timing.h>
+#undef P_INTERNAL_GUARD__
 
 #define MODULE_NAME "window"
 
@@ -48,19 +52,23 @@ struct p_window * p_window_open(const char *title,
     else
         win->type = detect_environment();
 
+    pc_present_timing_init(&win->present_timing);
+
     /* Init the event subsystem so that the user doesn't have to */
     p_event_send(&(const struct p_event) { .type = P_EVENT_CTL_INIT_ });
 
     switch (win->type) {
         case WINDOW_TYPE_X11:
-            if (window_X11_open(&win->x11, &win->info, title, area, flags))
+            if (window_X11_open(&win->x11, &win->info,
+                    &win->present_timing, title, area, flags))
                 goto_error("Failed to open X11 window");
             win->info.display_color_format = BGRX32;
             win->mouse_ev_offset.x = 0;
             win->mouse_ev_offset.y = 0;
             break;
         case WINDOW_TYPE_DRI:
-            if (window_dri_open(&win->dri, area, flags, &win->info)) {
+            if (window_dri_open(&win->dri, area, flags, &win->info,
+                    &win->present_timing)) {
                 s_log_warn("Failed to open DRI window. Falling back to fbdev.");
                 window_dri_close(&win->dri);
                 win->type = WINDOW_TYPE_FBDEV;
@@ -72,7 +80,8 @@ struct p_window * p_window_open(const char *title,
             break;
         case WINDOW_TYPE_FBDEV:
         fbdev_init:
-            if (window_fbdev_open(&win->fbdev, area, flags, &win->info)
+            if (window_fbdev_open(&win->fbdev, area, flags, &win->info,
+                    &win->present_timing)
             ) {
                 goto_error("Failed to open fbdev window");
             }
@@ -80,7 +89,7 @@ struct p_window * p_window_open(const char *title,
             win->mouse_ev_offset.y = win->info.client_area.y;
             break;
         case WINDOW_TYPE_DUMMY:
-            if (window_dummy_init(&win->dummy, flags))
+            if (window_dummy_init(&win->dummy, area, flags))
                 goto_error("Failed to init dummy window");
             win->info.display_color_format = RGBX32;
             win->mouse_ev_offset.x = 0;
@@ -128,22 +137,90 @@ void p_window_get_info(const struct p_window *win, struct p_window_info *out)
     memcpy(out, &win->info, sizeof(struct p_window_info));
 }
 
+void p_window_get_present_stats(const struct p_window *win,
+    struct p_window_present_stats *out)
+{
+    u_check_params(win != NULL && out != NULL);
+
+    switch (win->type) {
+    case WINDOW_TYPE_X11:
+        window_X11_get_present_stats(&win->x11, out);
+        return;
+    case WINDOW_TYPE_DRI:
+        window_dri_get_present_stats(&win->dri, out);
+        return;
+    case WINDOW_TYPE_FBDEV:
+        window_fbdev_get_present_stats(&win->fbdev, out);
+        return;
+    case WINDOW_TYPE_DUMMY:
+        /* Every frame is either presented or reported as failed */
+        memset(out, 0, sizeof(struct p_window_present_stats));
+        return;
+    }
+
+    s_log_fatal("impossible outcome");
+}
+
+void p_window_get_present_timing(struct p_window *win,
+    struct p_window_present_timing *out)
+{
+    u_check_params(win != NULL && out != NULL);
+
+    pc_present_timing_get(&win->present_timing, out);
+}
+
 struct pixel_flat_data * p_window_swap_buffers(struct p_window *win,
     const enum p_window_present_mode present_mode)
 {
+    return p_window_swap_buffers_damaged(win, present_mode, NULL, 0);
+}
+
+struct pixel_flat_data * p_window_swap_buffers_damaged(struct p_window *win,
+    const enum p_window_present_mode present_mode,
+    const rect_t *damage_rects, u32 n_damage_rects)
+{
+    u_check_params(win != NULL);
+
+    /* NULL means that the whole window is damaged */
+    struct region damage_region;
+    const struct region *damage = NULL;
+    if (damage_rects != NULL) {
+        region_clear(&damage_region);
+        for (u32 i = 0; i < n_damage_rects; i++)
+            region_add_rect(&damage_region, &damage_rects[i]);
+
+        const rect_t window_rect = {
+            0, 0, win->info.client_area.w, win->info.client_area.h
+        };
+        region_clip(&damage_region, &window_rect);
+        damage = &damage_region;
+    }
+
+    /* The frame may already get flipped to before the backend returns */
+    pc_present_timing_record_swap(&win->present_timing);
+
+    struct pixel_flat_data *ret = P_WINDOW_SWAP_BUFFERS_FAIL;
     switch (win->type) {
     case WINDOW_TYPE_X11:
-        return window_X11_swap_buffers(&win->x11, present_mode);
+        ret = window_X11_swap_buffers(&win->x11, present_mode, damage);
+        break;
     case WINDOW_TYPE_DRI:
-        return window_dri_swap_buffers(&win->dri, present_mode);
+        ret = window_dri_swap_buffers(&win->dri, present_mode, damage);
+        break;
     case WINDOW_TYPE_FBDEV:
-        return window_fbdev_swap_buffers(&win->fbdev, present_mode);
+        ret = window_fbdev_swap_buffers(&win->fbdev, present_mode, damage);
+        break;
     case WINDOW_TYPE_DUMMY:
-        s_log_error("Dummy windows don't support buffer swapping!");
-        return P_WINDOW_SWAP_BUFFERS_FAIL;
+        ret = window_dummy_swap_buffers(&win->dummy, present_mode, damage);
+        break;
+    default:
+        s_log_fatal("impossible outcome");
     }
 
-    s_log_fatal("impossible outcome");
+    if (ret == P_WINDOW_SWAP_BUFFERS_FAIL)
+        pc_present_timing_cancel_swap(&win->present_timing);
+
+    return ret;
 }
 
 i32 p_window_set_acceleration(struct p_window *win,
@@ -2,6 +2,8 @@
 #define P_TIME_H_
 
 #include <core/int.h>
+#include <core/histogram.h>
+#include <stdbool.h>
 
 typedef struct timestamp {
     i64 s;  /* seconds */
@@ -16,6 +18,15 @@ typedef struct timestamp {
     (o).ns += ((o).ns < 0) * 1000000000L;   \
 } while (0)
 
+/* Add `ns_` nano-seconds (which may be negative) to `t` */
+#define timestamp_add_ns(t, ns_) do {                           \
+    const i64 timestamp_total_ns_ = (t).ns + (i64)(ns_);        \
+    (t).s += timestamp_total_ns_ / 1000000000L;                 \
+    (t).ns = timestamp_total_ns_ % 1000000000L;                 \
+    (t).s -= ((t).ns < 0);                                      \
+    (t).ns += ((t).ns < 0) * 1000000000L;                       \
+} while (0)
+
 /* Retrieve the current UNIX time into `o`.
  * Does not guarantee high precision. */
 void p_time(timestamp_t *o);
@@ -35,4 +46,113 @@ void p_time_usleep(u32 u_seconds);
 void p_time_msleep(u32 m_seconds);
 void p_time_sleep(u32 seconds);
 
+/* How long before the deadline `p_time_sleep_until` stops sleeping
+ * and starts spinning. Anything else that blocks until a deadline
+ * (like `p_event_wait`) should wake up this much earlier
+ * and leave the rest to `p_time_sleep_until`. */
+#define P_TIME_SPIN_MARGIN_us 200
+
+/* Wait until `deadline` (as returned by `p_time_get_ticks`).
+ * Unlike the relative sleeps above, the deadline is absolute, so the time
+ * it takes to get here doesn't add up. The sleep itself ends
+ * `P_TIME_SPIN_MARGIN_us` early (to make up for the scheduler's
+ * wakeup latency), and the rest is spent spinning. */
+void p_time_sleep_until(const timestamp_t *deadline);
+
+/* Keeps a loop running at exactly one frame per `frame_duration_ns`.
+ *
+ * The deadlines are absolute (each one is exactly one frame duration
+ * after the previous one), so they don't drift. Each frame has a period
+ * (from the previous deadline to its own one), and it starts either
+ * at its deadline (`p_time_frame_sched_wait`), or earlier if there's
+ * a reason to (`p_time_frame_sched_begin_frame`). If the loop falls
+ * behind by whole periods, those are skipped instead of being made up for
+ * with a burst of frames.
+ *
+ * It can also run a fixed-timestep update accumulator: every frame adds
+ * the time since the previous one, and `p_time_frame_sched_step`
+ * takes it out in fixed steps. What's left over (as a fraction of a step)
+ * is the interpolation alpha for rendering.
+ *
+ * All the times are in nanoseconds on the `p_time_get_ticks` clock.
+ * The members are only meant to be read through the functions below. */
+struct p_time_frame_sched {
+    i64 frame_duration_ns;
+    i64 update_step_ns; /* 0 if the accumulator isn't used */
+
+    /* The next frame's period */
+    i64 period_start_ns;
+    i64 deadline_ns;
+
+    i64 first_frame_ns;
+    i64 last_frame_ns;
+    i64 accumulator_ns;
+
+    u64 n_frames;
+    u64 n_early_frames;
+    u64 n_skipped_periods;
+
+    /* How late the frames that waited for their deadline started */
+    struct histogram lateness_ns;
+
+    /* Between the starts of 2 consecutive frames */
+    struct histogram frame_interval_ns;
+};
+
+struct p_time_frame_stats {
+    u64 n_frames;
+
+    /* Frames that started before their deadline */
+    u64 n_early_frames;
+
+    /* Periods that were skipped because the loop fell behind */
+    u64 n_skipped_periods;
+
+    /* The difference between the time that actually passed
+     * since the first frame, and the number of periods
+     * (including the skipped ones) times the frame duration.
+     * With absolute deadlines this stays within about a frame. */
+    i64 drift_ns;
+
+    /* How late the frames that waited for their deadline started (jitter) */
+    struct histogram_summary lateness_ns;
+
+    /* Between the starts of 2 consecutive frames */
+    struct histogram_summary frame_interval_ns;
+};
+
+/* Initializes `s` for frames of `frame_duration_us`, and starts the first
+ * frame right away. If `update_step_us` is non-zero, the fixed-timestep
+ * accumulator is enabled with steps of that many microseconds. */
+void p_time_frame_sched_init(struct p_time_frame_sched *s,
+    u32 frame_duration_us, u32 update_step_us);
+
+/* Waits until the next frame's deadline (with `p_time_sleep_until`)
+ * and then starts it (see `p_time_frame_sched_begin_frame`) */
+void p_time_frame_sched_wait(struct p_time_frame_sched *s);
+
+/* Starts the next frame right now, instead of at its deadline.
+ * Should only be called after the next frame's period started. */
+void p_time_frame_sched_begin_frame(struct p_time_frame_sched *s);
+
+/* Retrieves when the next frame's period starts and when it's due
+ * into `period_start_o` and `deadline_o`. Either one may be `NULL`. */
+void p_time_frame_sched_get_period(const struct p_time_frame_sched *s,
+    timestamp_t *period_start_o, timestamp_t *deadline_o);
+
+/* Takes one update step out of the accumulator.
+ * Returns true if there was enough time for one, and false otherwise
+ * (or if the accumulator isn't used). Meant to be called in a loop
+ * after each frame starts, doing one update per `true`. */
+bool p_time_frame_sched_step(struct p_time_frame_sched *s);
+
+/* Returns how far (from 0 to 1) the accumulator got into the next
+ * update step, for interpolating between the last 2 updates
+ * when rendering. Always 0 if the accumulator isn't used. */
+f32 p_time_frame_sched_get_alpha(const struct p_time_frame_sched *s);
+
+/* Retrieves the frame pacing statistics of `s` into `o` */
+void p_time_frame_sched_get_stats(const struct p_time_frame_sched *s,
+    struct p_time_frame_stats *o);
+
 #endif /* P_TIME_H_ */
@@ -31,63 +31,152 @@ void p_mt_thread_wait(p_mt_thread_t *thread_p);
 /* Forcibly, immidiately terminates `thread`. */
 void p_mt_thread_terminate(p_mt_thread_t *thread_p);
 
-/** MUTEXES **/
-struct p_mt_mutex;
-typedef struct p_mt_mutex * p_mt_mutex_t;
-
-/* Should be used for static (global) mutexes ONLY.
- * If a static mutex is initialized to this value,
- * it will be autmatically cleaned up when the program exits. */
-#define P_MT_MUTEX_INITIALIZER ((void *)-1)
+/* Returns the number of CPUs (logical cores) that are currently online.
+ * Always returns at least 1. */
+u32 p_mt_get_cpu_count(void);
 
-/* A value that can be used to invalidate a mutex handle */
-#define P_MT_MUTEX_NULL ((p_mt_mutex_t)(void *)0)
-
-/* Returns a newly allocated mutex. Always succeeds. */
+/** MUTEXES **/
+/* Both the mutexes and the condition variables are plain values
+ * that don't own any memory, and all zeroes is always a valid
+ * (unlocked / not signaled) state. This means that they can be
+ * initialized statically (or with `memset`/`calloc`) with no races,
+ * allocations or cleanup.
+ *
+ * The members are only there to reserve the space for the platform's
+ * implementation and should never be accessed directly.
+ * `zero_` is the biggest one, so that `{ 0 }` zeroes all of the others. */
+typedef struct p_mt_mutex {
+    union {
+        u64 zero_;
+        /* Linux: 0 - unlocked, 1 - locked, 2 - locked with waiters */
+        _Atomic u32 futex_;
+        /* Windows: an `SRWLOCK` */
+        void *srwlock_;
+    } impl_;
+} p_mt_mutex_t;
+
+/* Can be used to initialize any mutex, static or not */
+#define P_MT_MUTEX_INITIALIZER { { 0 } }
+
+/* Returns a new (unlocked) mutex. Always succeeds. */
 p_mt_mutex_t p_mt_mutex_create(void);
 
-/* Locks the mutex pointed to by `mutex_p`.
- *
- * If it's NULL, a new mutex is allocated and `*mutex_p` is set to point to it.
- *
- * If the value of `*mutex_p` is equal to `P_MT_MUTEX_INITIALIZER`,
- * then in addition to the above, the new mutex is also registered
- * for automatic cleanup at program exit. */
+/* Locks the mutex pointed to by `mutex_p`,
+ * blocking until it becomes available. */
 void p_mt_mutex_lock(p_mt_mutex_t *mutex_p);
 
 /* Unlocks the mutex that `mutex_p` points to.
- * If `mutex_p` points to NULL, nothing happens. */
+ * If it isn't locked, nothing happens. */
 void p_mt_mutex_unlock(p_mt_mutex_t *mutex_p);
 
-/* Deallocates the mutex that `mutex_p` points to. */
+/* Waits until the mutex that `mutex_p` points to isn't used anymore,
+ * and resets it to the unlocked state. */
 void p_mt_mutex_destroy(p_mt_mutex_t *mutex_p);
 
-/* Deallocates all global mutexes initialized with `P_MT_MUTEX_INITIALIZER`.
- * Shouldn't be used outside of testing as it might leave dangling pointers,
- * plus it isn't really useful anyway. */
-void p_mt_mutex_global_cleanup(void);
-
 /** CONDITION VARIABLES **/
-struct p_mt_cond;
-typedef struct p_mt_cond * p_mt_cond_t;
-
-/* A value that can be used to invalidate a condition variable handle */
-#define P_MT_COND_NULL ((p_mt_cond_t)(void *)0)
+typedef struct p_mt_cond {
+    union {
+        u64 zero_;
+        /* Linux: `seq` is incremented on every signal,
+         * and is what the waiters sleep on */
+        struct {
+            _Atomic u32 seq;
+            _Atomic u32 n_waiters;
+        } futex_;
+        /* Windows: a `CONDITION_VARIABLE` */
+        void *cv_;
+    } impl_;
+} p_mt_cond_t;
+
+/* Can be used to initialize any condition variable, static or not */
+#define P_MT_COND_INITIALIZER { { 0 } }
 
 /* Returns a new condition variable. Always succeeds. */
 p_mt_cond_t p_mt_cond_create(void);
 
 /* Causes the current thread to block until the condition variable
- * `cond` is signaled (using `p_mt_cond_signal`) from another thread.
+ * `cond` is signaled (using `p_mt_cond_signal` or `p_mt_cond_broadcast`)
+ * from another thread.
  * This function must be called when `mutex` is locked.
- * It will also automatically unlock `mutex` prior to returning. */
-void p_mt_cond_wait(p_mt_cond_t cond, p_mt_mutex_t mutex);
+ * It will also automatically unlock `mutex` prior to returning.
+ *
+ * Like with any condition variable, the thread might also wake up
+ * without being signaled, so the condition it waits for
+ * must always be checked again in a loop. */
+void p_mt_cond_wait(p_mt_cond_t *cond, p_mt_mutex_t *mutex);
+
+/* Wakes up (at least) one of the threads blocked on waiting
+ * (`p_mt_cond_wait`) for the condition variable `cond` */
+void p_mt_cond_signal(p_mt_cond_t *cond);
 
 /* Wakes up all threads blocked on waiting (`p_mt_cond_wait`)
  * for the condition variable `cond` */
-void p_mt_cond_signal(p_mt_cond_t cond);
+void p_mt_cond_broadcast(p_mt_cond_t *cond);
 
-/* Destroys the condition variable that `cond_p` points to. */
+/* Resets the condition variable that `cond_p` points to.
+ * There must be no threads waiting for it. */
 void p_mt_cond_destroy(p_mt_cond_t *cond_p);
 
+/** JOBS **/
+/* A fixed pool of worker threads that run small, independent jobs.
+ *
+ * Each worker has its own deque (a Chase-Lev work-stealing deque)
+ * to which it pushes the jobs that it submits itself, and from which
+ * it pops them in LIFO order (the data they use is still in the cache).
+ * Workers that run out of jobs steal the oldest ones from the others.
+ * Jobs submitted from threads outside of the pool go to a shared queue.
+ *
+ * There are no explicit dependencies between jobs. Instead, jobs can be
+ * tracked with a counter, and waiting for it (`p_mt_jobs_wait`) runs
+ * other jobs in the meantime, so a job may submit more jobs and wait
+ * for them without ever tying up a worker (or deadlocking the pool). */
+struct p_mt_jobs;
+
+typedef void (*p_mt_job_fn_t)(void *arg);
+
+/* Processes the elements [`start`, `end`) of a `p_mt_jobs_parallel_for` */
+typedef void (*p_mt_job_range_fn_t)(void *arg, u32 start, u32 end);
+
+/* The number of jobs that were submitted with it, but haven't finished yet.
+ * Must be initialized to `P_MT_JOB_COUNTER_INIT` (or zeroed) before use,
+ * and can be reused once it's been waited for. */
+struct p_mt_job_counter {
+    _Atomic u32 n_pending;
+};
+#define P_MT_JOB_COUNTER_INIT { 0 }
+
+/* Spawns a pool of `n_threads` - 1 workers. The thread that waits for
+ * the jobs (`p_mt_jobs_wait`) also runs them, which makes up the last one.
+ * If `n_threads` is 0, there is one thread per CPU.
+ * If it's 1, there are no workers and all jobs run in `p_mt_jobs_wait`.
+ * Returns NULL on failure. */
+struct p_mt_jobs * p_mt_jobs_create(u32 n_threads);
+
+/* Stops all the workers and frees the pool that `jobs_p` points to.
+ * All the submitted jobs must have been waited for at this point. */
+void p_mt_jobs_destroy(struct p_mt_jobs **jobs_p);
+
+/* Returns the total number of threads that run the jobs of `jobs`
+ * (the workers plus the waiting thread) */
+u32 p_mt_jobs_get_n_threads(const struct p_mt_jobs *jobs);
+
+/* Queues up `fn(arg)` to be run by one of the threads in `jobs`.
+ * If `counter` isn't NULL, it's incremented now and decremented
+ * once the job has finished.
+ * Safe to call from any thread, including from inside of other jobs. */
+void p_mt_jobs_submit(struct p_mt_jobs *jobs, p_mt_job_fn_t fn, void *arg,
+    struct p_mt_job_counter *counter);
+
+/* Runs the jobs of `jobs` until all the ones tracked by `counter`
+ * have finished, and then returns. Once there's nothing left to run,
+ * the calling thread goes to sleep until the last one finishes. */
+void p_mt_jobs_wait(struct p_mt_jobs *jobs, struct p_mt_job_counter *counter);
+
+/* Calls `fn` for all the elements in [0, `n`), split into ranges
+ * of (at most) `grain` elements, in parallel. If `grain` is 0,
+ * it's picked so that each thread gets a few ranges.
+ * Returns once all the ranges have been processed. */
+void p_mt_jobs_parallel_for(struct p_mt_jobs *jobs, u32 n, u32 grain,
+    p_mt_job_range_fn_t fn, void *arg);
+
 #endif /* P_THREAD_H_ */
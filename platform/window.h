@@ -3,6 +3,7 @@
 
 #include <core/int.h>
 #include <core/pixel.h>
+#include <core/histogram.h>
 #include <core/shapes.h>
 #include <stdbool.h>
 
@@ -15,7 +16,9 @@ struct p_window;
                                                                             \
     /* Only used for testing purposes.                                      \
      * Contradicts with `P_WINDOW_NORMAL` (obviously)                       \
-     * and doesn't support any GPU acceleration. */                         \
+     * and doesn't support any GPU acceleration.                            \
+     * Nothing is displayed; the buffers are just plain memory,             \
+     * which is enough to run the renderer without a display. */            \
     X_(P_WINDOW_TYPE_DUMMY, 3)                                              \
                                                                             \
     /** WINDOW AREA AND POSITIONING **/                                     \
@@ -41,6 +44,19 @@ struct p_window;
      * This is the default. */                                              \
     X_(P_WINDOW_VSYNC_SUPPORT_OPTIONAL, 16)                                 \
                                                                             \
+    /** BUFFERING **/                                                       \
+    /* Only affects software rendering. Makes the window keep (at least)    \
+     * 3 buffers instead of 2, so that `p_window_swap_buffers`              \
+     * never has to wait for (or fail because of) the previous page flip.   \
+     * A frame that's presented while the previous one is still waiting     \
+     * to get on the screen is queued up, and if another one comes in       \
+     * before that happens, it replaces the queued one (which then counts   \
+     * as coalesced, see `p_window_get_present_stats`).                     \
+     *                                                                      \
+     * The back buffer returned by `p_window_swap_buffers` can then         \
+     * be any of them (not just the one presented 2 frames ago). */         \
+    X_(P_WINDOW_TRIPLE_BUFFERED, 18)                                        \
+                                                                            \
     /** GPU ACCELERATION FLAGS **/                                          \
     /* The fallback order is as follows:                                    \
      * Vulkan -> OpenGL -> Software (none) -> FAIL.                         \
@@ -146,6 +162,28 @@ enum p_window_present_mode {
 struct pixel_flat_data * p_window_swap_buffers(struct p_window *win,
     const enum p_window_present_mode present_mode);
 
+/* Same as `p_window_swap_buffers`, except that only the parts of the window
+ * described by the `n_damage_rects` rectangles in `damage_rects` are
+ * guaranteed to be updated. Software-rendered windows use this to copy
+ * and upload only the pixels that have actually changed.
+ *
+ * The rects are relative to the top-left corner of the window
+ * (i.e. in the same coordinates as the pixel buffer).
+ *
+ * The caller guarantees that all the pixels outside of the damage
+ * are the same as in the previously presented frame.
+ * The backends take care of their own buffering (e.g. a back buffer that
+ * is 2 frames old also gets the damage of the previous frame),
+ * so the caller only ever needs to describe the difference
+ * between this frame and the last one that was successfully presented.
+ *
+ * If `damage_rects` is NULL, the whole window is considered damaged.
+ * If `n_damage_rects` is 0 (and `damage_rects` isn't NULL),
+ * nothing has changed, but the frame is still presented. */
+struct pixel_flat_data * p_window_swap_buffers_damaged(struct p_window *win,
+    const enum p_window_present_mode present_mode,
+    const rect_t *damage_rects, u32 n_damage_rects);
+
 /* Closes, destroys and sets to `NULL` the window that `win_p` points to */
 void p_window_close(struct p_window **win_p);
 
@@ -159,6 +197,55 @@ struct p_window_info {
 };
 void p_window_get_info(const struct p_window *win, struct p_window_info *out);
 
+/* Retrieves the counters of the frames that were passed to
+ * `p_window_swap_buffers` successfully, but never made it
+ * to the screen on their own, into `out`.
+ * Backends that always present every frame report 0 for both. */
+struct p_window_present_stats {
+    /* Frames that were merged with the next one
+     * because the previous presentation was still in progress */
+    u64 n_coalesced_frames;
+
+    /* Frames that couldn't be presented at all */
+    u64 n_dropped_frames;
+};
+void p_window_get_present_stats(const struct p_window *win,
+    struct p_window_present_stats *out);
+
+/* Retrieves the frame pacing statistics of `win` into `out`.
+ *
+ * Every successful call to `p_window_swap_buffers` is timestamped
+ * and matched with the `P_EVENT_PAGE_FLIP` that puts its frame
+ * on the screen. The flip's timestamp (and vblank sequence number)
+ * comes from the display server or the kernel where possible.
+ * All durations are in nanoseconds, and the histograms only cover
+ * the last `HISTOGRAM_MAX_SAMPLES` frames. */
+struct p_window_present_timing {
+    /* Successful `p_window_swap_buffers` calls */
+    u64 n_swaps;
+
+    /* Page flips that succeeded/failed */
+    u64 n_flips;
+    u64 n_failed_flips;
+
+    /* The display's nominal refresh interval (0 if unknown) */
+    u64 refresh_interval_ns;
+
+    /* From the `p_window_swap_buffers` call to the frame's page flip */
+    struct histogram_summary swap_to_flip_ns;
+
+    /* Between 2 consecutive successful page flips */
+    struct histogram_summary flip_interval_ns;
+
+    /* The number of vblanks between 2 consecutive successful page flips
+     * that didn't show a new frame. Only available if the backend
+     * reports the vblank sequence numbers or the refresh interval
+     * is known; otherwise no samples are collected. */
+    struct histogram_summary missed_vblanks;
+};
+void p_window_get_present_timing(struct p_window *win,
+    struct p_window_present_timing *out);
+
 /* Sets the GPU acceleration mode in `win` to `new_acceleration_mode`.
  *
  * Destroys/deallocates everything associated with the previous acceleration
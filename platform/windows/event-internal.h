@@ -0,0 +1,10 @@
+#ifndef EVENT_INTERNAL_H_
+#define EVENT_INTERNAL_H_
+
+#include <platform/common/guard.h>
+
+/* Makes `p_event_wait` return, e.g. when the window thread
+ * receives input. Safe to call from any thread. */
+void event_wake(void);
+
+#endif /* EVENT_INTERNAL_H_ */
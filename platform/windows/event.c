@@ -1,89 +1,206 @@
 #include "../event.h"
+#include "../ptime.h"
 #include "../thread.h"
 #include <core/int.h>
+#include <core/log.h>
 #include <core/util.h>
-#include <core/vector.h>
+#include <core/mpsc-queue.h>
+#include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif /* WIN32_LEAN_AND_MEAN */
+#include <windows.h>
+#include <synchapi.h>
+#include <handleapi.h>
+#define P_INTERNAL_GUARD__
+#include "error.h"
+#undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include "event-internal.h"
+#undef P_INTERNAL_GUARD__
 
 #define MODULE_NAME "event"
 
-static VECTOR(struct p_event) g_event_queue = NULL;
+/* Enough for a few frames' worth of input and page flips
+ * even if the main loop stalls for a while */
+#define EVENT_QUEUE_CAPACITY 1024
+
+/* The queue itself is lock-free. The mutex only guards its creation
+ * and destruction, which the fast paths check for with
+ * `g_event_queue_initialized` */
+static struct mpsc_queue g_event_queue;
+static _Atomic bool g_event_queue_initialized = false;
 static p_mt_mutex_t g_event_queue_mutex = P_MT_MUTEX_INITIALIZER;
 
+/* A QUIT event that didn't fit into the queue.
+ * It's delivered after everything that's already in there,
+ * as losing it would make the app impossible to close. */
+static _Atomic bool g_quit_overflowed = false;
+
+/* An auto-reset event object that's set on every `p_event_send`,
+ * for `p_event_wait` to wait on. The keyboard and mouse are polled
+ * (with `GetAsyncKeyState`), so there are no input handles to wait on;
+ * instead, the window thread sets it when the window receives input. */
+static HANDLE g_wake_event = NULL;
+
 static void setup_event_queue(bool warn);
 static void destroy_event_queue(void);
+static void ensure_event_queue(void);
 
 i32 p_event_poll(struct p_event *o)
 {
     u_check_params(o != NULL);
-    u32 n_events = 0;
 
-    p_mt_mutex_lock(&g_event_queue_mutex);
-
-    if (g_event_queue == NULL)
-        setup_event_queue(true);
+    ensure_event_queue();
 
-    n_events = vector_size(g_event_queue);
-    if (n_events == 0)
-        goto ret;
+    /* Count the event that's about to be popped too */
+    const u64 n_events = mpsc_queue_size(&g_event_queue);
+    if (mpsc_queue_pop(&g_event_queue, o)) {
+        if (!atomic_exchange(&g_quit_overflowed, false))
+            return 0;
 
-    memcpy(o,
-        (u8 *)vector_end(g_event_queue) - sizeof(struct p_event),
-        sizeof(struct p_event)
-    );
-    vector_pop_back(&g_event_queue);
+        memset(o, 0, sizeof(struct p_event));
+        o->type = P_EVENT_QUIT;
+        p_time(&o->time);
+    }
 
     if (o->type == P_EVENT_QUIT)
         s_log_verbose("Caught QUIT event");
 
-ret:
-    p_mt_mutex_unlock(&g_event_queue_mutex);
-    return n_events;
+    return n_events > 0 ? (i32)n_events : 1;
 }
 
 void p_event_send(const struct p_event *ev)
 {
     u_check_params(ev != NULL);
 
-    p_mt_mutex_lock(&g_event_queue_mutex);
-
     switch (ev->type) {
         case P_EVENT_CTL_INIT_:
+            p_mt_mutex_lock(&g_event_queue_mutex);
             setup_event_queue(false);
+            p_mt_mutex_unlock(&g_event_queue_mutex);
             break;
         case P_EVENT_CTL_DESTROY_:
+            p_mt_mutex_lock(&g_event_queue_mutex);
             destroy_event_queue();
+            p_mt_mutex_unlock(&g_event_queue_mutex);
             break;
         default:
-            if (g_event_queue == NULL)
-                setup_event_queue(true);
-            vector_push_back(&g_event_queue, *ev);
+            ensure_event_queue();
+
+            struct p_event tmp_ev;
+            memcpy(&tmp_ev, ev, sizeof(struct p_event));
+            p_time(&tmp_ev.time);
+            if (mpsc_queue_push(&g_event_queue, &tmp_ev)) {
+                /* Only warn once per burst of dropped events */
+                if (mpsc_queue_get_n_overflows(&g_event_queue) % 256 == 1)
+                    s_log_warn("The event queue is full; dropping events");
+
+                if (tmp_ev.type != P_EVENT_QUIT)
+                    break;
+                atomic_store(&g_quit_overflowed, true);
+            }
+            event_wake();
             break;
     }
+}
 
-    p_mt_mutex_unlock(&g_event_queue_mutex);
+i32 p_event_wait(const timestamp_t *deadline)
+{
+    ensure_event_queue();
+
+    DWORD timeout_ms = INFINITE;
+    if (deadline != NULL) {
+        timestamp_t now, remaining;
+        p_time_get_ticks(&now);
+        timestamp_delta(remaining, now, *deadline);
+
+        /* Round up, so that we never wake up before the deadline */
+        const i64 remaining_ns = remaining.s * 1000000000LL + remaining.ns;
+        timeout_ms = remaining_ns > 0 ? (remaining_ns + 999999) / 1000000 : 0;
+    }
+
+    if (g_wake_event == NULL) {
+        if (timeout_ms == INFINITE)
+            return -1;
+
+        Sleep(timeout_ms);
+        return 0;
+    }
+
+    return WaitForSingleObject(g_wake_event, timeout_ms) == WAIT_OBJECT_0;
+}
+
+void event_wake(void)
+{
+    if (g_wake_event != NULL)
+        (void) SetEvent(g_wake_event);
+}
+
+u64 p_event_get_n_dropped(void)
+{
+    if (!atomic_load(&g_event_queue_initialized))
+        return 0;
+
+    return mpsc_queue_get_n_overflows(&g_event_queue);
 }
 
 static void setup_event_queue(bool warn)
 {
-    if (g_event_queue != NULL) {
+    if (atomic_load(&g_event_queue_initialized)) {
         s_log_warn("%s: Event queue already initialized!", __func__);
         return;
     } else if (warn) {
         s_log_warn("Event queue does not exist, initializing...");
     }
 
-    g_event_queue = vector_new(struct p_event);
+    if (mpsc_queue_init(&g_event_queue, EVENT_QUEUE_CAPACITY,
+            sizeof(struct p_event)))
+    {
+        s_log_fatal("Failed to set up the event queue!");
+    }
+    atomic_store(&g_quit_overflowed, false);
+
+    /* Not fatal - `p_event_wait` can always just sleep until the deadline */
+    g_wake_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (g_wake_event == NULL) {
+        s_log_error("Failed to create the wake event object: %s",
+            get_last_error_msg());
+    }
+
+    atomic_store(&g_event_queue_initialized, true);
 }
 
 static void destroy_event_queue(void)
 {
-    if (g_event_queue == NULL) {
+    if (!atomic_load(&g_event_queue_initialized)) {
         s_log_warn("%s: Event queue already destroyed!", __func__);
         return;
     }
     s_log_verbose("Destroying event queue...");
 
-    vector_destroy(&g_event_queue);
-    g_event_queue = NULL;
+    const u64 n_dropped = mpsc_queue_get_n_overflows(&g_event_queue);
+    if (n_dropped > 0)
+        s_log_warn("%lu event(s) were dropped because the queue was full",
+            n_dropped);
+
+    atomic_store(&g_event_queue_initialized, false);
+    mpsc_queue_destroy(&g_event_queue);
+    if (g_wake_event != NULL) {
+        (void) CloseHandle(g_wake_event);
+        g_wake_event = NULL;
+    }
+}
+
+static void ensure_event_queue(void)
+{
+    if (atomic_load(&g_event_queue_initialized))
+        return;
+
+    p_mt_mutex_lock(&g_event_queue_mutex);
+    if (!atomic_load(&g_event_queue_initialized))
+        setup_event_queue(true);
+    p_mt_mutex_unlock(&g_event_queue_mutex);
 }
@@ -2,7 +2,6 @@
 #include "core/log.h"
 #include <core/int.h>
 #include <core/util.h>
-#include <core/vector.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,26 +24,17 @@
 
 #define MODULE_NAME "thread"
 
-struct p_mt_mutex {
-    CRITICAL_SECTION cs;
-    _Atomic bool initialized;
-    _Atomic bool is_static;
-};
+/* `SRWLOCK`s and `CONDITION_VARIABLE`s are pointer-sized, and are valid
+ * when zeroed (`SRWLOCK_INIT` and `CONDITION_VARIABLE_INIT` are both 0),
+ * so they can be stored right inside of `p_mt_mutex_t` and `p_mt_cond_t` */
+static_assert(sizeof(SRWLOCK) == sizeof(((p_mt_mutex_t *)0)->impl_.srwlock_),
+    "SRWLOCK must fit in p_mt_mutex_t");
+static_assert(sizeof(CONDITION_VARIABLE) ==
+    sizeof(((p_mt_cond_t *)0)->impl_.cv_),
+    "CONDITION_VARIABLE must fit in p_mt_cond_t");
 
-static bool should_not_destroy_master_mutex = false;
-static struct p_mt_mutex master_mutex = {
-    .initialized = false,
-    .is_static = true,
-};
-static VECTOR(struct p_mt_mutex *) global_mutex_registry = NULL;
-static volatile atomic_flag registered_atexit_cleanup = ATOMIC_FLAG_INIT;
-
-struct p_mt_cond {
-    CONDITION_VARIABLE cond;
-};
-
-static void add_mutex_to_registry(struct p_mt_mutex *m);
-static void cleanup_global_mutexes(void);
+#define get_srwlock(mutex_p) ((SRWLOCK *)&(mutex_p)->impl_.srwlock_)
+#define get_cv(cond_p) ((CONDITION_VARIABLE *)&(cond_p)->impl_.cv_)
 
 i32 p_mt_thread_create(p_mt_thread_t *o,
     p_mt_thread_fn_t thread_fn, void *arg)
@@ -97,6 +87,14 @@ void p_mt_thread_wait(p_mt_thread_t *thread_p)
     *thread_p = NULL;
 }
 
+u32 p_mt_get_cpu_count(void)
+{
+    SYSTEM_INFO info = { 0 };
+    GetSystemInfo(&info);
+
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
 void p_mt_thread_terminate(p_mt_thread_t *thread_p)
 {
     u_check_params(thread_p != NULL);
@@ -113,141 +111,74 @@ void p_mt_thread_terminate(p_mt_thread_t *thread_p)
 
 p_mt_mutex_t p_mt_mutex_create(void)
 {
-    struct p_mt_mutex *m = calloc(1, sizeof(struct p_mt_mutex));
-    s_assert(m != NULL, "calloc() failed for struct mutex");
-
-    InitializeCriticalSection(&m->cs);
-    atomic_store(&m->initialized, true);
-    atomic_store(&m->is_static, false);
-
-    return m;
+    return (p_mt_mutex_t) P_MT_MUTEX_INITIALIZER;
 }
 
 void p_mt_mutex_lock(p_mt_mutex_t *mutex_p)
 {
     u_check_params(mutex_p != NULL);
-
-    if (*mutex_p == P_MT_MUTEX_INITIALIZER) {
-        *mutex_p = p_mt_mutex_create();
-        atomic_store(&(*mutex_p)->is_static, true);
-        add_mutex_to_registry(*mutex_p);
-    } if (*mutex_p == NULL || !atomic_load(&(*mutex_p)->initialized)) {
-        *mutex_p = p_mt_mutex_create();
-    }
-
-    EnterCriticalSection(&(*mutex_p)->cs);
+    AcquireSRWLockExclusive(get_srwlock(mutex_p));
 }
 
 void p_mt_mutex_unlock(p_mt_mutex_t *mutex_p)
 {
     u_check_params(mutex_p != NULL);
-    if (*mutex_p == NULL || !atomic_load(&(*mutex_p)->initialized))
+
+    /* Unlike critical sections, SRW locks can't be "unlocked"
+     * when they aren't locked */
+    if (mutex_p->impl_.srwlock_ == NULL)
         return;
 
-    LeaveCriticalSection(&(*mutex_p)->cs);
+    ReleaseSRWLockExclusive(get_srwlock(mutex_p));
 }
 
 void p_mt_mutex_destroy(p_mt_mutex_t *mutex_p)
 {
-    if (mutex_p == NULL || *mutex_p == NULL) return;
-
-    struct p_mt_mutex *m = *mutex_p;
-    if (!atomic_load(&m->initialized)) return;
+    if (mutex_p == NULL) return;
 
-    DeleteCriticalSection(&m->cs);
+    /* If the mutex is locked, block until it gets unlocked */
+    AcquireSRWLockExclusive(get_srwlock(mutex_p));
+    ReleaseSRWLockExclusive(get_srwlock(mutex_p));
 
-    atomic_store(&m->initialized, false);
-    atomic_store(&m->is_static, false);
-    u_nfree(mutex_p);
+    *mutex_p = (p_mt_mutex_t) P_MT_MUTEX_INITIALIZER;
 }
 
-void p_mt_mutex_global_cleanup(void)
+p_mt_cond_t p_mt_cond_create(void)
 {
-    if (atomic_load(&master_mutex.initialized))
-        EnterCriticalSection(&master_mutex.cs);
-
-    cleanup_global_mutexes();
-
-    if (atomic_load(&master_mutex.initialized))
-        LeaveCriticalSection(&master_mutex.cs);
+    return (p_mt_cond_t) P_MT_COND_INITIALIZER;
 }
 
-p_mt_cond_t p_mt_cond_create(void)
+void p_mt_cond_wait(p_mt_cond_t *cond, p_mt_mutex_t *mutex)
 {
-    p_mt_cond_t cond = calloc(1, sizeof(struct p_mt_cond));
-    s_assert(cond != NULL, "calloc() failed for new condition variable");
+    u_check_params(cond != NULL && mutex != NULL);
 
-    InitializeConditionVariable(&cond->cond);
+    if (SleepConditionVariableSRW(get_cv(cond), get_srwlock(mutex),
+            INFINITE, 0) == 0)
+    {
+        s_log_fatal("SleepConditionVariableSRW failed: %s",
+            get_last_error_msg());
+    }
 
-    return cond;
+    /* The lock is re-acquired when waking up */
+    ReleaseSRWLockExclusive(get_srwlock(mutex));
 }
 
-void p_mt_cond_wait(p_mt_cond_t cond, p_mt_mutex_t mutex)
+void p_mt_cond_signal(p_mt_cond_t *cond)
 {
-    u_check_params(cond != NULL && mutex != NULL &&
-        atomic_load(&mutex->initialized));
-    SleepConditionVariableCS(&cond->cond, &mutex->cs, INFINITE);
+    u_check_params(cond != NULL);
+    WakeConditionVariable(get_cv(cond));
 }
 
-void p_mt_cond_signal(p_mt_cond_t cond)
+void p_mt_cond_broadcast(p_mt_cond_t *cond)
 {
     u_check_params(cond != NULL);
-    WakeConditionVariable(&cond->cond);
+    WakeAllConditionVariable(get_cv(cond));
 }
 
 void p_mt_cond_destroy(p_mt_cond_t *cond_p)
 {
-    if (cond_p == NULL || *cond_p == NULL)
+    if (cond_p == NULL)
         return;
 
-    u_nzfree(cond_p);
-}
-
-static void add_mutex_to_registry(struct p_mt_mutex *m)
-{
-    if (!atomic_load(&master_mutex.initialized)) {
-        InitializeCriticalSection(&master_mutex.cs);
-        atomic_store(&master_mutex.initialized, true);
-    }
-
-    EnterCriticalSection(&master_mutex.cs);
-
-    if (!atomic_flag_test_and_set(&registered_atexit_cleanup)) {
-        if (atexit(cleanup_global_mutexes)) {
-            s_log_fatal("Failed to atexit() "
-                "the global mutex cleanup function.");
-        }
-    }
-
-    if (global_mutex_registry == NULL)
-        global_mutex_registry = vector_new(struct p_mt_mutex *);
-
-    vector_push_back(&global_mutex_registry, m);
-
-    LeaveCriticalSection(&master_mutex.cs);
-}
-
-static void cleanup_global_mutexes(void)
-{
-    for (u32 i = 0; i < vector_size(global_mutex_registry); i++) {
-        struct p_mt_mutex *curr_mutex = global_mutex_registry[i];
-
-        DeleteCriticalSection(&curr_mutex->cs);
-        atomic_store(&curr_mutex->initialized, false);
-        atomic_store(&curr_mutex->is_static, false);
-
-        free(curr_mutex);
-        global_mutex_registry[i] = NULL;
-    }
-
-    s_log_debug("Cleaned up all (%u) global mutexes.",
-        vector_size(global_mutex_registry)
-    );
-    vector_destroy(&global_mutex_registry);
-
-    /* If we're called at exit, clean up the master mutex too */
-    if (!should_not_destroy_master_mutex) {
-        DeleteCriticalSection(&master_mutex.cs);
-        atomic_store(&master_mutex.initialized, false);
-    }
+    *cond_p = (p_mt_cond_t) P_MT_COND_INITIALIZER;
 }
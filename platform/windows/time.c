@@ -15,6 +15,12 @@
 
 #define MODULE_NAME "time"
 
+/* How much `Sleep` can oversleep depends on the system timer resolution.
+ * That's 15.6 ms by default, but it's usually raised to 1 ms
+ * by something else that's running (and spinning for a whole frame
+ * just in case it isn't would be a waste) */
+#define WINDOWS_SLEEP_SLACK_ms 2
+
 static volatile atomic_flag frequency_initialized = ATOMIC_FLAG_INIT;
 static _Atomic u64 frequency;
 
@@ -118,3 +124,25 @@ void p_time_sleep(u32 seconds)
 {
     Sleep(seconds * 1000);
 }
+
+void p_time_sleep_until(const timestamp_t *deadline)
+{
+    u_check_params(deadline != NULL);
+
+    timestamp_t now, remaining;
+    p_time_get_ticks(&now);
+    timestamp_delta(remaining, now, *deadline);
+
+    /* Stop sleeping early enough that an oversleep
+     * doesn't make us miss the deadline */
+    const i64 remaining_us = remaining.s * 1000000 + remaining.ns / 1000;
+    const i64 sleep_ms =
+        (remaining_us - P_TIME_SPIN_MARGIN_us) / 1000 - WINDOWS_SLEEP_SLACK_ms;
+    if (sleep_ms > 0)
+        Sleep(sleep_ms);
+
+    do {
+        p_time_get_ticks(&now);
+        timestamp_delta(remaining, now, *deadline);
+    } while (remaining.s >= 0 && (remaining.s > 0 || remaining.ns > 0));
+}
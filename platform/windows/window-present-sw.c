@@ -50,7 +50,7 @@ i32 render_software_request_init_and_wait(HWND win_handle,
 
     return
         window_thread_request_operation_and_wait(win_handle,
-            REQ_OP_RENDER_INIT_SOFTWARE, &req, P_MT_MUTEX_NULL);
+            REQ_OP_RENDER_INIT_SOFTWARE, &req, NULL);
 }
 
 struct pixel_flat_data *
@@ -75,6 +75,7 @@ render_software_swap_and_request_present(HWND win_handle,
 
         ctx->user_ret.w = ctx->back_buf->w;
         ctx->user_ret.h = ctx->back_buf->h;
+        ctx->user_ret.stride = ctx->back_buf->w;
         ctx->user_ret.buf = ctx->back_buf->pixels;
 
         ctx->swap_done = true;
@@ -89,8 +90,8 @@ render_software_swap_and_request_present(HWND win_handle,
         req->type = REQ_OP_RENDER_PRESENT_SOFTWARE;
         req->arg = &ctx->front_buf->present_req_arg;
         req->status = REQ_STATUS_NOT_STARTED;
-        req->request_mutex = ctx->swap_mutex;
-        req->completion_cond = P_MT_COND_NULL;
+        req->request_mutex = &ctx->swap_mutex;
+        req->completion_cond = NULL;
         req->win_handle = win_handle;
 
         window_thread_request_operation(req);
@@ -108,7 +109,7 @@ void render_software_request_destruction_and_wait(HWND win_handle,
 
     struct render_destroy_software_req req = { .ctx = ctx };
     (void) window_thread_request_operation_and_wait(win_handle,
-        REQ_OP_RENDER_DESTROY_SOFTWARE, &req, P_MT_MUTEX_NULL);
+        REQ_OP_RENDER_DESTROY_SOFTWARE, &req, NULL);
 }
 
 enum window_thread_request_status render_software_handle_window_thread_request(
@@ -178,6 +179,7 @@ static i32 do_render_init_software(struct window_render_software_ctx *ctx,
 
     ctx->user_ret.w = ctx->back_buf->w;
     ctx->user_ret.h = ctx->back_buf->h;
+    ctx->user_ret.stride = ctx->back_buf->w;
     ctx->user_ret.buf = ctx->back_buf->pixels;
 
     return 0;
@@ -255,16 +257,14 @@ static void do_render_destroy_software(struct window_render_software_ctx *ctx)
     if (!atomic_exchange(&ctx->initialized_, false))
         return;
 
-    if (ctx->swap_mutex != P_MT_MUTEX_NULL) {
-        ctx->swap_done = true;
-        p_mt_mutex_lock(&ctx->swap_mutex);
-        p_mt_mutex_unlock(&ctx->swap_mutex);
-        p_mt_mutex_destroy(&ctx->swap_mutex);
-        ctx->swap_done = false;
-    }
+    ctx->swap_done = true;
+    p_mt_mutex_lock(&ctx->swap_mutex);
+    p_mt_mutex_unlock(&ctx->swap_mutex);
+    p_mt_mutex_destroy(&ctx->swap_mutex);
+    ctx->swap_done = false;
 
     ctx->user_ret.buf = NULL;
-    ctx->user_ret.w = ctx->user_ret.h = 0;
+    ctx->user_ret.w = ctx->user_ret.h = ctx->user_ret.stride = 0;
 
     if (ctx->window_thread_data_.memdc != NULL) {
         if (ctx->window_thread_data_.memdc_old_bitmap != NULL) {
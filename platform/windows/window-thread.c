@@ -16,6 +16,9 @@
 #define P_INTERNAL_GUARD__
 #include "global.h"
 #undef P_INTERNAL_GUARD__
+#define P_INTERNAL_GUARD__
+#include "event-internal.h"
+#undef P_INTERNAL_GUARD__
 #include "../event.h"
 #include "../thread.h"
 #include "../window.h"
@@ -83,16 +86,18 @@ void window_thread_fn(void *arg)
         init->result = result;
 
         /* All of `global_data` already initialized */
+
+        /* The condition variable lives in the init struct,
+         * so it must be signalled before the mutex is unlocked */
+        p_mt_cond_signal(&init->cond);
     }
     p_mt_mutex_unlock(&init->mutex);
 
     /* Any use of the init struct at this point is undefined behaviour
-     * because once the main thread gets signalled,
+     * because once the mutex is unlocked,
      * the underlying struct (that's constructed on the stack)
      * might go out of scope at any moment */
-    p_mt_cond_t cond = init->cond;
     init = NULL;
-    p_mt_cond_signal(cond);
 
     /* Exit if window init failed */
     if (result != 0)
@@ -119,7 +124,7 @@ void window_thread_request_operation(struct window_thread_request *req)
 {
     u_check_params(req != NULL
         && req->type > REQ_OP_MIN__ && req->type < REQ_OP_MAX__
-        && req->request_mutex != P_MT_MUTEX_NULL
+        && req->request_mutex != NULL
         && req->win_handle != NULL);
 
     req->status = REQ_STATUS_NOT_STARTED;
@@ -137,38 +142,39 @@ void window_thread_request_operation(struct window_thread_request *req)
 }
 
 i32 window_thread_request_operation_and_wait(HWND win_handle,
-    enum window_thread_request_type type, void *arg, p_mt_mutex_t mutex)
+    enum window_thread_request_type type, void *arg, p_mt_mutex_t *mutex)
 {
     u_check_params(type >= 0 && type < REQ_OP_MAX__ && win_handle != NULL);
 
     p_mt_cond_t cond = p_mt_cond_create();
-    p_mt_mutex_t tmp_mutex_ = P_MT_MUTEX_NULL;
-    if (mutex == P_MT_MUTEX_NULL) {
-        tmp_mutex_ = p_mt_mutex_create();
-        mutex = tmp_mutex_;
-    }
+    p_mt_mutex_t tmp_mutex_ = P_MT_MUTEX_INITIALIZER;
+    if (mutex == NULL)
+        mutex = &tmp_mutex_;
 
     enum window_thread_request_status status;
     struct window_thread_request req;
 
-    p_mt_mutex_lock(&mutex);
+    p_mt_mutex_lock(mutex);
     {
         req.win_handle = win_handle,
         req.type = type;
         req.arg = arg;
-        req.completion_cond = cond;
+        req.completion_cond = &cond;
         req.request_mutex = mutex;
         req.status = REQ_STATUS_NOT_STARTED;
 
         window_thread_request_operation(&req);
-        while (req.status == REQ_STATUS_PENDING)
-            p_mt_cond_wait(cond, mutex);
+        while (req.status == REQ_STATUS_PENDING) {
+            p_mt_cond_wait(&cond, mutex);
+            p_mt_mutex_lock(mutex);
+        }
 
         status = req.status;
     }
-    p_mt_mutex_unlock(&mutex);
+    p_mt_mutex_unlock(mutex);
 
-    if (tmp_mutex_ != P_MT_MUTEX_NULL)
+    p_mt_cond_destroy(&cond);
+    if (mutex == &tmp_mutex_)
         p_mt_mutex_destroy(&tmp_mutex_);
 
     return !(status == REQ_STATUS_SUCCESS);
@@ -247,15 +253,15 @@ static void handle_thread_request(void *arg)
     s_assert(req != NULL, "The request is NULL");
     s_assert(req->type > REQ_OP_MIN__ && req->type < REQ_OP_MAX__,
         "Invalid request type %d", req->type);
-    s_assert(req->request_mutex != P_MT_MUTEX_NULL,
+    s_assert(req->request_mutex != NULL,
         "The request status mutex is not initialized");
-    p_mt_mutex_lock(&req->request_mutex);
+    p_mt_mutex_lock(req->request_mutex);
     {
         s_assert(req->status == REQ_STATUS_PENDING,
             "Invalid value of the request status %d, (type: %d)",
             req->status, req->type);
     }
-    p_mt_mutex_unlock(&req->request_mutex);
+    p_mt_mutex_unlock(req->request_mutex);
 
     enum window_thread_request_status status;
 
@@ -277,11 +283,11 @@ static void handle_thread_request(void *arg)
         req->type, status);
 
     /* Signal completion to the requester */
-    p_mt_mutex_lock(&req->request_mutex);
+    p_mt_mutex_lock(req->request_mutex);
     req->status = status;
     if (req->completion_cond != NULL)
         p_mt_cond_signal(req->completion_cond);
-    p_mt_mutex_unlock(&req->request_mutex);
+    p_mt_mutex_unlock(req->request_mutex);
 }
 
 static LRESULT CALLBACK
@@ -308,6 +314,12 @@ window_procedure(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     struct window_thread_global_data *global_data_p =
         (void *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
 
+    /* The keyboard and mouse are polled,
+     * but the main loop might be waiting for input to do that */
+    if ((uMsg >= WM_KEYFIRST && uMsg <= WM_KEYLAST) ||
+        (uMsg >= WM_MOUSEFIRST && uMsg <= WM_MOUSELAST))
+        event_wake();
+
     switch (uMsg) {
     case WM_CLOSE:
         p_event_send(&(struct p_event) { .type = P_EVENT_QUIT });
@@ -106,12 +106,12 @@ struct window_thread_request {
 
     /* The mutex that protects the status variable
      * and (if used) the condition variable */
-    p_mt_mutex_t request_mutex;
+    p_mt_mutex_t *request_mutex;
 
     /* The condition variable that will be signalled once the request
      * is fulfilled. This parameter is optional -
      * if you don't want to use this, just set it to `NULL`. */
-    p_mt_cond_t completion_cond;
+    p_mt_cond_t *completion_cond;
 };
 
 /* The lower-level function that sends the request to the window thread.
@@ -144,6 +144,6 @@ void window_thread_request_operation(struct window_thread_request *req);
  *      reuse it between requests - for optimisation.
  */
 i32 window_thread_request_operation_and_wait(HWND win_handle,
-    enum window_thread_request_type type, void *arg, p_mt_mutex_t mutex);
+    enum window_thread_request_type type, void *arg, p_mt_mutex_t *mutex);
 
 #endif /* WINDOW_THREAD_H_ */
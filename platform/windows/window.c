@@ -65,10 +65,11 @@ struct p_window * p_window_open(const char *title,
         goto_error("Failed to init the window info struct");
 
     /* Create the window thread, which will do the rest of the work */
-    p_mt_mutex_t init_mutex = p_mt_mutex_create();
-    p_mt_cond_t init_cond = p_mt_cond_create();
-    struct window_init init;
-    p_mt_mutex_lock(&init_mutex);
+    struct window_init init = {
+        .cond = P_MT_COND_INITIALIZER,
+        .mutex = P_MT_MUTEX_INITIALIZER,
+    };
+    p_mt_mutex_lock(&init.mutex);
     {
         /* PARAMS */
         init.in.title = (const char *)title;
@@ -78,13 +79,9 @@ struct p_window * p_window_open(const char *title,
         /* Data returned by the thread */
         memset(&init.out, 0, sizeof(init.out));
 
-        /* Temporary thread sync/communication objects */
-        init.cond = init_cond,
-        init.mutex = init_mutex,
-
         init.result = -1;
     }
-    p_mt_mutex_unlock(&init_mutex);
+    p_mt_mutex_unlock(&init.mutex);
 
     /* Create the thread */
     atomic_store(&win->thread_started_, false);
@@ -96,10 +93,10 @@ struct p_window * p_window_open(const char *title,
     atomic_store(&win->thread_started_, true);
 
     /* Wait for the thread to complete window initialization */
-    p_mt_mutex_lock(&init_mutex);
-    {
-        while (init.result == -1)
-            p_mt_cond_wait(init_cond, init_mutex);
+    p_mt_mutex_lock(&init.mutex);
+    while (init.result == -1) {
+        p_mt_cond_wait(&init.cond, &init.mutex);
+        p_mt_mutex_lock(&init.mutex);
     }
     p_mt_mutex_unlock(&init.mutex);
 
@@ -172,6 +169,17 @@ struct pixel_flat_data * p_window_swap_buffers(struct p_window *win,
     }
 }
 
+struct pixel_flat_data * p_window_swap_buffers_damaged(struct p_window *win,
+    const enum p_window_present_mode present_mode,
+    const rect_t *damage_rects, u32 n_damage_rects)
+{
+    /* The whole window is always updated anyway */
+    (void) damage_rects;
+    (void) n_damage_rects;
+
+    return p_window_swap_buffers(win, present_mode);
+}
+
 void p_window_close(struct p_window **win_p)
 {
     if (win_p == NULL || *win_p == NULL || !atomic_load(&(*win_p)->exists_))
@@ -231,6 +239,24 @@ void p_window_get_info(const struct p_window *win, struct p_window_info *out)
     memcpy(out, &win->info, sizeof(struct p_window_info));
 }
 
+void p_window_get_present_stats(const struct p_window *win,
+    struct p_window_present_stats *out)
+{
+    u_check_params(win != NULL && out != NULL && atomic_load(&win->exists_));
+
+    /* Every frame is either presented or reported as failed */
+    memset(out, 0, sizeof(struct p_window_present_stats));
+}
+
+void p_window_get_present_timing(struct p_window *win,
+    struct p_window_present_timing *out)
+{
+    u_check_params(win != NULL && out != NULL && atomic_load(&win->exists_));
+
+    /* The page flips aren't tracked here (yet) */
+    memset(out, 0, sizeof(struct p_window_present_timing));
+}
+
 i32 p_window_set_acceleration(struct p_window *win,
     enum p_window_acceleration new_acceleration_mode)
 {
@@ -252,7 +278,7 @@ i32 p_window_set_acceleration(struct p_window *win,
         }
         struct render_destroy_software_req req = { .ctx = &win->render.sw };
         if (window_thread_request_operation_and_wait(win->win_handle,
-                REQ_OP_RENDER_DESTROY_SOFTWARE, &req, P_MT_MUTEX_NULL)
+                REQ_OP_RENDER_DESTROY_SOFTWARE, &req, NULL)
         ) {
             s_log_error("The render_destroy_software request failed!");
             return 1;
@@ -279,7 +305,7 @@ i32 p_window_set_acceleration(struct p_window *win,
             .ctx = &win->render.sw
         };
         if (window_thread_request_operation_and_wait(win->win_handle,
-                REQ_OP_RENDER_INIT_SOFTWARE, &req, P_MT_MUTEX_NULL)
+                REQ_OP_RENDER_INIT_SOFTWARE, &req, NULL)
         ) {
             s_log_error("Failed to initialize software rendering");
             return 1;
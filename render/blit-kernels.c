@@ -0,0 +1,483 @@
+#include <core/int.h>
+#include <core/log.h>
+#include <core/util.h>
+#include <core/math.h>
+#include <core/pixel.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#define R_INTERNAL_GUARD__
+#include "blit-kernels.h"
+#undef R_INTERNAL_GUARD__
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define R_BLIT_KERNELS_X86_ 1
+#include <immintrin.h>
+#define TARGET_SSE2_ __attribute__((target("sse2")))
+#define TARGET_AVX2_ __attribute__((target("avx2")))
+#else
+#define R_BLIT_KERNELS_X86_ 0
+#endif /* x86 && GNUC */
+
+#define MODULE_NAME "blit-kernels"
+
+static r_blit_row_fn_t scalar_copy;
+static r_blit_row_fn_t scalar_copy_swizzle;
+static r_blit_row_fn_t scalar_blend;
+static r_blit_row_fn_t scalar_blend_swizzle;
+static r_blit_row_fn_t scalar_blend_premul;
+static r_blit_row_fn_t scalar_blend_premul_swizzle;
+
+static const struct r_blit_kernels scalar_kernels = {
+    .name = "scalar",
+    .copy = scalar_copy,
+    .copy_swizzle = scalar_copy_swizzle,
+    .blend = scalar_blend,
+    .blend_swizzle = scalar_blend_swizzle,
+    .blend_premul = scalar_blend_premul,
+    .blend_premul_swizzle = scalar_blend_premul_swizzle,
+};
+
+#if (R_BLIT_KERNELS_X86_ == 1)
+static r_blit_row_fn_t sse2_copy_swizzle;
+static r_blit_row_fn_t sse2_blend;
+static r_blit_row_fn_t sse2_blend_swizzle;
+static r_blit_row_fn_t sse2_blend_premul;
+static r_blit_row_fn_t sse2_blend_premul_swizzle;
+
+/* A plain copy can't really be done any faster than with `memcpy`,
+ * which already uses the widest instructions available */
+static const struct r_blit_kernels sse2_kernels = {
+    .name = "sse2",
+    .copy = scalar_copy,
+    .copy_swizzle = sse2_copy_swizzle,
+    .blend = sse2_blend,
+    .blend_swizzle = sse2_blend_swizzle,
+    .blend_premul = sse2_blend_premul,
+    .blend_premul_swizzle = sse2_blend_premul_swizzle,
+};
+
+static r_blit_row_fn_t avx2_copy_swizzle;
+static r_blit_row_fn_t avx2_blend;
+static r_blit_row_fn_t avx2_blend_swizzle;
+static r_blit_row_fn_t avx2_blend_premul;
+static r_blit_row_fn_t avx2_blend_premul_swizzle;
+
+static const struct r_blit_kernels avx2_kernels = {
+    .name = "avx2",
+    .copy = scalar_copy,
+    .copy_swizzle = avx2_copy_swizzle,
+    .blend = avx2_blend,
+    .blend_swizzle = avx2_blend_swizzle,
+    .blend_premul = avx2_blend_premul,
+    .blend_premul_swizzle = avx2_blend_premul_swizzle,
+};
+#endif /* R_BLIT_KERNELS_X86_ */
+
+static const struct r_blit_kernels *_Atomic g_active_kernels = &scalar_kernels;
+static atomic_flag g_kernels_initialized = ATOMIC_FLAG_INIT;
+
+void r_blit_kernels_init(void)
+{
+    if (atomic_flag_test_and_set(&g_kernels_initialized))
+        return;
+
+    const struct r_blit_kernels *selected = NULL;
+    for (i32 i = R_BLIT_KERNEL_MAX_ - 1; i >= 0 && selected == NULL; i--)
+        selected = r_blit_kernels_get(i);
+
+    s_assert(selected != NULL, "The scalar kernels should always be available");
+
+    atomic_store(&g_active_kernels, selected);
+    s_log_verbose("Using %s blit kernels", selected->name);
+}
+
+const struct r_blit_kernels * r_blit_kernels_get_active(void)
+{
+    return atomic_load(&g_active_kernels);
+}
+
+const struct r_blit_kernels * r_blit_kernels_get(enum r_blit_kernel_type type)
+{
+    switch (type) {
+    case R_BLIT_KERNEL_SCALAR:
+        return &scalar_kernels;
+#if (R_BLIT_KERNELS_X86_ == 1)
+    case R_BLIT_KERNEL_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2") ? &sse2_kernels : NULL;
+    case R_BLIT_KERNEL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif /* R_BLIT_KERNELS_X86_ */
+    default:
+        return NULL;
+    }
+}
+
+static inline pixel_t swizzle_pixel(pixel_t p)
+{
+    const u8 tmp = p.r;
+    p.r = p.b;
+    p.b = tmp;
+    return p;
+}
+
+static inline void blend_pixel(pixel_t *dst, const pixel_t src)
+{
+    if (src.a == 255) {
+        *dst = src;
+    } else if (src.a > 0) {
+        const u8 inv_alpha = 255 - src.a;
+        dst->r = (src.r * src.a + dst->r * inv_alpha) / 255;
+        dst->g = (src.g * src.a + dst->g * inv_alpha) / 255;
+        dst->b = (src.b * src.a + dst->b * inv_alpha) / 255;
+    }
+}
+
+static inline void blend_premul_pixel(pixel_t *dst, const pixel_t src)
+{
+    if (src.a == 255) {
+        *dst = src;
+    } else if (src.a > 0) {
+        const u8 inv_alpha = 255 - src.a;
+        const u32 r = src.r + (dst->r * inv_alpha) / 255;
+        const u32 g = src.g + (dst->g * inv_alpha) / 255;
+        const u32 b = src.b + (dst->b * inv_alpha) / 255;
+        const u32 a = src.a + (dst->a * inv_alpha) / 255;
+        dst->r = u_min(r, 255);
+        dst->g = u_min(g, 255);
+        dst->b = u_min(b, 255);
+        dst->a = u_min(a, 255);
+    }
+}
+
+static void scalar_copy(pixel_t *restrict dst, const pixel_t *restrict src,
+    u32 n)
+{
+    memcpy(dst, src, n * sizeof(pixel_t));
+}
+
+static void scalar_copy_swizzle(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    for (u32 i = 0; i < n; i++)
+        dst[i] = swizzle_pixel(src[i]);
+}
+
+static void scalar_blend(pixel_t *restrict dst, const pixel_t *restrict src,
+    u32 n)
+{
+    for (u32 i = 0; i < n; i++)
+        blend_pixel(&dst[i], src[i]);
+}
+
+static void scalar_blend_swizzle(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    for (u32 i = 0; i < n; i++)
+        blend_pixel(&dst[i], swizzle_pixel(src[i]));
+}
+
+static void scalar_blend_premul(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    for (u32 i = 0; i < n; i++)
+        blend_premul_pixel(&dst[i], src[i]);
+}
+
+static void scalar_blend_premul_swizzle(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    for (u32 i = 0; i < n; i++)
+        blend_premul_pixel(&dst[i], swizzle_pixel(src[i]));
+}
+
+#if (R_BLIT_KERNELS_X86_ == 1)
+
+/* The blending is done on 16-bit lanes. Because
+ * `s * a + d * (255 - a)` is at most 255 * 255 = 65025,
+ * it always fits, and so does the exact division by 255:
+ *      x / 255 == (x + 1 + (x >> 8)) >> 8     for x in [0, 65025]
+ * This means that the results are identical to the scalar ones. */
+
+static inline TARGET_SSE2_ __m128i sse2_swizzle(__m128i p)
+{
+    const __m128i ga_mask = _mm_set1_epi32((i32)0xFF00FF00);
+    const __m128i lo_mask = _mm_set1_epi32(0x000000FF);
+
+    const __m128i b_to_r = _mm_and_si128(_mm_srli_epi32(p, 16), lo_mask);
+    const __m128i r_to_b = _mm_slli_epi32(_mm_and_si128(p, lo_mask), 16);
+    return _mm_or_si128(_mm_and_si128(p, ga_mask),
+        _mm_or_si128(b_to_r, r_to_b));
+}
+
+/* Blends 2 pixels (unpacked to 16-bit lanes) */
+static inline TARGET_SSE2_ __m128i sse2_blend_2px(__m128i s, __m128i d)
+{
+    /* Zero out the alpha lane so that the alpha of `dst` is preserved */
+    const __m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+
+    /* Broadcast each pixel's alpha to all of its lanes */
+    __m128i a = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_and_si128(a, rgb_mask);
+    const __m128i inv_a = _mm_sub_epi16(_mm_set1_epi16(255), a);
+
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, inv_a));
+    x = _mm_add_epi16(x, _mm_add_epi16(_mm_srli_epi16(x, 8), _mm_set1_epi16(1)));
+    return _mm_srli_epi16(x, 8);
+}
+
+/* Blends 2 premultiplied pixels (unpacked to 16-bit lanes).
+ * `d * (255 - a)` fits in the same way as above,
+ * and `_mm_packus_epi16` then takes care of the saturation. */
+static inline TARGET_SSE2_ __m128i sse2_blend_premul_2px(__m128i s, __m128i d)
+{
+    __m128i a = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128i inv_a = _mm_sub_epi16(_mm_set1_epi16(255), a);
+
+    __m128i x = _mm_mullo_epi16(d, inv_a);
+    x = _mm_add_epi16(x, _mm_add_epi16(_mm_srli_epi16(x, 8), _mm_set1_epi16(1)));
+    return _mm_add_epi16(s, _mm_srli_epi16(x, 8));
+}
+
+static inline TARGET_SSE2_ void sse2_blend_impl(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n, const bool swizzle, const bool premul)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i a_mask = _mm_set1_epi32((i32)0xFF000000);
+
+    u32 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        if (swizzle)
+            s = sse2_swizzle(s);
+
+        const __m128i s_a = _mm_and_si128(s, a_mask);
+        const __m128i opaque = _mm_cmpeq_epi32(s_a, a_mask);
+        if (_mm_movemask_epi8(opaque) == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)(dst + i), s);
+            continue;
+        } else if (_mm_movemask_epi8(_mm_cmpeq_epi32(s_a, zero)) == 0xFFFF) {
+            continue;
+        }
+
+        const __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        const __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        const __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        const __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+        const __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+
+        __m128i out;
+        if (premul) {
+            /* Transparent pixels leave `dst` untouched
+             * (and so do opaque ones, with the right alpha) */
+            const __m128i transparent = _mm_cmpeq_epi32(s_a, zero);
+            out = _mm_packus_epi16(
+                sse2_blend_premul_2px(s_lo, d_lo),
+                sse2_blend_premul_2px(s_hi, d_hi)
+            );
+            out = _mm_or_si128(_mm_and_si128(transparent, d),
+                _mm_andnot_si128(transparent, out));
+        } else {
+            /* Fully opaque pixels replace the alpha of `dst` */
+            out = _mm_or_si128(
+                _mm_packus_epi16(
+                    sse2_blend_2px(s_lo, d_lo),
+                    sse2_blend_2px(s_hi, d_hi)
+                ),
+                _mm_and_si128(opaque, a_mask)
+            );
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+
+    if (premul && swizzle)
+        scalar_blend_premul_swizzle(dst + i, src + i, n - i);
+    else if (premul)
+        scalar_blend_premul(dst + i, src + i, n - i);
+    else if (swizzle)
+        scalar_blend_swizzle(dst + i, src + i, n - i);
+    else
+        scalar_blend(dst + i, src + i, n - i);
+}
+
+static TARGET_SSE2_ void sse2_blend(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    sse2_blend_impl(dst, src, n, false, false);
+}
+
+static TARGET_SSE2_ void sse2_blend_swizzle(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    sse2_blend_impl(dst, src, n, true, false);
+}
+
+static TARGET_SSE2_ void sse2_blend_premul(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    sse2_blend_impl(dst, src, n, false, true);
+}
+
+static TARGET_SSE2_ void sse2_blend_premul_swizzle(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    sse2_blend_impl(dst, src, n, true, true);
+}
+
+static TARGET_SSE2_ void sse2_copy_swizzle(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    u32 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), sse2_swizzle(s));
+    }
+    scalar_copy_swizzle(dst + i, src + i, n - i);
+}
+
+static inline TARGET_AVX2_ __m256i avx2_swizzle(__m256i p)
+{
+    const __m256i shuf = _mm256_setr_epi8(
+        2, 1, 0, 3,  6, 5, 4, 7,  10, 9, 8, 11,  14, 13, 12, 15,
+        2, 1, 0, 3,  6, 5, 4, 7,  10, 9, 8, 11,  14, 13, 12, 15
+    );
+    return _mm256_shuffle_epi8(p, shuf);
+}
+
+/* Blends 4 pixels (unpacked to 16-bit lanes, 2 in each 128-bit half) */
+static inline TARGET_AVX2_ __m256i avx2_blend_4px(__m256i s, __m256i d)
+{
+    const __m256i rgb_mask = _mm256_set_epi16(
+        0, -1, -1, -1, 0, -1, -1, -1,
+        0, -1, -1, -1, 0, -1, -1, -1
+    );
+
+    __m256i a = _mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm256_and_si256(a, rgb_mask);
+    const __m256i inv_a = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+
+    __m256i x = _mm256_add_epi16(
+        _mm256_mullo_epi16(s, a),
+        _mm256_mullo_epi16(d, inv_a)
+    );
+    x = _mm256_add_epi16(x,
+        _mm256_add_epi16(_mm256_srli_epi16(x, 8), _mm256_set1_epi16(1))
+    );
+    return _mm256_srli_epi16(x, 8);
+}
+
+/* Blends 4 premultiplied pixels (unpacked to 16-bit lanes),
+ * see `sse2_blend_premul_2px` */
+static inline TARGET_AVX2_ __m256i avx2_blend_premul_4px(__m256i s, __m256i d)
+{
+    __m256i a = _mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m256i inv_a = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+
+    __m256i x = _mm256_mullo_epi16(d, inv_a);
+    x = _mm256_add_epi16(x,
+        _mm256_add_epi16(_mm256_srli_epi16(x, 8), _mm256_set1_epi16(1))
+    );
+    return _mm256_add_epi16(s, _mm256_srli_epi16(x, 8));
+}
+
+static inline TARGET_AVX2_ void avx2_blend_impl(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n, const bool swizzle, const bool premul)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i a_mask = _mm256_set1_epi32((i32)0xFF000000);
+
+    u32 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        if (swizzle)
+            s = avx2_swizzle(s);
+
+        const __m256i s_a = _mm256_and_si256(s, a_mask);
+        const __m256i opaque = _mm256_cmpeq_epi32(s_a, a_mask);
+        if (_mm256_movemask_epi8(opaque) == -1) {
+            _mm256_storeu_si256((__m256i *)(dst + i), s);
+            continue;
+        } else if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s_a, zero)) == -1) {
+            continue;
+        }
+
+        /* The unpack and pack instructions both operate
+         * within 128-bit lanes, so the pixel order is preserved */
+        const __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        const __m256i s_lo = _mm256_unpacklo_epi8(s, zero);
+        const __m256i s_hi = _mm256_unpackhi_epi8(s, zero);
+        const __m256i d_lo = _mm256_unpacklo_epi8(d, zero);
+        const __m256i d_hi = _mm256_unpackhi_epi8(d, zero);
+
+        __m256i out;
+        if (premul) {
+            const __m256i transparent = _mm256_cmpeq_epi32(s_a, zero);
+            out = _mm256_packus_epi16(
+                avx2_blend_premul_4px(s_lo, d_lo),
+                avx2_blend_premul_4px(s_hi, d_hi)
+            );
+            out = _mm256_blendv_epi8(out, d, transparent);
+        } else {
+            out = _mm256_or_si256(
+                _mm256_packus_epi16(
+                    avx2_blend_4px(s_lo, d_lo),
+                    avx2_blend_4px(s_hi, d_hi)
+                ),
+                _mm256_and_si256(opaque, a_mask)
+            );
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), out);
+    }
+
+    if (premul && swizzle)
+        scalar_blend_premul_swizzle(dst + i, src + i, n - i);
+    else if (premul)
+        scalar_blend_premul(dst + i, src + i, n - i);
+    else if (swizzle)
+        scalar_blend_swizzle(dst + i, src + i, n - i);
+    else
+        scalar_blend(dst + i, src + i, n - i);
+}
+
+static TARGET_AVX2_ void avx2_blend(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    avx2_blend_impl(dst, src, n, false, false);
+}
+
+static TARGET_AVX2_ void avx2_blend_swizzle(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    avx2_blend_impl(dst, src, n, true, false);
+}
+
+static TARGET_AVX2_ void avx2_blend_premul(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    avx2_blend_impl(dst, src, n, false, true);
+}
+
+static TARGET_AVX2_ void avx2_blend_premul_swizzle(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    avx2_blend_impl(dst, src, n, true, true);
+}
+
+static TARGET_AVX2_ void avx2_copy_swizzle(pixel_t *restrict dst,
+    const pixel_t *restrict src, u32 n)
+{
+    u32 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), avx2_swizzle(s));
+    }
+    scalar_copy_swizzle(dst + i, src + i, n - i);
+}
+
+#endif /* R_BLIT_KERNELS_X86_ */
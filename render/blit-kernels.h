@@ -0,0 +1,87 @@
+#ifndef R_BLIT_KERNELS_H_
+#define R_BLIT_KERNELS_H_
+#ifndef R_INTERNAL_GUARD__
+#error This header is internal to the cgd renderer module and is not intented to be used elsewhere
+#endif /* R_INTERNAL_GUARD__ */
+
+#include <core/int.h>
+#include <core/pixel.h>
+
+/* A function that processes a single row (span) of `n` pixels,
+ * reading from `src` and writing to `dst`.
+ * The two buffers must not overlap. */
+typedef void (r_blit_row_fn_t)(
+    pixel_t *restrict dst,
+    const pixel_t *restrict src,
+    u32 n
+);
+
+/* A set of row kernels used by the surface blitters.
+ *
+ * All implementations MUST produce results that are bit-for-bit identical
+ * to the scalar ones - the SIMD versions are only allowed to be faster. */
+struct r_blit_kernels {
+    const char *name;
+
+    /* Copy the pixels verbatim */
+    r_blit_row_fn_t *copy;
+
+    /* Copy the pixels, swapping the R and B channels (RGBA <-> BGRA) */
+    r_blit_row_fn_t *copy_swizzle;
+
+    /* Alpha-blend `src` over `dst`. For each pixel:
+     *  - if `src.a == 255`, `src` is written as-is,
+     *  - if `src.a == 0`, `dst` is left untouched,
+     *  - otherwise the R, G and B channels are blended with
+     *      `(s * a + d * (255 - a)) / 255`
+     *    and the alpha channel of `dst` is preserved. */
+    r_blit_row_fn_t *blend;
+
+    /* Same as `blend`, except that the R and B channels of `src`
+     * are swapped before anything else is done */
+    r_blit_row_fn_t *blend_swizzle;
+
+    /* Blend `src`, which is premultiplied by its alpha, over `dst`
+     * (the "over" operator). For each pixel:
+     *  - if `src.a == 255`, `src` is written as-is,
+     *  - if `src.a == 0`, `dst` is left untouched,
+     *  - otherwise all 4 channels (including the alpha) become
+     *      `s + d * (255 - a) / 255`
+     *    (saturated to 255, in case `src` isn't validly premultiplied) */
+    r_blit_row_fn_t *blend_premul;
+
+    /* Same as `blend_premul`, except that the R and B channels of `src`
+     * are swapped before anything else is done */
+    r_blit_row_fn_t *blend_premul_swizzle;
+};
+
+#define R_BLIT_KERNEL_TYPE_LIST \
+    X_(R_BLIT_KERNEL_SCALAR)    \
+    X_(R_BLIT_KERNEL_SSE2)      \
+    X_(R_BLIT_KERNEL_AVX2)      \
+
+#define X_(name) name,
+enum r_blit_kernel_type {
+    R_BLIT_KERNEL_TYPE_LIST
+    R_BLIT_KERNEL_MAX_
+};
+#undef X_
+
+#ifndef R_BLIT_KERNEL_TYPE_LIST_DEF__
+#undef R_BLIT_KERNEL_TYPE_LIST
+#endif /* R_BLIT_KERNEL_TYPE_LIST_DEF__ */
+
+/* Detects the features of the CPU (once) and selects
+ * the fastest set of kernels that can run on it.
+ * Safe to call multiple times. */
+void r_blit_kernels_init(void);
+
+/* Returns the currently selected set of kernels.
+ * Before `r_blit_kernels_init` is called, this will be the scalar one. */
+const struct r_blit_kernels * r_blit_kernels_get_active(void);
+
+/* Returns the kernels of the given type,
+ * or `NULL` if they are not supported by the CPU or the build. */
+const struct r_blit_kernels * r_blit_kernels_get(enum r_blit_kernel_type type);
+
+#endif /* R_BLIT_KERNELS_H_ */
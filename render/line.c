@@ -2,28 +2,58 @@
 #include <core/math.h>
 #include <core/util.h>
 #include <core/shapes.h>
+#include <core/vector.h>
+#include <stdlib.h>
 #define R_INTERNAL_GUARD__
 #include "rctx-internal.h"
 #undef R_INTERNAL_GUARD__
 #define R_INTERNAL_GUARD__
+#include "rcmd.h"
+#undef R_INTERNAL_GUARD__
+#define R_INTERNAL_GUARD__
 #include "putpixel-fast.h"
 #undef R_INTERNAL_GUARD__
 
 #define MODULE_NAME "line"
 
+static inline void clamp_endpoints(vec2d_t *start, vec2d_t *end,
+    u32 w, u32 h);
+
 void r_draw_line(struct r_ctx *rctx, vec2d_t start, vec2d_t end)
 {
     u_check_params(rctx != NULL);
 
+    if (rctx->pixels_rect.w == 0 || rctx->pixels_rect.h == 0)
+        return;
+
+    /* The line can only ever be drawn between its clamped endpoints */
+    vec2d_t s = start, e = end;
+    clamp_endpoints(&s, &e, rctx->pixels_rect.w, rctx->pixels_rect.h);
+    const i32 min_x = u_min((i32)s.x, (i32)e.x);
+    const i32 min_y = u_min((i32)s.y, (i32)e.y);
+    const i32 max_x = u_max((i32)s.x, (i32)e.x);
+    const i32 max_y = u_max((i32)s.y, (i32)e.y);
+
+    r_ctx_push_cmd(rctx, &(const struct r_cmd) {
+        .type = R_CMD_DRAW_LINE,
+        .color = rctx->current_color,
+        .bounds = { min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 },
+        .d.line = { start, end },
+    });
+}
+
+void r_rasterize_line(struct pixel_flat_data *buf,
+    vec2d_t start, vec2d_t end, pixel_t color, const rect_t *clip)
+{
     /* Cut off any part of the line that
      * would extend beyond the framebuffer */
-    start.x = u_clamp(start.x, 0.f, (f32)(rctx->curr_buf->w - 1));
-    start.y = u_clamp(start.y, 0.f, (f32)(rctx->curr_buf->w - 1));
-    end.x = u_clamp(end.x, 0.f, (f32)(rctx->curr_buf->h - 1));
-    end.y = u_clamp(end.y, 0.f, (f32)(rctx->curr_buf->h - 1));
+    clamp_endpoints(&start, &end, buf->w, buf->h);
 
-    i32 dx = end.x - start.x;
-    i32 dy = end.y - start.y;
+    const i32 end_x = end.x;
+    const i32 end_y = end.y;
+
+    i32 dx = end_x - (i32)start.x;
+    i32 dy = end_y - (i32)start.y;
     if (dx == 0 || dy == 0) return;
 
     i32 step_x = 1, step_y = 1;
@@ -42,14 +72,21 @@ void r_draw_line(struct r_ctx *rctx, vec2d_t start, vec2d_t end)
     i32 x = start.x;
     i32 y = start.y;
 
+    const i64 clip_x0 = clip->x, clip_x1 = (i64)clip->x + clip->w;
+    const i64 clip_y0 = clip->y, clip_y1 = (i64)clip->y + clip->h;
+#define in_clip_(x_, y_) \
+    ((x_) >= clip_x0 && (x_) < clip_x1 && (y_) >= clip_y0 && (y_) < clip_y1)
+
     if (abs(dx) > abs(dy)) {
         /* Shallow slope (|dx| > |dy|) - Increment x more frequently */
-        for (; x != end.x; x += step_x) {
-            r_putpixel_fast_matching_pixelfmt_(
-                rctx->curr_buf->buf,
-                x, y, rctx->curr_buf->w,
-                rctx->current_color
-            );
+        for (; x != end_x; x += step_x) {
+            if (in_clip_(x, y)) {
+                r_putpixel_fast_matching_pixelfmt_(
+                    buf->buf,
+                    x, y, buf->stride,
+                    color
+                );
+            }
 
             err -= dy;
             if (err < 0) {
@@ -60,11 +97,13 @@ void r_draw_line(struct r_ctx *rctx, vec2d_t start, vec2d_t end)
     } else {
         /* Steep slope (|dy| > |dx|) - Increment y more frequently */
         err = dy / 2;  /* Reset err to be based on dy for this case */
-        for (; y != end.y; y += step_y) {
-            r_putpixel_fast_matching_pixelfmt_(
-                rctx->curr_buf->buf,
-                x, y, rctx->curr_buf->w,
-                rctx->current_color);
+        for (; y != end_y; y += step_y) {
+            if (in_clip_(x, y)) {
+                r_putpixel_fast_matching_pixelfmt_(
+                    buf->buf,
+                    x, y, buf->stride,
+                    color);
+            }
 
             err -= dx;
             if (err < 0) {
@@ -73,4 +112,14 @@ void r_draw_line(struct r_ctx *rctx, vec2d_t start, vec2d_t end)
             }
         }
     }
+#undef in_clip_
+}
+
+static inline void clamp_endpoints(vec2d_t *start, vec2d_t *end,
+    u32 w, u32 h)
+{
+    start->x = u_clamp(start->x, 0.f, (f32)(w - 1));
+    start->y = u_clamp(start->y, 0.f, (f32)(h - 1));
+    end->x = u_clamp(end->x, 0.f, (f32)(w - 1));
+    end->y = u_clamp(end->y, 0.f, (f32)(h - 1));
 }
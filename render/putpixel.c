@@ -13,7 +13,8 @@ void r_putpixel_rgba(struct pixel_flat_data *data, u32 x, u32 y, pixel_t val)
     if (data == NULL || data->buf == NULL || x >= data->w || y >= data->h)
         return;
 
-    r_putpixel_fast_matching_pixelfmt_(data->buf, (i32)x, (i32)y, data->w, val);
+    r_putpixel_fast_matching_pixelfmt_(data->buf, (i32)x, (i32)y,
+        data->stride, val);
 }
 
 void r_putpixel_bgra(struct pixel_flat_data *data, u32 x, u32 y, pixel_t val)
@@ -21,6 +22,6 @@ void r_putpixel_bgra(struct pixel_flat_data *data, u32 x, u32 y, pixel_t val)
     if (data == NULL || data->buf == NULL || x >= data->w || y >= data->h)
         return;
 
-    r_putpixel_fast_(data->buf, (i32)x, (i32)y, data->w,
+    r_putpixel_fast_(data->buf, (i32)x, (i32)y, data->stride,
         val, (pixelfmt_t)BGRA32);
 }
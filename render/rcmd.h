@@ -0,0 +1,98 @@
+#ifndef R_CMD_H_
+#define R_CMD_H_
+#ifndef R_INTERNAL_GUARD__
+#error This header is internal to the cgd renderer module and is not intented to be used elsewhere
+#endif /* R_INTERNAL_GUARD__ */
+
+#include <core/int.h>
+#include <core/pixel.h>
+#include <core/shapes.h>
+#include <core/vector.h>
+#include "surface.h"
+
+/* The draw calls (`r_fill_rect`, `r_surface_render`, etc.) don't touch
+ * any pixels themselves. Instead, they append a command to the list of
+ * the frame that's currently being recorded. The whole list is then handed
+ * to the renderer thread in `r_flush`, which executes ("rasterizes") it
+ * while the main thread is free to continue with the next frame.
+ *
+ * Since the whole frame is known before anything is drawn, the renderer
+ * thread can also compare it with the previous one and only redraw
+ * (and present) the parts of the frame that have actually changed.
+ * For that to work, each command knows which pixels it could touch
+ * (its `bounds`), and the rasterizers must only ever touch the pixels
+ * inside of both those bounds and the `clip` rect they're given. */
+
+#define R_CMD_TYPE_LIST     \
+    X_(R_CMD_RESET)         \
+    X_(R_CMD_INVALIDATE)    \
+    X_(R_CMD_FILL_RECT)     \
+    X_(R_CMD_DRAW_RECT)     \
+    X_(R_CMD_DRAW_LINE)     \
+    X_(R_CMD_SURFACE)       \
+
+#define X_(name) name,
+enum r_cmd_type {
+    R_CMD_TYPE_LIST
+    R_CMD_MAX_
+};
+#undef X_
+
+#ifndef R_CMD_TYPE_LIST_DEF__
+#undef R_CMD_TYPE_LIST
+#endif /* R_CMD_TYPE_LIST_DEF__ */
+
+struct r_cmd {
+    enum r_cmd_type type;
+
+    /* The draw color at the time the command was recorded
+     * (already converted to the display's pixel format) */
+    pixel_t color;
+
+    /* The part of the frame that the command can draw to.
+     * Always within the frame (and never empty). */
+    rect_t bounds;
+
+    union r_cmd_data {
+        /* `R_CMD_FILL_RECT` and `R_CMD_DRAW_RECT` */
+        rect_t rect;
+
+        /* `R_CMD_DRAW_LINE` */
+        struct r_cmd_line {
+            vec2d_t start, end;
+        } line;
+
+        /* `R_CMD_SURFACE`. The rects are already resolved
+         * (i.e. they are never `NULL` like the user-provided ones can be) */
+        struct r_cmd_surface {
+            const struct r_surface *src;
+            /* `src->version` at the time the command was recorded.
+             * The address alone doesn't tell whether it's the same
+             * pixels as in the previous frame. */
+            u64 src_version;
+            rect_t src_rect, dst_rect;
+            enum r_surface_filter filter;
+        } surface;
+    } d;
+};
+
+typedef VECTOR(struct r_cmd) r_cmd_list_t;
+
+/* The functions that do the actual drawing.
+ * All of them are called from the renderer thread
+ * and write to `buf` (which has the pixel format `buf_fmt`),
+ * but only to the pixels inside of `clip`.
+ *
+ * A pixel must end up with the same value regardless of the `clip`
+ * (as long as it's inside of it), as otherwise redrawing only a part of
+ * the frame would make it different from the rest. */
+void r_rasterize_fill_rect(struct pixel_flat_data *buf,
+    const rect_t *rect, pixel_t color, const rect_t *clip);
+void r_rasterize_draw_rect(struct pixel_flat_data *buf,
+    const rect_t *rect, pixel_t color, const rect_t *clip);
+void r_rasterize_line(struct pixel_flat_data *buf,
+    vec2d_t start, vec2d_t end, pixel_t color, const rect_t *clip);
+void r_rasterize_surface(struct pixel_flat_data *buf, pixelfmt_t buf_fmt,
+    const struct r_cmd_surface *cmd, const rect_t *clip);
+
+#endif /* R_CMD_H_ */
@@ -5,10 +5,22 @@
 #endif /* R_INTERNAL_GUARD__ */
 
 #include "rctx.h"
+#include "rcmd.h"
+#include "tile-raster.h"
+#include "scale-cache.h"
 #include <core/pixel.h>
+#include <core/region.h>
 #include <core/shapes.h>
+#include <core/spinlock.h>
+#include <core/histogram.h>
 #include <platform/window.h>
 #include <platform/thread.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* The maximum number of window buffers whose damage is tracked.
+ * Any buffer beyond that is just redrawn completely. */
+#define R_MAX_TRACKED_BUFFERS 4
 
 struct r_ctx {
     enum r_type type;
@@ -16,22 +28,84 @@ struct r_ctx {
     struct p_window *win;
     struct p_window_info win_info;
 
+    /* The buffer that the renderer thread currently draws to.
+     * Should only ever be touched by the renderer thread
+     * (except for during initialization) */
     struct pixel_flat_data *curr_buf;
 
     rect_t pixels_rect;
 
+    /* The pixel format that the frames are drawn in.
+     * Same as the display's, except that the alpha channel
+     * is never ignored (see `r_ctx_get_pixelfmt`). */
+    pixelfmt_t buf_fmt;
+
     pixel_t current_color;
 
+    /* The commands of the frame that's currently being recorded.
+     * Only accessed by the thread that makes the draw calls. */
+    r_cmd_list_t cmds;
+
+    /* The pre-scaled copies of the surfaces that are drawn scaled.
+     * Only accessed by the thread that makes the draw calls. */
+    struct r_scale_cache scale_cache;
+
     p_mt_thread_t thread;
     struct r_ctx_thread_info {
         _Atomic bool running;
         p_mt_cond_t cond;
         p_mt_mutex_t mutex;
+
+        /* Protected by `mutex`. Set by `r_flush` when a new frame
+         * is handed over, and cleared by the renderer thread
+         * once it's been drawn and presented. */
+        bool frame_pending;
+
+        /* The commands of the frame that's being drawn.
+         * Owned by the renderer thread while `frame_pending` is true. */
+        r_cmd_list_t submitted_cmds;
     } thread_info;
 
-    u64 total_frames, dropped_frames;
+    /* Used to only redraw and present the parts of each frame
+     * that have changed. Only ever touched by the renderer thread. */
+    struct r_ctx_damage_info {
+        /* The commands of the last frame that was drawn,
+         * which the new ones get compared to */
+        r_cmd_list_t prev_cmds;
+
+        /* The parts of each of the window's buffers that are out of date,
+         * i.e. that have changed since the last time we drew to them.
+         * The buffers are identified by their pixel data pointers. */
+        struct r_buffer_damage {
+            const pixel_t *buf;
+            struct region damage;
+        } buffers[R_MAX_TRACKED_BUFFERS];
+        u32 n_buffers;
+
+        /* Everything that has changed since
+         * the last successfully presented frame */
+        struct region present_damage;
+    } damage;
+
+    /* Splits the drawing of each frame across multiple threads.
+     * Only used by the renderer thread. */
+    struct r_tile_raster tile_raster;
+
+    /* Written by the renderer thread */
+    _Atomic u64 total_frames, dropped_frames;
+
+    /* How long it took to draw each frame (in ns).
+     * Written by the renderer thread, protected by `render_time_lock`. */
+    struct histogram render_time_ns;
+    spinlock_t render_time_lock;
 };
 
+/* Appends `cmd` to the frame that's being recorded.
+ * Clips the command's bounds to the frame,
+ * and drops it altogether if it wouldn't draw anything. */
+void r_ctx_push_cmd(struct r_ctx *ctx, const struct r_cmd *cmd);
+
+/* The renderer thread. `arg` is the `struct r_ctx *` */
 extern void renderer_main(void *arg);
 
 #endif /* RCTX_INTERNAL_H_ */
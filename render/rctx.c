@@ -4,7 +4,11 @@
 #include <core/log.h>
 #include <core/util.h>
 #include <core/pixel.h>
+#include <core/region.h>
+#include <core/vector.h>
 #include <core/shapes.h>
+#include <core/spinlock.h>
+#include <core/histogram.h>
 #include <platform/window.h>
 #include <platform/thread.h>
 #include <stdatomic.h>
@@ -14,13 +18,15 @@
 #define R_INTERNAL_GUARD__
 #include "rctx-internal.h"
 #undef R_INTERNAL_GUARD__
+#define R_INTERNAL_GUARD__
+#include "blit-kernels.h"
+#undef R_INTERNAL_GUARD__
 
 #define MODULE_NAME "rctx"
 
 struct r_ctx * r_ctx_init(struct p_window *win, enum r_type type, u32 flags)
 {
     u_check_params(win != NULL);
-    (void) flags;
 
     struct r_ctx *ctx = calloc(1, sizeof(struct r_ctx));
     s_assert(ctx != NULL, "calloc() for struct r_ctx failed!");
@@ -58,19 +64,47 @@ struct r_ctx * r_ctx_init(struct p_window *win, enum r_type type, u32 flags)
     ctx->curr_buf = ret;
     u_rect_from_pixel_data(ctx->curr_buf, &ctx->pixels_rect);
 
+    /* Don't ignore the alpha channel since we are not drawing
+     * to a normal surface, but to the whole framebuffer,
+     * which is where everything else also gets rendered */
+    ctx->buf_fmt = ctx->win_info.display_color_format;
+    if (ctx->buf_fmt == BGRX32)
+        ctx->buf_fmt = BGRA32;
+    else if (ctx->buf_fmt == RGBX32)
+        ctx->buf_fmt = RGBA32;
+
     ctx->current_color = BLACK_PIXEL;
 
+    /* Pick the fastest blitting routines that the CPU supports */
+    r_blit_kernels_init();
+
+    ctx->cmds = vector_new(struct r_cmd);
+    r_scale_cache_init(&ctx->scale_cache, R_SCALE_CACHE_DEFAULT_BUDGET);
+    ctx->thread_info.submitted_cmds = vector_new(struct r_cmd);
+    ctx->damage.prev_cmds = vector_new(struct r_cmd);
+    ctx->damage.n_buffers = 0;
+    region_clear(&ctx->damage.present_damage);
+    histogram_clear(&ctx->render_time_ns);
+    spinlock_init(&ctx->render_time_lock);
+
+    /* Prepare the threads that do the actual drawing */
+    u32 n_raster_threads = flags & R_CTX_N_THREADS_MASK;
+    if (n_raster_threads == 0)
+        n_raster_threads = p_mt_get_cpu_count();
+    if (r_tile_raster_init(&ctx->tile_raster, &ctx->pixels_rect,
+            n_raster_threads))
+        goto_error("Failed to initialize the tile rasterizer");
+
     /* Prepare and start the thread */
     ctx->thread_info.mutex = p_mt_mutex_create();
     ctx->thread_info.cond = p_mt_cond_create();
+    ctx->thread_info.frame_pending = false;
     atomic_store(&ctx->thread_info.running, true);
-    if (p_mt_thread_create(&ctx->thread, renderer_main, &ctx->thread_info)) {
+    if (p_mt_thread_create(&ctx->thread, renderer_main, ctx)) {
         atomic_store(&ctx->thread_info.running, false);
         goto_error("Failed to spawn the renderer thread!");
     }
 
-    ctx->total_frames = ctx->dropped_frames = 0;
-
     return ctx;
 
 err:
@@ -84,18 +118,51 @@ void r_ctx_destroy(struct r_ctx **ctx_p)
     struct r_ctx *ctx = *ctx_p;
 
     if (atomic_load(&ctx->thread_info.running)) {
+        /* The renderer thread will finish drawing
+         * any pending frame before exiting */
+        p_mt_mutex_lock(&ctx->thread_info.mutex);
         atomic_store(&ctx->thread_info.running, false);
-        p_mt_cond_signal(ctx->thread_info.cond);
+        p_mt_cond_signal(&ctx->thread_info.cond);
+        p_mt_mutex_unlock(&ctx->thread_info.mutex);
+
         p_mt_thread_wait(&ctx->thread);
-        p_mt_cond_destroy(&ctx->thread_info.cond);
-        p_mt_mutex_destroy(&ctx->thread_info.mutex);
     }
+    r_tile_raster_destroy(&ctx->tile_raster);
 
-    const f32 ratio = ctx->total_frames != 0 ?
-        ((f32)ctx->dropped_frames / (f32)ctx->total_frames) :
+    p_mt_cond_destroy(&ctx->thread_info.cond);
+    p_mt_mutex_destroy(&ctx->thread_info.mutex);
+
+    if (ctx->damage.prev_cmds != NULL)
+        vector_destroy(&ctx->damage.prev_cmds);
+    if (ctx->thread_info.submitted_cmds != NULL)
+        vector_destroy(&ctx->thread_info.submitted_cmds);
+    if (ctx->cmds != NULL)
+        vector_destroy(&ctx->cmds);
+
+    /* The renderer thread is gone, so none of the copies are in use */
+    r_scale_cache_destroy(&ctx->scale_cache);
+
+    struct r_frame_stats stats;
+    r_ctx_get_frame_stats(ctx, &stats);
+    const f32 ratio = stats.total_frames != 0 ?
+        ((f32)stats.dropped_frames / (f32)stats.total_frames) :
         0.0f;
-    s_log_verbose("Dropped frames: %lu/%lu (%f%%)",
-        ctx->dropped_frames, ctx->total_frames, ratio);
+    s_log_verbose("Dropped frames: %lu/%lu (%f%%), "
+        "coalesced by the window: %lu, dropped by the window: %lu",
+        stats.dropped_frames, stats.total_frames, ratio,
+        stats.coalesced_frames, stats.window_dropped_frames);
+
+    struct r_frame_timing timing;
+    r_ctx_get_frame_timing(ctx, &timing);
+    s_log_verbose("Render time p50/p99: %lu/%lu us, "
+        "swap to flip p50/p99: %lu/%lu us, "
+        "flip interval p50/p99: %lu/%lu us, missed vblanks p99: %lu",
+        timing.render_time_ns.p50 / 1000, timing.render_time_ns.p99 / 1000,
+        timing.present.swap_to_flip_ns.p50 / 1000,
+        timing.present.swap_to_flip_ns.p99 / 1000,
+        timing.present.flip_interval_ns.p50 / 1000,
+        timing.present.flip_interval_ns.p99 / 1000,
+        timing.present.missed_vblanks.p99);
 
     u_nzfree(ctx_p);
 }
@@ -111,29 +178,117 @@ void r_ctx_set_color(struct r_ctx *ctx, color_RGBA32_t color)
     ctx->current_color = color;
 }
 
+pixelfmt_t r_ctx_get_pixelfmt(const struct r_ctx *ctx)
+{
+    u_check_params(ctx != NULL);
+    return ctx->buf_fmt;
+}
+
+void r_ctx_set_scale_cache_budget(struct r_ctx *ctx, u64 n_bytes)
+{
+    u_check_params(ctx != NULL);
+    r_scale_cache_set_budget(&ctx->scale_cache, n_bytes);
+}
+
+void r_ctx_get_frame_stats(const struct r_ctx *ctx, struct r_frame_stats *out)
+{
+    u_check_params(ctx != NULL && out != NULL);
+
+    struct p_window_present_stats win_stats;
+    p_window_get_present_stats(ctx->win, &win_stats);
+
+    out->total_frames = atomic_load(&ctx->total_frames);
+    out->dropped_frames = atomic_load(&ctx->dropped_frames);
+    out->coalesced_frames = win_stats.n_coalesced_frames;
+    out->window_dropped_frames = win_stats.n_dropped_frames;
+}
+
+void r_ctx_get_frame_timing(struct r_ctx *ctx, struct r_frame_timing *out)
+{
+    u_check_params(ctx != NULL && out != NULL);
+
+    /* Summarize a copy, so that the renderer thread isn't held up */
+    struct histogram render_time_ns;
+    spinlock_acquire(&ctx->render_time_lock);
+    render_time_ns = ctx->render_time_ns;
+    spinlock_release(&ctx->render_time_lock);
+
+    histogram_summarize(&render_time_ns, &out->render_time_ns);
+    p_window_get_present_timing(ctx->win, &out->present);
+}
+
 void r_flush(struct r_ctx *ctx)
 {
     u_check_params(ctx != NULL);
-    struct pixel_flat_data *new_buf = p_window_swap_buffers(ctx->win,
-        ctx->win_info.vsync_supported ?
-            P_WINDOW_PRESENT_VSYNC :
-            P_WINDOW_PRESENT_NOW
-    );
-    ctx->total_frames++;
+    struct r_ctx_thread_info *const info = &ctx->thread_info;
+
+    p_mt_mutex_lock(&info->mutex);
+
+    /* Wait for the renderer thread to finish the previous frame */
+    while (info->frame_pending) {
+        p_mt_cond_wait(&info->cond, &info->mutex);
+        p_mt_mutex_lock(&info->mutex);
+    }
 
-    s_assert(new_buf != NULL, "wtf");
-    if (new_buf == P_WINDOW_SWAP_BUFFERS_FAIL)
-        ctx->dropped_frames++;
-    else
-        ctx->curr_buf = new_buf;
+    /* Hand over the recorded commands and take the (now empty)
+     * list of the previous frame to record the next one into */
+    r_cmd_list_t tmp = info->submitted_cmds;
+    info->submitted_cmds = ctx->cmds;
+    ctx->cmds = tmp;
+
+    info->frame_pending = true;
+    p_mt_cond_signal(&info->cond);
+    p_mt_mutex_unlock(&info->mutex);
+
+    /* The previous frame is done, so the copies
+     * that only it used can now be freed */
+    r_scale_cache_next_frame(&ctx->scale_cache);
+}
+
+void r_finish(struct r_ctx *ctx)
+{
+    u_check_params(ctx != NULL);
+    struct r_ctx_thread_info *const info = &ctx->thread_info;
+
+    p_mt_mutex_lock(&info->mutex);
+    while (info->frame_pending) {
+        p_mt_cond_wait(&info->cond, &info->mutex);
+        p_mt_mutex_lock(&info->mutex);
+    }
+    p_mt_mutex_unlock(&info->mutex);
 }
 
 void r_reset(struct r_ctx *ctx)
 {
     u_check_params(ctx != NULL);
-    s_assert(ctx->curr_buf != NULL && ctx->curr_buf->buf != NULL,
-        "Attempt to write to a NULL buffer");
-    memset(ctx->curr_buf->buf, 0,
-        ctx->curr_buf->w * ctx->curr_buf->h * sizeof(pixel_t)
-    );
+
+    r_ctx_push_cmd(ctx, &(const struct r_cmd) {
+        .type = R_CMD_RESET,
+        .bounds = ctx->pixels_rect,
+    });
+}
+
+void r_invalidate(struct r_ctx *ctx)
+{
+    u_check_params(ctx != NULL);
+
+    /* The sources of the scaled copies might have changed too */
+    r_scale_cache_invalidate(&ctx->scale_cache);
+
+    r_ctx_push_cmd(ctx, &(const struct r_cmd) {
+        .type = R_CMD_INVALIDATE,
+        .bounds = ctx->pixels_rect,
+    });
+}
+
+void r_ctx_push_cmd(struct r_ctx *ctx, const struct r_cmd *cmd)
+{
+    struct r_cmd final_cmd = *cmd;
+
+    /* Commands that can't possibly draw anything
+     * don't need to be executed (or compared) at all */
+    if (!rect_intersect(&cmd->bounds, &ctx->pixels_rect, &final_cmd.bounds))
+        return;
+
+    vector_push_back(&ctx->cmds, final_cmd);
 }
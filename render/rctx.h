@@ -1,6 +1,7 @@
 #ifndef RCTX_H_
 #define RCTX_H_
 
+#include <core/pixel.h>
 #include <core/shapes.h>
 #include <platform/window.h>
 
@@ -13,12 +14,106 @@ enum r_type {
     R_TYPE_VULKAN,
 };
 
+/* The lowest 8 bits of the `flags` passed to `r_ctx_init`
+ * are the number of threads that rasterize the frames.
+ *
+ * The frame is split into tiles, which are then drawn in parallel.
+ * The result is always exactly the same regardless of the thread count.
+ * 1 means that everything is drawn by the renderer thread alone,
+ * and 0 (the default) picks one thread per CPU. */
+#define R_CTX_N_THREADS_MASK 0xFFU
+#define R_CTX_N_THREADS(n) ((u32)(n) & R_CTX_N_THREADS_MASK)
+
 struct r_ctx * r_ctx_init(struct p_window *win, enum r_type type, u32 flags);
 void r_ctx_destroy(struct r_ctx **rctx_p);
 
 void r_ctx_set_color(struct r_ctx *ctx, color_RGBA32_t color);
 
+/* Returns the pixel format that the frames are drawn in.
+ * Surfaces in this format can be blitted without any conversion
+ * (see `r_surface_optimize`).
+ *
+ * This is the display's pixel format, except that the alpha channel
+ * is never ignored (e.g. `BGRX32` becomes `BGRA32`). */
+pixelfmt_t r_ctx_get_pixelfmt(const struct r_ctx *ctx);
+
+/* Sets the amount of memory (in bytes) that the pre-scaled copies
+ * of the surfaces drawn with scaled `r_surface_render`s can take up.
+ * The least recently used copies are freed first when it runs out.
+ * 0 turns the caching off altogether. The default is 64 MiB. */
+void r_ctx_set_scale_cache_budget(struct r_ctx *ctx, u64 n_bytes);
+
+/* The numbers of frames that went through the renderer so far */
+struct r_frame_stats {
+    /* Frames that the renderer tried to present */
+    u64 total_frames;
+
+    /* Frames that the window refused to present. Their changes are
+     * presented together with the next frame instead. */
+    u64 dropped_frames;
+
+    /* Frames that the window accepted, but then merged with the next one
+     * (see `struct p_window_present_stats`) */
+    u64 coalesced_frames;
+
+    /* Frames that the window accepted, but then failed to present */
+    u64 window_dropped_frames;
+};
+
+/* Retrieves the frame counters of `ctx` into `out`.
+ * Can be called at any time (from the thread that owns `ctx`). */
+void r_ctx_get_frame_stats(const struct r_ctx *ctx, struct r_frame_stats *out);
+
+/* The frame pacing statistics of the recent frames */
+struct r_frame_timing {
+    /* How long it took the renderer thread to draw each frame (in ns),
+     * from picking up the flushed commands
+     * to handing the frame over to the window */
+    struct histogram_summary render_time_ns;
+
+    /* When the frames actually got on the screen
+     * (see `p_window_get_present_timing`) */
+    struct p_window_present_timing present;
+};
+
+/* Retrieves the frame pacing statistics of `ctx` into `out`.
+ * Can be called at any time (from the thread that owns `ctx`). */
+void r_ctx_get_frame_timing(struct r_ctx *ctx, struct r_frame_timing *out);
+
+/* Clears the whole frame (to transparent black).
+ *
+ * Frames that start with `r_reset` are compared with the previous frame
+ * (if it also started with `r_reset`), and only the parts where
+ * the draw calls differ are actually cleared, redrawn and presented.
+ * Otherwise, the whole frame is always redrawn. */
 void r_reset(struct r_ctx *ctx);
+
+/* Forces the whole frame to be redrawn and presented,
+ * even if the same draw calls were made as in the previous frame.
+ *
+ * Surfaces are compared by their address and `version`, so this is
+ * only needed when the pixels of a surface get changed directly
+ * (without calling `r_surface_update_opacity` afterwards).
+ * It also makes sure that the scaled copies of any such surface
+ * aren't used anymore. */
+void r_invalidate(struct r_ctx *ctx);
+
+/* Hands the frame recorded so far over to the renderer thread,
+ * which draws and presents it in the background.
+ *
+ * The draw calls (`r_fill_rect`, `r_surface_render`, etc) only record
+ * commands - nothing is actually drawn until the frame is flushed.
+ * Because of this, any surface passed to `r_surface_render` must stay
+ * valid (and unchanged) until the frame has been drawn,
+ * i.e. until the next call to `r_flush` or `r_finish` returns
+ * (see also `r_invalidate`).
+ *
+ * If the previous frame is still being drawn, this function
+ * blocks until it's finished. */
 void r_flush(struct r_ctx *ctx);
 
+/* Blocks until all the frames flushed so far
+ * have been drawn and presented */
+void r_finish(struct r_ctx *ctx);
+
 #endif /* RCTX_H_ */
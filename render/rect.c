@@ -4,88 +4,120 @@
 #include <core/util.h>
 #include <core/pixel.h>
 #include <core/shapes.h>
+#include <core/vector.h>
 #include <platform/window.h>
 #include <limits.h>
 #define R_INTERNAL_GUARD__
 #include "rctx-internal.h"
 #undef R_INTERNAL_GUARD__
 #define R_INTERNAL_GUARD__
+#include "rcmd.h"
+#undef R_INTERNAL_GUARD__
+#define R_INTERNAL_GUARD__
 #include "putpixel-fast.h"
 #undef R_INTERNAL_GUARD__
 
 #define MODULE_NAME "rect"
 
+static inline void fill_area(struct pixel_flat_data *buf_data,
+    i32 x0, i32 y0, i32 x1, i32 y1, pixel_t color, const rect_t *clip);
+
 void r_draw_rect(struct r_ctx *ctx,
     const i32 x, const i32 y, const i32 w, const i32 h)
 {
-    if (ctx == NULL || w < 0 || h < 0 ||
-        ctx->curr_buf->w > INT_MAX || ctx->curr_buf->h > INT_MAX ||
-        ctx->curr_buf->w == 0 || ctx->curr_buf->h == 0)
+    if (ctx == NULL || w < 0 || h < 0)
         return;
 
-    const i32 start_x = u_clamp(0, x,       (i32)ctx->curr_buf->w - 1);
-    const i32 end_x   = u_clamp(0, x + w,   (i32)ctx->curr_buf->w - 1);
-    const i32 start_y = u_clamp(0, y,       (i32)ctx->curr_buf->h - 1);
-    const i32 end_y   = u_clamp(0, y + h,   (i32)ctx->curr_buf->h - 1);
+    /* The bottom edge is drawn one row below the rect */
+    r_ctx_push_cmd(ctx, &(const struct r_cmd) {
+        .type = R_CMD_DRAW_RECT,
+        .color = ctx->current_color,
+        .bounds = { x, y, w, (u32)h + 1 },
+        .d.rect = { x, y, w, h },
+    });
+}
 
-    if (start_x == end_x || start_y == end_y)
+void r_fill_rect(struct r_ctx *ctx,
+    const i32 x, const i32 y, const i32 w, const i32 h)
+{
+    if (ctx == NULL || w < 0 || h < 0)
         return;
 
-    register pixel_t *const buf = ctx->curr_buf->buf;
-    register const color_RGBA32_t color = ctx->current_color;
-    register const u32 stride = ctx->curr_buf->w;
-    register i32 x_, y_;
+    r_ctx_push_cmd(ctx, &(const struct r_cmd) {
+        .type = R_CMD_FILL_RECT,
+        .color = ctx->current_color,
+        .bounds = { x, y, w, h },
+        .d.rect = { x, y, w, h },
+    });
+}
 
-    if (start_y == y) {
-        y_ = start_y;
-        for (x_ = start_x; x_ < end_x; x_++)
-            r_putpixel_fast_matching_pixelfmt_(buf, x_, y_, stride, color);
-    }
+void r_rasterize_draw_rect(struct pixel_flat_data *buf_data,
+    const rect_t *rect, pixel_t color, const rect_t *clip)
+{
+    if (buf_data->w > INT_MAX || buf_data->h > INT_MAX ||
+        buf_data->w == 0 || buf_data->h == 0)
+        return;
 
-    if (end_y == y + h) {
-        y_ = end_y;
-        for (x_ = start_x; x_ < end_x; x_++)
-            r_putpixel_fast_matching_pixelfmt_(buf, x_, y_, stride, color);
-    }
+    const i32 x = rect->x, y = rect->y, w = rect->w, h = rect->h;
 
-    if (start_x == x) {
-        x_ = start_x;
-        for (y_ = start_y + 1; y_ < end_y; y_++)
-            r_putpixel_fast_matching_pixelfmt_(buf, x_, y_, stride, color);
-    }
+    const i32 start_x = u_clamp(0, x,       (i32)buf_data->w - 1);
+    const i32 end_x   = u_clamp(0, x + w,   (i32)buf_data->w - 1);
+    const i32 start_y = u_clamp(0, y,       (i32)buf_data->h - 1);
+    const i32 end_y   = u_clamp(0, y + h,   (i32)buf_data->h - 1);
 
-    if (end_x == x + w) {
-        x_ = end_x - 1;
-        for (y_ = start_y + 1; y_ < end_y; y_++)
-            r_putpixel_fast_matching_pixelfmt_(buf, x_, y_, stride, color);
-    }
+    if (start_x == end_x || start_y == end_y)
+        return;
+
+    if (start_y == y)
+        fill_area(buf_data, start_x, start_y, end_x, start_y + 1, color, clip);
+
+    if (end_y == y + h)
+        fill_area(buf_data, start_x, end_y, end_x, end_y + 1, color, clip);
+
+    if (start_x == x)
+        fill_area(buf_data, start_x, start_y + 1, start_x + 1, end_y,
+            color, clip);
+
+    if (end_x == x + w)
+        fill_area(buf_data, end_x - 1, start_y + 1, end_x, end_y,
+            color, clip);
 }
 
-/* "u_" for "user-provided" */
-void r_fill_rect(struct r_ctx *ctx,
-    const i32 x, const i32 y,
-    const i32 w, const i32 h)
+void r_rasterize_fill_rect(struct pixel_flat_data *buf_data,
+    const rect_t *rect, pixel_t color, const rect_t *clip)
 {
-
-    if (ctx == NULL || w < 0 || h < 0 ||
-        ctx->curr_buf->w > INT_MAX || ctx->curr_buf->h > INT_MAX ||
-        ctx->curr_buf->w == 0 || ctx->curr_buf->h == 0)
+    if (buf_data->w > INT_MAX || buf_data->h > INT_MAX ||
+        buf_data->w == 0 || buf_data->h == 0)
         return;
 
-    const i32 start_x = u_clamp(x,      0, (i32)ctx->curr_buf->w - 1);
-    const i32 end_x   = u_clamp(x + w,  0, (i32)ctx->curr_buf->w - 1);
-    const i32 start_y = u_clamp(y,      0, (i32)ctx->curr_buf->h - 1);
-    const i32 end_y   = u_clamp(y + h,  0, (i32)ctx->curr_buf->h - 1);
+    const i32 x = rect->x, y = rect->y, w = rect->w, h = rect->h;
 
-    if (start_x == end_x || start_y == end_y)
+    const i32 start_x = u_clamp(x,      0, (i32)buf_data->w - 1);
+    const i32 end_x   = u_clamp(x + w,  0, (i32)buf_data->w - 1);
+    const i32 start_y = u_clamp(y,      0, (i32)buf_data->h - 1);
+    const i32 end_y   = u_clamp(y + h,  0, (i32)buf_data->h - 1);
+
+    fill_area(buf_data, start_x, start_y, end_x, end_y, color, clip);
+}
+
+/* Draws all the pixels from (x0, y0) up to (but excluding) (x1, y1)
+ * that are also inside of `clip` */
+static inline void fill_area(struct pixel_flat_data *buf_data,
+    i32 x0, i32 y0, i32 x1, i32 y1, pixel_t color, const rect_t *clip)
+{
+    x0 = u_max(x0, clip->x);
+    y0 = u_max(y0, clip->y);
+    x1 = u_min((i64)x1, (i64)clip->x + clip->w);
+    y1 = u_min((i64)y1, (i64)clip->y + clip->h);
+
+    if (x0 >= x1 || y0 >= y1)
         return;
 
-    register pixel_t *const buf = ctx->curr_buf->buf;
-    register const u32 stride = ctx->curr_buf->w;
-    register const color_RGBA32_t color = ctx->current_color;
+    register pixel_t *const buf = buf_data->buf;
+    register const u32 stride = buf_data->stride;
 
-    for (register i32 y_ = start_y; y_ < end_y; y_++) {
-        for (register i32 x_ = start_x; x_ < end_x; x_++) {
+    for (register i32 y_ = y0; y_ < y1; y_++) {
+        for (register i32 x_ = x0; x_ < x1; x_++) {
             r_putpixel_fast_matching_pixelfmt_(buf, x_, y_, stride, color);
         }
     }
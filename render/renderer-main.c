@@ -1,12 +1,234 @@
+#include <core/log.h>
+#include <core/math.h>
+#include <core/util.h>
+#include <core/pixel.h>
+#include <core/region.h>
+#include <core/shapes.h>
+#include <core/vector.h>
+#include <core/spinlock.h>
+#include <core/histogram.h>
+#include <platform/ptime.h>
+#include <platform/thread.h>
+#include <platform/window.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
 #define R_INTERNAL_GUARD__
 #include "rctx-internal.h"
 #undef R_INTERNAL_GUARD__
-#include <platform/thread.h>
+#define R_INTERNAL_GUARD__
+#include "rcmd.h"
+#undef R_INTERNAL_GUARD__
+
+#define MODULE_NAME "renderer"
+
+static void get_frame_damage(const r_cmd_list_t prev, const r_cmd_list_t curr,
+    const rect_t *frame_rect, struct region *o);
+static bool cmd_equal(const struct r_cmd *a, const struct r_cmd *b);
+static struct region * get_buffer_damage(struct r_ctx_damage_info *info,
+    const pixel_t *buf, const rect_t *frame_rect);
+
+static void record_render_time(struct r_ctx *ctx,
+    const timestamp_t *start_time);
+static void present_frame(struct r_ctx *ctx);
 
 void renderer_main(void *arg)
 {
-    struct r_ctx_thread_info *info = arg;
-    p_mt_mutex_lock(&info->mutex);
-    p_mt_cond_wait(info->cond, info->mutex);
+    struct r_ctx *ctx = arg;
+    struct r_ctx_thread_info *info = &ctx->thread_info;
+    struct r_ctx_damage_info *damage_info = &ctx->damage;
+
+    s_log_debug("Renderer thread started");
+
+    while (true) {
+        /* Wait for `r_flush` to hand us a new frame */
+        p_mt_mutex_lock(&info->mutex);
+        while (!info->frame_pending && atomic_load(&info->running)) {
+            p_mt_cond_wait(&info->cond, &info->mutex);
+            p_mt_mutex_lock(&info->mutex);
+        }
+
+        /* Finish drawing the last submitted frame even if we were told
+         * to stop, so that nothing that was flushed is lost */
+        if (!info->frame_pending) {
+            p_mt_mutex_unlock(&info->mutex);
+            break;
+        }
+        p_mt_mutex_unlock(&info->mutex);
+
+        timestamp_t start_time;
+        p_time_get_ticks(&start_time);
+
+        /* While `frame_pending` is set, `submitted_cmds` is ours */
+        const r_cmd_list_t cmds = info->submitted_cmds;
+
+        /* Find out what has changed since the previous frame,
+         * and mark it as out of date in all of the window's buffers */
+        struct region frame_damage;
+        get_frame_damage(damage_info->prev_cmds, cmds,
+            &ctx->pixels_rect, &frame_damage);
+        for (u32 i = 0; i < damage_info->n_buffers; i++) {
+            region_add_region(&damage_info->buffers[i].damage,
+                &frame_damage);
+        }
+        region_add_region(&damage_info->present_damage, &frame_damage);
+
+        /* If nothing changed since the last presented frame,
+         * there's nothing to draw or present either */
+        if (!region_empty(&damage_info->present_damage)) {
+            /* Only redraw the parts of the current buffer
+             * that are out of date */
+            struct region *const buf_damage =
+                get_buffer_damage(damage_info, ctx->curr_buf->buf,
+                    &ctx->pixels_rect);
+            r_tile_raster_draw(&ctx->tile_raster, ctx->curr_buf,
+                ctx->buf_fmt, cmds, buf_damage);
+            region_clear(buf_damage);
+
+            record_render_time(ctx, &start_time);
+            present_frame(ctx);
+        }
+
+        /* The frame we just drew is what the next one gets compared to */
+        p_mt_mutex_lock(&info->mutex);
+        info->submitted_cmds = damage_info->prev_cmds;
+        damage_info->prev_cmds = cmds;
+        vector_clear(&info->submitted_cmds);
+        info->frame_pending = false;
+        p_mt_cond_signal(&info->cond);
+        p_mt_mutex_unlock(&info->mutex);
+    }
+
+    s_log_debug("Renderer thread exiting");
     p_mt_thread_exit();
 }
+
+/* Writes the parts of the frame that differ between
+ * the commands in `prev` and `curr` to `o` */
+static void get_frame_damage(const r_cmd_list_t prev, const r_cmd_list_t curr,
+    const rect_t *frame_rect, struct region *o)
+{
+    region_clear(o);
+
+    /* A frame that doesn't start with a reset draws on top of whatever
+     * was in the buffer before, so it can't be compared to anything */
+    if (vector_size(curr) == 0 || curr[0].type != R_CMD_RESET ||
+        vector_size(prev) == 0 || prev[0].type != R_CMD_RESET)
+    {
+        region_add_rect(o, frame_rect);
+        return;
+    }
+
+    /* A pixel can only change if at least one of the commands
+     * that touch it is different */
+    const u32 n_prev = vector_size(prev), n_curr = vector_size(curr);
+    for (u32 i = 0; i < u_max(n_prev, n_curr); i++) {
+        if (i < n_curr && curr[i].type == R_CMD_INVALIDATE) {
+            region_clear(o);
+            region_add_rect(o, frame_rect);
+            return;
+        }
+
+        if (i < n_prev && i < n_curr && cmd_equal(&prev[i], &curr[i]))
+            continue;
+
+        if (i < n_prev)
+            region_add_rect(o, &prev[i].bounds);
+        if (i < n_curr)
+            region_add_rect(o, &curr[i].bounds);
+    }
+}
+
+static bool cmd_equal(const struct r_cmd *a, const struct r_cmd *b)
+{
+    /* Don't `memcmp` the whole struct, as the padding
+     * (and the unused parts of the union) can be anything */
+    if (a->type != b->type ||
+        memcmp(&a->color, &b->color, sizeof(pixel_t)) ||
+        memcmp(&a->bounds, &b->bounds, sizeof(rect_t)))
+        return false;
+
+    switch (a->type) {
+    case R_CMD_RESET:
+    case R_CMD_INVALIDATE:
+        return true;
+    case R_CMD_FILL_RECT:
+    case R_CMD_DRAW_RECT:
+        return !memcmp(&a->d.rect, &b->d.rect, sizeof(rect_t));
+    case R_CMD_DRAW_LINE:
+        return a->d.line.start.x == b->d.line.start.x &&
+            a->d.line.start.y == b->d.line.start.y &&
+            a->d.line.end.x == b->d.line.end.x &&
+            a->d.line.end.y == b->d.line.end.y;
+    case R_CMD_SURFACE:
+        return a->d.surface.src == b->d.surface.src &&
+            a->d.surface.src_version == b->d.surface.src_version &&
+            a->d.surface.filter == b->d.surface.filter &&
+            !memcmp(&a->d.surface.src_rect, &b->d.surface.src_rect,
+                sizeof(rect_t)) &&
+            !memcmp(&a->d.surface.dst_rect, &b->d.surface.dst_rect,
+                sizeof(rect_t));
+    default:
+        return false;
+    }
+}
+
+/* Returns the damage of the window buffer with the pixel data `buf`.
+ * Buffers that we haven't seen before are completely out of date. */
+static struct region * get_buffer_damage(struct r_ctx_damage_info *info,
+    const pixel_t *buf, const rect_t *frame_rect)
+{
+    for (u32 i = 0; i < info->n_buffers; i++) {
+        if (info->buffers[i].buf == buf)
+            return &info->buffers[i].damage;
+    }
+
+    /* Forget about the oldest buffer if there's no space left */
+    if (info->n_buffers == R_MAX_TRACKED_BUFFERS) {
+        memmove(&info->buffers[0], &info->buffers[1],
+            (R_MAX_TRACKED_BUFFERS - 1) * sizeof(struct r_buffer_damage));
+        info->n_buffers--;
+    }
+
+    struct r_buffer_damage *const new_buf = &info->buffers[info->n_buffers++];
+    new_buf->buf = buf;
+    region_clear(&new_buf->damage);
+    region_add_rect(&new_buf->damage, frame_rect);
+
+    return &new_buf->damage;
+}
+
+static void record_render_time(struct r_ctx *ctx,
+    const timestamp_t *start_time)
+{
+    timestamp_t end_time, delta;
+    p_time_get_ticks(&end_time);
+    timestamp_delta(delta, *start_time, end_time);
+
+    spinlock_acquire(&ctx->render_time_lock);
+    histogram_add(&ctx->render_time_ns, delta.s * 1000000000ULL + delta.ns);
+    spinlock_release(&ctx->render_time_lock);
+}
+
+static void present_frame(struct r_ctx *ctx)
+{
+    struct region *const damage = &ctx->damage.present_damage;
+
+    struct pixel_flat_data *new_buf = p_window_swap_buffers_damaged(ctx->win,
+        ctx->win_info.vsync_supported ?
+            P_WINDOW_PRESENT_VSYNC :
+            P_WINDOW_PRESENT_NOW,
+        damage->rects, damage->n_rects
+    );
+    ctx->total_frames++;
+
+    s_assert(new_buf != NULL, "wtf");
+    if (new_buf == P_WINDOW_SWAP_BUFFERS_FAIL) {
+        /* Keep the damage around, so that it's presented
+         * together with the next frame */
+        ctx->dropped_frames++;
+    } else {
+        ctx->curr_buf = new_buf;
+        region_clear(damage);
+    }
+}
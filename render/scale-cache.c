@@ -0,0 +1,253 @@
+#include <core/log.h>
+#include <core/int.h>
+#include <core/util.h>
+#include <core/pixel.h>
+#include <core/shapes.h>
+#include <core/vector.h>
+#include <stdbool.h>
+#include <string.h>
+#define R_INTERNAL_GUARD__
+#include "scale-cache.h"
+#undef R_INTERNAL_GUARD__
+#include "surface.h"
+
+#define MODULE_NAME "scale-cache"
+
+/* Copies bigger than this (in either dimension) are never made */
+#define MAX_SCALED_SIZE 16384
+
+static struct r_surface * make_scaled_copy(const struct r_surface *src,
+    const rect_t *area, u32 w, u32 h, enum r_surface_filter filter);
+static bool make_room(struct r_scale_cache *c, u64 n_bytes);
+static void remove_entry(struct r_scale_cache *c, u32 index);
+
+static inline bool can_free(const struct r_scale_cache *c,
+    const struct r_scale_cache_entry *e);
+static inline i64 scale_coord(i64 x, u32 to, u32 from);
+
+void r_scale_cache_init(struct r_scale_cache *c, u64 budget)
+{
+    u_check_params(c != NULL);
+
+    c->entries = vector_new(struct r_scale_cache_entry);
+    c->budget = budget;
+    c->used = 0;
+    c->frame = 0;
+}
+
+void r_scale_cache_destroy(struct r_scale_cache *c)
+{
+    if (c == NULL || c->entries == NULL) return;
+
+    for (u32 i = 0; i < vector_size(c->entries); i++)
+        r_surface_destroy(&c->entries[i].scaled);
+    vector_destroy(&c->entries);
+
+    memset(c, 0, sizeof(struct r_scale_cache));
+}
+
+const struct r_surface * r_scale_cache_get(struct r_scale_cache *c,
+    const struct r_surface *src, const rect_t *src_rect,
+    const rect_t *dst_rect, enum r_surface_filter filter,
+    rect_t *o_src_rect)
+{
+    u_check_params(c != NULL && src != NULL && src_rect != NULL &&
+        dst_rect != NULL && o_src_rect != NULL);
+
+    if (src_rect->w == 0 || src_rect->h == 0 ||
+        dst_rect->w == 0 || dst_rect->h == 0)
+        return NULL;
+
+    /* Figure out what to scale, and to what size */
+    rect_t area;
+    u32 w, h;
+    if (filter == R_SURFACE_FILTER_NEAREST) {
+        area = src->data_rect;
+        w = scale_coord(src->data.w, dst_rect->w, src_rect->w);
+        h = scale_coord(src->data.h, dst_rect->h, src_rect->h);
+
+        *o_src_rect = (rect_t) {
+            .x = scale_coord(src_rect->x, dst_rect->w, src_rect->w),
+            .y = scale_coord(src_rect->y, dst_rect->h, src_rect->h),
+            .w = dst_rect->w,
+            .h = dst_rect->h,
+        };
+    } else {
+        /* The pixels outside of the source surface
+         * can't be represented in the copy */
+        if (src_rect->x < 0 || src_rect->y < 0 ||
+            (i64)src_rect->x + src_rect->w > src->data.w ||
+            (i64)src_rect->y + src_rect->h > src->data.h)
+            return NULL;
+
+        area = *src_rect;
+        w = dst_rect->w;
+        h = dst_rect->h;
+
+        *o_src_rect = (rect_t) { 0, 0, w, h };
+    }
+    if (w == 0 || h == 0 || w > MAX_SCALED_SIZE || h > MAX_SCALED_SIZE ||
+        area.w > MAX_SCALED_SIZE || area.h > MAX_SCALED_SIZE)
+        return NULL;
+
+    for (u32 i = 0; i < vector_size(c->entries); i++) {
+        struct r_scale_cache_entry *const e = &c->entries[i];
+        if (!e->stale && e->src_version == src->version &&
+            e->filter == filter && e->w == w && e->h == h &&
+            !memcmp(&e->src_area, &area, sizeof(rect_t)))
+        {
+            e->last_used_frame = c->frame;
+            return e->scaled;
+        }
+    }
+
+    /* Not found - make a new copy, if there's space for it */
+    const u64 n_bytes = (u64)w * h * sizeof(pixel_t);
+    if (!make_room(c, n_bytes))
+        return NULL;
+
+    struct r_surface *const scaled =
+        make_scaled_copy(src, &area, w, h, filter);
+    if (scaled == NULL)
+        return NULL;
+
+    vector_push_back(&c->entries, (struct r_scale_cache_entry) {
+        .src_version = src->version,
+        .src_area = area,
+        .w = w,
+        .h = h,
+        .filter = filter,
+        .scaled = scaled,
+        .n_bytes = n_bytes,
+        .last_used_frame = c->frame,
+        .stale = false,
+    });
+    c->used += n_bytes;
+
+    return scaled;
+}
+
+void r_scale_cache_next_frame(struct r_scale_cache *c)
+{
+    u_check_params(c != NULL);
+
+    c->frame++;
+
+    u32 i = 0;
+    while (i < vector_size(c->entries)) {
+        const struct r_scale_cache_entry *const e = &c->entries[i];
+        if ((e->stale || c->frame - e->last_used_frame > R_SCALE_CACHE_MAX_AGE)
+            && can_free(c, e))
+        {
+            remove_entry(c, i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void r_scale_cache_invalidate(struct r_scale_cache *c)
+{
+    u_check_params(c != NULL);
+
+    for (u32 i = 0; i < vector_size(c->entries); i++)
+        c->entries[i].stale = true;
+}
+
+void r_scale_cache_set_budget(struct r_scale_cache *c, u64 budget)
+{
+    u_check_params(c != NULL);
+
+    c->budget = budget;
+    (void) make_room(c, 0);
+}
+
+static struct r_surface * make_scaled_copy(const struct r_surface *src,
+    const rect_t *area, u32 w, u32 h, enum r_surface_filter filter)
+{
+    struct r_surface *const ret = r_surface_create(w, h, src->color_format);
+    if (ret == NULL) {
+        s_log_error("Failed to create a %ux%u surface for a scaled copy",
+            w, h);
+        return NULL;
+    }
+
+    /* The copy has to have exactly the same pixels as the ones that
+     * a scaled blit would get from `src`. Blending them onto the empty
+     * surface could change them, so instead the blit is done from a view
+     * of `src` that claims to be opaque, which makes every pixel
+     * get copied as-is. */
+    struct r_surface opaque_view = *src;
+    opaque_view.opacity.type = R_OPACITY_OPAQUE;
+    r_surface_blit_filtered(ret, &opaque_view, area, &ret->data_rect, filter);
+
+    r_surface_update_opacity(ret);
+
+    return ret;
+}
+
+/* Frees the least recently used copies until `n_bytes` more can fit
+ * into the budget. Returns false if that isn't possible, because
+ * some of them are still in use. */
+static bool make_room(struct r_scale_cache *c, u64 n_bytes)
+{
+    if (n_bytes > c->budget)
+        return false;
+
+    while (c->used + n_bytes > c->budget) {
+        /* The stale copies go first, since they'll never be used again */
+        i64 lru = -1;
+        u64 lru_key = 0;
+        for (u32 i = 0; i < vector_size(c->entries); i++) {
+            const struct r_scale_cache_entry *const e = &c->entries[i];
+            if (!can_free(c, e))
+                continue;
+
+            const u64 key = e->stale ? 0 : e->last_used_frame + 1;
+            if (lru == -1 || key < lru_key) {
+                lru = i;
+                lru_key = key;
+            }
+        }
+        if (lru == -1)
+            return false;
+
+        remove_entry(c, lru);
+    }
+
+    return true;
+}
+
+static void remove_entry(struct r_scale_cache *c, u32 index)
+{
+    struct r_scale_cache_entry *const e = &c->entries[index];
+    c->used -= e->n_bytes;
+    r_surface_destroy(&e->scaled);
+
+    /* The order doesn't matter */
+    const u32 last = vector_size(c->entries) - 1;
+    if (index != last)
+        c->entries[index] = c->entries[last];
+    vector_pop_back(&c->entries);
+}
+
+/* A copy that was drawn from in the frame `n` might still be used by
+ * the renderer thread until the frame `n` is drawn, which only
+ * surely happens once `r_flush` hands over the frame `n + 1`.
+ * The same goes for the renderer comparing the surface (address)
+ * with the one in the previous frame. */
+static inline bool can_free(const struct r_scale_cache *c,
+    const struct r_scale_cache_entry *e)
+{
+    return e->last_used_frame + 2 <= c->frame;
+}
+
+/* Returns `x` * `to` / `from`, rounded to the nearest integer */
+static inline i64 scale_coord(i64 x, u32 to, u32 from)
+{
+    const i64 num = 2 * x * to + from;
+    const i64 den = 2 * (i64)from;
+
+    /* Round towards negative infinity, not zero */
+    return num >= 0 ? num / den : -((-num + den - 1) / den);
+}
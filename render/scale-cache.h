@@ -0,0 +1,105 @@
+#ifndef R_SCALE_CACHE_H_
+#define R_SCALE_CACHE_H_
+#ifndef R_INTERNAL_GUARD__
+#error This header is internal to the cgd renderer module and is not intented to be used elsewhere
+#endif /* R_INTERNAL_GUARD__ */
+
+#include "surface.h"
+#include <core/int.h>
+#include <core/shapes.h>
+#include <core/vector.h>
+#include <stdbool.h>
+
+/* Surfaces that get drawn scaled (like the parallax backgrounds,
+ * which are stretched over the whole window) tend to be drawn
+ * at the same scale frame after frame. Instead of scaling them again
+ * every time, `r_surface_render` keeps pre-scaled copies of them here,
+ * so that all that's left to do is an unscaled blit.
+ *
+ * With nearest filtering, the whole surface is scaled, so that drawing
+ * a different part of it at the same scale (e.g. scrolling through it)
+ * still uses the same copy. Bilinear filtering has to clamp to the edges
+ * of the source rect (as otherwise the pixels around it would bleed in),
+ * so only the source rect is scaled, and only it can be drawn from the copy.
+ *
+ * A copy is only ever used for the exact version of the source surface
+ * that it was made from (see `r_surface.version`), so changes to the
+ * source never show up late. The ones that aren't used anymore
+ * are freed once they are old enough (or when more space is needed),
+ * in a least-recently-used order.
+ *
+ * Only accessed by the thread that makes the draw calls. */
+
+/* The default amount of memory (in bytes) that the pixels
+ * of the scaled copies can take up */
+#define R_SCALE_CACHE_DEFAULT_BUDGET (64ULL * 1024 * 1024)
+
+/* Copies that haven't been used for this many frames are freed */
+#define R_SCALE_CACHE_MAX_AGE 120
+
+struct r_scale_cache_entry {
+    /* The key */
+    u64 src_version;
+    rect_t src_area; /* The part of the source that was scaled */
+    u32 w, h; /* The size that it was scaled to */
+    enum r_surface_filter filter;
+
+    struct r_surface *scaled;
+    u64 n_bytes;
+
+    /* The frame in which the copy was last drawn from */
+    u64 last_used_frame;
+
+    /* Set when the copy shouldn't be used anymore,
+     * but might still be referenced by a frame that's being drawn */
+    bool stale;
+};
+
+struct r_scale_cache {
+    /* There's rarely more than a handful of entries,
+     * so a simple linear search is good enough */
+    VECTOR(struct r_scale_cache_entry) entries;
+
+    u64 budget;
+    u64 used;
+
+    /* The number of the frame that's currently being recorded */
+    u64 frame;
+};
+
+/* Prepares an empty cache that may take up to `budget` bytes */
+void r_scale_cache_init(struct r_scale_cache *c, u64 budget);
+
+/* Frees all the scaled copies. None of them may be in use anymore. */
+void r_scale_cache_destroy(struct r_scale_cache *c);
+
+/* Returns a scaled copy of `src` that can be drawn with an unscaled blit
+ * from `*o_src_rect` to `dst_rect` instead of the scaled blit from
+ * `src_rect` to `dst_rect` (with the filter `filter`), creating it first
+ * if needed.
+ *
+ * Returns `NULL` if there isn't one and it can't be created
+ * (e.g. when it wouldn't fit in the budget), in which case the blit
+ * should just be done the normal way.
+ *
+ * The copy stays valid until the frame that's currently being
+ * recorded has been drawn. */
+const struct r_surface * r_scale_cache_get(struct r_scale_cache *c,
+    const struct r_surface *src, const rect_t *src_rect,
+    const rect_t *dst_rect, enum r_surface_filter filter,
+    rect_t *o_src_rect);
+
+/* Must be called once the recorded frame is handed over to the renderer
+ * thread (and the previous one has finished drawing).
+ * Frees the copies that are too old or stale. */
+void r_scale_cache_next_frame(struct r_scale_cache *c);
+
+/* Makes sure that none of the existing copies get used again
+ * (e.g. when the source surfaces might have been changed directly) */
+void r_scale_cache_invalidate(struct r_scale_cache *c);
+
+/* Changes the budget to `budget` bytes, freeing
+ * as many copies as needed (and possible) to fit into it */
+void r_scale_cache_set_budget(struct r_scale_cache *c, u64 budget);
+
+#endif /* R_SCALE_CACHE_H_ */
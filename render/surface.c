@@ -5,8 +5,11 @@
 #include <core/math.h>
 #include <core/pixel.h>
 #include <core/shapes.h>
+#include <core/vector.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 #define R_INTERNAL_GUARD__
 #include "surface.h"
 #undef R_INTERNAL_GUARD__
@@ -14,28 +17,95 @@
 #include "rctx-internal.h"
 #undef R_INTERNAL_GUARD__
 #define R_INTERNAL_GUARD__
-#include "putpixel-fast.h"
+#include "rcmd.h"
+#undef R_INTERNAL_GUARD__
+#define R_INTERNAL_GUARD__
+#include "blit-kernels.h"
+#undef R_INTERNAL_GUARD__
+#define R_INTERNAL_GUARD__
+#include "scale-cache.h"
 #undef R_INTERNAL_GUARD__
 
 #define MODULE_NAME "surface"
 
-typedef void (blit_function_t)(
-    const struct pixel_flat_data *restrict src_data,
-    struct pixel_flat_data *restrict dst_data,
-    const rect_t *src_rect,
-    const rect_t *dst_rect,
-    const f32 scale_x,
-    const f32 scale_y,
-    const pixelfmt_t dst_pixelfmt
-);
-static blit_function_t unscaled_unconverted_alpha_blit;
-static blit_function_t unscaled_converted_alpha_blit;
-static blit_function_t scaled_unconverted_alpha_blit;
-static blit_function_t scaled_converted_alpha_blit;
-static blit_function_t unscaled_unconverted_noalpha_blit;
-static blit_function_t unscaled_converted_noalpha_blit;
-static blit_function_t scaled_unconverted_noalpha_blit;
-static blit_function_t scaled_converted_noalpha_blit;
+/* The number of pixels that are converted at once
+ * (through a temporary buffer on the stack) */
+#define CONVERT_CHUNK_SIZE 256
+
+/* `src_rect` and `dst_rect` are the (unclipped) rects that the user asked
+ * for, and they only determine which source pixel ends up where.
+ * The pixels that actually get written are the ones in `area`, which
+ * is always within `dst_rect`, `dst_data` and only ever maps
+ * to pixels that are within `src_rect` and `src_data`. */
+struct blit_info {
+    const struct r_surface *src;
+    struct pixel_flat_data *dst_data;
+    const rect_t *src_rect;
+    const rect_t *dst_rect;
+    rect_t area;
+    enum r_surface_filter filter;
+
+    /* The part of `src` that may be read from (`src_rect` ∩ `src_data`) */
+    i64 src_min_x, src_min_y, src_max_x, src_max_y;
+
+    /* The row kernels picked for the pixel formats of `src` and `dst` */
+    r_blit_row_fn_t *copy;
+    r_blit_row_fn_t *blend;
+
+    /* Whether the source pixels need to be premultiplied
+     * before they're passed to `blend` */
+    bool premultiply_src;
+};
+/* The source pixel(s) that a column of the destination samples from.
+ * With nearest filtering only `s0` is used. With bilinear filtering,
+ * `weight` is the weight of `s1` (out of 256) - and `s0` gets the rest. */
+struct blit_column {
+    u32 s0, s1;
+    u32 weight;
+};
+
+static void unscaled_blit(const struct blit_info *b);
+static void scaled_blit(const struct blit_info *b);
+static void scaled_nearest_blit(const struct blit_info *b,
+    const struct blit_column *columns);
+static void scaled_bilinear_blit(const struct blit_info *b,
+    const struct blit_column *columns);
+static void blit_span(const struct blit_info *b, enum r_opacity opacity,
+    pixel_t *dst, const pixel_t *src, u32 n);
+
+static struct r_surface * surface_new(struct pixel_flat_data *pixels,
+    pixelfmt_t color_format);
+static void clear_opacity(struct r_surface *s);
+static void new_version(struct r_surface *s);
+static void analyze_row_opacity(struct r_surface *s, const pixel_t *row,
+    u64 *n_opaque, u64 *n_transparent);
+static const struct r_opacity_span * get_row_spans(const struct r_surface *s,
+    u32 y, struct r_opacity_span *whole_row);
+static inline enum r_opacity get_pixel_opacity(pixel_t px);
+
+static void do_blit(struct pixel_flat_data *dst_data, pixelfmt_t dst_fmt,
+    const struct r_surface *src, const rect_t *src_rect,
+    const rect_t *dst_rect, enum r_surface_filter filter,
+    const rect_t *clip);
+static void check_rects(const rect_t *src_rect, const rect_t *dst_rect);
+static bool trim_axis(i32 *area_start, u32 *area_len,
+    i32 dst_origin, u32 dst_len, i32 src_origin, u32 src_len,
+    i64 src_min, i64 src_max);
+static inline u64 map_coord_fp(i64 d, i32 dst_origin, u32 dst_len,
+    u32 src_len);
+static inline i64 map_coord(i64 d, i32 dst_origin, u32 dst_len,
+    i32 src_origin, u32 src_len);
+static inline void map_coord_bilinear(i64 d, i32 dst_origin, u32 dst_len,
+    i32 src_origin, u32 src_len, i64 src_min, i64 src_max,
+    u32 *o_s0, u32 *o_s1, u32 *o_weight);
+static inline pixel_t bilinear_sample(pixel_t p00, pixel_t p01,
+    pixel_t p10, pixel_t p11, u32 wx, u32 wy);
+
+static inline bool pixelfmt_is_bgr(pixelfmt_t fmt);
+static inline bool pixelfmt_has_alpha(pixelfmt_t fmt);
+static inline bool pixelfmt_is_premul(pixelfmt_t fmt);
+static void premultiply(pixel_t *dst, const pixel_t *src, u64 n);
+static void unpremultiply(pixel_t *buf, u64 n);
 
 struct r_surface * r_surface_create(u32 w, u32 h,
     pixelfmt_t color_format)
@@ -48,12 +118,15 @@ struct r_surface * r_surface_create(u32 w, u32 h,
     struct pixel_flat_data pixel_data;
     pixel_data.w = w;
     pixel_data.h = h;
+    pixel_data.stride = w;
     pixel_data.buf = calloc(w * h, sizeof(pixel_t));
     if (pixel_data.buf == NULL)
         goto_error("Failed to allocate new surface (width: %u, height: %u).",
             w, h);
 
-    return r_surface_init(&pixel_data, color_format);
+    /* Don't bother analyzing the opacity,
+     * since the caller will most likely overwrite the pixels anyway */
+    return surface_new(&pixel_data, color_format);
 
 err:
     if (pixel_data.buf != NULL) u_nfree(&pixel_data.buf);
@@ -65,27 +138,68 @@ struct r_surface * r_surface_init(struct pixel_flat_data *pixels,
 {
     u_check_params(pixels != NULL);
 
-    if (color_format == RGB24 || color_format == BGR24) {
-        s_log_error("24-bit surfaces are not yet supported!");
+    struct r_surface *s = surface_new(pixels, color_format);
+    if (s == NULL)
         return NULL;
-    }
 
-    struct r_surface *s = calloc(1, sizeof(struct r_surface));
-    s_assert(s != NULL, "calloc() failed for new surface");
+    r_surface_update_opacity(s);
+    return s;
+}
 
-    s->color_format = color_format;
-    s->data.w = pixels->w;
-    s->data.h = pixels->h;
-    s->data.buf = pixels->buf;
-    u_rect_from_pixel_data(&s->data, &s->data_rect);
+void r_surface_update_opacity(struct r_surface *s)
+{
+    u_check_params(s != NULL);
 
-    return s;
+    clear_opacity(s);
+
+    const u64 n_pixels = (u64)s->data.w * s->data.h;
+    if (n_pixels == 0) {
+        s->opacity.type = R_OPACITY_TRANSPARENT;
+        return;
+    } else if (!pixelfmt_has_alpha(s->color_format)) {
+        s->opacity.type = R_OPACITY_OPAQUE;
+        return;
+    }
+
+    s->opacity.spans = vector_new(struct r_opacity_span);
+    s->opacity.row_offsets = malloc((s->data.h + 1) * sizeof(u32));
+    s_assert(s->opacity.row_offsets != NULL,
+        "malloc() failed for the opacity row offsets");
+
+    u64 n_opaque = 0, n_transparent = 0;
+    for (u32 y = 0; y < s->data.h; y++) {
+        s->opacity.row_offsets[y] = vector_size(s->opacity.spans);
+        analyze_row_opacity(s, pixel_flat_data_at(&s->data, 0, y),
+            &n_opaque, &n_transparent);
+    }
+    s->opacity.row_offsets[s->data.h] = vector_size(s->opacity.spans);
+
+    /* Don't keep the spans around if they're all the same anyway */
+    if (n_opaque == n_pixels) {
+        clear_opacity(s);
+        s->opacity.type = R_OPACITY_OPAQUE;
+    } else if (n_transparent == n_pixels) {
+        clear_opacity(s);
+        s->opacity.type = R_OPACITY_TRANSPARENT;
+    } else {
+        vector_shrink_to_fit(&s->opacity.spans);
+        s->opacity.type = R_OPACITY_MIXED;
+    }
 }
 
 void r_surface_blit(struct r_surface *dst, const struct r_surface *src,
     const rect_t *src_rect, const rect_t *dst_rect)
 {
-    u_check_params(src != NULL && dst != NULL);
+    r_surface_blit_filtered(dst, src, src_rect, dst_rect,
+        R_SURFACE_FILTER_NEAREST);
+}
+
+void r_surface_blit_filtered(struct r_surface *dst,
+    const struct r_surface *src, const rect_t *src_rect,
+    const rect_t *dst_rect, enum r_surface_filter filter)
+{
+    u_check_params(src != NULL && dst != NULL &&
+        filter >= 0 && filter < R_SURFACE_FILTER_MAX_);
     if (src->color_format == RGB24 || src->color_format == BGR24 ||
         dst->color_format == RGB24 || dst->color_format == BGR24)
         s_log_fatal("24-bit surfaces are not yet supported!");
@@ -101,99 +215,160 @@ void r_surface_blit(struct r_surface *dst, const struct r_surface *src,
         sizeof(rect_t)
     );
 
-    s_assert((i32)final_src_rect.w >= 0 && (i32)final_src_rect.h >= 0,
-        "The source rect's dimensions are too big (integer overflow)");
-    s_assert((i32)final_dst_rect.w >= 0 && (i32)final_dst_rect.h >= 0,
-        "The destination rect's dimensions are too big (integer overflow)");
+    check_rects(&final_src_rect, &final_dst_rect);
 
-    /* The scale must be calculated before clipping the rects */
-    const f32 scale_x = (f32)final_src_rect.w / (f32)final_dst_rect.w;
-    const f32 scale_y = (f32)final_src_rect.h / (f32)final_dst_rect.h;
+    do_blit(&dst->data, dst->color_format, src,
+        &final_src_rect, &final_dst_rect, filter, NULL);
 
-    /* Clip the rects to make sure we don't read or write out of bounds */
-    rect_t tmp = final_dst_rect;
-    rect_clip(&final_dst_rect, &dst->data_rect);
+    /* The pixels of `dst` have changed
+     * and it's not worth it to figure out how exactly */
+    clear_opacity(dst);
+}
 
-    /* "Project" the changes made to dst_rect onto src_rect */
-    final_src_rect.x -= (f32)(tmp.x - final_dst_rect.x) * scale_x;
-    final_src_rect.y -= (f32)(tmp.y - final_dst_rect.y) * scale_y;
-    final_src_rect.w -= (f32)(tmp.w - final_dst_rect.w) * scale_x;
-    final_src_rect.h -= (f32)(tmp.h - final_dst_rect.h) * scale_y;
+void r_surface_render(struct r_ctx *rctx, const struct r_surface *src,
+    const rect_t *src_rect, const rect_t *dst_rect)
+{
+    r_surface_render_filtered(rctx, src, src_rect, dst_rect,
+        R_SURFACE_FILTER_NEAREST);
+}
 
-    /* Again, ensure that we don't read out of bounds */
-    rect_clip(&final_src_rect, &src->data_rect);
+void r_surface_render_filtered(struct r_ctx *rctx,
+    const struct r_surface *src, const rect_t *src_rect,
+    const rect_t *dst_rect, enum r_surface_filter filter)
+{
+    u_check_params(rctx != NULL && src != NULL &&
+        filter >= 0 && filter < R_SURFACE_FILTER_MAX_);
+    if (src->color_format == RGB24 || src->color_format == BGR24)
+        s_log_fatal("24-bit surfaces are not yet supported!");
 
-    /* Return early if there is nothing to do */
-    if (final_src_rect.w == 0 || final_src_rect.h == 0 ||
-        final_dst_rect.w == 0 || final_dst_rect.h == 0)
-        return;
+    rect_t final_src_rect = src_rect != NULL ? *src_rect : src->data_rect;
+    const rect_t final_dst_rect = dst_rect != NULL ?
+        *dst_rect : rctx->pixels_rect;
+    check_rects(&final_src_rect, &final_dst_rect);
+
+    /* Don't scale the same thing all over again every frame */
+    if (final_src_rect.w != final_dst_rect.w ||
+        final_src_rect.h != final_dst_rect.h)
+    {
+        rect_t scaled_src_rect;
+        const struct r_surface *const scaled = r_scale_cache_get(
+            &rctx->scale_cache, src, &final_src_rect, &final_dst_rect,
+            filter, &scaled_src_rect
+        );
+        if (scaled != NULL) {
+            src = scaled;
+            final_src_rect = scaled_src_rect;
+        }
+    }
 
-    /* Use faster blitting functions if we can */
-    const u8 needs_pixel_conversion =
-        (src->color_format != dst->color_format)
-        << 0;
-
-    const u8 needs_scaling =
-        (final_src_rect.w != final_dst_rect.w ||
-         final_src_rect.h != final_dst_rect.h)
-        << 1;
-
-    /* If both src or dst have a pixel format that ignores
-     * the alpha channel, the blit can ingore it */
-    const u8 uses_alpha = (1 || !(
-            (src->color_format == RGBX32 || src->color_format == BGRX32) &&
-            (dst->color_format == RGBX32 || dst->color_format == BGRX32)
-        )) << 2;
-
-    /* Fancy switch statement */
-#define CONV    1 << 0
-#define SCALE   1 << 1
-#define ALPHA   1 << 2
-#define NO_CONV     0 << 0
-#define NO_SCALE    0 << 1
-#define NO_ALPHA    0 << 2
-    static blit_function_t *const blit_function_table[8] = {
-        [NO_SCALE | NO_CONV | NO_ALPHA  ] = &unscaled_unconverted_noalpha_blit,
-        [NO_SCALE | NO_CONV | ALPHA     ] = &unscaled_unconverted_alpha_blit,
-        [NO_SCALE | CONV    | NO_ALPHA  ] = &unscaled_converted_noalpha_blit,
-        [NO_SCALE | CONV    | ALPHA     ] = &unscaled_converted_alpha_blit,
-        [SCALE    | NO_CONV | NO_ALPHA  ] = &scaled_unconverted_noalpha_blit,
-        [SCALE    | NO_CONV | ALPHA     ] = &scaled_unconverted_alpha_blit,
-        [SCALE    | CONV    | NO_ALPHA  ] = &scaled_converted_noalpha_blit,
-        [SCALE    | CONV    | ALPHA     ] = &scaled_converted_alpha_blit,
-    };
+    r_ctx_push_cmd(rctx, &(const struct r_cmd) {
+        .type = R_CMD_SURFACE,
+        .bounds = final_dst_rect,
+        .d.surface = {
+            .src = src,
+            .src_version = src->version,
+            .src_rect = final_src_rect,
+            .dst_rect = final_dst_rect,
+            .filter = filter,
+        },
+    });
+}
 
-    const u8 index = needs_scaling | needs_pixel_conversion | uses_alpha;
-    s_assert(/* (always true) index >= 0 && */ index < 8, "how?");
+i32 r_surface_convert(struct r_surface *s, pixelfmt_t fmt)
+{
+    u_check_params(s != NULL);
 
-    (*(blit_function_table[index])) (
-        &src->data, &dst->data,
-        &final_src_rect, &final_dst_rect,
-        scale_x, scale_y,
-        dst->color_format
-    );
+    if (s->color_format == RGB24 || s->color_format == BGR24 ||
+        fmt == RGB24 || fmt == BGR24)
+    {
+        s_log_error("24-bit surfaces are not yet supported!");
+        return 1;
+    }
+
+    if (s->color_format == fmt)
+        return 0;
+
+    const bool swap_b_r = pixelfmt_is_bgr(s->color_format) !=
+        pixelfmt_is_bgr(fmt);
+
+    /* The alpha channel of formats that ignore it may be just garbage */
+    const bool set_alpha = !pixelfmt_has_alpha(s->color_format) &&
+        pixelfmt_has_alpha(fmt);
+
+    /* Tightly packed pixels can all be converted in one go */
+    const bool packed = s->data.stride == s->data.w;
+    const u32 n_rows = packed ? u_min(s->data.h, 1) : s->data.h;
+    const u64 row_len = packed ? (u64)s->data.w * s->data.h : s->data.w;
+
+    const bool unpremul = pixelfmt_is_premul(s->color_format) &&
+        !pixelfmt_is_premul(fmt);
+    const bool premul = !pixelfmt_is_premul(s->color_format) &&
+        pixelfmt_is_premul(fmt);
+
+    /* The row kernels can't work in place,
+     * so the pixels have to go through a temporary buffer */
+    const struct r_blit_kernels *const kernels = r_blit_kernels_get_active();
+    pixel_t tmp[CONVERT_CHUNK_SIZE];
+
+    for (u32 y = 0; y < n_rows; y++) {
+        pixel_t *const row = pixel_flat_data_at(&s->data, 0, y);
+
+        if (unpremul)
+            unpremultiply(row, row_len);
+
+        u64 i = 0;
+        while (swap_b_r && i < row_len) {
+            const u32 n = u_min(row_len - i, CONVERT_CHUNK_SIZE);
+            kernels->copy_swizzle(tmp, row + i, n);
+            kernels->copy(row + i, tmp, n);
+            i += n;
+        }
+
+        if (set_alpha) {
+            for (i = 0; i < row_len; i++)
+                row[i].a = 255;
+        }
+
+        if (premul)
+            premultiply(row, row, row_len);
+    }
+
+    /* The opacity only changes if the alpha channel starts
+     * or stops being ignored */
+    const bool update_opacity = pixelfmt_has_alpha(s->color_format) !=
+        pixelfmt_has_alpha(fmt);
+
+    s->color_format = fmt;
+    if (update_opacity)
+        r_surface_update_opacity(s);
+    else
+        new_version(s);
+
+    return 0;
 }
 
-void r_surface_render(struct r_ctx *rctx, const struct r_surface *src,
-    const rect_t *src_rect, const rect_t *dst_rect)
+i32 r_surface_optimize(struct r_surface *s, const struct r_ctx *rctx)
 {
-    u_check_params(rctx != NULL && src != NULL);
+    u_check_params(s != NULL && rctx != NULL);
 
-    struct r_surface tmp_rctx_surface;
-    memcpy(&tmp_rctx_surface.data, rctx->curr_buf,
-        sizeof(struct pixel_flat_data));
-    memcpy(&tmp_rctx_surface.data_rect, &rctx->pixels_rect, sizeof(rect_t));
+    /* Don't throw away the premultiplication, if it's already been done */
+    pixelfmt_t fmt = r_ctx_get_pixelfmt(rctx);
+    if (pixelfmt_is_premul(s->color_format))
+        fmt = pixelfmt_is_bgr(fmt) ? BGRA32_PREMUL : RGBA32_PREMUL;
 
-    /* Don't ignore the alpha channel since we are not drawing
-     * to a normal surface, but to the whole framebuffer,
-     * which is where everything else also gets rendered */
-    tmp_rctx_surface.color_format = rctx->win_info.display_color_format;
-    if (tmp_rctx_surface.color_format == BGRX32)
-        tmp_rctx_surface.color_format = BGRA32;
-    else if (tmp_rctx_surface.color_format == RGBX32)
-        tmp_rctx_surface.color_format = RGBA32;
+    if (r_surface_convert(s, fmt)) {
+        s_log_error("Failed to convert the surface to the display's format");
+        return 1;
+    }
+
+    return 0;
+}
 
-    r_surface_blit(&tmp_rctx_surface, src, src_rect, dst_rect);
+void r_rasterize_surface(struct pixel_flat_data *buf, pixelfmt_t buf_fmt,
+    const struct r_cmd_surface *cmd, const rect_t *clip)
+{
+    do_blit(buf, buf_fmt, cmd->src, &cmd->src_rect, &cmd->dst_rect,
+        cmd->filter, clip);
 }
 
 void r_surface_destroy(struct r_surface **surface_p)
@@ -204,256 +379,513 @@ void r_surface_destroy(struct r_surface **surface_p)
     if (surface->data.buf != NULL)
         u_nfree(&surface->data.buf);
 
+    clear_opacity(surface);
+
     u_nzfree(surface_p);
 }
 
-static void unscaled_unconverted_alpha_blit(
-    const struct pixel_flat_data *restrict src_data,
-    struct pixel_flat_data *restrict dst_data,
-    const rect_t *src_rect,
-    const rect_t *dst_rect,
-    const f32 scale_x,
-    const f32 scale_y,
-    const pixelfmt_t dst_pixelfmt
-)
-{
-    (void) scale_x;
-    (void) scale_y;
-    (void) dst_pixelfmt;
-    for (u32 dy = 0; dy < dst_rect->h; dy++) {
-        for (u32 dx = 0; dx < dst_rect->w; dx++) {
-            const u32 src_offset =
-                (src_data->w * (src_rect->y + dy)) + (src_rect->x + dx);
-
-            r_putpixel_fast_matching_pixelfmt_(
-                dst_data->buf,
-                (i32)(dst_rect->x + dx),
-                (i32)(dst_rect->y + dy),
-                dst_data->w,
-                (*(src_data->buf + src_offset))
-            );
-        }
+static void do_blit(struct pixel_flat_data *dst_data, pixelfmt_t dst_fmt,
+    const struct r_surface *src, const rect_t *src_rect,
+    const rect_t *dst_rect, enum r_surface_filter filter,
+    const rect_t *clip)
+{
+    if (src_rect->w == 0 || src_rect->h == 0 ||
+        dst_rect->w == 0 || dst_rect->h == 0 ||
+        src->opacity.type == R_OPACITY_TRANSPARENT)
+        return;
+
+    struct blit_info b = {
+        .src = src,
+        .dst_data = dst_data,
+        .src_rect = src_rect,
+        .dst_rect = dst_rect,
+        .filter = filter,
+    };
+
+    /* Clip the destination area to make sure we don't write out of bounds */
+    b.area = *dst_rect;
+    const rect_t dst_data_rect = { 0, 0, dst_data->w, dst_data->h };
+    rect_clip(&b.area, &dst_data_rect);
+    if (clip != NULL)
+        rect_clip(&b.area, clip);
+
+    /* Again, ensure that we don't read out of bounds
+     * (or outside of `src_rect`) */
+    b.src_min_x = u_max(0, src_rect->x);
+    b.src_min_y = u_max(0, src_rect->y);
+    b.src_max_x = u_min((i64)src->data.w, (i64)src_rect->x + src_rect->w);
+    b.src_max_y = u_min((i64)src->data.h, (i64)src_rect->y + src_rect->h);
+    if (!trim_axis(&b.area.x, &b.area.w, dst_rect->x, dst_rect->w,
+            src_rect->x, src_rect->w, b.src_min_x, b.src_max_x) ||
+        !trim_axis(&b.area.y, &b.area.h, dst_rect->y, dst_rect->h,
+            src_rect->y, src_rect->h, b.src_min_y, b.src_max_y))
+        return;
+
+    /* The only conversion we ever need to do (with 24-bit formats
+     * being unsupported) is swapping the R and B channels,
+     * and (for the pixels that get blended) premultiplying the alpha */
+    const struct r_blit_kernels *const kernels = r_blit_kernels_get_active();
+    const bool swizzle =
+        pixelfmt_is_bgr(src->color_format) != pixelfmt_is_bgr(dst_fmt);
+    b.copy = swizzle ? kernels->copy_swizzle : kernels->copy;
+
+    if (pixelfmt_is_premul(src->color_format)) {
+        b.blend = swizzle ? kernels->blend_premul_swizzle :
+            kernels->blend_premul;
+    } else if (pixelfmt_is_premul(dst_fmt)) {
+        /* For the destination to stay premultiplied,
+         * the source pixels have to be premultiplied too */
+        b.premultiply_src = true;
+        b.blend = swizzle ? kernels->blend_premul_swizzle :
+            kernels->blend_premul;
+    } else {
+        b.blend = swizzle ? kernels->blend_swizzle : kernels->blend;
     }
+
+    if (src_rect->w != dst_rect->w || src_rect->h != dst_rect->h)
+        scaled_blit(&b);
+    else
+        unscaled_blit(&b);
 }
 
-static void unscaled_unconverted_noalpha_blit(
-    const struct pixel_flat_data *restrict src_data,
-    struct pixel_flat_data *restrict dst_data,
-    const rect_t *src_rect,
-    const rect_t *dst_rect,
-    const f32 scale_x,
-    const f32 scale_y,
-    const pixelfmt_t dst_pixelfmt
-)
-{
-    (void) scale_x;
-    (void) scale_y;
-    (void) dst_pixelfmt;
-
-    for (u32 y = dst_rect->y; y < dst_rect->y + dst_rect->h; y++) {
-        const u32 dst_offset = ((dst_rect->y + y) * dst_data->w) + dst_rect->x;
-        const u32 src_offset = ((src_rect->y + y) * src_data->w) + src_rect->x;
-
-        memcpy(
-            dst_data->buf + dst_offset,
-            src_data->buf + src_offset,
-            dst_rect->w * sizeof(pixel_t)
-        );
+/* The fixed-point coordinate math in `map_coord_fp` only works
+ * for rects up to this size (which should be more than enough) */
+#define SCALED_BLIT_MAX_SIZE (1U << 20)
+
+static void check_rects(const rect_t *src_rect, const rect_t *dst_rect)
+{
+    s_assert((i32)src_rect->w >= 0 && (i32)src_rect->h >= 0,
+        "The source rect's dimensions are too big (integer overflow)");
+    s_assert((i32)dst_rect->w >= 0 && (i32)dst_rect->h >= 0,
+        "The destination rect's dimensions are too big (integer overflow)");
+
+    if (src_rect->w != dst_rect->w || src_rect->h != dst_rect->h) {
+        s_assert(src_rect->w <= SCALED_BLIT_MAX_SIZE &&
+            src_rect->h <= SCALED_BLIT_MAX_SIZE &&
+            dst_rect->w <= SCALED_BLIT_MAX_SIZE &&
+            dst_rect->h <= SCALED_BLIT_MAX_SIZE,
+            "The rects are too big to be scaled");
     }
 }
 
-static void unscaled_converted_alpha_blit(
-    const struct pixel_flat_data *restrict src_data,
-    struct pixel_flat_data *restrict dst_data,
-    const rect_t *src_rect,
-    const rect_t *dst_rect,
-    const f32 scale_x,
-    const f32 scale_y,
-    const pixelfmt_t dst_pixelfmt
-)
-{
-    (void) scale_x;
-    (void) scale_y;
-
-    for (u32 dy = 0; dy < dst_rect->h; dy++) {
-        for (u32 dx = 0; dx < dst_rect->w; dx++) {
-            const u32 src_offset =
-                (src_data->w * (src_rect->y + dy)) + (src_rect->x + dx);
-
-            r_putpixel_fast_(
-                dst_data->buf,
-                (i32)(dst_rect->x + dx),
-                (i32)(dst_rect->y + dy),
-                dst_data->w,
-                *(src_data->buf + src_offset),
-                dst_pixelfmt
-            );
+/* Shrinks the part of an axis of the destination area (`area_start` and
+ * `area_len`) so that all of it maps to source coordinates
+ * within [`src_min`, `src_max`). The mapping only ever grows, so it's
+ * enough to just cut off the pixels at both ends that don't fit.
+ * Returns false if there is nothing left. */
+static bool trim_axis(i32 *area_start, u32 *area_len,
+    i32 dst_origin, u32 dst_len, i32 src_origin, u32 src_len,
+    i64 src_min, i64 src_max)
+{
+    while (*area_len > 0 &&
+        map_coord(*area_start, dst_origin, dst_len, src_origin, src_len)
+            < src_min)
+    {
+        (*area_start)++;
+        (*area_len)--;
+    }
+
+    while (*area_len > 0 &&
+        map_coord((i64)*area_start + *area_len - 1,
+            dst_origin, dst_len, src_origin, src_len) >= src_max)
+    {
+        (*area_len)--;
+    }
+
+    return *area_len > 0;
+}
+
+/* Returns the position (in 16.16 fixed point, relative to the source
+ * origin) that the center of the destination pixel `d` maps to.
+ *
+ * It's calculated directly from the rects (instead of by repeatedly
+ * adding a step) so that it's exact, never drifts, and doesn't depend
+ * on where the blit starts - and so neither does the result. */
+static inline u64 map_coord_fp(i64 d, i32 dst_origin, u32 dst_len,
+    u32 src_len)
+{
+    return (((u64)(d - dst_origin) * 2 + 1) * src_len << 15) / dst_len;
+}
+
+/* Returns the source coordinate that the destination coordinate `d`
+ * samples from (i.e. the source pixel that its center falls into) */
+static inline i64 map_coord(i64 d, i32 dst_origin, u32 dst_len,
+    i32 src_origin, u32 src_len)
+{
+    return src_origin +
+        (i64)(map_coord_fp(d, dst_origin, dst_len, src_len) >> 16);
+}
+
+/* Finds the 2 source pixels whose centers are the closest
+ * to where the center of the destination pixel `d` maps to,
+ * along with the weight of the second one (out of 256).
+ * The pixels are clamped to [`src_min`, `src_max`). */
+static inline void map_coord_bilinear(i64 d, i32 dst_origin, u32 dst_len,
+    i32 src_origin, u32 src_len, i64 src_min, i64 src_max,
+    u32 *o_s0, u32 *o_s1, u32 *o_weight)
+{
+    /* The pixel centers are at +0.5, so the position has to be moved
+     * back by half a pixel. It's also moved forward by a whole pixel
+     * (and then back again), so that it never goes negative. */
+    const u64 pos = map_coord_fp(d, dst_origin, dst_len, src_len) + 0x8000;
+    const i64 s0 = src_origin + (i64)(pos >> 16) - 1;
+
+    *o_s0 = u_clamp(s0, src_min, src_max - 1);
+    *o_s1 = u_clamp(s0 + 1, src_min, src_max - 1);
+    *o_weight = (pos >> 8) & 0xFF;
+}
+
+/* Interpolates between the 4 pixels, with `wx` being the weight
+ * of the right ones, and `wy` being the weight of the bottom ones */
+static inline pixel_t bilinear_sample(pixel_t p00, pixel_t p01,
+    pixel_t p10, pixel_t p11, u32 wx, u32 wy)
+{
+#define LERP_2D_(c) (u8)((                                      \
+        (p00.c * (256 - wx) + p01.c * wx) * (256 - wy) +        \
+        (p10.c * (256 - wx) + p11.c * wx) * wy +                \
+        32768                                                   \
+    ) >> 16)
+
+    return (pixel_t) { LERP_2D_(r), LERP_2D_(g), LERP_2D_(b), LERP_2D_(a) };
+
+#undef LERP_2D_
+}
+
+static inline bool pixelfmt_is_bgr(pixelfmt_t fmt)
+{
+    return fmt == BGRA32 || fmt == BGRX32 || fmt == BGR24 ||
+        fmt == BGRA32_PREMUL;
+}
+
+static inline bool pixelfmt_has_alpha(pixelfmt_t fmt)
+{
+    return fmt == RGBA32 || fmt == BGRA32 ||
+        fmt == RGBA32_PREMUL || fmt == BGRA32_PREMUL;
+}
+
+static inline bool pixelfmt_is_premul(pixelfmt_t fmt)
+{
+    return fmt == RGBA32_PREMUL || fmt == BGRA32_PREMUL;
+}
+
+/* `dst` and `src` may be the same buffer */
+static void premultiply(pixel_t *dst, const pixel_t *src, u64 n)
+{
+    for (u64 i = 0; i < n; i++) {
+        const u32 a = src[i].a;
+        dst[i].r = (src[i].r * a + 127) / 255;
+        dst[i].g = (src[i].g * a + 127) / 255;
+        dst[i].b = (src[i].b * a + 127) / 255;
+        dst[i].a = a;
+    }
+}
+
+static void unpremultiply(pixel_t *buf, u64 n)
+{
+    for (u64 i = 0; i < n; i++) {
+        const u32 a = buf[i].a;
+        if (a == 0) {
+            buf[i] = EMPTY_PIXEL;
+        } else if (a < 255) {
+            buf[i].r = u_min((buf[i].r * 255 + a / 2) / a, 255);
+            buf[i].g = u_min((buf[i].g * 255 + a / 2) / a, 255);
+            buf[i].b = u_min((buf[i].b * 255 + a / 2) / a, 255);
         }
     }
 }
 
-static void unscaled_converted_noalpha_blit(
-    const struct pixel_flat_data *restrict src_data,
-    struct pixel_flat_data *restrict dst_data,
-    const rect_t *src_rect,
-    const rect_t *dst_rect,
-    const f32 scale_x,
-    const f32 scale_y,
-    const pixelfmt_t dst_pixelfmt
-)
-{
-    (void) scale_x;
-    (void) scale_y;
-
-    for (u32 dy = 0; dy < dst_rect->h; dy++) {
-        for (u32 dx = 0; dx < dst_rect->w; dx++) {
-            const u32 src_offset =
-                (src_data->w * (src_rect->y + dy)) + (src_rect->x + dx);
-
-            r_putpixel_fast_noalpha_(
-                dst_data->buf,
-                (i32)(dst_rect->x + dx),
-                (i32)(dst_rect->y + dy),
-                dst_data->w,
-                *(src_data->buf + src_offset),
-                dst_pixelfmt
-            );
+static void unscaled_blit(const struct blit_info *b)
+{
+    const struct pixel_flat_data *const src_data = &b->src->data;
+    const rect_t *const area = &b->area;
+
+    const u32 src_x = b->src_rect->x + (area->x - b->dst_rect->x);
+    const u32 src_y = b->src_rect->y + (area->y - b->dst_rect->y);
+
+    for (u32 dy = 0; dy < area->h; dy++) {
+        pixel_t *const dst_row =
+            pixel_flat_data_at(b->dst_data, area->x, area->y + dy);
+        const pixel_t *const src_row =
+            pixel_flat_data_at(src_data, 0, src_y + dy);
+
+        /* Go through the spans that the row overlaps with */
+        struct r_opacity_span whole_row;
+        const struct r_opacity_span *span =
+            get_row_spans(b->src, src_y + dy, &whole_row);
+        while (span->end <= src_x)
+            span++;
+
+        u32 x = src_x;
+        while (x < src_x + area->w) {
+            const u32 end = u_min(span->end, src_x + area->w);
+            blit_span(b, span->opacity,
+                dst_row + (x - src_x), src_row + x, end - x);
+            x = end;
+            span++;
         }
     }
 }
 
-static void scaled_unconverted_alpha_blit(
-    const struct pixel_flat_data *restrict src_data,
-    struct pixel_flat_data *restrict dst_data,
-    const rect_t *src_rect,
-    const rect_t *dst_rect,
-    const f32 scale_x,
-    const f32 scale_y,
-    const pixelfmt_t dst_pixelfmt
-)
-{
-    (void) dst_pixelfmt;
-
-    f32 sx = (f32)src_rect->x;
-    f32 sy = (f32)src_rect->y;
-
-    for (i32 y = dst_rect->y; y < dst_rect->y + (i32)dst_rect->h; y++) {
-        for (i32 x = dst_rect->x; x < dst_rect->x + (i32)dst_rect->w; x++) {
-            const pixel_t src_pixel = *(
-                src_data->buf
-                + ((src_rect->y + (i32)sy) * src_data->w)
-                + (src_rect->x + (i32)sx)
-            );
-
-            r_putpixel_fast_matching_pixelfmt_(
-                dst_data->buf,
-                x, y, dst_data->w,
-                src_pixel
-            );
-            sx += scale_x;
+/* The scaled blits first gather the source pixels of (a part of) a row
+ * into a temporary buffer, so that the same row kernels can be used */
+#define SCALED_BLIT_CHUNK_SIZE 256
+
+/* The column tables of blits up to this wide are kept on the stack */
+#define SCALED_BLIT_STACK_COLUMNS 1024
+
+static void scaled_blit(const struct blit_info *b)
+{
+    const rect_t *const area = &b->area;
+
+    /* Which source pixels a column samples from only depends on its x,
+     * so it's calculated just once for every column */
+    struct blit_column stack_columns[SCALED_BLIT_STACK_COLUMNS];
+    struct blit_column *columns = stack_columns;
+    if (area->w > SCALED_BLIT_STACK_COLUMNS) {
+        columns = malloc(area->w * sizeof(struct blit_column));
+        s_assert(columns != NULL, "malloc() failed for the column table");
+    }
+
+    for (u32 dx = 0; dx < area->w; dx++) {
+        struct blit_column *const c = &columns[dx];
+        if (b->filter == R_SURFACE_FILTER_BILINEAR) {
+            map_coord_bilinear((i64)area->x + dx,
+                b->dst_rect->x, b->dst_rect->w,
+                b->src_rect->x, b->src_rect->w,
+                b->src_min_x, b->src_max_x,
+                &c->s0, &c->s1, &c->weight);
+        } else {
+            c->s0 = c->s1 = map_coord((i64)area->x + dx,
+                b->dst_rect->x, b->dst_rect->w,
+                b->src_rect->x, b->src_rect->w);
+            c->weight = 0;
+        }
+    }
+
+    if (b->filter == R_SURFACE_FILTER_BILINEAR)
+        scaled_bilinear_blit(b, columns);
+    else
+        scaled_nearest_blit(b, columns);
+
+    if (columns != stack_columns)
+        free(columns);
+}
+
+static void scaled_nearest_blit(const struct blit_info *b,
+    const struct blit_column *columns)
+{
+    const struct pixel_flat_data *const src_data = &b->src->data;
+    const rect_t *const area = &b->area;
+    pixel_t row_buf[SCALED_BLIT_CHUNK_SIZE];
+
+    for (u32 dy = 0; dy < area->h; dy++) {
+        const i64 sy = map_coord((i64)area->y + dy,
+            b->dst_rect->y, b->dst_rect->h, b->src_rect->y, b->src_rect->h);
+        const pixel_t *const src_row = pixel_flat_data_at(src_data, 0, sy);
+        pixel_t *const dst_row =
+            pixel_flat_data_at(b->dst_data, area->x, area->y + dy);
+
+        struct r_opacity_span whole_row;
+        const struct r_opacity_span *span =
+            get_row_spans(b->src, sy, &whole_row);
+
+        /* Since the source x only ever grows, the pixels can be split
+         * into runs that all come from the same span */
+        u32 dx = 0;
+        while (dx < area->w) {
+            while (span->end <= columns[dx].s0)
+                span++;
+
+            u32 n = 0;
+            do {
+                row_buf[n] = src_row[columns[dx + n].s0];
+                n++;
+            } while (dx + n < area->w && columns[dx + n].s0 < span->end &&
+                n < SCALED_BLIT_CHUNK_SIZE);
+
+            blit_span(b, span->opacity, dst_row + dx, row_buf, n);
+            dx += n;
         }
-        sx = 0;
-        sy += scale_y;
     }
 }
 
-static void scaled_unconverted_noalpha_blit(
-    const struct pixel_flat_data *restrict src_data,
-    struct pixel_flat_data *restrict dst_data,
-    const rect_t *src_rect,
-    const rect_t *dst_rect,
-    const f32 scale_x,
-    const f32 scale_y,
-    const pixelfmt_t dst_pixelfmt
-)
-{
-    (void) dst_pixelfmt;
-
-    f32 sx = (f32)src_rect->x;
-    f32 sy = (f32)src_rect->y;
-
-    for (i32 y = dst_rect->y; y < dst_rect->y + (i32)dst_rect->h; y++) {
-        for (i32 x = dst_rect->x; x < dst_rect->x + (i32)dst_rect->w; x++) {
-            const pixel_t src_pixel = *(
-                src_data->buf
-                + ((src_rect->y + (i32)sy) * src_data->w)
-                + (src_rect->x + (i32)sx)
-            );
-
-            r_putpixel_fast_matching_pixelfmt_noalpha_(
-                dst_data->buf,
-                x, y, dst_data->w,
-                src_pixel
-            );
-            sx += scale_x;
+static void scaled_bilinear_blit(const struct blit_info *b,
+    const struct blit_column *columns)
+{
+    const struct pixel_flat_data *const src_data = &b->src->data;
+    const rect_t *const area = &b->area;
+    pixel_t row_buf[SCALED_BLIT_CHUNK_SIZE];
+
+    /* A filtered pixel is made of pixels from different spans,
+     * so the only thing that can be relied on is the whole surface
+     * being opaque (the transparent ones never even get here) */
+    const enum r_opacity opacity = b->src->opacity.type == R_OPACITY_OPAQUE ?
+        R_OPACITY_OPAQUE : R_OPACITY_MIXED;
+
+    for (u32 dy = 0; dy < area->h; dy++) {
+        u32 sy0, sy1, wy;
+        map_coord_bilinear((i64)area->y + dy,
+            b->dst_rect->y, b->dst_rect->h, b->src_rect->y, b->src_rect->h,
+            b->src_min_y, b->src_max_y, &sy0, &sy1, &wy);
+
+        const pixel_t *const row0 = pixel_flat_data_at(src_data, 0, sy0);
+        const pixel_t *const row1 = pixel_flat_data_at(src_data, 0, sy1);
+        pixel_t *const dst_row =
+            pixel_flat_data_at(b->dst_data, area->x, area->y + dy);
+
+        for (u32 dx = 0; dx < area->w; dx += SCALED_BLIT_CHUNK_SIZE) {
+            const u32 n = u_min(area->w - dx, SCALED_BLIT_CHUNK_SIZE);
+            for (u32 i = 0; i < n; i++) {
+                const struct blit_column *const c = &columns[dx + i];
+                row_buf[i] = bilinear_sample(
+                    row0[c->s0], row0[c->s1],
+                    row1[c->s0], row1[c->s1],
+                    c->weight, wy
+                );
+            }
+
+            blit_span(b, opacity, dst_row + dx, row_buf, n);
         }
-        sx = 0;
-        sy += scale_y;
     }
 }
 
-static void scaled_converted_alpha_blit(
-    const struct pixel_flat_data *restrict src_data,
-    struct pixel_flat_data *restrict dst_data,
-    const rect_t *src_rect,
-    const rect_t *dst_rect,
-    const f32 scale_x,
-    const f32 scale_y,
-    const pixelfmt_t dst_pixelfmt
-)
-{
-    f32 sx = src_rect->x;
-    f32 sy = src_rect->y;
-    for (i32 y = dst_rect->y; y < dst_rect->y + (i32)dst_rect->h; y++) {
-        for (i32 x = dst_rect->x; x < dst_rect->x + (i32)dst_rect->w; x++) {
-            const pixel_t src_pixel = *(
-                src_data->buf
-                + ((src_rect->y + (i32)sy) * src_data->w)
-                + (src_rect->x + (i32)sx)
-            );
-
-            r_putpixel_fast_(
-                dst_data->buf,
-                x, y, dst_data->w,
-                src_pixel,
-                dst_pixelfmt
-            );
-            sx += scale_x;
+static void blit_span(const struct blit_info *b, enum r_opacity opacity,
+    pixel_t *dst, const pixel_t *src, u32 n)
+{
+    switch (opacity) {
+    case R_OPACITY_OPAQUE:
+        b->copy(dst, src, n);
+        break;
+    case R_OPACITY_TRANSPARENT:
+        break;
+    default: case R_OPACITY_UNKNOWN: case R_OPACITY_MIXED:
+        if (!b->premultiply_src) {
+            b->blend(dst, src, n);
+            break;
+        }
+
+        pixel_t tmp[CONVERT_CHUNK_SIZE];
+        for (u32 i = 0; i < n; i += CONVERT_CHUNK_SIZE) {
+            const u32 chunk = u_min(n - i, CONVERT_CHUNK_SIZE);
+            premultiply(tmp, src + i, chunk);
+            b->blend(dst + i, tmp, chunk);
         }
-        sx = 0;
-        sy += scale_y;
+        break;
+    }
+}
+
+static struct r_surface * surface_new(struct pixel_flat_data *pixels,
+    pixelfmt_t color_format)
+{
+    if (color_format == RGB24 || color_format == BGR24) {
+        s_log_error("24-bit surfaces are not yet supported!");
+        return NULL;
     }
+
+    struct r_surface *s = calloc(1, sizeof(struct r_surface));
+    s_assert(s != NULL, "calloc() failed for new surface");
+
+    s->color_format = color_format;
+    s_assert(pixels->stride >= pixels->w,
+        "The stride of the pixel data (%u) is smaller than its width (%u)",
+        pixels->stride, pixels->w);
+
+    s->data.w = pixels->w;
+    s->data.h = pixels->h;
+    s->data.stride = pixels->stride;
+    s->data.buf = pixels->buf;
+    u_rect_from_pixel_data(&s->data, &s->data_rect);
+
+    clear_opacity(s);
+
+    return s;
+}
+
+/* Called whenever the pixels of `s` (might) change,
+ * so it also gives `s` a new version */
+static void clear_opacity(struct r_surface *s)
+{
+    new_version(s);
+
+    if (s->opacity.spans != NULL)
+        vector_destroy(&s->opacity.spans);
+    if (s->opacity.row_offsets != NULL)
+        u_nfree(&s->opacity.row_offsets);
+
+    /* Formats without alpha are always opaque, no matter the pixels */
+    s->opacity.type = pixelfmt_has_alpha(s->color_format) ?
+        R_OPACITY_UNKNOWN : R_OPACITY_OPAQUE;
+}
+
+static void new_version(struct r_surface *s)
+{
+    static _Atomic u64 next_version = 1;
+    s->version = atomic_fetch_add(&next_version, 1);
 }
 
-static void scaled_converted_noalpha_blit(
-    const struct pixel_flat_data *restrict src_data,
-    struct pixel_flat_data *restrict dst_data,
-    const rect_t *src_rect,
-    const rect_t *dst_rect,
-    const f32 scale_x,
-    const f32 scale_y,
-    const pixelfmt_t dst_pixelfmt
-)
-{
-    f32 sx = src_rect->x;
-    f32 sy = src_rect->y;
-    for (i32 y = dst_rect->y; y < dst_rect->y + (i32)dst_rect->h; y++) {
-        for (i32 x = dst_rect->x; x < dst_rect->x + (i32)dst_rect->w; x++) {
-            const pixel_t src_pixel = *(
-                src_data->buf
-                + ((src_rect->y + (i32)sy) * src_data->w)
-                + (src_rect->x + (i32)sx)
-            );
-
-            r_putpixel_fast_noalpha_(
-                dst_data->buf,
-                x, y, dst_data->w,
-                src_pixel,
-                dst_pixelfmt
-            );
-            sx += scale_x;
+/* Appends the spans of `row` to the opacity info of `s`.
+ * Short opaque or transparent runs are merged into the translucent spans
+ * around them (see `R_OPACITY_MIN_SPAN_LEN`). This doesn't change the result
+ * of the blits at all, since blending an opaque pixel is the same
+ * as copying it, and blending a transparent one is a no-op. */
+static void analyze_row_opacity(struct r_surface *s, const pixel_t *row,
+    u64 *n_opaque, u64 *n_transparent)
+{
+    const u32 w = s->data.w;
+    const u32 first_span = vector_size(s->opacity.spans);
+
+    u32 x = 0;
+    while (x < w) {
+        const enum r_opacity opacity = get_pixel_opacity(row[x]);
+        u32 end = x + 1;
+        while (end < w && get_pixel_opacity(row[end]) == opacity)
+            end++;
+
+        if (opacity == R_OPACITY_OPAQUE)
+            *n_opaque += end - x;
+        else if (opacity == R_OPACITY_TRANSPARENT)
+            *n_transparent += end - x;
+
+        enum r_opacity span_opacity = opacity;
+        if (end - x < R_OPACITY_MIN_SPAN_LEN && end - x < w)
+            span_opacity = R_OPACITY_MIXED;
+
+        const u32 n_spans = vector_size(s->opacity.spans);
+        struct r_opacity_span *const last = n_spans > first_span ?
+            &s->opacity.spans[n_spans - 1] : NULL;
+        if (last != NULL && last->opacity == span_opacity) {
+            last->end = end;
+        } else {
+            vector_push_back(&s->opacity.spans, (struct r_opacity_span) {
+                .end = end,
+                .opacity = span_opacity,
+            });
         }
-        sx = 0;
-        sy += scale_y;
+
+        x = end;
     }
 }
+
+/* Returns the first span of the row `y` of `s`. If `s` doesn't have
+ * per-row spans, `whole_row` is set up to cover the whole row
+ * and returned instead. */
+static const struct r_opacity_span * get_row_spans(const struct r_surface *s,
+    u32 y, struct r_opacity_span *whole_row)
+{
+    if (s->opacity.type == R_OPACITY_MIXED)
+        return &s->opacity.spans[s->opacity.row_offsets[y]];
+
+    whole_row->end = s->data.w;
+    whole_row->opacity = s->opacity.type;
+    return whole_row;
+}
+
+static inline enum r_opacity get_pixel_opacity(pixel_t px)
+{
+    if (px.a == 255)
+        return R_OPACITY_OPAQUE;
+    else if (px.a == 0)
+        return R_OPACITY_TRANSPARENT;
+    else
+        return R_OPACITY_MIXED;
+}
@@ -2,8 +2,10 @@
 #define R_SURFACE_H_
 
 #include "rctx.h"
+#include <core/int.h>
 #include <core/pixel.h>
 #include <core/shapes.h>
+#include <core/vector.h>
 
 /* A surface is just a 2d array (with a certain width and height)
  * of pixels (of a certain format).
@@ -12,24 +14,93 @@
  * outside of just the rendering subystem and its purposes.
  */
 
+/* How see-through (a part of) a surface is */
+enum r_opacity {
+    /* Not known - every pixel has to be blended */
+    R_OPACITY_UNKNOWN,
+
+    /* Every pixel has an alpha of 255 - they can just be copied */
+    R_OPACITY_OPAQUE,
+
+    /* Every pixel has an alpha of 0 - they can be skipped altogether */
+    R_OPACITY_TRANSPARENT,
+
+    /* The pixels are a mix of the above and/or translucent,
+     * so they have to be blended */
+    R_OPACITY_MIXED,
+};
+
+/* A run of pixels in a row of a surface, which spans from the end
+ * of the previous span (or the start of the row) up to `end` */
+struct r_opacity_span {
+    u32 end;
+    enum r_opacity opacity; /* Never `R_OPACITY_UNKNOWN` */
+};
+
+/* Spans of opaque or transparent pixels shorter than this are
+ * just blended along with their translucent neighbors,
+ * since splitting the rows into such small pieces would only
+ * make the blits slower (and the span lists longer) */
+#define R_OPACITY_MIN_SPAN_LEN 16
+
 struct r_surface {
     struct pixel_flat_data data;    /* The pixel buffer */
     rect_t data_rect;               /* Always { 0, 0, data->w, data->h } */
     pixelfmt_t color_format;        /* The pixel format */
+
+    /* Changes whenever the pixels of the surface are modified through
+     * the functions below (or `r_surface_update_opacity` is called).
+     * Never the same for 2 different surfaces, even if one happens
+     * to be allocated at the address of the other. */
+    u64 version;
+
+    /* Which parts of the surface need to be blended when it's blitted,
+     * and which can be just copied or skipped. */
+    struct r_surface_opacity_info {
+        /* The opacity of the whole surface */
+        enum r_opacity type;
+
+        /* Only if `type` is `R_OPACITY_MIXED` -
+         * the spans of each row, one row after another.
+         * The spans of the row `y` are the ones from `row_offsets[y]`
+         * up to (but not including) `row_offsets[y + 1]`,
+         * and they always cover the whole row. */
+        VECTOR(struct r_opacity_span) spans;
+        u32 *row_offsets;
+    } opacity;
 };
 
 /* Create a new surface and allocate its pixel buffer to be of width `w`
- * and height `h`, and set the pixel format to `color_format`. */
+ * and height `h`, and set the pixel format to `color_format`.
+ *
+ * Since the pixels are presumably going to be written by the caller,
+ * the opacity of the new surface is unknown
+ * (see `r_surface_update_opacity`). */
 struct r_surface * r_surface_create(u32 w, u32 h, pixelfmt_t color_format);
 
 /* Create a new surface with the pre-allocate buffer `pixels`
- * and the pixel format `color_format`. Always succeeds. */
+ * and the pixel format `color_format`, and analyze its opacity.
+ * Always succeeds. */
 struct r_surface * r_surface_init(struct pixel_flat_data *pixels,
     pixelfmt_t color_format);
 
+/* Finds out which parts of `s` are opaque, transparent or translucent,
+ * so that the blits can copy or skip them instead of blending every pixel.
+ *
+ * Must be called whenever the pixels of `s` are modified directly;
+ * otherwise the blits will end up using outdated information.
+ * (`r_surface_blit` takes care of this for its destination surface,
+ * although in that case the opacity just becomes unknown).
+ *
+ * The same rules apply as for `r_surface_convert` regarding
+ * the surface being in use by the renderer. */
+void r_surface_update_opacity(struct r_surface *s);
+
 /* Blit (copy) the pixels in `src` limited by the area `src_rect`
  * onto the area `dst_rect` on `dst`'s pixels.
  * If needed, scaling and/or pixel format conversion is performed.
+ * The pixels are alpha-blended, except for those that
+ * `src`'s opacity info says don't need to be.
  * Only pixels that fit in the buffer's dimensions AND the area
  * are selected; the rest get cut off.
  *
@@ -42,10 +113,62 @@ struct r_surface * r_surface_init(struct pixel_flat_data *pixels,
 void r_surface_blit(struct r_surface *dst, const struct r_surface *src,
     const rect_t *src_rect, const rect_t *dst_rect);
 
-/* Performs a blit from `src` to the rendering buffer of `rctx` */
+/* Performs a blit from `src` to the rendering buffer of `rctx`.
+ *
+ * Scaled blits are usually done from a copy of `src` that's already
+ * been scaled in one of the previous frames, which is only redone
+ * when the scale or the version of `src` changes
+ * (see `r_ctx_set_scale_cache_budget`). The result is the same,
+ * except that with nearest filtering, the position of `src_rect`
+ * gets rounded to whole pixels of the scaled copy. */
 void r_surface_render(struct r_ctx *rctx, const struct r_surface *src,
     const rect_t *src_rect, const rect_t *dst_rect);
 
+/* How the source pixels are sampled when a surface is scaled */
+enum r_surface_filter {
+    /* Take the pixel that's the closest. Fast, but blocky */
+    R_SURFACE_FILTER_NEAREST,
+
+    /* Interpolate between the 4 closest pixels. Smoother, but slower.
+     * Works best with premultiplied surfaces (see `RGBA32_PREMUL`);
+     * with the straight ones, the color of the transparent pixels
+     * bleeds into the edges of the opaque ones. */
+    R_SURFACE_FILTER_BILINEAR,
+
+    R_SURFACE_FILTER_MAX_
+};
+
+/* Same as `r_surface_blit` and `r_surface_render`, but with the
+ * filtering used for scaling set to `filter` (the ones above always
+ * use `R_SURFACE_FILTER_NEAREST`). Unscaled blits are never filtered. */
+void r_surface_blit_filtered(struct r_surface *dst,
+    const struct r_surface *src, const rect_t *src_rect,
+    const rect_t *dst_rect, enum r_surface_filter filter);
+void r_surface_render_filtered(struct r_ctx *rctx,
+    const struct r_surface *src, const rect_t *src_rect,
+    const rect_t *dst_rect, enum r_surface_filter filter);
+
+/* Converts the pixels of `s` (in place) to the format `fmt`.
+ *
+ * Blits between surfaces of the same format (or formats that only differ
+ * in whether they ignore the alpha channel) don't need any per-pixel
+ * conversion, so it's much better to convert a surface once
+ * than to have it converted every time it's drawn.
+ *
+ * The surface must not be in use by the renderer
+ * (i.e. passed to `r_surface_render` in a frame that hasn't
+ * been drawn yet) while it's being converted.
+ *
+ * Returns 0 on success and non-zero if the conversion isn't supported
+ * (e.g. to or from a 24-bit format), in which case `s` is left untouched. */
+i32 r_surface_convert(struct r_surface *s, pixelfmt_t fmt);
+
+/* Converts `s` to the format that `rctx` draws its frames in
+ * (see `r_ctx_get_pixelfmt`), so that `r_surface_render` can just
+ * copy or blend its pixels, without swapping any channels.
+ * Returns 0 on success and non-zero on failure. */
+i32 r_surface_optimize(struct r_surface *s, const struct r_ctx *rctx);
+
 /* Destroy the surface at `**surface_p`,
  * and set `*surface_p` to `NULL`. */
 void r_surface_destroy(struct r_surface **surface_p);
@@ -0,0 +1,233 @@
+#include <core/log.h>
+#include <core/int.h>
+#include <core/math.h>
+#include <core/util.h>
+#include <core/pixel.h>
+#include <core/region.h>
+#include <core/shapes.h>
+#include <core/vector.h>
+#include <platform/thread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#define R_INTERNAL_GUARD__
+#include "tile-raster.h"
+#undef R_INTERNAL_GUARD__
+#define R_INTERNAL_GUARD__
+#include "rcmd.h"
+#undef R_INTERNAL_GUARD__
+
+#define MODULE_NAME "tile-raster"
+
+static void draw_tiles(void *arg, u32 start, u32 end);
+static void draw_tile(struct r_tile_raster *tr, u32 tile_index);
+static void execute_cmd(const struct r_cmd *cmd,
+    struct pixel_flat_data *buf, pixelfmt_t buf_fmt, const rect_t *clip);
+
+static inline rect_t get_tile_rect(const struct r_tile_raster *tr, u32 index);
+static inline bool get_tile_range(const struct r_tile_raster *tr,
+    const rect_t *r, u32 *o_x0, u32 *o_y0, u32 *o_x1, u32 *o_y1);
+
+i32 r_tile_raster_init(struct r_tile_raster *tr, const rect_t *frame_rect,
+    u32 n_threads)
+{
+    u_check_params(tr != NULL && frame_rect != NULL && n_threads > 0);
+    memset(tr, 0, sizeof(struct r_tile_raster));
+
+    tr->frame_rect = *frame_rect;
+    tr->n_tiles_x = (frame_rect->w + R_TILE_SIZE - 1) / R_TILE_SIZE;
+    tr->n_tiles_y = (frame_rect->h + R_TILE_SIZE - 1) / R_TILE_SIZE;
+    const u32 n_tiles = tr->n_tiles_x * tr->n_tiles_y;
+
+    if (n_tiles > 0) {
+        tr->bins = calloc(n_tiles, sizeof(*tr->bins));
+        tr->tile_dirty = calloc(n_tiles, sizeof(bool));
+        tr->jobs = calloc(n_tiles, sizeof(u32));
+        s_assert(tr->bins != NULL && tr->tile_dirty != NULL &&
+            tr->jobs != NULL, "calloc() failed for the tile data");
+
+        for (u32 i = 0; i < n_tiles; i++)
+            tr->bins[i] = vector_new(u32);
+    }
+
+    n_threads = u_min(n_threads, R_TILE_RASTER_MAX_THREADS);
+    tr->job_pool = p_mt_jobs_create(n_threads);
+    if (tr->job_pool == NULL)
+        goto_error("Failed to create the rasterizer job pool");
+
+    s_log_debug("Initialized the tile rasterizer: %ux%u tiles, %u thread(s)",
+        tr->n_tiles_x, tr->n_tiles_y, p_mt_jobs_get_n_threads(tr->job_pool));
+
+    return 0;
+
+err:
+    r_tile_raster_destroy(tr);
+    return 1;
+}
+
+void r_tile_raster_destroy(struct r_tile_raster *tr)
+{
+    if (tr == NULL) return;
+
+    p_mt_jobs_destroy(&tr->job_pool);
+
+    if (tr->bins != NULL) {
+        for (u32 i = 0; i < tr->n_tiles_x * tr->n_tiles_y; i++) {
+            if (tr->bins[i] != NULL)
+                vector_destroy(&tr->bins[i]);
+        }
+        u_nfree(&tr->bins);
+    }
+    if (tr->tile_dirty != NULL)
+        u_nfree(&tr->tile_dirty);
+    if (tr->jobs != NULL)
+        u_nfree(&tr->jobs);
+
+    memset(tr, 0, sizeof(struct r_tile_raster));
+}
+
+void r_tile_raster_draw(struct r_tile_raster *tr,
+    struct pixel_flat_data *buf, pixelfmt_t buf_fmt,
+    const r_cmd_list_t cmds, const struct region *damage)
+{
+    /* Find all the tiles that need to be redrawn */
+    tr->n_jobs = 0;
+    for (u32 i = 0; i < damage->n_rects; i++) {
+        u32 x0, y0, x1, y1;
+        if (!get_tile_range(tr, &damage->rects[i], &x0, &y0, &x1, &y1))
+            continue;
+
+        for (u32 y = y0; y < y1; y++) {
+            for (u32 x = x0; x < x1; x++) {
+                const u32 index = y * tr->n_tiles_x + x;
+                if (tr->tile_dirty[index])
+                    continue;
+
+                tr->tile_dirty[index] = true;
+                vector_clear(&tr->bins[index]);
+                tr->jobs[tr->n_jobs++] = index;
+            }
+        }
+    }
+    if (tr->n_jobs == 0)
+        return;
+
+    /* Bin the commands to the (dirty) tiles they touch */
+    for (u32 i = 0; i < vector_size(cmds); i++) {
+        u32 x0, y0, x1, y1;
+        if (!get_tile_range(tr, &cmds[i].bounds, &x0, &y0, &x1, &y1))
+            continue;
+
+        for (u32 y = y0; y < y1; y++) {
+            for (u32 x = x0; x < x1; x++) {
+                const u32 index = y * tr->n_tiles_x + x;
+                if (tr->tile_dirty[index])
+                    vector_push_back(&tr->bins[index], i);
+            }
+        }
+    }
+
+    tr->frame.buf = buf;
+    tr->frame.buf_fmt = buf_fmt;
+    tr->frame.cmds = cmds;
+    tr->frame.damage = damage;
+
+    /* The tiles can take very different amounts of time to draw,
+     * so each one is a job of its own */
+    p_mt_jobs_parallel_for(tr->job_pool, tr->n_jobs, 1, draw_tiles, tr);
+
+    for (u32 i = 0; i < tr->n_jobs; i++)
+        tr->tile_dirty[tr->jobs[i]] = false;
+
+    memset(&tr->frame, 0, sizeof(struct r_tile_raster_frame));
+}
+
+static void draw_tiles(void *arg, u32 start, u32 end)
+{
+    struct r_tile_raster *tr = arg;
+    for (u32 i = start; i < end; i++)
+        draw_tile(tr, tr->jobs[i]);
+}
+
+static void draw_tile(struct r_tile_raster *tr, u32 tile_index)
+{
+    const struct r_tile_raster_frame *const f = &tr->frame;
+    const rect_t tile_rect = get_tile_rect(tr, tile_index);
+    const VECTOR(u32) bin = tr->bins[tile_index];
+
+    for (u32 i = 0; i < f->damage->n_rects; i++) {
+        rect_t area;
+        if (!rect_intersect(&f->damage->rects[i], &tile_rect, &area))
+            continue;
+
+        for (u32 j = 0; j < vector_size(bin); j++) {
+            const struct r_cmd *const cmd = &f->cmds[bin[j]];
+
+            rect_t clip;
+            if (rect_intersect(&cmd->bounds, &area, &clip))
+                execute_cmd(cmd, f->buf, f->buf_fmt, &clip);
+        }
+    }
+}
+
+static void execute_cmd(const struct r_cmd *cmd,
+    struct pixel_flat_data *buf, pixelfmt_t buf_fmt, const rect_t *clip)
+{
+    switch (cmd->type) {
+    case R_CMD_RESET:
+        for (u32 y = 0; y < clip->h; y++) {
+            memset(pixel_flat_data_at(buf, clip->x, clip->y + y), 0,
+                clip->w * sizeof(pixel_t));
+        }
+        break;
+    case R_CMD_INVALIDATE:
+        break;
+    case R_CMD_FILL_RECT:
+        r_rasterize_fill_rect(buf, &cmd->d.rect, cmd->color, clip);
+        break;
+    case R_CMD_DRAW_RECT:
+        r_rasterize_draw_rect(buf, &cmd->d.rect, cmd->color, clip);
+        break;
+    case R_CMD_DRAW_LINE:
+        r_rasterize_line(buf, cmd->d.line.start, cmd->d.line.end,
+            cmd->color, clip);
+        break;
+    case R_CMD_SURFACE:
+        r_rasterize_surface(buf, buf_fmt, &cmd->d.surface, clip);
+        break;
+    default:
+        s_log_error("Invalid command type: %d", cmd->type);
+        break;
+    }
+}
+
+static inline rect_t get_tile_rect(const struct r_tile_raster *tr, u32 index)
+{
+    rect_t ret = {
+        .x = tr->frame_rect.x + (index % tr->n_tiles_x) * R_TILE_SIZE,
+        .y = tr->frame_rect.y + (index / tr->n_tiles_x) * R_TILE_SIZE,
+        .w = R_TILE_SIZE,
+        .h = R_TILE_SIZE,
+    };
+    rect_clip(&ret, &tr->frame_rect);
+    return ret;
+}
+
+/* Writes the range of tiles [x0, x1) x [y0, y1) that `r` overlaps with.
+ * Returns false if it doesn't overlap with any. */
+static inline bool get_tile_range(const struct r_tile_raster *tr,
+    const rect_t *r, u32 *o_x0, u32 *o_y0, u32 *o_x1, u32 *o_y1)
+{
+    rect_t tmp;
+    if (!rect_intersect(r, &tr->frame_rect, &tmp))
+        return false;
+
+    const u32 x = tmp.x - tr->frame_rect.x;
+    const u32 y = tmp.y - tr->frame_rect.y;
+    *o_x0 = x / R_TILE_SIZE;
+    *o_y0 = y / R_TILE_SIZE;
+    *o_x1 = (x + tmp.w + R_TILE_SIZE - 1) / R_TILE_SIZE;
+    *o_y1 = (y + tmp.h + R_TILE_SIZE - 1) / R_TILE_SIZE;
+
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef R_TILE_RASTER_H_
+#define R_TILE_RASTER_H_
+#ifndef R_INTERNAL_GUARD__
+#error This header is internal to the cgd renderer module and is not intented to be used elsewhere
+#endif /* R_INTERNAL_GUARD__ */
+
+#include "rcmd.h"
+#include <core/int.h>
+#include <core/pixel.h>
+#include <core/region.h>
+#include <core/shapes.h>
+#include <core/vector.h>
+#include <platform/thread.h>
+#include <stdbool.h>
+
+/* The frame is split into square tiles of this many pixels.
+ * Each command is "binned" to the tiles that it touches,
+ * and then the tiles are drawn in parallel by a job pool.
+ *
+ * Since the rasterizers only ever touch the pixels inside of their `clip`,
+ * and the result doesn't depend on it, every pixel ends up exactly the same
+ * as if the whole frame was drawn by one thread. */
+#define R_TILE_SIZE 64
+
+/* The upper limit for the number of rasterizer threads */
+#define R_TILE_RASTER_MAX_THREADS 64
+
+struct r_tile_raster {
+    rect_t frame_rect;
+    u32 n_tiles_x, n_tiles_y;
+
+    /* For each tile, the indices of the commands that touch it (in order) */
+    VECTOR(u32) *bins;
+
+    /* For each tile, whether any part of it needs to be redrawn */
+    bool *tile_dirty;
+
+    /* The indices of the tiles that need to be redrawn in this frame */
+    u32 *jobs;
+    u32 n_jobs;
+
+    /* The frame that's currently being drawn.
+     * Only valid while `r_tile_raster_draw` is running. */
+    struct r_tile_raster_frame {
+        struct pixel_flat_data *buf;
+        pixelfmt_t buf_fmt;
+        const struct r_cmd *cmds;
+        const struct region *damage;
+    } frame;
+
+    /* The threads that draw the tiles. The thread that calls
+     * `r_tile_raster_draw` also does its share of the work. */
+    struct p_mt_jobs *job_pool;
+};
+
+/* Prepares `tr` for drawing frames of the size `frame_rect`
+ * using `n_threads` threads in total (including the caller of
+ * `r_tile_raster_draw`), and creates the job pool.
+ * Returns 0 on success and non-zero on failure. */
+i32 r_tile_raster_init(struct r_tile_raster *tr, const rect_t *frame_rect,
+    u32 n_threads);
+
+/* Stops the workers and frees all resources used by `tr` */
+void r_tile_raster_destroy(struct r_tile_raster *tr);
+
+/* Draws the parts of `buf` described by `damage` by executing `cmds`,
+ * spreading the work across all threads.
+ * Returns once everything has been drawn. */
+void r_tile_raster_draw(struct r_tile_raster *tr,
+    struct pixel_flat_data *buf, pixelfmt_t buf_fmt,
+    const r_cmd_list_t cmds, const struct region *damage);
+
+#endif /* R_TILE_RASTER_H_ */
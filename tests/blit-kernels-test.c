@@ -0,0 +1,133 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <core/pixel.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#define R_INTERNAL_GUARD__
+#include <render/blit-kernels.h>
+#undef R_INTERNAL_GUARD__
+
+#define MODULE_NAME "blit-kernels-test"
+#include "log-util.h"
+
+/* Big enough to exercise both the vector loops and the scalar tails */
+#define MAX_ROW_LEN 291
+#define N_ITERATIONS 2000
+
+static i32 test_kernels(const struct r_blit_kernels *ref,
+    const struct r_blit_kernels *k);
+static i32 test_row_fn(r_blit_row_fn_t *ref_fn, r_blit_row_fn_t *fn,
+    const char *fn_name, const char *kernels_name);
+static void fill_random(pixel_t *buf, u32 n);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    srand(1234);
+
+    const struct r_blit_kernels *ref = r_blit_kernels_get(R_BLIT_KERNEL_SCALAR);
+    if (ref == NULL)
+        goto_error("The scalar kernels are not available!");
+
+    for (u32 i = 0; i < R_BLIT_KERNEL_MAX_; i++) {
+        const struct r_blit_kernels *k = r_blit_kernels_get(i);
+        if (k == NULL) {
+            s_log_info("Kernel type %u is not supported, skipping", i);
+            continue;
+        }
+
+        s_log_info("Testing the \"%s\" kernels...", k->name);
+        if (test_kernels(ref, k))
+            goto err;
+    }
+
+    r_blit_kernels_init();
+    s_log_info("Selected kernels: \"%s\"", r_blit_kernels_get_active()->name);
+
+    s_log_info("Test result is OK");
+    return EXIT_SUCCESS;
+
+err:
+    s_log_info("Test result is FAIL");
+    return EXIT_FAILURE;
+}
+
+static i32 test_kernels(const struct r_blit_kernels *ref,
+    const struct r_blit_kernels *k)
+{
+#define TEST_FN(fn_name)                                                \
+    if (test_row_fn(ref->fn_name, k->fn_name, #fn_name, k->name))       \
+        return 1;
+
+    TEST_FN(copy);
+    TEST_FN(copy_swizzle);
+    TEST_FN(blend);
+    TEST_FN(blend_swizzle);
+    TEST_FN(blend_premul);
+    TEST_FN(blend_premul_swizzle);
+
+#undef TEST_FN
+
+    return 0;
+}
+
+static i32 test_row_fn(r_blit_row_fn_t *ref_fn, r_blit_row_fn_t *fn,
+    const char *fn_name, const char *kernels_name)
+{
+    static pixel_t src[MAX_ROW_LEN];
+    static pixel_t ref_dst[MAX_ROW_LEN], dst[MAX_ROW_LEN];
+
+    for (u32 i = 0; i < N_ITERATIONS; i++) {
+        const u32 len = rand() % MAX_ROW_LEN;
+        /* Also test unaligned buffers */
+        const u32 offset = rand() % (MAX_ROW_LEN - len);
+
+        fill_random(src, MAX_ROW_LEN);
+        fill_random(ref_dst, MAX_ROW_LEN);
+        memcpy(dst, ref_dst, sizeof(dst));
+
+        ref_fn(ref_dst + offset, src + offset, len);
+        fn(dst + offset, src + offset, len);
+
+        if (memcmp(ref_dst, dst, sizeof(dst))) {
+            for (u32 j = 0; j < MAX_ROW_LEN; j++) {
+                if (!memcmp(&ref_dst[j], &dst[j], sizeof(pixel_t)))
+                    continue;
+
+                s_log_error("%s->%s: mismatch at pixel %u "
+                    "(len %u, offset %u): expected "
+                    "(%hhu, %hhu, %hhu, %hhu), got (%hhu, %hhu, %hhu, %hhu)",
+                    kernels_name, fn_name, j, len, offset,
+                    u_color_arg_expand(ref_dst[j]),
+                    u_color_arg_expand(dst[j])
+                );
+                break;
+            }
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void fill_random(pixel_t *buf, u32 n)
+{
+    for (u32 i = 0; i < n; i++) {
+        buf[i].r = rand() % 256;
+        buf[i].g = rand() % 256;
+        buf[i].b = rand() % 256;
+
+        /* Make sure that the fully opaque and fully transparent
+         * special cases are also hit fairly often */
+        switch (rand() % 4) {
+            case 0: buf[i].a = 0; break;
+            case 1: buf[i].a = 255; break;
+            default: buf[i].a = rand() % 256; break;
+        }
+    }
+}
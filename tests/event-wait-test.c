@@ -0,0 +1,168 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <platform/event.h>
+#include <platform/ptime.h>
+#include <platform/thread.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define MODULE_NAME "event-wait-test"
+#include "log-util.h"
+
+#define SHORT_TIMEOUT_us 20000
+
+/* Long enough that hitting it means the wakeup didn't work */
+#define LONG_TIMEOUT_us 5000000
+#define SENDER_DELAY_us 20000
+
+static i32 test_timeout(void);
+static i32 test_wakeup(void);
+static i32 test_pending_wakeup(void);
+static void sender_fn(void *arg);
+static void get_deadline(timestamp_t *o, i64 us);
+static void drain_events(void);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    i32 ret = EXIT_FAILURE;
+
+    p_event_send(&(const struct p_event) { .type = P_EVENT_CTL_INIT_ });
+
+    s_log_info("Testing the deadline...");
+    if (test_timeout())
+        goto_error("Timeout test failed");
+
+    s_log_info("Testing the wakeup from another thread...");
+    if (test_wakeup())
+        goto_error("Wakeup test failed");
+
+    s_log_info("Testing an event sent before the wait...");
+    if (test_pending_wakeup())
+        goto_error("Pending wakeup test failed");
+
+    ret = EXIT_SUCCESS;
+err:
+    p_event_send(&(const struct p_event) { .type = P_EVENT_CTL_DESTROY_ });
+    s_log_info("Test result is %s", ret == EXIT_SUCCESS ? "OK" : "FAIL");
+    return ret;
+}
+
+static i32 test_timeout(void)
+{
+    timestamp_t start, deadline;
+    p_time_get_ticks(&start);
+    get_deadline(&deadline, SHORT_TIMEOUT_us);
+
+    if (p_event_wait(&deadline)) {
+        s_log_error("Woken up even though no events were sent");
+        return 1;
+    }
+
+    const i64 waited_us = p_time_delta_us(&start);
+    s_log_debug("Waited %li us for a %i us timeout",
+        waited_us, SHORT_TIMEOUT_us);
+    if (waited_us < SHORT_TIMEOUT_us) {
+        s_log_error("Returned %li us before the deadline",
+            SHORT_TIMEOUT_us - waited_us);
+        return 1;
+    }
+
+    /* A deadline that already passed doesn't block */
+    p_time_get_ticks(&start);
+    if (p_event_wait(&deadline)) {
+        s_log_error("Woken up even though no events were sent");
+        return 1;
+    }
+    if (p_time_delta_us(&start) > SHORT_TIMEOUT_us) {
+        s_log_error("Blocked on a deadline that already passed");
+        return 1;
+    }
+
+    return 0;
+}
+
+static i32 test_wakeup(void)
+{
+    p_mt_thread_t sender;
+    if (p_mt_thread_create(&sender, sender_fn, NULL)) {
+        s_log_error("Failed to create the sender thread");
+        return 1;
+    }
+
+    timestamp_t start, deadline;
+    p_time_get_ticks(&start);
+    get_deadline(&deadline, LONG_TIMEOUT_us);
+
+    const i32 woken_up = p_event_wait(&deadline);
+    const i64 waited_us = p_time_delta_us(&start);
+    p_mt_thread_wait(&sender);
+
+    s_log_debug("Woken up after %li us", waited_us);
+    if (!woken_up || waited_us >= LONG_TIMEOUT_us) {
+        s_log_error("Not woken up by the event");
+        return 1;
+    }
+
+    struct p_event ev;
+    if (p_event_poll(&ev) == 0 || ev.type != P_EVENT_PAUSE) {
+        s_log_error("The event that woke us up isn't in the queue");
+        return 1;
+    }
+    drain_events();
+
+    return 0;
+}
+
+static i32 test_pending_wakeup(void)
+{
+    /* A burst of events only needs to wake up the wait once */
+    for (u32 i = 0; i < 3; i++)
+        p_event_send(&(const struct p_event) { .type = P_EVENT_PAUSE });
+
+    timestamp_t deadline;
+    get_deadline(&deadline, LONG_TIMEOUT_us);
+    if (!p_event_wait(&deadline)) {
+        s_log_error("Not woken up by the events sent before the wait");
+        return 1;
+    }
+    drain_events();
+
+    /* The wakeup must have been used up by the previous wait */
+    get_deadline(&deadline, SHORT_TIMEOUT_us);
+    if (p_event_wait(&deadline)) {
+        s_log_error("Woken up again by the same events");
+        return 1;
+    }
+
+    return 0;
+}
+
+static void sender_fn(void *arg)
+{
+    (void) arg;
+
+    p_time_usleep(SENDER_DELAY_us);
+    p_event_send(&(const struct p_event) { .type = P_EVENT_PAUSE });
+
+    p_mt_thread_exit();
+}
+
+static void get_deadline(timestamp_t *o, i64 us)
+{
+    p_time_get_ticks(o);
+    o->ns += (us % 1000000) * 1000;
+    o->s += us / 1000000 + o->ns / 1000000000;
+    o->ns %= 1000000000;
+}
+
+static void drain_events(void)
+{
+    struct p_event ev;
+    while (p_event_poll(&ev))
+        ;
+}
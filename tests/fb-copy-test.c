@@ -0,0 +1,117 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#define P_INTERNAL_GUARD__
+#include <platform/common/fb-copy.h>
+#undef P_INTERNAL_GUARD__
+
+#define MODULE_NAME "fb-copy-test"
+#include "log-util.h"
+
+/* Big enough to exercise the cache line loop, the 16-byte loop
+ * and both of the unaligned ends, at every alignment */
+#define MAX_ROW_SIZE 301
+#define MAX_ALIGNMENT 16
+#define N_ROWS 5
+#define ROW_STRIDE (MAX_ROW_SIZE + MAX_ALIGNMENT + 7)
+#define BUF_SIZE (ROW_STRIDE * N_ROWS + MAX_ALIGNMENT)
+
+static i32 test_method(enum pc_fb_copy_method method);
+static i32 test_select(void);
+static void fill_random(u8 *buf, u64 size);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    i32 ret = EXIT_FAILURE;
+
+    for (u32 i = 0; i < PC_FB_COPY_METHOD_MAX_; i++) {
+        if (!pc_fb_copy_is_available(i)) {
+            s_log_info("Copy method %u is not available, skipping", i);
+            continue;
+        }
+
+        s_log_info("Testing copy method %u...", i);
+        if (test_method(i))
+            goto_error("Copy method %u test failed", i);
+    }
+
+    s_log_info("Testing the method selection...");
+    if (test_select())
+        goto_error("Method selection test failed");
+
+    ret = EXIT_SUCCESS;
+err:
+    s_log_info("Test result is %s", ret == EXIT_SUCCESS ? "OK" : "FAIL");
+    return ret;
+}
+
+static i32 test_method(enum pc_fb_copy_method method)
+{
+    static u8 src[BUF_SIZE], dst[BUF_SIZE], expected[BUF_SIZE];
+
+    for (u32 src_align = 0; src_align < MAX_ALIGNMENT; src_align += 3) {
+        for (u32 dst_align = 0; dst_align < MAX_ALIGNMENT; dst_align++) {
+            for (u32 size = 0; size <= MAX_ROW_SIZE; size++) {
+                fill_random(src, BUF_SIZE);
+                fill_random(dst, BUF_SIZE);
+                memcpy(expected, dst, BUF_SIZE);
+
+                for (u32 y = 0; y < N_ROWS; y++) {
+                    memcpy(expected + dst_align + y * ROW_STRIDE,
+                        src + src_align + y * ROW_STRIDE, size);
+                }
+
+                pc_fb_copy_rows(method,
+                    dst + dst_align, ROW_STRIDE,
+                    src + src_align, ROW_STRIDE,
+                    size, N_ROWS);
+
+                /* Nothing outside of the rows may be touched either */
+                if (memcmp(dst, expected, BUF_SIZE)) {
+                    s_log_error("Mismatch with src alignment %u, "
+                        "dst alignment %u and row size %u",
+                        src_align, dst_align, size);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static i32 test_select(void)
+{
+    static u8 buf[BUF_SIZE], orig[BUF_SIZE];
+    fill_random(buf, BUF_SIZE);
+    memcpy(orig, buf, BUF_SIZE);
+
+    const enum pc_fb_copy_method method = pc_fb_copy_select(buf, BUF_SIZE);
+    if (method < 0 || method >= PC_FB_COPY_METHOD_MAX_ ||
+        !pc_fb_copy_is_available(method))
+    {
+        s_log_error("Invalid method selected: %i", method);
+        return 1;
+    }
+
+    /* The benchmark must only ever write back what was already there */
+    if (memcmp(buf, orig, BUF_SIZE)) {
+        s_log_error("The contents of the buffer were changed");
+        return 1;
+    }
+
+    return 0;
+}
+
+static void fill_random(u8 *buf, u64 size)
+{
+    for (u64 i = 0; i < size; i++)
+        buf[i] = rand() & 0xff;
+}
@@ -0,0 +1,215 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <platform/ptime.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define MODULE_NAME "frame-sched-test"
+#include "log-util.h"
+
+#define FRAME_DURATION_us 4000
+#define N_FRAMES 50
+
+/* Generous, as the tests may run on a busy machine */
+#define MAX_LATENESS_ns 2000000
+
+/* The accumulator is clamped to 5 steps, which is more than 2 frames here,
+ * so it can only be clamped after a period was skipped */
+#define UPDATE_STEP_us 1700
+
+static i32 test_pacing(void);
+static i32 test_skipped_periods(void);
+static i32 test_accumulator(void);
+static i32 test_sleep_until(void);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    i32 ret = EXIT_FAILURE;
+
+    s_log_info("Testing p_time_sleep_until...");
+    if (test_sleep_until())
+        goto_error("p_time_sleep_until test failed");
+
+    s_log_info("Testing the frame pacing...");
+    if (test_pacing())
+        goto_error("Frame pacing test failed");
+
+    s_log_info("Testing the skipping of missed periods...");
+    if (test_skipped_periods())
+        goto_error("Skipped periods test failed");
+
+    s_log_info("Testing the fixed-timestep accumulator...");
+    if (test_accumulator())
+        goto_error("Accumulator test failed");
+
+    ret = EXIT_SUCCESS;
+err:
+    s_log_info("Test result is %s", ret == EXIT_SUCCESS ? "OK" : "FAIL");
+    return ret;
+}
+
+static i32 test_sleep_until(void)
+{
+    timestamp_t deadline, now, late;
+    p_time_get_ticks(&deadline);
+    timestamp_add_ns(deadline, FRAME_DURATION_us * 1000LL);
+
+    p_time_sleep_until(&deadline);
+    p_time_get_ticks(&now);
+
+    /* `late` is how far past the deadline we are,
+     * so it would have a negative `s` if we woke up too early */
+    timestamp_delta(late, deadline, now);
+    if (late.s < 0) {
+        s_log_error("Woke up before the deadline");
+        return 1;
+    }
+    s_log_debug("Woke up %li ns after the deadline", late.ns);
+
+    /* A deadline that already passed returns right away */
+    p_time_sleep_until(&deadline);
+
+    return 0;
+}
+
+static i32 test_pacing(void)
+{
+    struct p_time_frame_sched s;
+    timestamp_t start;
+    p_time_get_ticks(&start);
+    p_time_frame_sched_init(&s, FRAME_DURATION_us, 0);
+
+    for (u32 i = 0; i < N_FRAMES; i++)
+        p_time_frame_sched_wait(&s);
+
+    const i64 elapsed_us = p_time_delta_us(&start);
+    struct p_time_frame_stats stats;
+    p_time_frame_sched_get_stats(&s, &stats);
+
+    s_log_debug("%u frames in %li us, drift %li ns, "
+        "lateness p50/p99/max %lu/%lu/%lu ns, interval mean %lu ns",
+        N_FRAMES, elapsed_us, stats.drift_ns,
+        stats.lateness_ns.p50, stats.lateness_ns.p99, stats.lateness_ns.max,
+        stats.frame_interval_ns.mean);
+
+    if (stats.n_frames != N_FRAMES + 1 || stats.n_early_frames != 0) {
+        s_log_error("Wrong frame counts: %lu total, %lu early",
+            stats.n_frames, stats.n_early_frames);
+        return 1;
+    }
+    if (elapsed_us < N_FRAMES * FRAME_DURATION_us) {
+        s_log_error("%u frames only took %li us", N_FRAMES, elapsed_us);
+        return 1;
+    }
+    if (stats.lateness_ns.n_samples != N_FRAMES) {
+        s_log_error("Wrong number of lateness samples: %u",
+            stats.lateness_ns.n_samples);
+        return 1;
+    }
+
+    /* Unless the machine was so busy that whole frames had to be skipped,
+     * the deadlines being absolute means the lateness doesn't add up */
+    if (stats.n_skipped_periods == 0 &&
+        (stats.drift_ns < 0 || stats.drift_ns > MAX_LATENESS_ns))
+    {
+        s_log_error("The schedule drifted by %li ns", stats.drift_ns);
+        return 1;
+    }
+
+    return 0;
+}
+
+static i32 test_skipped_periods(void)
+{
+    struct p_time_frame_sched s;
+    p_time_frame_sched_init(&s, FRAME_DURATION_us, 0);
+
+    timestamp_t first_deadline;
+    p_time_frame_sched_get_period(&s, NULL, &first_deadline);
+
+    /* Stall for 3.5 frames */
+    p_time_usleep(FRAME_DURATION_us * 7 / 2);
+    p_time_frame_sched_begin_frame(&s);
+
+    struct p_time_frame_stats stats;
+    p_time_frame_sched_get_stats(&s, &stats);
+    if (stats.n_skipped_periods < 2) {
+        s_log_error("Only %lu periods were skipped",
+            stats.n_skipped_periods);
+        return 1;
+    }
+
+    /* The next deadline must still be on the same grid */
+    timestamp_t period_start, deadline, diff;
+    p_time_frame_sched_get_period(&s, &period_start, &deadline);
+    timestamp_delta(diff, first_deadline, deadline);
+    const i64 diff_ns = diff.s * 1000000000LL + diff.ns;
+    if (diff_ns % (FRAME_DURATION_us * 1000LL) != 0) {
+        s_log_error("The next deadline is off the grid by %li ns",
+            diff_ns % (FRAME_DURATION_us * 1000LL));
+        return 1;
+    }
+
+    /* And the current time must be inside the next period */
+    if (p_time_delta_us(&period_start) < 0 ||
+        p_time_delta_us(&deadline) >= 0)
+    {
+        s_log_error("The next period doesn't contain the current time");
+        return 1;
+    }
+
+    return 0;
+}
+
+static i32 test_accumulator(void)
+{
+    struct p_time_frame_sched s;
+    p_time_frame_sched_init(&s, FRAME_DURATION_us, UPDATE_STEP_us);
+
+    u64 n_steps = 0;
+    for (u32 i = 0; i < N_FRAMES; i++) {
+        p_time_frame_sched_wait(&s);
+        while (p_time_frame_sched_step(&s))
+            n_steps++;
+
+        const f32 alpha = p_time_frame_sched_get_alpha(&s);
+        if (alpha < 0.f || alpha >= 1.f) {
+            s_log_error("Invalid interpolation alpha: %f", alpha);
+            return 1;
+        }
+    }
+
+    /* Every bit of time between the frames went into the accumulator
+     * (unless the clamping after a long stall kicked in) */
+    struct p_time_frame_stats stats;
+    p_time_frame_sched_get_stats(&s, &stats);
+    const i64 elapsed_ns = s.last_frame_ns - s.first_frame_ns;
+    const i64 accounted_ns = n_steps * UPDATE_STEP_us * 1000LL
+        + (i64)(p_time_frame_sched_get_alpha(&s) * UPDATE_STEP_us * 1000.f);
+
+    s_log_debug("%lu update steps in %li ns", n_steps, elapsed_ns);
+    if (stats.n_skipped_periods == 0 &&
+        llabs(elapsed_ns - accounted_ns) > 1000)
+    {
+        s_log_error("%li ns passed, but the steps account for %li ns",
+            elapsed_ns, accounted_ns);
+        return 1;
+    }
+
+    /* Without the accumulator there are never any steps */
+    p_time_frame_sched_init(&s, FRAME_DURATION_us, 0);
+    p_time_frame_sched_wait(&s);
+    if (p_time_frame_sched_step(&s) ||
+        p_time_frame_sched_get_alpha(&s) != 0.f)
+    {
+        s_log_error("Got update steps even though the accumulator is off");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <core/histogram.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define MODULE_NAME "histogram-test"
+#include "log-util.h"
+
+#define N_ROLLING_SAMPLES (HISTOGRAM_MAX_SAMPLES * 3 + 17)
+
+static i32 test_empty(void);
+static i32 test_percentiles(void);
+static i32 test_rolling(void);
+static i32 test_buckets(void);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    i32 ret = EXIT_FAILURE;
+
+    s_log_info("Testing an empty histogram...");
+    if (test_empty())
+        goto_error("Empty histogram test failed");
+
+    s_log_info("Testing the percentiles...");
+    if (test_percentiles())
+        goto_error("Percentile test failed");
+
+    s_log_info("Testing the rolling window...");
+    if (test_rolling())
+        goto_error("Rolling window test failed");
+
+    s_log_info("Testing the buckets...");
+    if (test_buckets())
+        goto_error("Bucket test failed");
+
+    ret = EXIT_SUCCESS;
+err:
+    s_log_info("Test result is %s", ret == EXIT_SUCCESS ? "OK" : "FAIL");
+    return ret;
+}
+
+static i32 test_empty(void)
+{
+    static struct histogram h;
+    histogram_clear(&h);
+
+    struct histogram_summary s;
+    memset(&s, 0xff, sizeof(s));
+    histogram_summarize(&h, &s);
+
+    return s.n_samples != 0 || s.total_samples != 0 ||
+        s.min != 0 || s.max != 0 || s.mean != 0 || s.p99 != 0;
+}
+
+static i32 test_percentiles(void)
+{
+    static struct histogram h;
+    histogram_clear(&h);
+
+    /* 1..100 in a scrambled order */
+    for (u32 i = 0; i < 100; i++)
+        histogram_add(&h, (i * 37) % 100 + 1);
+
+    struct histogram_summary s;
+    histogram_summarize(&h, &s);
+
+    if (s.n_samples != 100 || s.total_samples != 100) {
+        s_log_error("Wrong sample count: %u/%lu", s.n_samples, s.total_samples);
+        return 1;
+    }
+    if (s.min != 1 || s.max != 100 || s.mean != 50) {
+        s_log_error("Wrong min/max/mean: %lu/%lu/%lu", s.min, s.max, s.mean);
+        return 1;
+    }
+    if (s.p50 != 50 || s.p90 != 90 || s.p99 != 99) {
+        s_log_error("Wrong percentiles: %lu/%lu/%lu", s.p50, s.p90, s.p99);
+        return 1;
+    }
+
+    return 0;
+}
+
+static i32 test_rolling(void)
+{
+    static struct histogram h;
+    histogram_clear(&h);
+
+    for (u32 i = 0; i < N_ROLLING_SAMPLES; i++)
+        histogram_add(&h, i);
+
+    struct histogram_summary s;
+    histogram_summarize(&h, &s);
+
+    /* Only the last `HISTOGRAM_MAX_SAMPLES` samples are kept */
+    const u64 oldest = N_ROLLING_SAMPLES - HISTOGRAM_MAX_SAMPLES;
+    if (s.n_samples != HISTOGRAM_MAX_SAMPLES ||
+        s.total_samples != N_ROLLING_SAMPLES)
+    {
+        s_log_error("Wrong sample count: %u/%lu", s.n_samples, s.total_samples);
+        return 1;
+    }
+    if (s.min != oldest || s.max != N_ROLLING_SAMPLES - 1) {
+        s_log_error("Wrong min/max: %lu/%lu (should be %lu/%u)",
+            s.min, s.max, oldest, N_ROLLING_SAMPLES - 1);
+        return 1;
+    }
+
+    histogram_clear(&h);
+    histogram_add(&h, 7);
+    histogram_summarize(&h, &s);
+    if (s.n_samples != 1 || s.total_samples != 1 || s.min != 7 || s.max != 7) {
+        s_log_error("The histogram wasn't cleared properly");
+        return 1;
+    }
+
+    return 0;
+}
+
+static i32 test_buckets(void)
+{
+    static struct histogram h;
+    histogram_clear(&h);
+
+    histogram_add(&h, 0);
+    histogram_add(&h, 1);
+    histogram_add(&h, 2);
+    histogram_add(&h, 3);
+    histogram_add(&h, 4);
+    histogram_add(&h, 1000);
+    histogram_add(&h, (u64)1 << 40);
+
+    struct histogram_summary s;
+    histogram_summarize(&h, &s);
+
+    /* 0 | 1 | 2, 3 | 4 | ... | 1000 (in [512, 1024)) | ... | 2^40 */
+    static const struct {
+        u32 bucket;
+        u32 count;
+    } expected[] = {
+        { 0, 1 }, { 1, 1 }, { 2, 2 }, { 3, 1 }, { 10, 1 },
+        { HISTOGRAM_N_BUCKETS - 1, 1 },
+    };
+
+    u32 total = 0;
+    for (u32 i = 0; i < u_arr_size(expected); i++) {
+        if (s.buckets[expected[i].bucket] != expected[i].count) {
+            s_log_error("Bucket %u has %u samples (should have %u)",
+                expected[i].bucket, s.buckets[expected[i].bucket],
+                expected[i].count);
+            return 1;
+        }
+    }
+    for (u32 i = 0; i < HISTOGRAM_N_BUCKETS; i++)
+        total += s.buckets[i];
+
+    return total != s.n_samples;
+}
@@ -0,0 +1,247 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <platform/thread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define MODULE_NAME "jobs-test"
+#include "log-util.h"
+
+#define N_JOBS 10000
+#define N_ELEMENTS 100003
+
+/* The depth of the job tree in the nested test (2^depth leaves) */
+#define TREE_DEPTH 12
+
+#define N_SUBMITTER_THREADS 3
+
+static i32 test_pool(u32 n_threads);
+static i32 test_counter(struct p_mt_jobs *jobs);
+static i32 test_parallel_for(struct p_mt_jobs *jobs);
+static i32 test_nested(struct p_mt_jobs *jobs);
+static i32 test_concurrent_submitters(struct p_mt_jobs *jobs);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    i32 ret = EXIT_FAILURE;
+
+    /* Without any workers, with a few, and with one thread per CPU */
+    static const u32 n_threads[] = { 1, 4, 0 };
+    for (u32 i = 0; i < u_arr_size(n_threads); i++) {
+        s_log_info("Testing a pool of %u thread(s)...", n_threads[i]);
+        if (test_pool(n_threads[i]))
+            goto_error("Job pool test failed for %u thread(s)",
+                n_threads[i]);
+    }
+
+    ret = EXIT_SUCCESS;
+err:
+    s_log_info("Test result is %s", ret == EXIT_SUCCESS ? "OK" : "FAIL");
+    return ret;
+}
+
+static i32 test_pool(u32 n_threads)
+{
+    struct p_mt_jobs *jobs = p_mt_jobs_create(n_threads);
+    if (jobs == NULL) {
+        s_log_error("Failed to create the job pool");
+        return 1;
+    }
+
+    i32 ret = 1;
+
+    if (test_counter(jobs))
+        goto_error("Counter test failed");
+
+    if (test_parallel_for(jobs))
+        goto_error("parallel_for test failed");
+
+    if (test_nested(jobs))
+        goto_error("Nested jobs test failed");
+
+    if (test_concurrent_submitters(jobs))
+        goto_error("Concurrent submitters test failed");
+
+    ret = 0;
+err:
+    p_mt_jobs_destroy(&jobs);
+    return ret;
+}
+
+static void increment_job(void *arg)
+{
+    atomic_fetch_add((_Atomic u32 *)arg, 1);
+}
+
+static i32 test_counter(struct p_mt_jobs *jobs)
+{
+    _Atomic u32 n_done = 0;
+    struct p_mt_job_counter counter = P_MT_JOB_COUNTER_INIT;
+
+    for (u32 i = 0; i < N_JOBS; i++)
+        p_mt_jobs_submit(jobs, increment_job, &n_done, &counter);
+    p_mt_jobs_wait(jobs, &counter);
+
+    if (atomic_load(&n_done) != N_JOBS) {
+        s_log_error("Only %u/%u jobs were done after the wait",
+            atomic_load(&n_done), N_JOBS);
+        return 1;
+    }
+
+    /* The counter can be reused, and waiting with nothing
+     * left to do returns right away */
+    p_mt_jobs_wait(jobs, &counter);
+    p_mt_jobs_submit(jobs, increment_job, &n_done, &counter);
+    p_mt_jobs_wait(jobs, &counter);
+    if (atomic_load(&n_done) != N_JOBS + 1) {
+        s_log_error("The reused counter didn't wait for its job");
+        return 1;
+    }
+
+    return 0;
+}
+
+static void mark_range(void *arg, u32 start, u32 end)
+{
+    _Atomic u8 *marks = arg;
+    for (u32 i = start; i < end; i++)
+        atomic_fetch_add(&marks[i], 1);
+}
+
+static i32 test_parallel_for(struct p_mt_jobs *jobs)
+{
+    static const u32 grains[] = { 0, 1, 7, 4096, N_ELEMENTS, N_ELEMENTS * 2 };
+
+    _Atomic u8 *marks = calloc(N_ELEMENTS, sizeof(_Atomic u8));
+    s_assert(marks != NULL, "calloc() failed for the marks");
+
+    i32 ret = 1;
+
+    for (u32 g = 0; g < u_arr_size(grains); g++) {
+        memset((void *)marks, 0, N_ELEMENTS * sizeof(_Atomic u8));
+        p_mt_jobs_parallel_for(jobs, N_ELEMENTS, grains[g], mark_range,
+            (void *)marks);
+
+        /* Every element must have been processed exactly once */
+        for (u32 i = 0; i < N_ELEMENTS; i++) {
+            if (atomic_load(&marks[i]) != 1) {
+                s_log_error("Element %u was processed %u times (grain %u)",
+                    i, atomic_load(&marks[i]), grains[g]);
+                goto err;
+            }
+        }
+    }
+
+    /* An empty range doesn't call the function at all */
+    p_mt_jobs_parallel_for(jobs, 0, 0, mark_range, NULL);
+
+    ret = 0;
+err:
+    free((void *)marks);
+    return ret;
+}
+
+struct tree_node_arg {
+    struct p_mt_jobs *jobs;
+    u32 depth;
+    _Atomic u32 *n_leaves;
+};
+
+/* Spawns 2 children and waits for them (while running other jobs) */
+static void tree_node_job(void *arg)
+{
+    const struct tree_node_arg *a = arg;
+    if (a->depth == 0) {
+        atomic_fetch_add(a->n_leaves, 1);
+        return;
+    }
+
+    struct tree_node_arg children[2];
+    struct p_mt_job_counter counter = P_MT_JOB_COUNTER_INIT;
+    for (u32 i = 0; i < 2; i++) {
+        children[i] = *a;
+        children[i].depth = a->depth - 1;
+        p_mt_jobs_submit(a->jobs, tree_node_job, &children[i], &counter);
+    }
+    p_mt_jobs_wait(a->jobs, &counter);
+}
+
+static i32 test_nested(struct p_mt_jobs *jobs)
+{
+    _Atomic u32 n_leaves = 0;
+    struct tree_node_arg root = {
+        .jobs = jobs,
+        .depth = TREE_DEPTH,
+        .n_leaves = &n_leaves,
+    };
+
+    struct p_mt_job_counter counter = P_MT_JOB_COUNTER_INIT;
+    p_mt_jobs_submit(jobs, tree_node_job, &root, &counter);
+    p_mt_jobs_wait(jobs, &counter);
+
+    if (atomic_load(&n_leaves) != 1U << TREE_DEPTH) {
+        s_log_error("Only %u/%u leaves of the job tree were reached",
+            atomic_load(&n_leaves), 1U << TREE_DEPTH);
+        return 1;
+    }
+
+    return 0;
+}
+
+struct submitter_arg {
+    struct p_mt_jobs *jobs;
+    _Atomic u32 n_done;
+};
+
+static void submitter_fn(void *arg)
+{
+    struct submitter_arg *a = arg;
+    struct p_mt_job_counter counter = P_MT_JOB_COUNTER_INIT;
+
+    for (u32 i = 0; i < N_JOBS / N_SUBMITTER_THREADS; i++)
+        p_mt_jobs_submit(a->jobs, increment_job, &a->n_done, &counter);
+    p_mt_jobs_wait(a->jobs, &counter);
+
+    p_mt_thread_exit();
+}
+
+static i32 test_concurrent_submitters(struct p_mt_jobs *jobs)
+{
+    struct submitter_arg args[N_SUBMITTER_THREADS];
+    p_mt_thread_t threads[N_SUBMITTER_THREADS];
+
+    u32 n_started = 0;
+    for (u32 i = 0; i < N_SUBMITTER_THREADS; i++) {
+        args[i].jobs = jobs;
+        atomic_store(&args[i].n_done, 0);
+        if (p_mt_thread_create(&threads[i], submitter_fn, &args[i]))
+            break;
+        n_started++;
+    }
+
+    for (u32 i = 0; i < n_started; i++)
+        p_mt_thread_wait(&threads[i]);
+
+    if (n_started != N_SUBMITTER_THREADS) {
+        s_log_error("Failed to start the submitter threads");
+        return 1;
+    }
+
+    /* Each thread's wait only returns once all of its own jobs are done */
+    for (u32 i = 0; i < N_SUBMITTER_THREADS; i++) {
+        if (atomic_load(&args[i].n_done) != N_JOBS / N_SUBMITTER_THREADS) {
+            s_log_error("Submitter %u: only %u/%u jobs were done", i,
+                atomic_load(&args[i].n_done), N_JOBS / N_SUBMITTER_THREADS);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,257 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <core/mpsc-queue.h>
+#include <platform/ptime.h>
+#include <platform/thread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define MODULE_NAME "mpsc-queue-test"
+#include "log-util.h"
+
+#define SMALL_QUEUE_CAPACITY 8
+
+/* Small enough for the queue to fill up every now and then */
+#define STRESS_QUEUE_CAPACITY 64
+#define N_PRODUCERS 6
+#define N_ITEMS_PER_PRODUCER 50000
+
+struct item {
+    u32 producer;
+    u32 seq;
+};
+
+struct producer_arg {
+    struct mpsc_queue *q;
+    u32 id;
+    _Atomic bool *start;
+    _Atomic u64 n_pushed;
+    u64 n_failed_pushes;
+};
+
+static i32 test_fifo(void);
+static i32 test_overflow(void);
+static i32 test_stress(void);
+static void producer_fn(void *arg);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    i32 ret = EXIT_FAILURE;
+
+    s_log_info("Testing the FIFO order...");
+    if (test_fifo())
+        goto_error("FIFO test failed");
+
+    s_log_info("Testing the overflow policy...");
+    if (test_overflow())
+        goto_error("Overflow test failed");
+
+    s_log_info("Stress testing with %u producers...", N_PRODUCERS);
+    if (test_stress())
+        goto_error("Stress test failed");
+
+    ret = EXIT_SUCCESS;
+err:
+    s_log_info("Test result is %s", ret == EXIT_SUCCESS ? "OK" : "FAIL");
+    return ret;
+}
+
+static i32 test_fifo(void)
+{
+    static struct mpsc_queue q;
+    if (mpsc_queue_init(&q, SMALL_QUEUE_CAPACITY, sizeof(u32))) {
+        s_log_error("Failed to initialize the queue");
+        return 1;
+    }
+
+    i32 ret = 1;
+    u32 next_push = 0, next_pop = 0;
+
+    /* Go around the ring a few times, with varying fill levels */
+    for (u32 round = 0; round < 10; round++) {
+        for (u32 i = 0; i < (round % SMALL_QUEUE_CAPACITY) + 1; i++) {
+            if (mpsc_queue_push(&q, &next_push))
+                goto_error("Push %u failed", next_push);
+            next_push++;
+        }
+
+        if (mpsc_queue_size(&q) != next_push - next_pop)
+            goto_error("Wrong size: %lu", mpsc_queue_size(&q));
+
+        u32 val = 0;
+        while (mpsc_queue_pop(&q, &val) == 0) {
+            if (val != next_pop)
+                goto_error("Popped %u, expected %u", val, next_pop);
+            next_pop++;
+        }
+        if (next_pop != next_push)
+            goto_error("Only %u of %u items were popped", next_pop, next_push);
+    }
+
+    ret = 0;
+err:
+    mpsc_queue_destroy(&q);
+    return ret;
+}
+
+static i32 test_overflow(void)
+{
+    static struct mpsc_queue q;
+    if (mpsc_queue_init(&q, SMALL_QUEUE_CAPACITY, sizeof(u32))) {
+        s_log_error("Failed to initialize the queue");
+        return 1;
+    }
+
+    i32 ret = 1;
+
+    for (u32 i = 0; i < SMALL_QUEUE_CAPACITY; i++) {
+        if (mpsc_queue_push(&q, &i))
+            goto_error("Push %u failed before the queue was full", i);
+    }
+
+    /* The new items are the ones that get dropped */
+    const u32 dropped = 1234;
+    for (u32 i = 0; i < 3; i++) {
+        if (mpsc_queue_push(&q, &dropped) == 0)
+            goto_error("Push succeeded even though the queue is full");
+    }
+    if (mpsc_queue_get_n_overflows(&q) != 3)
+        goto_error("Wrong overflow count: %lu", mpsc_queue_get_n_overflows(&q));
+
+    u32 val = 0;
+    for (u32 i = 0; i < SMALL_QUEUE_CAPACITY; i++) {
+        if (mpsc_queue_pop(&q, &val) || val != i)
+            goto_error("Popped %u, expected %u", val, i);
+    }
+    if (mpsc_queue_pop(&q, &val) == 0)
+        goto_error("Popped an item that should have been dropped");
+
+    /* Once there's space again, pushing works */
+    if (mpsc_queue_push(&q, &dropped) || mpsc_queue_pop(&q, &val) ||
+        val != dropped)
+    {
+        goto_error("The queue didn't recover from the overflow");
+    }
+
+    ret = 0;
+err:
+    mpsc_queue_destroy(&q);
+    return ret;
+}
+
+static i32 test_stress(void)
+{
+    static struct mpsc_queue q;
+    if (mpsc_queue_init(&q, STRESS_QUEUE_CAPACITY, sizeof(struct item))) {
+        s_log_error("Failed to initialize the queue");
+        return 1;
+    }
+
+    i32 ret = 1;
+    _Atomic bool start = false;
+    struct producer_arg args[N_PRODUCERS] = { 0 };
+    p_mt_thread_t threads[N_PRODUCERS] = { 0 };
+    u32 n_threads = 0;
+
+    for (u32 i = 0; i < N_PRODUCERS; i++) {
+        args[i].q = &q;
+        args[i].id = i;
+        args[i].start = &start;
+        if (p_mt_thread_create(&threads[i], producer_fn, &args[i]))
+            goto_error("Failed to create producer thread %u", i);
+        n_threads++;
+    }
+    atomic_store(&start, true);
+
+    /* Items from the same producer must come out in the order
+     * they were pushed in, without any gaps (the producers retry
+     * the pushes that fail because the queue is full) */
+    i64 last_seq[N_PRODUCERS];
+    for (u32 i = 0; i < N_PRODUCERS; i++)
+        last_seq[i] = -1;
+
+    u64 n_popped = 0;
+    bool producers_done = false;
+    while (true) {
+        struct item it;
+        if (mpsc_queue_pop(&q, &it)) {
+            if (producers_done)
+                break;
+
+            /* Check whether the last item was already popped */
+            u64 n_pushed = 0;
+            for (u32 i = 0; i < N_PRODUCERS; i++)
+                n_pushed += atomic_load(&args[i].n_pushed);
+            if (n_pushed == (u64)N_PRODUCERS * N_ITEMS_PER_PRODUCER)
+                producers_done = true;
+            else
+                p_time_usleep(1);
+            continue;
+        }
+
+        if (it.producer >= N_PRODUCERS)
+            goto_error("Invalid producer id %u", it.producer);
+        if ((i64)it.seq != last_seq[it.producer] + 1) {
+            goto_error("Item %u of producer %u came after item %li",
+                it.seq, it.producer, last_seq[it.producer]);
+        }
+        last_seq[it.producer] = it.seq;
+        n_popped++;
+    }
+
+    if (n_popped != (u64)N_PRODUCERS * N_ITEMS_PER_PRODUCER) {
+        goto_error("Only %lu of %u items were popped",
+            n_popped, N_PRODUCERS * N_ITEMS_PER_PRODUCER);
+    }
+
+    ret = 0;
+err:
+    atomic_store(&start, true);
+    for (u32 i = 0; i < n_threads; i++)
+        p_mt_thread_wait(&threads[i]);
+
+    /* Every failed push must have been counted as an overflow */
+    if (ret == 0) {
+        u64 n_failed_pushes = 0;
+        for (u32 i = 0; i < N_PRODUCERS; i++)
+            n_failed_pushes += args[i].n_failed_pushes;
+
+        const u64 n_overflows = mpsc_queue_get_n_overflows(&q);
+        s_log_info("Popped %lu items, with %lu overflows",
+            n_popped, n_overflows);
+        if (n_overflows != n_failed_pushes) {
+            s_log_error("Wrong overflow count: %lu (should be %lu)",
+                n_overflows, n_failed_pushes);
+            ret = 1;
+        }
+    }
+
+    mpsc_queue_destroy(&q);
+    return ret;
+}
+
+static void producer_fn(void *arg)
+{
+    struct producer_arg *const a = arg;
+    while (!atomic_load(a->start))
+        p_time_usleep(1);
+
+    for (u32 i = 0; i < N_ITEMS_PER_PRODUCER; i++) {
+        const struct item it = { .producer = a->id, .seq = i };
+        /* Let the consumer catch up (there might be only 1 CPU) */
+        while (mpsc_queue_push(a->q, &it)) {
+            a->n_failed_pushes++;
+            p_time_usleep(1);
+        }
+        atomic_fetch_add(&a->n_pushed, 1);
+    }
+
+    p_mt_thread_exit();
+}
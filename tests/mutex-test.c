@@ -0,0 +1,259 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <platform/thread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define MODULE_NAME "mutex-test"
+#include "log-util.h"
+
+#define N_THREADS 4
+#define N_INCREMENTS 100000
+
+#define N_PING_PONGS 10000
+
+/* Never explicitly initialized */
+static p_mt_mutex_t g_static_mutex = P_MT_MUTEX_INITIALIZER;
+static u64 g_static_counter = 0;
+
+static i32 test_mutual_exclusion(void);
+static i32 test_ping_pong(void);
+static i32 test_signal_and_broadcast(void);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    i32 ret = EXIT_FAILURE;
+
+    s_log_info("Testing mutual exclusion...");
+    if (test_mutual_exclusion())
+        goto_error("Mutual exclusion test failed");
+
+    s_log_info("Testing a condition variable ping-pong...");
+    if (test_ping_pong())
+        goto_error("Ping-pong test failed");
+
+    s_log_info("Testing signal and broadcast...");
+    if (test_signal_and_broadcast())
+        goto_error("Signal/broadcast test failed");
+
+    ret = EXIT_SUCCESS;
+err:
+    s_log_info("Test result is %s", ret == EXIT_SUCCESS ? "OK" : "FAIL");
+    return ret;
+}
+
+struct counter_arg {
+    p_mt_mutex_t mutex;
+    u64 counter;
+};
+
+static void increment_fn(void *arg)
+{
+    struct counter_arg *a = arg;
+
+    for (u32 i = 0; i < N_INCREMENTS; i++) {
+        p_mt_mutex_lock(&a->mutex);
+        a->counter++;
+        p_mt_mutex_unlock(&a->mutex);
+
+        /* All threads race to lock the static mutex for the first time */
+        p_mt_mutex_lock(&g_static_mutex);
+        g_static_counter++;
+        p_mt_mutex_unlock(&g_static_mutex);
+    }
+
+    p_mt_thread_exit();
+}
+
+static i32 test_mutual_exclusion(void)
+{
+    /* Zeroed memory is an unlocked mutex */
+    struct counter_arg arg;
+    memset(&arg, 0, sizeof(arg));
+
+    p_mt_thread_t threads[N_THREADS];
+    u32 n_started = 0;
+    for (u32 i = 0; i < N_THREADS; i++) {
+        if (p_mt_thread_create(&threads[i], increment_fn, &arg))
+            break;
+        n_started++;
+    }
+    for (u32 i = 0; i < n_started; i++)
+        p_mt_thread_wait(&threads[i]);
+
+    if (n_started != N_THREADS) {
+        s_log_error("Failed to start the threads");
+        return 1;
+    }
+
+    p_mt_mutex_destroy(&arg.mutex);
+
+    if (arg.counter != (u64)N_THREADS * N_INCREMENTS ||
+        g_static_counter != (u64)N_THREADS * N_INCREMENTS)
+    {
+        s_log_error("Lost increments: %lu and %lu (expected %lu)",
+            arg.counter, g_static_counter, (u64)N_THREADS * N_INCREMENTS);
+        return 1;
+    }
+
+    return 0;
+}
+
+struct ping_pong_arg {
+    p_mt_mutex_t mutex;
+    p_mt_cond_t cond;
+    u32 turn;
+};
+
+/* Waits for `turn` to be odd and makes it even again */
+static void pong_fn(void *arg)
+{
+    struct ping_pong_arg *a = arg;
+
+    for (u32 i = 0; i < N_PING_PONGS; i++) {
+        p_mt_mutex_lock(&a->mutex);
+        while (a->turn % 2 == 0) {
+            p_mt_cond_wait(&a->cond, &a->mutex);
+            p_mt_mutex_lock(&a->mutex);
+        }
+        a->turn++;
+        p_mt_cond_signal(&a->cond);
+        p_mt_mutex_unlock(&a->mutex);
+    }
+
+    p_mt_thread_exit();
+}
+
+static i32 test_ping_pong(void)
+{
+    struct ping_pong_arg arg = {
+        .mutex = P_MT_MUTEX_INITIALIZER,
+        .cond = P_MT_COND_INITIALIZER,
+        .turn = 0,
+    };
+
+    p_mt_thread_t thread;
+    if (p_mt_thread_create(&thread, pong_fn, &arg)) {
+        s_log_error("Failed to start the pong thread");
+        return 1;
+    }
+
+    for (u32 i = 0; i < N_PING_PONGS; i++) {
+        p_mt_mutex_lock(&arg.mutex);
+        while (arg.turn % 2 == 1) {
+            p_mt_cond_wait(&arg.cond, &arg.mutex);
+            p_mt_mutex_lock(&arg.mutex);
+        }
+        arg.turn++;
+        p_mt_cond_signal(&arg.cond);
+        p_mt_mutex_unlock(&arg.mutex);
+    }
+
+    p_mt_thread_wait(&thread);
+    p_mt_cond_destroy(&arg.cond);
+    p_mt_mutex_destroy(&arg.mutex);
+
+    if (arg.turn != 2 * N_PING_PONGS) {
+        s_log_error("Wrong number of turns: %u", arg.turn);
+        return 1;
+    }
+
+    return 0;
+}
+
+struct waiter_arg {
+    p_mt_mutex_t mutex;
+    p_mt_cond_t cond;
+    u32 n_waiting;
+    u32 n_tickets;
+    _Atomic u32 n_woken;
+};
+
+/* Takes one ticket, waiting for it if there are none */
+static void waiter_fn(void *arg)
+{
+    struct waiter_arg *a = arg;
+
+    p_mt_mutex_lock(&a->mutex);
+    a->n_waiting++;
+    while (a->n_tickets == 0) {
+        p_mt_cond_wait(&a->cond, &a->mutex);
+        p_mt_mutex_lock(&a->mutex);
+    }
+    a->n_tickets--;
+    p_mt_mutex_unlock(&a->mutex);
+
+    atomic_fetch_add(&a->n_woken, 1);
+    p_mt_thread_exit();
+}
+
+static i32 test_signal_and_broadcast(void)
+{
+    struct waiter_arg arg = {
+        .mutex = P_MT_MUTEX_INITIALIZER,
+        .cond = P_MT_COND_INITIALIZER,
+    };
+    atomic_store(&arg.n_woken, 0);
+
+    p_mt_thread_t threads[N_THREADS];
+    u32 n_started = 0;
+    for (u32 i = 0; i < N_THREADS; i++) {
+        if (p_mt_thread_create(&threads[i], waiter_fn, &arg))
+            break;
+        n_started++;
+    }
+    if (n_started != N_THREADS) {
+        s_log_error("Failed to start the waiter threads");
+
+        /* Let the ones that did start exit */
+        p_mt_mutex_lock(&arg.mutex);
+        arg.n_tickets = N_THREADS;
+        p_mt_cond_broadcast(&arg.cond);
+        p_mt_mutex_unlock(&arg.mutex);
+        goto err;
+    }
+
+    /* Wait for all of them to start waiting */
+    bool all_waiting = false;
+    while (!all_waiting) {
+        p_mt_mutex_lock(&arg.mutex);
+        all_waiting = arg.n_waiting == N_THREADS;
+        p_mt_mutex_unlock(&arg.mutex);
+    }
+
+    /* Signal one waiter at a time... */
+    for (u32 i = 0; i < N_THREADS / 2; i++) {
+        p_mt_mutex_lock(&arg.mutex);
+        arg.n_tickets++;
+        p_mt_cond_signal(&arg.cond);
+        p_mt_mutex_unlock(&arg.mutex);
+    }
+
+    /* ...and then wake up all of the rest at once */
+    p_mt_mutex_lock(&arg.mutex);
+    arg.n_tickets += N_THREADS - N_THREADS / 2;
+    p_mt_cond_broadcast(&arg.cond);
+    p_mt_mutex_unlock(&arg.mutex);
+
+err:
+    for (u32 i = 0; i < n_started; i++)
+        p_mt_thread_wait(&threads[i]);
+
+    p_mt_cond_destroy(&arg.cond);
+    p_mt_mutex_destroy(&arg.mutex);
+
+    if (atomic_load(&arg.n_woken) != N_THREADS) {
+        s_log_error("Only %u/%u waiters were woken up",
+            atomic_load(&arg.n_woken), N_THREADS);
+        return 1;
+    }
+
+    return 0;
+}
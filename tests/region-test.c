@@ -0,0 +1,130 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <core/shapes.h>
+#include <core/region.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define MODULE_NAME "region-test"
+#include "log-util.h"
+
+/* The area in which the random rects are placed.
+ * Small enough to check every single point in it. */
+#define AREA_W 128
+#define AREA_H 96
+#define MAX_RECTS_PER_ITERATION 40
+#define N_ITERATIONS 300
+
+static i32 test(void);
+static rect_t random_rect(void);
+static bool rect_has_point(const rect_t *r, i32 x, i32 y);
+static bool region_has_point(const struct region *r, i32 x, i32 y);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    srand(1234);
+
+    s_log_info("Running %u iterations...", N_ITERATIONS);
+    for (u32 i = 0; i < N_ITERATIONS; i++) {
+        if (test()) {
+            s_log_info("Test result is FAIL");
+            return EXIT_FAILURE;
+        }
+    }
+
+    s_log_info("Test result is OK");
+    return EXIT_SUCCESS;
+}
+
+static i32 test(void)
+{
+    static rect_t added[MAX_RECTS_PER_ITERATION];
+    struct region r;
+    region_clear(&r);
+
+    const u32 n_added = 1 + rand() % MAX_RECTS_PER_ITERATION;
+    for (u32 i = 0; i < n_added; i++) {
+        added[i] = random_rect();
+        region_add_rect(&r, &added[i]);
+
+        if (r.n_rects > REGION_MAX_RECTS) {
+            s_log_error("Region has too many rects (%u)", r.n_rects);
+            return 1;
+        }
+    }
+
+    const rect_t clip = random_rect();
+    struct region clipped = r;
+    region_clip(&clipped, &clip);
+
+    /* A region may only ever grow, never lose any area */
+    for (i32 y = -AREA_H / 2; y < AREA_H + AREA_H / 2; y++) {
+        for (i32 x = -AREA_W / 2; x < AREA_W + AREA_W / 2; x++) {
+            bool in_added = false;
+            for (u32 i = 0; i < n_added && !in_added; i++)
+                in_added = rect_has_point(&added[i], x, y);
+
+            const bool in_region = region_has_point(&r, x, y);
+            if (in_added && !in_region) {
+                s_log_error("Point (%i, %i) was lost from the region", x, y);
+                return 1;
+            }
+
+            const bool in_clipped = region_has_point(&clipped, x, y);
+            const bool expected = in_region && rect_has_point(&clip, x, y);
+            if (in_clipped != expected) {
+                s_log_error("Point (%i, %i) is %s the clipped region "
+                    "when it shouldn't be", x, y,
+                    in_clipped ? "in" : "not in");
+                return 1;
+            }
+        }
+    }
+
+    /* The bounding box must contain the whole region */
+    const rect_t bbox = region_bounding_box(&r);
+    for (u32 i = 0; i < r.n_rects; i++) {
+        rect_t tmp = r.rects[i];
+        rect_clip(&tmp, &bbox);
+        if (memcmp(&tmp, &r.rects[i], sizeof(rect_t))) {
+            s_log_error("Rect (%i, %i, %u, %u) is outside of the "
+                "bounding box (%i, %i, %u, %u)",
+                rect_arg_expand(r.rects[i]), rect_arg_expand(bbox));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static rect_t random_rect(void)
+{
+    /* Also place some of the rects partially outside of the area */
+    return (rect_t) {
+        .x = (rand() % (AREA_W + AREA_W / 2)) - AREA_W / 4,
+        .y = (rand() % (AREA_H + AREA_H / 2)) - AREA_H / 4,
+        .w = rand() % (AREA_W / 3),
+        .h = rand() % (AREA_H / 3),
+    };
+}
+
+static bool rect_has_point(const rect_t *r, i32 x, i32 y)
+{
+    return x >= r->x && y >= r->y &&
+        (i64)x < (i64)r->x + r->w && (i64)y < (i64)r->y + r->h;
+}
+
+static bool region_has_point(const struct region *r, i32 x, i32 y)
+{
+    for (u32 i = 0; i < r->n_rects; i++) {
+        if (rect_has_point(&r->rects[i], x, y))
+            return true;
+    }
+    return false;
+}
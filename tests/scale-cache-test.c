@@ -0,0 +1,252 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <core/pixel.h>
+#include <core/shapes.h>
+#include <render/surface.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#define R_INTERNAL_GUARD__
+#include <render/scale-cache.h>
+#undef R_INTERNAL_GUARD__
+
+#define MODULE_NAME "scale-cache-test"
+#include "log-util.h"
+
+#define SRC_W 40
+#define SRC_H 30
+#define DST_W 170
+#define DST_H 110
+#define N_ITERATIONS 300
+
+/* Small enough for the copies to get evicted all the time
+ * (see `test_budget`) */
+#define BUDGET (4 * DST_W * DST_H * sizeof(pixel_t))
+
+static i32 test_equal_to_direct(struct r_scale_cache *c,
+    struct r_surface *src);
+static i32 test_versions(struct r_scale_cache *c, struct r_surface *src);
+static i32 test_budget(struct r_scale_cache *c, struct r_surface *src);
+static rect_t random_rect(u32 max_w, u32 max_h);
+static void fill_random(struct r_surface *s);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    srand(4321);
+
+    struct r_surface *src = r_surface_create(SRC_W, SRC_H, RGBA32_PREMUL);
+    if (src == NULL) {
+        s_log_error("Failed to create the source surface");
+        return EXIT_FAILURE;
+    }
+    fill_random(src);
+
+    struct r_scale_cache c;
+    r_scale_cache_init(&c, BUDGET);
+
+    i32 ret = EXIT_SUCCESS;
+    if (test_equal_to_direct(&c, src) || test_versions(&c, src) ||
+        test_budget(&c, src))
+        ret = EXIT_FAILURE;
+
+    r_scale_cache_destroy(&c);
+    r_surface_destroy(&src);
+
+    s_log_info("Test result is %s", ret == EXIT_SUCCESS ? "OK" : "FAIL");
+    return ret;
+}
+
+/* Drawing from a scaled copy must give the same pixels
+ * as scaling the source directly */
+static i32 test_equal_to_direct(struct r_scale_cache *c,
+    struct r_surface *src)
+{
+    struct r_surface *direct = r_surface_create(DST_W, DST_H, RGBA32_PREMUL);
+    struct r_surface *cached = r_surface_create(DST_W, DST_H, RGBA32_PREMUL);
+    if (direct == NULL || cached == NULL) {
+        s_log_error("Failed to create the destination surfaces");
+        goto fail;
+    }
+
+    s_log_info("Comparing cached and direct blits...");
+    for (u32 i = 0; i < N_ITERATIONS; i++) {
+        const enum r_surface_filter filter = rand() % R_SURFACE_FILTER_MAX_;
+
+        /* With nearest filtering, the source rect only maps to whole
+         * pixels of the copy if the scale is a whole number */
+        const u32 scale = 1 + rand() % 4;
+        rect_t src_rect = random_rect(SRC_W, SRC_H);
+        rect_t dst_rect = {
+            .x = rand() % DST_W - DST_W / 4,
+            .y = rand() % DST_H - DST_H / 4,
+            .w = src_rect.w * scale,
+            .h = src_rect.h * scale,
+        };
+        if (filter == R_SURFACE_FILTER_BILINEAR)
+            dst_rect = random_rect(DST_W, DST_H);
+        if (src_rect.w == dst_rect.w && src_rect.h == dst_rect.h)
+            continue;
+
+        fill_random(direct);
+        memcpy(cached->data.buf, direct->data.buf,
+            DST_W * DST_H * sizeof(pixel_t));
+
+        rect_t scaled_src_rect;
+        const struct r_surface *scaled = r_scale_cache_get(c, src,
+            &src_rect, &dst_rect, filter, &scaled_src_rect);
+        if (scaled == NULL)
+            continue;
+        if (scaled_src_rect.w != dst_rect.w ||
+            scaled_src_rect.h != dst_rect.h)
+        {
+            s_log_error("The scaled source rect isn't the size of the "
+                "destination rect");
+            goto fail;
+        }
+
+        r_surface_blit_filtered(direct, src, &src_rect, &dst_rect, filter);
+        r_surface_blit(cached, scaled, &scaled_src_rect, &dst_rect);
+        if (memcmp(direct->data.buf, cached->data.buf,
+                DST_W * DST_H * sizeof(pixel_t)))
+        {
+            s_log_error("Cached blit differs from the direct one "
+                "(filter %d, src (%i, %i, %u, %u), dst (%i, %i, %u, %u))",
+                filter, rect_arg_expand(src_rect), rect_arg_expand(dst_rect));
+            goto fail;
+        }
+
+        r_scale_cache_next_frame(c);
+    }
+
+    r_surface_destroy(&direct);
+    r_surface_destroy(&cached);
+    return 0;
+
+fail:
+    r_surface_destroy(&direct);
+    r_surface_destroy(&cached);
+    return 1;
+}
+
+/* A copy must only be reused as long as the source doesn't change */
+static i32 test_versions(struct r_scale_cache *c, struct r_surface *src)
+{
+    const rect_t dst_rect = { 0, 0, SRC_W * 2, SRC_H * 2 };
+    rect_t tmp;
+
+    s_log_info("Checking the invalidation of copies...");
+    const struct r_surface *first = r_scale_cache_get(c, src,
+        &src->data_rect, &dst_rect, R_SURFACE_FILTER_NEAREST, &tmp);
+    const struct r_surface *second = r_scale_cache_get(c, src,
+        &src->data_rect, &dst_rect, R_SURFACE_FILTER_NEAREST, &tmp);
+    if (first == NULL || first != second) {
+        s_log_error("The same copy wasn't reused");
+        return 1;
+    }
+
+    /* Scrolling through the surface at the same scale
+     * shouldn't need a new copy either */
+    const rect_t scrolled_src_rect = { 3, 1, SRC_W / 2, SRC_H / 2 };
+    const rect_t scrolled_dst_rect = { 0, 0, SRC_W, SRC_H };
+    const struct r_surface *scrolled = r_scale_cache_get(c, src,
+        &scrolled_src_rect, &scrolled_dst_rect,
+        R_SURFACE_FILTER_NEAREST, &tmp);
+    if (scrolled != first || tmp.x != 6 || tmp.y != 2) {
+        s_log_error("A copy wasn't reused for a different part "
+            "of the same surface");
+        return 1;
+    }
+
+    /* Modify the source */
+    src->data.buf[0] = (pixel_t) { 1, 2, 3, 4 };
+    r_surface_update_opacity(src);
+    const struct r_surface *after_blit = r_scale_cache_get(c, src,
+        &src->data_rect, &dst_rect, R_SURFACE_FILTER_NEAREST, &tmp);
+    if (after_blit == NULL || after_blit == first) {
+        s_log_error("An outdated copy was used after the source changed");
+        return 1;
+    }
+
+    r_scale_cache_invalidate(c);
+    const struct r_surface *after_invalidate = r_scale_cache_get(c, src,
+        &src->data_rect, &dst_rect, R_SURFACE_FILTER_NEAREST, &tmp);
+    if (after_invalidate == NULL || after_invalidate == after_blit) {
+        s_log_error("An invalidated copy was used");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* The copies must stay within the budget,
+ * but never get freed while they might still be in use */
+static i32 test_budget(struct r_scale_cache *c, struct r_surface *src)
+{
+    const rect_t dst_rect = { 0, 0, DST_W, DST_H };
+    const rect_t big_dst_rect = { 0, 0, DST_W * 2, DST_H * 2 };
+    rect_t tmp;
+
+    /* Make sure that nothing from the other tests is still in use */
+    r_scale_cache_next_frame(c);
+    r_scale_cache_next_frame(c);
+
+    s_log_info("Checking the budget...");
+    for (u32 i = 0; i < N_ITERATIONS; i++) {
+        const rect_t src_rect = random_rect(SRC_W, SRC_H);
+        const struct r_surface *scaled = r_scale_cache_get(c, src,
+            &src_rect, &dst_rect, R_SURFACE_FILTER_BILINEAR, &tmp);
+        if (c->used > c->budget) {
+            s_log_error("The cache is over its budget (%lu/%lu)",
+                (unsigned long)c->used, (unsigned long)c->budget);
+            return 1;
+        }
+
+        /* There are 2 copies made in every frame. Exactly 4 of them
+         * fit into the budget, so there should always be just enough space
+         * for the ones from the previous frame (which are still in use)
+         * and this one. */
+        if (scaled == NULL) {
+            s_log_error("The cache refused a copy that should've fit");
+            return 1;
+        }
+        if (i % 2 == 1)
+            r_scale_cache_next_frame(c);
+    }
+
+    if (r_scale_cache_get(c, src, &src->data_rect, &big_dst_rect,
+            R_SURFACE_FILTER_BILINEAR, &tmp) != NULL)
+    {
+        s_log_error("The cache accepted a copy bigger than its budget");
+        return 1;
+    }
+
+    return 0;
+}
+
+static rect_t random_rect(u32 max_w, u32 max_h)
+{
+    const u32 w = 1 + rand() % max_w;
+    const u32 h = 1 + rand() % max_h;
+    return (rect_t) {
+        .x = rand() % (max_w - w + 1),
+        .y = rand() % (max_h - h + 1),
+        .w = w,
+        .h = h,
+    };
+}
+
+static void fill_random(struct r_surface *s)
+{
+    for (u32 i = 0; i < s->data.w * s->data.h; i++) {
+        const u8 a = rand() % 256;
+        s->data.buf[i] = (pixel_t) {
+            rand() % (a + 1), rand() % (a + 1), rand() % (a + 1), a
+        };
+    }
+    r_surface_update_opacity(s);
+}
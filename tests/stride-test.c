@@ -0,0 +1,183 @@
+#include <core/log.h>
+#include <core/util.h>
+#include <core/pixel.h>
+#include <core/shapes.h>
+#include <render/surface.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define MODULE_NAME "stride-test"
+#include "log-util.h"
+
+#define SRC_W 37
+#define SRC_H 29
+#define DST_W 120
+#define DST_H 90
+#define PADDING 11
+#define N_ITERATIONS 300
+
+/* The padding at the end of each row must never be touched */
+#define PADDING_PIXEL ((pixel_t) { 0xde, 0xad, 0xbe, 0xef })
+
+static struct r_surface * create_padded_surface(u32 w, u32 h,
+    pixelfmt_t fmt);
+static bool surfaces_equal(const struct r_surface *a,
+    const struct r_surface *b);
+static bool padding_intact(const struct r_surface *s);
+static void copy_pixels(struct r_surface *dst, const struct r_surface *src);
+static rect_t random_rect(i32 max_x, i32 max_y, u32 max_w, u32 max_h);
+static void fill_random(struct r_surface *s);
+
+int cgd_main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    if (test_log_setup())
+        return EXIT_FAILURE;
+
+    srand(1234);
+
+    i32 ret = EXIT_FAILURE;
+    struct r_surface *src = r_surface_create(SRC_W, SRC_H, RGBA32_PREMUL);
+    struct r_surface *padded_src =
+        create_padded_surface(SRC_W, SRC_H, RGBA32_PREMUL);
+    struct r_surface *dst = r_surface_create(DST_W, DST_H, RGBA32_PREMUL);
+    struct r_surface *padded_dst =
+        create_padded_surface(DST_W, DST_H, RGBA32_PREMUL);
+    if (src == NULL || padded_src == NULL ||
+        dst == NULL || padded_dst == NULL)
+        goto_error("Failed to create the surfaces");
+
+    /* Every blit must give the same result no matter the strides
+     * of the source and destination */
+    s_log_info("Comparing blits from/to padded buffers...");
+    for (u32 i = 0; i < N_ITERATIONS; i++) {
+        fill_random(src);
+        copy_pixels(padded_src, src);
+        fill_random(dst);
+        copy_pixels(padded_dst, dst);
+
+        const enum r_surface_filter filter = rand() % R_SURFACE_FILTER_MAX_;
+        const rect_t src_rect = random_rect(SRC_W, SRC_H, SRC_W, SRC_H);
+        rect_t dst_rect = random_rect(DST_W, DST_H, DST_W, DST_H);
+        if (rand() % 2) {
+            dst_rect.w = src_rect.w;
+            dst_rect.h = src_rect.h;
+        }
+
+        r_surface_blit_filtered(dst, src, &src_rect, &dst_rect, filter);
+        r_surface_blit_filtered(padded_dst, padded_src,
+            &src_rect, &dst_rect, filter);
+
+        if (!surfaces_equal(dst, padded_dst) || !padding_intact(padded_dst)) {
+            goto_error("Blit with padded buffers differs "
+                "(filter %d, src (%i, %i, %u, %u), dst (%i, %i, %u, %u))",
+                filter, rect_arg_expand(src_rect), rect_arg_expand(dst_rect));
+        }
+    }
+
+    s_log_info("Comparing conversions of padded buffers...");
+    if (r_surface_convert(dst, BGRA32) ||
+        r_surface_convert(padded_dst, BGRA32))
+        goto_error("Failed to convert the surfaces");
+    if (!surfaces_equal(dst, padded_dst) || !padding_intact(padded_dst))
+        goto_error("Conversion of a padded buffer differs");
+
+    r_surface_update_opacity(dst);
+    r_surface_update_opacity(padded_dst);
+    if (dst->opacity.type != padded_dst->opacity.type)
+        goto_error("The opacity of a padded buffer differs");
+
+    ret = EXIT_SUCCESS;
+err:
+    if (src != NULL) r_surface_destroy(&src);
+    if (padded_src != NULL) r_surface_destroy(&padded_src);
+    if (dst != NULL) r_surface_destroy(&dst);
+    if (padded_dst != NULL) r_surface_destroy(&padded_dst);
+
+    s_log_info("Test result is %s", ret == EXIT_SUCCESS ? "OK" : "FAIL");
+    return ret;
+}
+
+static struct r_surface * create_padded_surface(u32 w, u32 h,
+    pixelfmt_t fmt)
+{
+    struct pixel_flat_data pixels = {
+        .w = w,
+        .h = h,
+        .stride = w + PADDING,
+    };
+    pixels.buf = malloc((u64)pixels.stride * h * sizeof(pixel_t));
+    if (pixels.buf == NULL)
+        return NULL;
+
+    for (u64 i = 0; i < (u64)pixels.stride * h; i++)
+        pixels.buf[i] = PADDING_PIXEL;
+
+    /* The surface takes over the buffer */
+    struct r_surface *ret = r_surface_init(&pixels, fmt);
+    if (ret == NULL)
+        u_nfree(&pixels.buf);
+
+    return ret;
+}
+
+static bool surfaces_equal(const struct r_surface *a,
+    const struct r_surface *b)
+{
+    for (u32 y = 0; y < a->data.h; y++) {
+        if (memcmp(pixel_flat_data_at(&a->data, 0, y),
+                pixel_flat_data_at(&b->data, 0, y),
+                a->data.w * sizeof(pixel_t)))
+            return false;
+    }
+    return true;
+}
+
+static bool padding_intact(const struct r_surface *s)
+{
+    for (u32 y = 0; y < s->data.h; y++) {
+        const pixel_t *const row = pixel_flat_data_at(&s->data, 0, y);
+        for (u32 x = s->data.w; x < s->data.stride; x++) {
+            if (memcmp(&row[x], &PADDING_PIXEL, sizeof(pixel_t)))
+                return false;
+        }
+    }
+    return true;
+}
+
+static void copy_pixels(struct r_surface *dst, const struct r_surface *src)
+{
+    for (u32 y = 0; y < src->data.h; y++) {
+        memcpy(pixel_flat_data_at(&dst->data, 0, y),
+            pixel_flat_data_at(&src->data, 0, y),
+            src->data.w * sizeof(pixel_t));
+    }
+    r_surface_update_opacity(dst);
+}
+
+/* The rects may stick out of (0, 0, `max_x`, `max_y`) */
+static rect_t random_rect(i32 max_x, i32 max_y, u32 max_w, u32 max_h)
+{
+    return (rect_t) {
+        .x = rand() % max_x - max_x / 4,
+        .y = rand() % max_y - max_y / 4,
+        .w = 1 + rand() % max_w,
+        .h = 1 + rand() % max_h,
+    };
+}
+
+static void fill_random(struct r_surface *s)
+{
+    for (u32 y = 0; y < s->data.h; y++) {
+        pixel_t *const row = pixel_flat_data_at(&s->data, 0, y);
+        for (u32 x = 0; x < s->data.w; x++) {
+            const u8 a = rand() % 4 == 0 ? 255 : rand() % 256;
+            row[x] = (pixel_t) {
+                rand() % (a + 1), rand() % (a + 1), rand() % (a + 1), a
+            };
+        }
+    }
+    r_surface_update_opacity(s);
+}
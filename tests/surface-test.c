@@ -124,6 +124,8 @@ int cgd_main(int argc, char **argv)
             err -= 2*x + 1;
         }
     }
+    /* Let the blits skip the transparent parts */
+    r_surface_update_opacity(surface2);
 
     bool running = true;
     struct p_event ev = { 0 };
@@ -198,9 +200,10 @@ int cgd_main(int argc, char **argv)
         p_time_usleep(1000000 / FPS);
     }
 
+    /* Make sure the renderer is done with the surfaces */
+    r_ctx_destroy(&rctx);
     r_surface_destroy(&surface2);
     asset_destroy(&asset);
-    r_ctx_destroy(&rctx);
     p_keyboard_destroy(&kb);
     p_window_close(&win);
 
@@ -208,9 +211,9 @@ int cgd_main(int argc, char **argv)
     return EXIT_SUCCESS;
 
 err:
+    if (rctx != NULL) r_ctx_destroy(&rctx);
     if (surface2 != NULL) r_surface_destroy(&surface2);
     if (asset != NULL) asset_destroy(&asset);
-    if (rctx != NULL) r_ctx_destroy(&rctx);
     if(kb != NULL) p_keyboard_destroy(&kb);
     if (win != NULL) p_window_close(&win);
     s_log_info("Test result is FAIL");